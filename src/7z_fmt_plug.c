@@ -25,12 +25,26 @@
 #include "sha2.h"
 #include "crc32.h"
 #include "unicode.h"
+#include "johnswap.h"
+#include "sse-intrinsics.h"
+
+/*
+ * The multi-lane kdf below only pays off with 16 SHA-256 lanes (AVX-512).
+ * With fewer, the one key at a time SHA256_Update loop is as fast or faster.
+ */
+#if defined(MMX_COEF_SHA256) && MMX_COEF_SHA256 < 16
+#undef MMX_COEF_SHA256
+#endif
 
 #define FORMAT_LABEL		"7z"
 #define FORMAT_NAME		"7-Zip"
 #define FORMAT_TAG		"$7z$"
 #define TAG_LENGTH		4
+#ifdef MMX_COEF_SHA256
+#define ALGORITHM_NAME		"(experimental) " SHA256_ALGORITHM_NAME
+#else
 #define ALGORITHM_NAME		"(experimental) SHA256 32/" ARCH_BITS_STR
+#endif
 #define BENCHMARK_COMMENT	""
 #define BENCHMARK_LENGTH	-1
 #define BINARY_SIZE		0
@@ -39,7 +53,11 @@
 #define SALT_SIZE		sizeof(struct custom_salt)
 #define SALT_ALIGN		4
 #define MIN_KEYS_PER_CRYPT	1
+#ifdef MMX_COEF_SHA256
+#define MAX_KEYS_PER_CRYPT	MMX_COEF_SHA256
+#else
 #define MAX_KEYS_PER_CRYPT	1
+#endif
 #define OMP_SCALE               1 // tuned on core i7
 
 #define BIG_ENOUGH 		(8192 * 32)
@@ -57,6 +75,7 @@ static struct fmt_tests sevenzip_tests[] = {
 
 static char (*saved_key)[PLAINTEXT_LENGTH + 1];
 static int *cracked;
+static int max_crypts;
 
 static struct custom_salt {
 	int NumCyclesPower;
@@ -82,10 +101,12 @@ static void init(struct fmt_main *self)
 	omp_t *= OMP_SCALE;
 	self->params.max_keys_per_crypt *= omp_t;
 #endif
+	max_crypts = self->params.max_keys_per_crypt;
+	/* one extra slot, used for the unused tail lanes of a SIMD group */
 	saved_key = mem_calloc_tiny(sizeof(*saved_key) *
-			self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
+			(1 + max_crypts), MEM_ALIGN_WORD);
 	cracked = mem_calloc_tiny(sizeof(*cracked) *
-			self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
+			(1 + max_crypts), MEM_ALIGN_WORD);
 	CRC32_Init(&crc);
 }
 
@@ -272,7 +293,120 @@ static int sevenzip_decrypt(unsigned char *derived_key, unsigned char *data)
 
 
 
-void sevenzip_kdf(UTF8 *password, unsigned char *master)
+static int sevenzip_utf16(UTF8 *password, UTF16 *buffer)
+{
+	int len;
+
+	/* Convert password to utf-16-le format (--encoding aware) */
+	len = enc_to_utf16(buffer, PLAINTEXT_LENGTH, password, strlen((char*)password));
+	if (len <= 0) {
+		password[-len] = 0; // match truncation
+		len = strlen16(buffer);
+	}
+	return len * 2;
+}
+
+#ifdef MMX_COEF_SHA256
+/*
+ * The kdf is SHA-256 over 2^NumCyclesPower repeats of (utf-16 password ||
+ * 64-bit LE round counter).  Rather than feed that through SHA256_Update,
+ * each lane keeps a copy of one repeat and copies it straight into its own
+ * 64 byte block, bumping the counter in place.  All lanes are then run
+ * through SSESHA256body together.  Keys are grouped by length in crypt_all
+ * so the lanes of a group normally finish on the same block; a lane that
+ * finishes early just has its state saved and idles until the others are
+ * done.
+ */
+typedef struct {
+	unsigned char unit[2 * PLAINTEXT_LENGTH + 8];
+	int ulen, upos;
+	long long round, rounds;
+	int state;	/* 0 = data, 1 = padding, 2 = length only, 3 = done */
+} sevenzip_lane;
+
+/* fill the next 64 byte block of a lane, returns 1 if it is the last one */
+static int sevenzip_fill(sevenzip_lane *l, unsigned char *block)
+{
+	int n = 0, i;
+
+	while (l->state == 0 && n < 64) {
+		int c = l->ulen - l->upos;
+
+		if (c > 64 - n)
+			c = 64 - n;
+		memcpy(block + n, l->unit + l->upos, c);
+		n += c;
+		if ((l->upos += c) == l->ulen) {
+			l->upos = 0;
+			for (i = l->ulen - 8; i < l->ulen; i++)
+				if (++(l->unit[i]) != 0)
+					break;
+			if (++l->round == l->rounds)
+				l->state = 1;
+		}
+	}
+	if (l->state == 0)
+		return 0;
+	if (l->state == 1) {
+		if (n == 64)
+			return 0;
+		block[n++] = 0x80;
+		l->state = 2;
+	}
+	memset(block + n, 0, 64 - n);
+	if (n > 56)
+		return 0;
+	{
+		unsigned long long bits = (unsigned long long)l->rounds * l->ulen * 8;
+
+		for (i = 63; i > 55; i--, bits >>= 8)
+			block[i] = (unsigned char)bits;
+	}
+	l->state = 3;
+	return 1;
+}
+
+static void sevenzip_kdf(int *keys, unsigned char (*master)[32])
+{
+	sevenzip_lane lanes[MMX_COEF_SHA256];
+	ALIGN(16) unsigned char buf[MMX_COEF_SHA256 * 128];
+	ALIGN(16) ARCH_WORD_32 sse_out[8 * MMX_COEF_SHA256];
+	int i, j, todo = MMX_COEF_SHA256, blk = 0;
+
+	for (i = 0; i < MMX_COEF_SHA256; i++) {
+		sevenzip_lane *l = &lanes[i];
+		int len = sevenzip_utf16((UTF8*)saved_key[keys[i]], (UTF16*)l->unit);
+
+		memset(l->unit + len, 0, 8);
+		l->ulen = len + 8;
+		l->upos = 0;
+		l->round = 0;
+		l->rounds = (long long) 1 << cur_salt->NumCyclesPower;
+		l->state = 0;
+	}
+
+	while (todo) {
+		unsigned done = 0;
+
+		for (i = 0; i < MMX_COEF_SHA256; i++)
+			if (lanes[i].state != 3 &&
+			    sevenzip_fill(&lanes[i], &buf[i * 128]))
+				done |= 1U << i;
+		SSESHA256body((__m128i *)buf, sse_out, sse_out,
+		              SSEi_FLAT_IN | SSEi_2BUF_INPUT_FIRST_BLK |
+		              (blk++ ? SSEi_RELOAD : 0));
+		for (i = 0; done; i++, done >>= 1)
+			if (done & 1) {
+				ARCH_WORD_32 *o = (ARCH_WORD_32 *)master[i];
+
+				for (j = 0; j < 8; j++)
+					o[j] = JOHNSWAP(sse_out[j * MMX_COEF_SHA256 + i]);
+				todo--;
+			}
+	}
+}
+#else
+static void sevenzip_kdf(UTF8 *password, unsigned char *master)
 {
 	int len;
 	long long rounds = (long long) 1 << cur_salt->NumCyclesPower;
@@ -284,16 +418,10 @@ void sevenzip_kdf(UTF8 *password, unsigned char *master)
 #endif
 	SHA256_CTX sha;
 
-	/* Convert password to utf-16-le format (--encoding aware) */
-	len = enc_to_utf16(buffer, PLAINTEXT_LENGTH, password, strlen((char*)password));
-	if (len <= 0) {
-		password[-len] = 0; // match truncation
-		len = strlen16(buffer);
-	}
-	len *= 2;
+	len = sevenzip_utf16(password, buffer);
 
 	/* kdf */
-        SHA256_Init(&sha);
+	SHA256_Init(&sha);
 	for (round = 0; round < rounds; round++) {
 		//SHA256_Update(&sha, "", cur_salt->SaltSize);
 		SHA256_Update(&sha, (char*)buffer, len);
@@ -308,11 +436,44 @@ void sevenzip_kdf(UTF8 *password, unsigned char *master)
 	}
 	SHA256_Final(master, &sha);
 }
+#endif
 
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
 	int index = 0;
+#ifdef MMX_COEF_SHA256
+	int *MixOrder, tot_todo = 0, len;
+
+	// order the keys by length, so the lanes of a group run the same
+	// number of SHA-256 blocks.  Tail lanes point at the spare slot.
+	MixOrder = mem_alloc(sizeof(int) * (count + MMX_COEF_SHA256));
+	saved_key[max_crypts][0] = 0;
+	for (len = 0; len <= PLAINTEXT_LENGTH; ++len)
+		for (index = 0; index < count; ++index)
+			if (strlen(saved_key[index]) == len)
+				MixOrder[tot_todo++] = index;
+	while (tot_todo & (MMX_COEF_SHA256 - 1))
+		MixOrder[tot_todo++] = max_crypts;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (index = 0; index < tot_todo; index += MMX_COEF_SHA256)
+	{
+		/* derive keys */
+		unsigned char master[MMX_COEF_SHA256][32];
+		int i;
+
+		sevenzip_kdf(&MixOrder[index], master);
+
+		/* do decryption and checks */
+		for (i = 0; i < MMX_COEF_SHA256; i++)
+			cracked[MixOrder[index + i]] =
+				(sevenzip_decrypt(master[i], cur_salt->data) == 0);
+	}
+	MEM_FREE(MixOrder);
+#else
 #ifdef _OPENMP
 #pragma omp parallel for
 	for (index = 0; index < count; index += MAX_KEYS_PER_CRYPT)
@@ -328,6 +489,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		else
 			cracked[index] = 0;
 	}
+#endif
 	return count;
 }
 
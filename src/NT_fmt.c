@@ -248,6 +248,7 @@ static void fmt_NT_init(struct fmt_main *self)
 #endif
 		/* This avoids an if clause for every set_key */
 		fmt_NT.methods.set_key = set_key_utf8;
+		fmt_NT.methods.set_key_range = NULL;
 		/* kick it up from 27. We will 'adjust' in the setkey_utf8 function.  */
 		fmt_NT.params.plaintext_length = 3 * PLAINTEXT_LENGTH;
 		tests[1].plaintext = "\xC3\xBC";         // German u-umlaut in UTF-8
@@ -265,6 +266,7 @@ static void fmt_NT_init(struct fmt_main *self)
 #endif
 		} else {
 			fmt_NT.methods.set_key = set_key_encoding;
+			fmt_NT.methods.set_key_range = NULL;
 		}
 		if (CP_to_Unicode[0xfc] == 0x00fc) {
 			tests[1].plaintext = "\xFC";         // German u-umlaut in UTF-8
@@ -502,6 +504,24 @@ static int get_hash_6(int index)
 #endif
 }
 
+static void get_hashes(int size, int count, int *hash)
+{
+	unsigned int mask = password_hash_sizes[size] - 1;
+	int index;
+
+	for (index = 0; index < count; index++)
+#if defined(NT_X86_64)
+		hash[index] = output8x[32*(index>>3)+8+index%8] & mask;
+#elif defined(NT_SSE2)
+		if(index<NT_NUM_KEYS4)
+			hash[index] = output4x[16*(index>>2)+4+index%4] & mask;
+		else
+			hash[index] = output1x[(index-NT_NUM_KEYS4)*4+1] & mask;
+#else
+		hash[index] = output1x[(index<<2)+1] & mask;
+#endif
+}
+
 static int cmp_all(void *binary, int count)
 {
 	unsigned int i=0;
@@ -716,6 +736,67 @@ static void set_key(char *_key, int index)
 #endif
 }
 
+// Key buffer of index, with its stride and the offset of its length word
+static inline unsigned int *get_key_buffer(int index, unsigned int *xBuf,
+                                           unsigned int *lenStoreOffset)
+{
+#if defined(NT_X86_64)
+	*xBuf = 8;
+	*lenStoreOffset = 112;
+	return &nt_buffer8x[128 * (index >> 3) + index % 8];
+#elif defined(NT_SSE2)
+	if(index < NT_NUM_KEYS4) {
+		*xBuf = 4;
+		*lenStoreOffset = 56;
+		return &nt_buffer4x[64 * (index >> 2) + index % 4];
+	}
+	*xBuf = 1;
+	*lenStoreOffset = 14;
+	return &nt_buffer1x[16 * (index - NT_NUM_KEYS4)];
+#else
+	*xBuf = 1;
+	*lenStoreOffset = 14;
+	return &nt_buffer1x[index << 4];
+#endif
+}
+
+// Only used along with the non-UTF8 set_key(), where key[pos] is the UCS-2
+// character pos.  The other keys are copied from the first one, and then
+// that character is replaced.
+static void set_key_range(char *key, int pos, char *chars, int count,
+                          int index)
+{
+	unsigned int *src, *dst, srcBuf, srcOffset, xBuf, lenStoreOffset;
+	unsigned int md4_size, words, shift, i;
+
+	set_key(key, index);
+	src = get_key_buffer(index, &srcBuf, &srcOffset);
+	md4_size = src[srcOffset] >> 4;
+	words = (md4_size >> 1) + 1;
+	shift = (pos & 1) << 4;
+
+	i = (pos >> 1) * srcBuf;
+	src[i] = (src[i] & ~(0xffff << shift)) |
+		((unsigned int)(unsigned char)*chars++ << shift);
+
+	while (--count) {
+		dst = get_key_buffer(++index, &xBuf, &lenStoreOffset);
+		for (i = 0; i < words; i++)
+			dst[i * xBuf] = src[i * srcBuf];
+		for (i *= xBuf; i <= last_i[index]; i += xBuf)
+			dst[i] = 0;
+		if (xBuf == 1)
+			last_i[index] = words;
+		else
+			last_i[index] = md4_size << (xBuf >> 2);
+		dst[lenStoreOffset] = md4_size << 4;
+
+		i = (pos >> 1) * xBuf;
+		dst[i] = (dst[i] & ~(0xffff << shift)) |
+			((unsigned int)(unsigned char)*chars++ << shift);
+	}
+}
+
 // UTF-8 conversion right into key buffer
 // This is common code for the SSE/MMX/generic variants
 static inline void set_key_helper_utf8(unsigned int * keybuffer, unsigned int xBuf,
@@ -1013,6 +1094,8 @@ struct fmt_main fmt_NT = {
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+		get_hashes,
+		set_key_range
 	}
 };
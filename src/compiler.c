@@ -19,9 +19,22 @@
 #include "params.h"
 #include "memory.h"
 #include "compiler.h"
+#include "os.h"
 
 #undef PRINT_INSNS
 
+/*
+ * Native code is only generated for x86-64 with the System V calling
+ * convention, and needs mmap(2) for executable memory.
+ */
+#if defined(__x86_64__) && !defined(_WIN64) && !defined(PRINT_INSNS) && \
+    HAVE_SYS_MMAN_H
+#define C_NATIVE			1
+#include <sys/mman.h>
+#else
+#define C_NATIVE			0
+#endif
+
 char *c_errors[] = {
 	NULL,	/* No error */
 	"Unknown identifier",
@@ -68,6 +81,13 @@ static c_int *c_data_ptr;
 static union c_insn c_stack[C_STACK_SIZE];
 static union c_insn *c_sp;
 
+#if C_NATIVE
+/* Native code for the program, and its entry point for each instruction */
+static unsigned char *c_native_code = NULL;
+static size_t c_native_size;
+static void **c_native_map = NULL;
+#endif
+
 static union c_insn *c_loop_start;
 static struct c_fixup *c_break_fixups = NULL;
 
@@ -358,7 +378,18 @@ static void c_free_fixup(struct c_fixup *list, union c_insn *pc)
 	}
 }
 
+static void c_native_free(void)
+{
+#if C_NATIVE
+	if (c_native_code)
+		munmap(c_native_code, c_native_size);
+	c_native_code = NULL;
+	MEM_FREE(c_native_map);
+#endif
+}
+
 void c_cleanup() {
+	c_native_free();
 	MEM_FREE(c_code_start);
 	MEM_FREE(c_data_start);
 	c_free_ident(c_funcs, NULL);
@@ -841,6 +872,7 @@ int c_compile(int (*ext_getchar)(void), void (*ext_rewind)(void),
 	c_ext_getchar = ext_getchar;
 	c_ext_rewind = ext_rewind;
 
+	c_native_free();
 	MEM_FREE(c_code_start);
 	MEM_FREE(c_data_start);
 	c_free_ident(c_funcs, NULL);
@@ -878,10 +910,264 @@ void *c_lookup(char *name)
 	return NULL;
 }
 
+#if C_NATIVE
+
+/*
+ * Native code generator.  Each instruction is translated to a fixed x86-64
+ * code sequence doing exactly what the interpreter below does, with imm kept
+ * in eax and sp in rdi, so the program's stack lives in c_stack just like it
+ * does when interpreted.  Only rax, rcx, rdx, rsi and rdi are used, so the
+ * code can be called as a C function taking sp as its only argument.
+ */
+
+/* The longest code sequence for a single instruction word */
+#define C_NATIVE_MAX			0x20
+
+#define SUB_SP				"\x48\x83\xEF\x10"
+#define LOAD_A				"\x48\x8B\x4F\xE8"
+#define STORE_A				"\x89\x11\x89\xD0" SUB_SP
+#define SETCC(cc)			"\x39\x47\xE0\x0F" cc "\xC0\x0F\xB6\xC0" \
+					SUB_SP
+#define OP(code)			{sizeof(code) - 1, code}
+
+/* Code for the operators, in the order of c_ops[] */
+static const struct {
+	unsigned char length;
+	char code[C_NATIVE_MAX];
+} c_native_ops[] = {
+/* [ */	OP(LOAD_A "\x48\x63\xD0\x48\x8D\x0C\x91\x48\x89\x4F\xE8\x8B\x01"
+	    SUB_SP),
+/* = */	OP(LOAD_A "\x89\x01" SUB_SP),
+/* += */	OP(LOAD_A "\x8B\x11\x01\xC2" STORE_A),
+/* -= */	OP(LOAD_A "\x8B\x11\x29\xC2" STORE_A),
+/* *= */	OP(LOAD_A "\x8B\x11\x0F\xAF\xD0" STORE_A),
+/* /= */	OP(LOAD_A "\x89\xC6\x8B\x01\x99\xF7\xFE\x89\x01" SUB_SP),
+/* %= */	OP(LOAD_A "\x89\xC6\x8B\x01\x99\xF7\xFE" STORE_A),
+/* |= */	OP(LOAD_A "\x8B\x11\x09\xC2" STORE_A),
+/* ^= */	OP(LOAD_A "\x8B\x11\x31\xC2" STORE_A),
+/* &= */	OP(LOAD_A "\x8B\x11\x21\xC2" STORE_A),
+/* <<= */	OP("\x48\x8B\x77\xE8\x89\xC1\x8B\x06\xD3\xE0\x89\x06" SUB_SP),
+/* >>= */	OP("\x48\x8B\x77\xE8\x89\xC1\x8B\x06\xD3\xF8\x89\x06" SUB_SP),
+/* || */	OP("\x0B\x47\xE0" SUB_SP),
+/* && */	OP("\x85\xC0\x0F\x95\xC2\x83\x7F\xE0\x00\x0F\x95\xC0"
+	    "\x20\xD0\x0F\xB6\xC0" SUB_SP),
+/* ! */	OP("\x85\xC0\x0F\x94\xC0\x0F\xB6\xC0"),
+/* == */	OP(SETCC("\x94")),
+/* != */	OP("\xF7\xD8\x03\x47\xE0" SUB_SP),
+/* > */	OP(SETCC("\x9F")),
+/* < */	OP(SETCC("\x9C")),
+/* >= */	OP(SETCC("\x9D")),
+/* <= */	OP(SETCC("\x9E")),
+/* | */	OP("\x0B\x47\xE0" SUB_SP),
+/* ^ */	OP("\x33\x47\xE0" SUB_SP),
+/* & */	OP("\x23\x47\xE0" SUB_SP),
+/* << */	OP("\x89\xC1\x8B\x47\xE0\xD3\xE0" SUB_SP),
+/* >> */	OP("\x89\xC1\x8B\x47\xE0\xD3\xF8" SUB_SP),
+/* + */	OP("\x03\x47\xE0" SUB_SP),
+/* - */	OP("\xF7\xD8\x03\x47\xE0" SUB_SP),
+/* * */	OP("\x0F\xAF\x47\xE0" SUB_SP),
+/* / */	OP("\x89\xC1\x8B\x47\xE0\x99\xF7\xF9" SUB_SP),
+/* % */	OP("\x89\xC1\x8B\x47\xE0\x99\xF7\xF9\x89\xD0" SUB_SP),
+/* ~ */	OP("\xF7\xD0"),
+/* - */	OP("\xF7\xD8"),
+/* ++ */	OP("\x83\xC0\x01\x48\x8B\x4F\xF8\x89\x01"),
+/* -- */	OP("\x83\xE8\x01\x48\x8B\x4F\xF8\x89\x01"),
+/* ++ */	OP("\x8D\x50\x01\x48\x8B\x4F\xF8\x89\x11"),
+/* -- */	OP("\x8D\x50\xFF\x48\x8B\x4F\xF8\x89\x11")
+};
+
+#undef SUB_SP
+#undef LOAD_A
+#undef STORE_A
+#undef SETCC
+#undef OP
+
+#define EMIT(byte) \
+	*c_native_ptr++ = (byte)
+
+static unsigned char *c_native_ptr;
+
+static void c_native_emit32(c_int value)
+{
+	memcpy(c_native_ptr, &value, 4);
+	c_native_ptr += 4;
+}
+
+/*
+ * Emits a push of count values, described by the bits of mem (set for
+ * variables, clear for immediate values), and takes their operands.
+ */
+static union c_insn *c_native_push(union c_insn *pc, int count, int mem)
+{
+	int i;
+
+/* mov [rdi-16],eax */
+	EMIT(0x89); EMIT(0x47); EMIT(0xF0);
+
+	for (i = 0; i < count; i++, pc++) {
+		int last = i == count - 1;
+
+		if (mem & (1 << i)) {
+/* mov rcx,addr; mov [rdi+16*i+8],rcx */
+			EMIT(0x48); EMIT(0xB9);
+			memcpy(c_native_ptr, &pc->mem, 8);
+			c_native_ptr += 8;
+			EMIT(0x48); EMIT(0x89); EMIT(0x4F); EMIT(16 * i + 8);
+			if (last) {
+/* mov eax,[rcx] */
+				EMIT(0x8B); EMIT(0x01);
+			} else {
+/* mov edx,[rcx]; mov [rdi+16*i],edx */
+				EMIT(0x8B); EMIT(0x11);
+				EMIT(0x89); EMIT(0x57); EMIT(16 * i);
+			}
+		} else if (last) {
+/* mov eax,imm */
+			EMIT(0xB8);
+			c_native_emit32(pc->imm);
+		} else {
+/* mov dword [rdi+16*i],imm */
+			EMIT(0xC7); EMIT(0x47); EMIT(16 * i);
+			c_native_emit32(pc->imm);
+		}
+	}
+
+/* add rdi,16*count */
+	EMIT(0x48); EMIT(0x83); EMIT(0xC7); EMIT(16 * count);
+
+	return pc;
+}
+
+int c_native(void)
+{
+	union c_insn *pc, *end = c_code_ptr;
+	size_t count = end - c_code_start;
+	unsigned char **fixups;
+	int nfixups = 0;
+
+	c_native_free();
+	if (!c_code_start)
+		return 0;
+
+	c_native_size = (count + 1) * C_NATIVE_MAX;
+	c_native_code = mmap(NULL, c_native_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (c_native_code == MAP_FAILED) {
+		c_native_code = NULL;
+		return 0;
+	}
+
+	c_native_map = mem_calloc((count + 1) * sizeof(*c_native_map));
+	fixups = mem_alloc(count * sizeof(*fixups));
+
+	c_native_ptr = c_native_code;
+	for (pc = c_code_start; pc < end;) {
+		void (*op)(void) = pc->op;
+		int i;
+
+		c_native_map[pc++ - c_code_start] = c_native_ptr;
+
+		if (op == c_op_return) {
+			EMIT(0xC3);
+		} else if (op == c_op_bz || op == c_op_ba) {
+			if (op == c_op_bz) {
+/* sub rdi,16; test eax,eax; jz */
+				EMIT(0x48); EMIT(0x83); EMIT(0xEF); EMIT(0x10);
+				EMIT(0x85); EMIT(0xC0);
+				EMIT(0x0F); EMIT(0x84);
+			} else {
+/* jmp */
+				EMIT(0xE9);
+			}
+/* The displacement holds the target instruction until it's known */
+			fixups[nfixups++] = c_native_ptr;
+			c_native_emit32((pc++)->pc - c_code_start);
+		} else if (op == c_op_push_imm) {
+			pc = c_native_push(pc, 1, 0);
+		} else if (op == c_op_push_mem) {
+			pc = c_native_push(pc, 1, 1);
+		} else if (op == c_op_push_imm_imm) {
+			pc = c_native_push(pc, 2, 0);
+		} else if (op == c_op_push_imm_mem) {
+			pc = c_native_push(pc, 2, 2);
+		} else if (op == c_op_push_mem_imm) {
+			pc = c_native_push(pc, 2, 1);
+		} else if (op == c_op_push_mem_mem) {
+			pc = c_native_push(pc, 2, 3);
+		} else if (op == c_op_push_mem_mem_mem) {
+			pc = c_native_push(pc, 3, 7);
+		} else if (op == c_op_push_mem_mem_mem_imm) {
+			pc = c_native_push(pc, 4, 7);
+		} else if (op == c_op_push_mem_mem_mem_mem) {
+			pc = c_native_push(pc, 4, 15);
+		} else if (op == c_op_pop || op == c_op_assign_pop) {
+			if (op == c_op_assign_pop) {
+/* mov rcx,[rdi-24]; mov [rcx],eax */
+				EMIT(0x48); EMIT(0x8B); EMIT(0x4F); EMIT(0xE8);
+				EMIT(0x89); EMIT(0x01);
+			}
+/* sub rdi,16 or 32 */
+			EMIT(0x48); EMIT(0x83); EMIT(0xEF);
+			EMIT(op == c_op_pop ? 0x10 : 0x20);
+		} else {
+			for (i = 0; c_ops[i].prec > 0; i++)
+			if (c_ops[i].op == op)
+				break;
+			if (!c_ops[i].prec ||
+			    i >= sizeof(c_native_ops) / sizeof(c_native_ops[0])) {
+				MEM_FREE(fixups);
+				c_native_free();
+				return 0;
+			}
+			memcpy(c_native_ptr, c_native_ops[i].code,
+			    c_native_ops[i].length);
+			c_native_ptr += c_native_ops[i].length;
+		}
+	}
+	c_native_map[count] = c_native_ptr;
+
+	while (nfixups--) {
+		unsigned char *fixup = fixups[nfixups];
+		c_int target;
+
+		memcpy(&target, fixup, 4);
+		target = (unsigned char *)c_native_map[target] - (fixup + 4);
+		memcpy(fixup, &target, 4);
+	}
+	MEM_FREE(fixups);
+
+	if (mprotect(c_native_code, c_native_size, PROT_READ | PROT_EXEC)) {
+		c_native_free();
+		return 0;
+	}
+
+	return 1;
+}
+
+#undef EMIT
+
+#else
+
+int c_native(void)
+{
+	return 0;
+}
+
+#endif
+
 #if !defined(__GNUC__) || defined(PRINT_INSNS)
 
 void c_execute_fast(void *addr)
 {
+#if C_NATIVE
+	if (c_native_code) {
+		((void (*)(union c_insn *))
+		    c_native_map[(union c_insn *)addr - c_code_start])
+		    (&c_stack[2]);
+		return;
+	}
+#endif
+
 	c_stack[0].pc = NULL;
 	c_sp = &c_stack[2];
 
@@ -914,7 +1200,7 @@ void c_execute_fast(void *addr)
 void c_execute_fast(void *addr)
 {
 	union c_insn *pc = addr;
-	union c_insn *sp = c_stack;
+	union c_insn *sp = &c_stack[2];
 	c_int imm = 0;
 
 	static void *ops[] = {
@@ -992,6 +1278,14 @@ void c_execute_fast(void *addr)
 		return;
 	}
 
+#if C_NATIVE
+	if (c_native_code) {
+		((void (*)(union c_insn *))
+		    c_native_map[pc - c_code_start])(&c_stack[2]);
+		return;
+	}
+#endif
+
 	goto *(pc++)->op;
 
 op_return:
@@ -77,6 +77,14 @@ extern int c_compile(int (*ext_getchar)(void), void (*ext_rewind)(void),
  */
 extern void *c_lookup(char *name);
 
+/*
+ * Translates the program compiled with c_compile() to native machine code,
+ * which c_execute_fast() then runs instead of interpreting the program.
+ * Returns zero if this isn't supported on the system, in which case the
+ * program keeps being interpreted.
+ */
+extern int c_native(void);
+
 /*
  * Executes a function previously compiled with c_compile().
  */
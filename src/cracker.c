@@ -32,6 +32,7 @@
 #include "idle.h"
 #include "formats.h"
 #include "loader.h"
+#include "cracker.h"
 #include "logger.h"
 #include "status.h"
 #include "recovery.h"
@@ -40,11 +41,18 @@
 #include "unicode.h"
 #include "john.h"
 #include "fake_salts.h"
+#include "config.h"
 #ifdef HAVE_MPI
 #include "john-mpi.h"
 #endif
 #include "path.h"
 
+#ifdef CRK_PIPELINE
+#include <pthread.h>
+#include <sys/time.h>
+#include <omp.h>
+#endif
+
 #ifdef index
 #undef index
 #endif
@@ -53,6 +61,20 @@
 static clock_t salt_time = 0;
 #endif
 
+/*
+ * How many candidates ahead of the one being looked up crk_password_loop()
+ * fetches the bitmap word for.
+ */
+#define CRK_PREFETCH_AHEAD		8
+
+#ifdef __GNUC__
+#define CRK_PREFETCH_BITMAP(salt, hash) \
+	__builtin_prefetch(&(salt)->bitmap[(unsigned int)(hash) / \
+	    (sizeof(*(salt)->bitmap) * 8)])
+#else
+#define CRK_PREFETCH_BITMAP(salt, hash)
+#endif
+
 static struct db_main *crk_db;
 static struct fmt_params crk_params;
 static struct fmt_methods crk_methods;
@@ -61,9 +83,45 @@ static void *crk_last_salt;
 static void (*crk_fix_state)(void);
 static struct db_keys *crk_guesses;
 static int64 *crk_timestamps;
+static int *crk_hashes;
 static char crk_stdout_key[PLAINTEXT_BUFFER_SIZE];
 long int crk_pot_pos;
 
+#ifdef CRK_PIPELINE
+/*
+ * Candidate pipeline.  The cracking mode keeps running on the main thread,
+ * and crk_process_key() only copies its keys into one of two batch buffers.
+ * A full batch is handed to the hashing thread, which does the set_key()
+ * calls and the salt loop while the mode fills the other buffer.
+ *
+ * To keep restored sessions exact, the mode's fix_state() is called right
+ * after a batch is handed off, and anything that may save the session
+ * (timed saves, abort, pause, pot sync) is only acted upon once the hashing
+ * thread has finished that batch.  So an abort waits for the batch in
+ * flight, which is at most one crypt_all() per salt.
+ */
+static int crk_pipe;
+static char *crk_pipe_buf[2];
+static int crk_pipe_fill;	/* buffer the mode is filling */
+static int crk_pipe_count;	/* keys in it */
+static int crk_pipe_todo;	/* keys in the buffer being hashed */
+static int crk_pipe_busy, crk_pipe_result, crk_pipe_exit;
+/*
+ * Ranges from crk_process_key_range() take count slots of a batch buffer:
+ * the key goes to the first one and its count characters to the rest.
+ */
+static struct crk_pipe_range {
+	int index, count, pos;
+} *crk_pipe_ranges[2];
+static int crk_pipe_nranges[2];
+static pthread_t crk_pipe_thread;
+static pthread_mutex_t crk_pipe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t crk_pipe_cond = PTHREAD_COND_INITIALIZER;
+
+static void crk_pipe_start(void);
+static void crk_pipe_stop(void);
+#endif
+
 static void crk_dummy_set_salt(void *salt)
 {
 }
@@ -146,9 +204,23 @@ void crk_init(struct db_main *db, void (*fix_state)(void),
 		size = crk_params.max_keys_per_crypt * sizeof(int64);
 		memset(crk_timestamps = mem_alloc_tiny(size, sizeof(int64)),
 		       -1, size);
+		crk_hashes = mem_alloc_tiny(crk_params.max_keys_per_crypt *
+		    sizeof(*crk_hashes), MEM_ALIGN_CACHE);
 	} else
 		crk_stdout_key[0] = 0;
 
+#ifdef CRK_PIPELINE
+	if (crk_pipe)
+		crk_pipe_stop();
+	/*
+	 * "single crack" mode uses crk_process_salt() with its guesses, and
+	 * with a single CPU there's nothing to overlap.
+	 */
+	if (db->loaded && !guesses && omp_get_num_procs() > 1 &&
+	    cfg_get_bool(SECTION_OPTIONS, NULL, "CandidatePipeline", 1))
+		crk_pipe_start();
+#endif
+
 	rec_save();
 
 	crk_help();
@@ -176,7 +248,8 @@ static void crk_remove_salt(struct db_salt *salt)
 		int hash = crk_methods.salt_hash(salt->salt);
 
 		if (crk_db->salt_hash[hash] == salt) {
-			if (crk_methods.salt_hash(salt->next->salt) == hash)
+			if (salt->next &&
+			    crk_methods.salt_hash(salt->next->salt) == hash)
 				crk_db->salt_hash[hash] = salt->next;
 			else
 				crk_db->salt_hash[hash] = NULL;
@@ -215,16 +288,38 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 
 	hash = crk_db->format->methods.binary_hash[salt->hash_size](pw->binary);
 	count = 0;
-	current = &salt->hash[hash >> PASSWORD_HASH_SHR];
-	do {
-		if (crk_db->format->methods.binary_hash[salt->hash_size]
-		    ((*current)->binary) == hash)
-			count++;
-		if (*current == pw)
-			*current = pw->next_hash;
-		else
-			current = &(*current)->next_hash;
-	} while (*current);
+
+/*
+ * With a compact table, leave a tombstone in the entry so that the probe
+ * sequences through it still work.
+ */
+	if (salt->table) {
+		struct db_table *table = salt->table;
+		struct db_table_entry *entry;
+		unsigned int slot = DB_TABLE_SLOT(table, hash);
+
+		while ((entry = &table->entries[slot])->index !=
+		    DB_TABLE_EMPTY) {
+			if (entry->hash == (unsigned int)hash &&
+			    entry->index != DB_TABLE_REMOVED) {
+				count++;
+				if (table->passwords[entry->index] == pw)
+					entry->index = DB_TABLE_REMOVED;
+			}
+			slot = (slot + 1) & table->mask;
+		}
+	} else {
+		current = &salt->hash[hash >> PASSWORD_HASH_SHR];
+		do {
+			if (crk_db->format->methods.binary_hash[salt->hash_size]
+			    ((*current)->binary) == hash)
+				count++;
+			if (*current == pw)
+				*current = pw->next_hash;
+			else
+				current = &(*current)->next_hash;
+		} while (*current);
+	}
 
 	assert(count >= 1);
 
@@ -245,6 +340,62 @@ static void crk_remove_hash(struct db_salt *salt, struct db_password *pw)
 	pw->binary = NULL;
 }
 
+#ifdef HAVE_MPI
+/*
+ * Hashes we cracked, to be sent to the other MPI nodes, and hashes cracked by
+ * them, to be removed at a point where a pot reload would be safe.  Both are
+ * only sent or received by the main thread, in crk_mpi_probe() and while it
+ * waits in crk_pipe_sync().  The candidate pipeline's hashing thread makes no
+ * MPI calls, it only queues its cracks (under crk_pipe_mutex) to be sent.
+ */
+static struct crk_mpi_guess {
+	struct crk_mpi_guess *next;
+	char ciphertext[1];
+} *crk_mpi_cracked, *crk_mpi_guesses;
+
+static void crk_mpi_queue(struct crk_mpi_guess **list, char *ciphertext)
+{
+	struct crk_mpi_guess *guess;
+	size_t len = strlen(ciphertext);
+
+	guess = mem_alloc(sizeof(*guess) + len);
+	memcpy(guess->ciphertext, ciphertext, len + 1);
+#ifdef CRK_PIPELINE
+	if (crk_pipe)
+		pthread_mutex_lock(&crk_pipe_mutex);
+#endif
+	guess->next = *list;
+	*list = guess;
+#ifdef CRK_PIPELINE
+	if (crk_pipe)
+		pthread_mutex_unlock(&crk_pipe_mutex);
+#endif
+}
+
+static void crk_mpi_send_cracked(void)
+{
+	struct crk_mpi_guess *guess, *list;
+
+#ifdef CRK_PIPELINE
+	if (crk_pipe)
+		pthread_mutex_lock(&crk_pipe_mutex);
+#endif
+	list = crk_mpi_cracked;
+	crk_mpi_cracked = NULL;
+#ifdef CRK_PIPELINE
+	if (crk_pipe)
+		pthread_mutex_unlock(&crk_pipe_mutex);
+#endif
+
+	while ((guess = list)) {
+		list = guess->next;
+		mpi_send_others(JOHN_MPI_CRACKED, guess->ciphertext,
+		                strlen(guess->ciphertext));
+		MEM_FREE(guess);
+	}
+}
+#endif
+
 /* Negative index is not counted/reported (got it from pot sync) */
 static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 	int index)
@@ -308,6 +459,13 @@ static int crk_process_guess(struct db_salt *salt, struct db_password *pw,
 		          NULL : crk_methods.source(pw->source, pw->binary),
 		          repkey, key, crk_db->options->field_sep_char);
 
+#ifdef HAVE_MPI
+		/* Have the other nodes drop it, see crk_mpi_probe() */
+		if (mpi_p > 1 && !dupe && !(crk_params.flags & FMT_NOT_EXACT))
+			crk_mpi_queue(&crk_mpi_cracked,
+			    crk_methods.source(pw->source, pw->binary));
+#endif
+
 		if (options.flags & FLG_CRKSTAT)
 			event_pending = event_status = 1;
 
@@ -410,6 +568,31 @@ static int crk_remove_pot_entry(char *ciphertext)
 		      (1U << (hash % (sizeof(*salt->bitmap) * 8)))))
 			return 0;
 
+		if (salt->table) {
+			struct db_table *table = salt->table;
+			struct db_table_entry *entry;
+			unsigned int slot = DB_TABLE_SLOT(table, hash);
+
+			while ((entry = &table->entries[slot])->index !=
+			    DB_TABLE_EMPTY) {
+				slot = (slot + 1) & table->mask;
+				if (entry->hash != (unsigned int)hash ||
+				    entry->index == DB_TABLE_REMOVED)
+					continue;
+				pw = table->passwords[entry->index];
+				if (!strcmp(crk_methods.source(pw->source,
+				    pw->binary), ciphertext)) {
+					if (crk_process_guess(salt, pw, -1))
+						return 1;
+
+					if (!(crk_db->options->flags &
+					    DB_WORDS))
+						break;
+				}
+			}
+			return 0;
+		}
+
 		pw = salt->hash[hash >> PASSWORD_HASH_SHR];
 		do {
 			char *source;
@@ -429,6 +612,35 @@ static int crk_remove_pot_entry(char *ciphertext)
 	return 0;
 }
 
+#ifdef HAVE_MPI
+/* Set if event_reload was only raised for crk_mpi_guesses */
+static int crk_mpi_guesses_only;
+
+static int crk_mpi_remove_guesses(void)
+{
+	struct crk_mpi_guess *guess;
+	int total = crk_db->password_count, done = 0;
+
+	ldr_in_pot = 1;
+
+	while ((guess = crk_mpi_guesses)) {
+		crk_mpi_guesses = guess->next;
+		if (!done &&
+		    crk_methods.valid(guess->ciphertext, crk_db->format))
+			done = crk_remove_pot_entry(guess->ciphertext);
+		MEM_FREE(guess);
+	}
+
+	ldr_in_pot = 0;
+
+	if (total != crk_db->password_count)
+		log_event("+ MPI sync removed %d hashes; %s",
+		          total - crk_db->password_count, crk_loaded_counts());
+
+	return done;
+}
+#endif
+
 int crk_reload_pot(void)
 {
 	char line[LINE_BUFFER_SIZE];
@@ -446,6 +658,15 @@ int crk_reload_pot(void)
 	if (crk_params.flags & FMT_NOT_EXACT)
 		return 0;
 
+#ifdef HAVE_MPI
+	if (crk_mpi_guesses && crk_mpi_remove_guesses())
+		return 1;
+	if (crk_mpi_guesses_only) {
+		crk_mpi_guesses_only = 0;
+		return 0;
+	}
+#endif
+
 	if ((pot_fd =
 	     open(path_expand(options.loader.activepot), O_RDONLY)) == -1) {
 		if (errno != ENOENT)
@@ -518,15 +739,41 @@ static void crk_mpi_probe(void)
 	static MPI_Status s;
 	int flag;
 
+	crk_mpi_send_cracked();
+
 	MPI_Iprobe(MPI_ANY_SOURCE, JOHN_MPI_RELOAD, MPI_COMM_WORLD, &flag, &s);
 	if (flag) {
 		static MPI_Request r;
 		char buf[16];
 
 		event_reload = 1;
+		crk_mpi_guesses_only = 0;
 		MPI_Irecv(buf, 1, MPI_CHAR, MPI_ANY_SOURCE,
 		          JOHN_MPI_RELOAD, MPI_COMM_WORLD, &r);
 	}
+
+	/* Queue hashes cracked by other nodes for crk_reload_pot() */
+	while (1) {
+		struct crk_mpi_guess *guess;
+		int count;
+
+		MPI_Iprobe(MPI_ANY_SOURCE, JOHN_MPI_CRACKED, MPI_COMM_WORLD,
+		           &flag, &s);
+		if (!flag)
+			break;
+
+		MPI_Get_count(&s, MPI_CHAR, &count);
+		guess = mem_alloc(sizeof(*guess) + count);
+		MPI_Recv(guess->ciphertext, count, MPI_CHAR, s.MPI_SOURCE,
+		         JOHN_MPI_CRACKED, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		guess->ciphertext[count] = 0;
+		guess->next = crk_mpi_guesses;
+		crk_mpi_guesses = guess;
+
+		if (!event_reload)
+			crk_mpi_guesses_only = 1;
+		event_reload = 1;
+	}
 }
 #endif
 
@@ -628,6 +875,10 @@ static int crk_password_loop(struct db_salt *salt)
 
 	idle_yield();
 
+#ifdef CRK_PIPELINE
+	/* Events are seen to by the main thread, see crk_pipe_sync() */
+	if (!crk_pipe)
+#endif
 	if (event_pending && crk_process_event())
 		return -1;
 
@@ -660,9 +911,55 @@ static int crk_password_loop(struct db_salt *salt)
 				}
 			}
 		} while ((pw = pw->next));
+		return 0;
+	}
+
+/*
+ * Get the bitmap indices for the whole batch first, in one call where the
+ * format supports that, and then look them up.  Fetching the bitmap words a
+ * few candidates ahead hides most of the cache misses on large bitmaps.
+ */
+	if (crk_methods.get_hashes)
+		crk_methods.get_hashes(salt->hash_size, match, crk_hashes);
+	else
+	for (index = 0; index < match; index++)
+		crk_hashes[index] = salt->index(index);
+
+	if (salt->table) {
+		struct db_table *table = salt->table;
+		struct db_table_entry *entry;
+		unsigned int slot;
+
+		for (index = 0; index < match; index++) {
+			int hash = crk_hashes[index];
+			if (index + CRK_PREFETCH_AHEAD < match)
+				CRK_PREFETCH_BITMAP(salt,
+				    crk_hashes[index + CRK_PREFETCH_AHEAD]);
+			if (!(salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
+			    (1U << (hash % (sizeof(*salt->bitmap) * 8)))))
+				continue;
+			slot = DB_TABLE_SLOT(table, hash);
+			while ((entry = &table->entries[slot])->index !=
+			    DB_TABLE_EMPTY) {
+				slot = (slot + 1) & table->mask;
+				if (entry->hash != (unsigned int)hash ||
+				    entry->index == DB_TABLE_REMOVED ||
+				    !crk_methods.cmp_one(table->binaries +
+				    entry->index * table->binary_stride, index))
+					continue;
+				pw = table->passwords[entry->index];
+				if (crk_methods.cmp_exact(crk_methods.source(
+				    pw->source, pw->binary), index))
+				if (crk_process_guess(salt, pw, index))
+					return 1;
+			}
+		}
 	} else
 	for (index = 0; index < match; index++) {
-		int hash = salt->index(index);
+		int hash = crk_hashes[index];
+		if (index + CRK_PREFETCH_AHEAD < match)
+			CRK_PREFETCH_BITMAP(salt,
+			    crk_hashes[index + CRK_PREFETCH_AHEAD]);
 		if (salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] &
 		    (1U << (hash % (sizeof(*salt->bitmap) * 8)))) {
 			pw = salt->hash[hash >> PASSWORD_HASH_SHR];
@@ -704,8 +1001,165 @@ static int crk_salt_loop(void)
 	crk_last_salt = NULL;
 	crk_fix_state();
 
+#ifdef HAVE_MPI
+	if (mpi_p > 1)
+		mpi_progress();
+#endif
+
+	crk_methods.clear_keys();
+
+	if (ext_abort)
+		event_abort = 1;
+
+	if (ext_status && !event_abort) {
+		ext_status = 0;
+		event_status = 0;
+		status_print();
+	}
+
+	return ext_abort;
+}
+
+#ifdef CRK_PIPELINE
+/* Salt loop for one batch, run by the hashing thread */
+static int crk_pipe_salt_loop(void)
+{
+	struct db_salt *salt;
+	char *buf = crk_pipe_buf[crk_pipe_fill ^ 1];
+	struct crk_pipe_range *range = crk_pipe_ranges[crk_pipe_fill ^ 1];
+	struct crk_pipe_range *end = range + crk_pipe_nranges[crk_pipe_fill ^ 1];
+	size_t size = crk_params.plaintext_length + 1;
+	int index;
+
+	index = 0;
+	while (index < crk_pipe_todo) {
+		if (range < end && range->index == index) {
+			crk_methods.set_key_range(&buf[index * size],
+			    range->pos, &buf[(index + 1) * size],
+			    range->count, index);
+			index += range->count;
+			range++;
+		} else {
+			crk_methods.set_key(&buf[index * size], index);
+			index++;
+		}
+	}
+	crk_key_index = crk_pipe_todo;
+
+	salt = crk_db->salts;
+	do {
+		crk_methods.set_salt(salt->salt);
+		if (crk_password_loop(salt))
+			break;
+	} while ((salt = salt->next));
+
+	add32to64(&status.cands, crk_key_index);
+
+	crk_key_index = 0;
+	crk_last_salt = NULL;
+
 	crk_methods.clear_keys();
 
+	return salt != NULL;
+}
+
+static void *crk_pipe_worker(void *arg)
+{
+	sigset_t mask;
+
+	/* Leave the signals to the main thread */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	pthread_mutex_lock(&crk_pipe_mutex);
+	while (1) {
+		while (!crk_pipe_busy && !crk_pipe_exit)
+			pthread_cond_wait(&crk_pipe_cond, &crk_pipe_mutex);
+		if (!crk_pipe_busy)
+			break;
+		pthread_mutex_unlock(&crk_pipe_mutex);
+
+		crk_pipe_result = crk_pipe_salt_loop();
+
+		pthread_mutex_lock(&crk_pipe_mutex);
+		crk_pipe_busy = 0;
+		pthread_cond_broadcast(&crk_pipe_cond);
+	}
+	pthread_mutex_unlock(&crk_pipe_mutex);
+
+	return NULL;
+}
+
+static void crk_pipe_start(void)
+{
+	size_t size = (size_t)(crk_params.plaintext_length + 1) *
+		crk_params.max_keys_per_crypt;
+
+	crk_pipe_buf[0] = mem_alloc(size);
+	crk_pipe_buf[1] = mem_alloc(size);
+	crk_pipe_buf[1][0] = 0;
+	if (crk_methods.set_key_range) {
+		size = (crk_params.max_keys_per_crypt / 2 + 1) *
+			sizeof(struct crk_pipe_range);
+		crk_pipe_ranges[0] = mem_alloc(size);
+		crk_pipe_ranges[1] = mem_alloc(size);
+	}
+	crk_pipe_nranges[0] = crk_pipe_nranges[1] = 0;
+	crk_pipe_fill = crk_pipe_count = crk_pipe_todo = 0;
+	crk_pipe_busy = crk_pipe_result = crk_pipe_exit = 0;
+
+	if (pthread_create(&crk_pipe_thread, NULL, crk_pipe_worker, NULL)) {
+		log_event("Candidate pipeline disabled: %s", strerror(errno));
+		MEM_FREE(crk_pipe_buf[0]);
+		MEM_FREE(crk_pipe_buf[1]);
+		MEM_FREE(crk_pipe_ranges[0]);
+		MEM_FREE(crk_pipe_ranges[1]);
+		return;
+	}
+	crk_pipe = 1;
+}
+
+/*
+ * Waits for the batch in flight.  Status requests are served meanwhile, but
+ * anything that could save the session waits until the batch is done.
+ */
+static int crk_pipe_sync(void)
+{
+	pthread_mutex_lock(&crk_pipe_mutex);
+	while (crk_pipe_busy) {
+		struct timeval now;
+		struct timespec until;
+
+		gettimeofday(&now, NULL);
+		until.tv_sec = now.tv_sec + (now.tv_usec >= 900000);
+		until.tv_nsec = (now.tv_usec + 100000) % 1000000 * 1000;
+		pthread_cond_timedwait(&crk_pipe_cond, &crk_pipe_mutex, &until);
+
+		if (event_status) {
+			event_status = 0;
+			status_print();
+		}
+		if (event_ticksafety) {
+			event_ticksafety = 0;
+			status_ticks_overflow_safety();
+		}
+#ifdef HAVE_MPI
+		/* Keep our cracks and the chunk queue moving meanwhile */
+		if (mpi_p > 1 && crk_pipe_busy) {
+			pthread_mutex_unlock(&crk_pipe_mutex);
+			crk_mpi_send_cracked();
+			mpi_progress();
+			pthread_mutex_lock(&crk_pipe_mutex);
+		}
+#endif
+	}
+	pthread_mutex_unlock(&crk_pipe_mutex);
+
+	if (crk_pipe_result) {
+		crk_pipe_result = 0;
+		return 1;
+	}
+
 	if (ext_abort)
 		event_abort = 1;
 
@@ -715,11 +1169,97 @@ static int crk_salt_loop(void)
 		status_print();
 	}
 
+	if (event_pending && crk_process_event())
+		return 1;
+
 	return ext_abort;
 }
 
+static int crk_pipe_flush(void)
+{
+	if (crk_pipe_sync())
+		return 1;
+
+	if (event_reload && crk_reload_pot())
+		return 1;
+
+	pthread_mutex_lock(&crk_pipe_mutex);
+	crk_pipe_todo = crk_pipe_count;
+	crk_pipe_fill ^= 1;
+	crk_pipe_nranges[crk_pipe_fill] = 0;
+	crk_pipe_busy = 1;
+	pthread_cond_broadcast(&crk_pipe_cond);
+	pthread_mutex_unlock(&crk_pipe_mutex);
+
+	crk_pipe_count = 0;
+	crk_fix_state();
+
+#ifdef HAVE_MPI
+	if (mpi_p > 1)
+		mpi_progress();
+#endif
+
+	return 0;
+}
+
+static void crk_pipe_stop(void)
+{
+	crk_pipe_sync();
+
+	pthread_mutex_lock(&crk_pipe_mutex);
+	crk_pipe_exit = 1;
+	pthread_cond_broadcast(&crk_pipe_cond);
+	pthread_mutex_unlock(&crk_pipe_mutex);
+	pthread_join(crk_pipe_thread, NULL);
+
+	MEM_FREE(crk_pipe_buf[0]);
+	MEM_FREE(crk_pipe_buf[1]);
+	MEM_FREE(crk_pipe_ranges[0]);
+	MEM_FREE(crk_pipe_ranges[1]);
+	crk_pipe = 0;
+}
+#endif
+
+#ifdef CRK_PIPELINE
+/* Queues count (at least 2) keys from a range for the hashing thread */
+static int crk_pipe_key_range(char *key, int pos, char *chars, int count)
+{
+	size_t size = crk_params.plaintext_length + 1;
+	char *slot = &crk_pipe_buf[crk_pipe_fill][crk_pipe_count * size];
+	struct crk_pipe_range *range;
+
+	range = &crk_pipe_ranges[crk_pipe_fill][
+	    crk_pipe_nranges[crk_pipe_fill]++];
+	range->index = crk_pipe_count;
+	range->count = count;
+	range->pos = pos;
+
+	strnzcpy(slot, key, size);
+	memcpy(slot + size, chars, count);
+
+	crk_pipe_count += count;
+	if (crk_pipe_count >= crk_params.max_keys_per_crypt)
+		return crk_pipe_flush();
+
+	return 0;
+}
+#endif
+
 int crk_process_key(char *key)
 {
+#ifdef CRK_PIPELINE
+	if (crk_pipe) {
+		strnzcpy(&crk_pipe_buf[crk_pipe_fill][crk_pipe_count++ *
+		         (crk_params.plaintext_length + 1)],
+		         key, crk_params.plaintext_length + 1);
+
+		if (crk_pipe_count >= crk_params.max_keys_per_crypt)
+			return crk_pipe_flush();
+
+		return 0;
+	}
+#endif
+
 	if (crk_db->loaded) {
 		crk_methods.set_key(key, crk_key_index++);
 
@@ -756,6 +1296,52 @@ int crk_process_key(char *key)
 	return ext_abort;
 }
 
+int crk_process_key_range(char *key, int pos, char *chars, int count)
+{
+	int n;
+
+	if (!crk_methods.set_key_range || !crk_db->loaded)
+		return -1;
+
+#ifdef CRK_PIPELINE
+	if (crk_pipe) {
+		while (count) {
+			n = crk_params.max_keys_per_crypt - crk_pipe_count;
+			if (n > count)
+				n = count;
+			if (n == 1) {
+				char last[PLAINTEXT_BUFFER_SIZE];
+
+				strnzcpy(last, key, sizeof(last));
+				last[pos] = *chars;
+				if (crk_process_key(last))
+					return 1;
+			} else if (crk_pipe_key_range(key, pos, chars, n))
+				return 1;
+			chars += n;
+			count -= n;
+		}
+		return 0;
+	}
+#endif
+
+	while (count) {
+		n = crk_params.max_keys_per_crypt - crk_key_index;
+		if (n > count)
+			n = count;
+		crk_methods.set_key_range(key, pos, chars, n, crk_key_index);
+		crk_key_index += n;
+		chars += n;
+		count -= n;
+
+		if (crk_key_index >= crk_params.max_keys_per_crypt)
+		if (crk_salt_loop())
+			return 1;
+	}
+
+	return 0;
+}
+
 /* This function is used by single.c only */
 int crk_process_salt(struct db_salt *salt)
 {
@@ -817,6 +1403,11 @@ int crk_process_salt(struct db_salt *salt)
 
 char *crk_get_key1(void)
 {
+#ifdef CRK_PIPELINE
+	/* The format's keys are the hashing thread's business */
+	if (crk_pipe)
+		return crk_pipe_buf[crk_pipe_fill ^ 1];
+#endif
 	if (crk_db->loaded)
 		return crk_methods.get_key(0);
 	else
@@ -825,6 +1416,15 @@ char *crk_get_key1(void)
 
 char *crk_get_key2(void)
 {
+#ifdef CRK_PIPELINE
+	if (crk_pipe) {
+		if (crk_pipe_todo > 1)
+			return &crk_pipe_buf[crk_pipe_fill ^ 1]
+				[(crk_pipe_todo - 1) *
+				 (crk_params.plaintext_length + 1)];
+		return NULL;
+	}
+#endif
 	if (crk_key_index > 1 && crk_key_index < crk_last_key)
 		return crk_methods.get_key(crk_key_index - 1);
 	else
@@ -836,9 +1436,21 @@ char *crk_get_key2(void)
 
 void crk_done(void)
 {
+#ifdef CRK_PIPELINE
+	if (crk_pipe) {
+		if (!crk_pipe_sync() &&
+		    crk_pipe_count && crk_db->salts && !event_abort)
+			crk_pipe_flush();
+		crk_pipe_stop();
+	} else
+#endif
 	if (crk_db->loaded) {
 		if (crk_key_index && crk_db->salts && !event_abort)
 			crk_salt_loop();
 	}
+#ifdef HAVE_MPI
+	if (mpi_p > 1)
+		crk_mpi_send_cracked();
+#endif
 	c_cleanup();
 }
@@ -12,6 +12,16 @@
 
 #include "loader.h"
 
+/*
+ * When defined, crk_process_key() hands full key batches to a hashing
+ * thread, so that the cracking mode can generate the next batch meanwhile.
+ * OpenCL and CUDA formats may save the session from within crypt_all(), so
+ * we don't do it for those builds.
+ */
+#if defined(_OPENMP) && !defined(HAVE_OPENCL) && !defined(HAVE_CUDA)
+#define CRK_PIPELINE			1
+#endif
+
 /* Our last read position in pot file (during crack) */
 extern long int crk_pot_pos;
 
@@ -32,6 +42,16 @@ extern void crk_init(struct db_main *db, void (*fix_state)(void),
  */
 extern int crk_process_key(char *key);
 
+/*
+ * Tries count keys that are equal to key except for the character at
+ * position pos, which is taken from chars[] in turn.  Returns -1 without
+ * doing anything if the format has no set_key_range() method or when keys
+ * are not processed directly, in which case the caller should fall back to
+ * crk_process_key().  Otherwise, the return value is the same as for
+ * crk_process_key().
+ */
+extern int crk_process_key_range(char *key, int pos, char *chars, int count);
+
 /*
  * Resets the guessed keys buffer and processes all the buffered keys for
  * this salt. The return value is the same as for crk_process_key().
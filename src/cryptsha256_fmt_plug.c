@@ -96,13 +96,9 @@ void main() {
 #include "johnswap.h"
 #include "sse-intrinsics.h"
 
-#ifdef MMX_COEF_SHA256
-// there are problems with SSE OMP builds.  Until found, simply do not allow OMP.
-//#undef _OPENMP
-//#undef FMT_OMP
-//#define FMT_OMP 0
-// Well, I tried by turning of OMP, but the run still failed.  So, I will simply
-// leave OMP on, but turn off SSE in an OMP build, until I get this figured out.
+// The lockstep SIMD rounds loop only beats the scalar one with 16 lanes
+// (AVX-512).  With fewer lanes, keep the one key at a time SHA256 loop.
+#if defined(MMX_COEF_SHA256) && MMX_COEF_SHA256 < 16
 #undef MMX_COEF_SHA256
 #endif
 
@@ -242,7 +238,7 @@ static int max_crypts;
 
 /* these 2 values are used in setup of the cryptloopstruct, AND to do our SHA256_Init() calls, in the inner loop */
 static const unsigned char padding[128] = { 0x80, 0 /* 0,0,0,0.... */ };
-#ifndef JTR_INC_COMMON_CRYPTO_SHA2
+#if !defined(JTR_INC_COMMON_CRYPTO_SHA2) && !defined(MMX_COEF_SHA256)
 static const ARCH_WORD_32 ctx_init[8] =
 	{0x6A09E667,0xBB67AE85,0x3C6EF372,0xA54FF53A,0x510E527F,0x9B05688C,0x1F83D9AB,0x5BE0CD19};
 #endif
@@ -312,8 +308,8 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 	unsigned char *cp = crypt_struct->buf;
 	cryptloopstruct *pstr = crypt_struct;
 #ifdef MMX_COEF_SHA256
-	// in SSE mode, we FORCE every buffer to be 2 blocks, even if it COULD fit into 1.
-	// Then we simply use the 2 block SSE code.
+	// in SSE mode, each of the 8 buffer types is BLKS 2 block slots, one per lane,
+	// so that the lanes of a group are 2*64 bytes apart (SSEi_2BUF_INPUT layout).
 	unsigned char *next_cp;
 #endif
 
@@ -344,6 +340,7 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 
 	// Adjust cp for idx;
 #ifdef MMX_COEF_SHA256
+	cp += idx*2*64;
 	next_cp = cp + (2*64*BLKS);
 #endif
 
@@ -515,7 +512,7 @@ static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, c
 	pstr->cptr[idx][20] = cp + off_pc;
 	memcpy(cp, p_bytes, plen); cp += (plen+BINARY_SIZE);
 	if (!idx) pstr->datlen[21] = dlen_pc;
-	memcpy(cp, padding, tot_psc-2-len_pc);
+	memcpy(cp, padding, tot_pc-2-len_pc);
 	pstr->bufs[idx][21][tot_pc-2] = (len_pc<<3)>>8;
 	pstr->bufs[idx][21][tot_pc-1] = (len_pc<<3)&0xFF;
 
@@ -619,21 +616,31 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 //	}
 
 #ifdef MMX_COEF_SHA256
-	// group based upon size splits.
+	// group based upon size splits.  All lanes of a group must use the same number
+	// of blocks for each of the 42 crypts, and that depends on the salt length too.
+	// The 4 lengths only ever grow with the password length, so there are at most
+	// 5 such groups, each a contiguous range of password lengths.
 	MixOrder = mem_alloc(sizeof(int)*(count+5*MMX_COEF_SHA256));
 	{
-		const int lens[6] = {0,4,8,12,24,36};
-		int j;
+		int len, sig, last_sig = -1;
 		tot_todo = 0;
-		saved_key_length[count] = 0; // point all 'tail' MMX buffer elements to this location.
-		for (j = 0; j < 5; ++j) {
-			for (index = 0; index < count; ++index) {
-				if (saved_key_length[index] >= lens[j] && saved_key_length[index] < lens[j+1])
-					MixOrder[tot_todo++] = index;
+		saved_key_length[max_crypts] = 0; // point all 'tail' MMX buffer elements to this location.
+		for (len = 0; len <= PLAINTEXT_LENGTH; ++len) {
+			sig = (len + BINARY_SIZE > 55) |
+			      ((len + cur_salt->len + BINARY_SIZE > 55) << 1) |
+			      (((len<<1) + BINARY_SIZE > 55) << 2) |
+			      (((len<<1) + cur_salt->len + BINARY_SIZE > 55) << 3);
+			if (sig != last_sig) {
+				while (tot_todo & (MMX_COEF_SHA256-1))
+					MixOrder[tot_todo++] = max_crypts;
+				last_sig = sig;
 			}
-			while (tot_todo & (MMX_COEF_SHA256-1))
-				MixOrder[tot_todo++] = count;
+			for (index = 0; index < count; ++index)
+				if (saved_key_length[index] == len)
+					MixOrder[tot_todo++] = index;
 		}
+		while (tot_todo & (MMX_COEF_SHA256-1))
+			MixOrder[tot_todo++] = max_crypts;
 	}
 #else
 	// no need to mix. just run them one after the next, in any order.
@@ -663,7 +670,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		char s_bytes[PLAINTEXT_LENGTH+1];
 		ALIGN(16) cryptloopstruct crypt_struct;
 #ifdef MMX_COEF_SHA256
-		ALIGN(16) ARCH_WORD_32 sse_out[64];
+		ALIGN(16) ARCH_WORD_32 sse_out[8*MMX_COEF_SHA256];
 #endif
 
 		for (idx = 0; idx < MAX_KEYS_PER_CRYPT; ++idx)
@@ -778,7 +785,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 				for (k = 0; k < MMX_COEF_SHA256; ++k) {
 					ARCH_WORD_32 *o = (ARCH_WORD_32 *)crypt_struct.cptr[k][idx];
 					for (j = 0; j < 8; ++j)
-						*o++ = JOHNSWAP(sse_out[(j<<(MMX_COEF_SHA256>>1))+k]);
+						*o++ = JOHNSWAP(sse_out[(j*MMX_COEF_SHA256)+k]);
 				}
 			}
 			if (++idx == 42)
@@ -789,7 +796,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 			for (k = 0; k < MMX_COEF_SHA256; ++k) {
 				ARCH_WORD_32 *o = (ARCH_WORD_32 *)crypt_out[MixOrder[index+k]];
 				for (j = 0; j < 8; ++j)
-					*o++ = JOHNSWAP(sse_out[(j<<(MMX_COEF_SHA256>>1))+k]);
+					*o++ = JOHNSWAP(sse_out[(j*MMX_COEF_SHA256)+k]);
 			}
 		}
 #else
@@ -18,15 +18,38 @@
 #include "params.h"
 #include "common.h"
 #include "formats.h"
+#include "johnswap.h"
+#include "sse-intrinsics.h"
+
+// The lockstep SIMD rounds loop is slower than the scalar one with only 2
+// lanes (SSE2), so it is used from 4 lanes (AVX2) up.
+#if defined(MMX_COEF_SHA512) && MMX_COEF_SHA512 < 4
+#undef MMX_COEF_SHA512
+#endif
 
 #ifdef _OPENMP
 #define OMP_SCALE			16
 #include <omp.h>
 #endif
 
+// In SIMD mode, the keys are regrouped (see crypt_all) so that all lanes of
+// a group need the same number of blocks for each of the 42 rounds buffers.
+// Asking for more keys than one group per thread keeps most groups full.
+#ifdef MMX_COEF_SHA512
+#ifdef _OPENMP
+#define MMX_COEF_SCALE			(64/MMX_COEF_SHA512)
+#else
+#define MMX_COEF_SCALE			(128/MMX_COEF_SHA512)
+#endif
+#else
+#define MMX_COEF_SCALE			1
+#endif
+
 #define FORMAT_LABEL			"sha512crypt"
 
-#if ARCH_BITS >= 64
+#ifdef MMX_COEF_SHA512
+#define ALGORITHM_NAME			SHA512_ALGORITHM_NAME
+#elif ARCH_BITS >= 64
 #define ALGORITHM_NAME			"64/" ARCH_BITS_STR " " SHA2_LIB
 #else
 #define ALGORITHM_NAME			"32/" ARCH_BITS_STR " " SHA2_LIB
@@ -42,7 +65,11 @@
 #define SALT_ALIGN			4
 
 #define MIN_KEYS_PER_CRYPT		1
+#ifdef MMX_COEF_SHA512
+#define MAX_KEYS_PER_CRYPT		MMX_COEF_SHA512
+#else
 #define MAX_KEYS_PER_CRYPT		1
+#endif
 
 #include "cryptsha512_common.h"
 
@@ -55,9 +82,28 @@ static struct fmt_tests tests[] = {
 	{NULL}
 };
 
+#ifdef MMX_COEF_SHA512
+/* The rounds loop hashes one of 8 buffer layouts per round: cp, pspc, cspp,   */
+/* ppc, cpp, psc, csp and pc (p is the P byte sequence, s the S sequence and c */
+/* the result of the prior round), in a pattern 42 long (2*3*7).  Each layout  */
+/* is built once per key, already padded and in BE order, and each round then  */
+/* writes its result straight into the c slot of the next round's buffer.     */
+/* Within a layout, the lanes' buffers are 4*128 bytes apart, which is the    */
+/* SSEi_4BUF_INPUT flat layout.  3 blocks are enough for a 125 byte password. */
+#define BLKS MMX_COEF_SHA512
+
+typedef struct cryptloopstruct_t {
+	unsigned char buf[8*4*128*BLKS];
+	unsigned char *bufs[42];		// lane 0 start of the buffer for each round
+	unsigned char *cptr[BLKS][42];	// where round n's result goes, for each lane
+	int datlen[42];					// number of 128 byte blocks for each round
+} cryptloopstruct;
+#endif
+
 static int (*saved_key_length);
 static char (*saved_key)[PLAINTEXT_LENGTH + 1];
 static ARCH_WORD_32 (*crypt_out)[BINARY_SIZE / sizeof(ARCH_WORD_32)];
+static int max_crypts;
 
 static struct saltstruct {
 	unsigned int len;
@@ -67,17 +113,19 @@ static struct saltstruct {
 
 static void init(struct fmt_main *self)
 {
+	int omp_t = 1;
 #ifdef _OPENMP
-	int omp_t;
-
 	omp_t = omp_get_max_threads();
 	self->params.min_keys_per_crypt = omp_t * MIN_KEYS_PER_CRYPT;
 	omp_t *= OMP_SCALE;
-	self->params.max_keys_per_crypt = omp_t * MAX_KEYS_PER_CRYPT;
 #endif
-	saved_key_length = mem_calloc_tiny(sizeof(*saved_key_length) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
-	saved_key = mem_calloc_tiny(sizeof(*saved_key) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
-	crypt_out = mem_calloc_tiny(sizeof(*crypt_out) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
+	max_crypts = MMX_COEF_SCALE * omp_t * MAX_KEYS_PER_CRYPT;
+	self->params.max_keys_per_crypt = max_crypts;
+	// we allocate 1 more than needed, and use that 'extra' value as a zero length PW to fill in the
+	// tail groups in SIMD mode.
+	saved_key_length = mem_calloc_tiny(sizeof(*saved_key_length) * (1+max_crypts), MEM_ALIGN_WORD);
+	saved_key = mem_calloc_tiny(sizeof(*saved_key) * (1+max_crypts), MEM_ALIGN_WORD);
+	crypt_out = mem_calloc_tiny(sizeof(*crypt_out) * (1+max_crypts), MEM_ALIGN_WORD);
 }
 
 static int get_hash_0(int index) { return crypt_out[index][0] & 0xf; }
@@ -103,14 +151,102 @@ static char *get_key(int index)
 	return saved_key[index];
 }
 
+#ifdef MMX_COEF_SHA512
+// number of 128 byte blocks needed to hash len bytes, after padding
+#define NBLKS(len)	(((len) + 17 + 127) / 128)
+
+static void LoadCryptStruct(cryptloopstruct *crypt_struct, int index, int idx, char *p_bytes, char *s_bytes)
+{
+	unsigned plen = saved_key_length[index], slen = cur_salt->len;
+	unsigned char *bufs[8] = { 0 };
+	int i;
+
+	for (i = 0; i < 42; ++i) {
+		// bit 2: odd round (p first, c last), bit 1: salt added, bit 0: p added again
+		int t = ((i & 1) << 2) | ((i % 3 != 0) << 1) | (i % 7 != 0);
+		unsigned len = plen + BINARY_SIZE + ((t & 2) ? slen : 0) + ((t & 1) ? plen : 0);
+		unsigned tot = NBLKS(len) * 128;
+
+		if (!bufs[t]) {
+			unsigned char *cp;
+
+			cp = bufs[t] = crypt_struct->buf + (t*BLKS + idx)*4*128;
+			if (t & 4) {
+				memcpy(cp, p_bytes, plen); cp += plen;
+			} else
+				cp += BINARY_SIZE;
+			if (t & 2) {
+				memcpy(cp, s_bytes, slen); cp += slen;
+			}
+			if (t & 1) {
+				memcpy(cp, p_bytes, plen); cp += plen;
+			}
+			if (t & 4)
+				cp += BINARY_SIZE;
+			else {
+				memcpy(cp, p_bytes, plen); cp += plen;
+			}
+			memset(cp, 0, tot - len);
+			*cp = 0x80;
+			bufs[t][tot-2] = (len<<3)>>8;
+			bufs[t][tot-1] = (len<<3)&0xFF;
+		}
+		if (!idx) {
+			crypt_struct->bufs[i] = bufs[t];
+			crypt_struct->datlen[i] = tot / 128;
+		}
+		// the result of the prior round goes into this round's c slot
+		crypt_struct->cptr[idx][i ? i - 1 : 41] = bufs[t] + ((t & 4) ? len - BINARY_SIZE : 0);
+	}
+	// For the first round only, we DO copy in the c value.
+	memcpy(crypt_struct->cptr[idx][41], crypt_out[index], BINARY_SIZE);
+}
+#endif
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
 	int index = 0;
+	int *MixOrder, tot_todo;
+
+#ifdef MMX_COEF_SHA512
+	// group keys whose rounds buffers all take the same number of blocks.  The
+	// block counts only ever grow with the password length, so each group is a
+	// contiguous range of lengths, and there are at most 7 of them.
+	MixOrder = mem_alloc(sizeof(int)*(count+7*MMX_COEF_SHA512));
+	{
+		int len, sig, last_sig = -1;
+		tot_todo = 0;
+		saved_key_length[max_crypts] = 0; // point all 'tail' SIMD lanes to this location.
+		for (len = 0; len <= PLAINTEXT_LENGTH; ++len) {
+			sig = NBLKS(len + BINARY_SIZE) |
+			      (NBLKS(len + cur_salt->len + BINARY_SIZE) << 2) |
+			      (NBLKS((len<<1) + BINARY_SIZE) << 4) |
+			      (NBLKS((len<<1) + cur_salt->len + BINARY_SIZE) << 6);
+			if (sig != last_sig) {
+				while (tot_todo & (MMX_COEF_SHA512-1))
+					MixOrder[tot_todo++] = max_crypts;
+				last_sig = sig;
+			}
+			for (index = 0; index < count; ++index)
+				if (saved_key_length[index] == len)
+					MixOrder[tot_todo++] = index;
+		}
+		while (tot_todo & (MMX_COEF_SHA512-1))
+			MixOrder[tot_todo++] = max_crypts;
+	}
+#else
+	// no need to mix. just run them one after the next, in any order.
+	MixOrder = mem_alloc(sizeof(int)*count);
+	for (index = 0; index < count; ++index)
+		MixOrder[index] = index;
+	tot_todo = count;
+#endif
+
 #ifdef _OPENMP
 #pragma omp parallel for
-	for (index = 0; index < count; index++)
 #endif
+	for (index = 0; index < tot_todo; index += MAX_KEYS_PER_CRYPT)
 	{
 		// portably align temp_result char * pointer machine word size.
 		union xx {
@@ -121,118 +257,163 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		SHA512_CTX ctx;
 		SHA512_CTX alt_ctx;
 		size_t cnt;
+		int idx;
 		char *cp;
 		char p_bytes[PLAINTEXT_LENGTH+1];
 		char s_bytes[PLAINTEXT_LENGTH+1];
+#ifdef MMX_COEF_SHA512
+		ALIGN(16) cryptloopstruct crypt_struct;
+		ALIGN(16) ARCH_WORD_64 sse_out[8*MMX_COEF_SHA512];
+#endif
 
-		/* Prepare for the real work.  */
-		SHA512_Init(&ctx);
-
-		/* Add the key string.  */
-		SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
-
-		/* The last part is the salt string.  This must be at most 16
-		   characters and it ends at the first `$' character (for
-		   compatibility with existing implementations).  */
-		SHA512_Update(&ctx, cur_salt->salt, cur_salt->len);
-
-
-		/* Compute alternate SHA512 sum with input KEY, SALT, and KEY.  The
-		   final result will be added to the first context.  */
-		SHA512_Init(&alt_ctx);
+		for (idx = 0; idx < MAX_KEYS_PER_CRYPT; ++idx)
+		{
+			int i = MixOrder[index+idx];
 
-		/* Add key.  */
-		SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+			/* Prepare for the real work.  */
+			SHA512_Init(&ctx);
 
-		/* Add salt.  */
-		SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
+			/* Add the key string.  */
+			SHA512_Update(&ctx, (unsigned char*)saved_key[i], saved_key_length[i]);
 
-		/* Add key again.  */
-		SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+			/* The last part is the salt string.  This must be at most 16
+			   characters and it ends at the first `$' character (for
+			   compatibility with existing implementations).  */
+			SHA512_Update(&ctx, cur_salt->salt, cur_salt->len);
 
-		/* Now get result of this (64 bytes) and add it to the other
-		   context.  */
-		SHA512_Final((unsigned char*)crypt_out[index], &alt_ctx);
 
-		/* Add for any character in the key one byte of the alternate sum.  */
-		for (cnt = saved_key_length[index]; cnt > BINARY_SIZE; cnt -= BINARY_SIZE)
-			SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-		SHA512_Update(&ctx, (unsigned char*)crypt_out[index], cnt);
+			/* Compute alternate SHA512 sum with input KEY, SALT, and KEY.  The
+			   final result will be added to the first context.  */
+			SHA512_Init(&alt_ctx);
 
-		/* Take the binary representation of the length of the key and for every
-		   1 add the alternate sum, for every 0 the key.  */
-		for (cnt = saved_key_length[index]; cnt > 0; cnt >>= 1)
-			if ((cnt & 1) != 0)
-				SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-			else
-				SHA512_Update(&ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+			/* Add key.  */
+			SHA512_Update(&alt_ctx, (unsigned char*)saved_key[i], saved_key_length[i]);
 
-		/* Create intermediate result.  */
-		SHA512_Final((unsigned char*)crypt_out[index], &ctx);
+			/* Add salt.  */
+			SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
 
-		/* Start computation of P byte sequence.  */
-		SHA512_Init(&alt_ctx);
+			/* Add key again.  */
+			SHA512_Update(&alt_ctx, (unsigned char*)saved_key[i], saved_key_length[i]);
 
-		/* For every character in the password add the entire password.  */
-		for (cnt = 0; cnt < saved_key_length[index]; ++cnt)
-			SHA512_Update(&alt_ctx, (unsigned char*)saved_key[index], saved_key_length[index]);
+			/* Now get result of this (64 bytes) and add it to the other
+			   context.  */
+			SHA512_Final((unsigned char*)crypt_out[i], &alt_ctx);
 
-		/* Finish the digest.  */
-		SHA512_Final(temp_result, &alt_ctx);
+			/* Add for any character in the key one byte of the alternate sum.  */
+			for (cnt = saved_key_length[i]; cnt > BINARY_SIZE; cnt -= BINARY_SIZE)
+				SHA512_Update(&ctx, (unsigned char*)crypt_out[i], BINARY_SIZE);
+			SHA512_Update(&ctx, (unsigned char*)crypt_out[i], cnt);
 
-		/* Create byte sequence P.  */
-		cp = p_bytes;
-		for (cnt = saved_key_length[index]; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
-			cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
-		memcpy (cp, temp_result, cnt);
+			/* Take the binary representation of the length of the key and for every
+			   1 add the alternate sum, for every 0 the key.  */
+			for (cnt = saved_key_length[i]; cnt > 0; cnt >>= 1)
+				if ((cnt & 1) != 0)
+					SHA512_Update(&ctx, (unsigned char*)crypt_out[i], BINARY_SIZE);
+				else
+					SHA512_Update(&ctx, (unsigned char*)saved_key[i], saved_key_length[i]);
 
-		/* Start computation of S byte sequence.  */
-		SHA512_Init(&alt_ctx);
+			/* Create intermediate result.  */
+			SHA512_Final((unsigned char*)crypt_out[i], &ctx);
 
-		/* For every character in the password add the entire password.  */
-		for (cnt = 0; cnt < 16 + ((unsigned char*)crypt_out[index])[0]; ++cnt)
-			SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
+			/* Start computation of P byte sequence.  */
+			SHA512_Init(&alt_ctx);
 
-		/* Finish the digest.  */
-		SHA512_Final(temp_result, &alt_ctx);
+			/* For every character in the password add the entire password.  */
+			for (cnt = 0; cnt < saved_key_length[i]; ++cnt)
+				SHA512_Update(&alt_ctx, (unsigned char*)saved_key[i], saved_key_length[i]);
 
-		/* Create byte sequence S.  */
-		cp = s_bytes;
-		for (cnt = cur_salt->len; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
-			cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
-		memcpy (cp, temp_result, cnt);
+			/* Finish the digest.  */
+			SHA512_Final(temp_result, &alt_ctx);
 
-		/* Repeatedly run the collected hash value through SHA512 to
-		   burn CPU cycles.  */
-		for (cnt = 0; cnt < cur_salt->rounds; ++cnt)
-			{
-				/* New context.  */
-				SHA512_Init(&ctx);
+			/* Create byte sequence P.  */
+			cp = p_bytes;
+			for (cnt = saved_key_length[i]; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
+				cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
+			memcpy (cp, temp_result, cnt);
 
-				/* Add key or last result.  */
-				if ((cnt & 1) != 0)
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
-				else
-					SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
+			/* Start computation of S byte sequence.  */
+			SHA512_Init(&alt_ctx);
 
-				/* Add salt for numbers not divisible by 3.  */
-				if (cnt % 3 != 0)
-					SHA512_Update(&ctx, s_bytes, cur_salt->len);
+			/* For every character in the password add the entire password.  */
+			for (cnt = 0; cnt < 16 + ((unsigned char*)crypt_out[i])[0]; ++cnt)
+				SHA512_Update(&alt_ctx, cur_salt->salt, cur_salt->len);
 
-				/* Add key for numbers not divisible by 7.  */
-				if (cnt % 7 != 0)
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
+			/* Finish the digest.  */
+			SHA512_Final(temp_result, &alt_ctx);
 
-				/* Add key or last result.  */
-				if ((cnt & 1) != 0)
-					SHA512_Update(&ctx, (unsigned char*)crypt_out[index], BINARY_SIZE);
-				else
-					SHA512_Update(&ctx, p_bytes, saved_key_length[index]);
+			/* Create byte sequence S.  */
+			cp = s_bytes;
+			for (cnt = cur_salt->len; cnt >= BINARY_SIZE; cnt -= BINARY_SIZE)
+				cp = (char *) memcpy (cp, temp_result, BINARY_SIZE) + BINARY_SIZE;
+			memcpy (cp, temp_result, cnt);
 
-				/* Create intermediate [SIC] result.  */
-				SHA512_Final((unsigned char*)crypt_out[index], &ctx);
+			/* Repeatedly run the collected hash value through SHA512 to
+			   burn CPU cycles.  */
+#ifdef MMX_COEF_SHA512
+			LoadCryptStruct(&crypt_struct, i, idx, p_bytes, s_bytes);
+#else
+			for (cnt = 0; cnt < cur_salt->rounds; ++cnt)
+				{
+					/* New context.  */
+					SHA512_Init(&ctx);
+
+					/* Add key or last result.  */
+					if ((cnt & 1) != 0)
+						SHA512_Update(&ctx, p_bytes, saved_key_length[i]);
+					else
+						SHA512_Update(&ctx, (unsigned char*)crypt_out[i], BINARY_SIZE);
+
+					/* Add salt for numbers not divisible by 3.  */
+					if (cnt % 3 != 0)
+						SHA512_Update(&ctx, s_bytes, cur_salt->len);
+
+					/* Add key for numbers not divisible by 7.  */
+					if (cnt % 7 != 0)
+						SHA512_Update(&ctx, p_bytes, saved_key_length[i]);
+
+					/* Add key or last result.  */
+					if ((cnt & 1) != 0)
+						SHA512_Update(&ctx, (unsigned char*)crypt_out[i], BINARY_SIZE);
+					else
+						SHA512_Update(&ctx, p_bytes, saved_key_length[i]);
+
+					/* Create intermediate [SIC] result.  */
+					SHA512_Final((unsigned char*)crypt_out[i], &ctx);
+				}
+#endif
+		}
+#ifdef MMX_COEF_SHA512
+		// all lanes run the rounds in lockstep, through the prebuilt buffers
+		idx = 0;
+		for (cnt = 1; ; ++cnt) {
+			unsigned char *cp = crypt_struct.bufs[idx];
+			int j, k;
+
+			SSESHA512body((__m128i *)cp, sse_out, NULL, SSEi_FLAT_IN|SSEi_4BUF_INPUT_FIRST_BLK);
+			for (j = 1; j < crypt_struct.datlen[idx]; ++j)
+				SSESHA512body((__m128i *)&cp[j*128], sse_out, sse_out, SSEi_FLAT_IN|SSEi_4BUF_INPUT_FIRST_BLK|SSEi_RELOAD);
+
+			if (cnt == cur_salt->rounds)
+				break;
+			for (k = 0; k < MMX_COEF_SHA512; ++k) {
+				ARCH_WORD_64 *o = (ARCH_WORD_64 *)crypt_struct.cptr[k][idx];
+				for (j = 0; j < 8; ++j)
+					*o++ = JOHNSWAP64(sse_out[(j*MMX_COEF_SHA512)+k]);
 			}
+			if (++idx == 42)
+				idx = 0;
+		}
+		{
+			int j, k;
+			for (k = 0; k < MMX_COEF_SHA512; ++k) {
+				ARCH_WORD_64 *o = (ARCH_WORD_64 *)crypt_out[MixOrder[index+k]];
+				for (j = 0; j < 8; ++j)
+					*o++ = JOHNSWAP64(sse_out[(j*MMX_COEF_SHA512)+k]);
+			}
+		}
+#endif
 	}
+	MEM_FREE(MixOrder);
 	return count;
 }
 
@@ -273,9 +454,7 @@ static void *get_salt(char *ciphertext)
 static int cmp_all(void *binary, int count)
 {
 	int index = 0;
-#ifdef _OPENMP
 	for (; index < count; index++)
-#endif
 		if (!memcmp(binary, crypt_out[index], BINARY_SIZE))
 			return 1;
 	return 0;
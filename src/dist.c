@@ -0,0 +1,328 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+#define NEED_OS_FORK
+#include "os.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if OS_FORK
+#include <sys/mman.h>
+#include <sched.h>
+#endif
+
+#include "misc.h"
+#include "memory.h"
+#include "logger.h"
+#include "options.h"
+#include "recovery.h"
+#ifdef HAVE_MPI
+#include "john-mpi.h"
+#endif
+#include "dist.h"
+
+#if OS_FORK && defined(__GNUC__) && \
+    (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+#define DIST_FORK			1
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS			MAP_ANON
+#endif
+#else
+#define DIST_FORK			0
+#endif
+
+/*
+ * With MPI, the shared state lives in an RMA window on rank 0, and each node
+ * works on a local copy of it while holding an exclusive lock on the window.
+ * This needs MPI-3 passive target synchronization, but no cooperation from
+ * rank 0's cracking loop.
+ */
+#if defined(HAVE_MPI) && MPI_VERSION >= 3
+#define DIST_MPI			1
+#else
+#define DIST_MPI			0
+#endif
+
+#define DIST_SHARED			(DIST_FORK || DIST_MPI)
+
+/*
+ * How long a restored node waits for the others to register their state
+ * before it starts claiming anyway.  Only a node that failed to start at all
+ * is expected to keep us waiting this long.
+ */
+#define DIST_RESTORE_WAIT		60
+
+int dist_active = 0;
+
+#if DIST_SHARED
+static struct dist_shared {
+	volatile int lock;
+	volatile int pending;
+	int have_next;
+	struct dist_chunk next;
+	struct {
+		int valid;
+		struct dist_chunk chunk;
+	} held[1];
+} *dist;
+
+static int dist_node_count;
+static size_t dist_size;
+
+/*
+ * The shared counter as of our last claim.  Chunks below it had been claimed
+ * by then, which is all a saved snapshot needs to promise, and saves don't
+ * need to take the lock.
+ */
+static struct dist_chunk dist_seen;
+
+#if DIST_MPI
+static MPI_Win dist_win = MPI_WIN_NULL;
+#endif
+
+static void dist_lock(void)
+{
+#if DIST_MPI
+	if (dist_win != MPI_WIN_NULL) {
+		MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, dist_win);
+		MPI_Get(dist, dist_size, MPI_BYTE, 0, 0, dist_size, MPI_BYTE,
+		    dist_win);
+		MPI_Win_flush(0, dist_win);
+		return;
+	}
+#endif
+#if DIST_FORK
+	while (__sync_lock_test_and_set(&dist->lock, 1))
+		sched_yield();
+#endif
+}
+
+static void dist_unlock(void)
+{
+#if DIST_MPI
+	if (dist_win != MPI_WIN_NULL) {
+		MPI_Put(dist, dist_size, MPI_BYTE, 0, 0, dist_size, MPI_BYTE,
+		    dist_win);
+		MPI_Win_unlock(0, dist_win);
+		return;
+	}
+#endif
+#if DIST_FORK
+	__sync_lock_release(&dist->lock);
+#endif
+}
+
+static int dist_cmp(struct dist_chunk *a, struct dist_chunk *b)
+{
+	if (a->major != b->major)
+		return a->major < b->major ? -1 : 1;
+	if (a->minor != b->minor)
+		return a->minor < b->minor ? -1 : 1;
+	return 0;
+}
+
+static int dist_node(void)
+{
+	return options.node_min - 1;
+}
+#endif
+
+void dist_init(void)
+{
+#if DIST_SHARED
+	int nodes;
+
+	if (!(options.flags & (FLG_WORDLIST_CHK | FLG_MASK_CHK |
+	    FLG_INC_CHK | FLG_MKV_CHK)) ||
+	    (options.flags & (FLG_STDIN_CHK | FLG_PIPE_CHK)))
+		return;
+
+#ifdef HAVE_MPI
+	nodes = mpi_p > 1 ? mpi_p : options.fork;
+#else
+	nodes = options.fork;
+#endif
+
+/* Other nodes (e.g. another machine) may take part in the static split */
+	if (options.node_min != 1 || options.node_count != nodes)
+		return;
+
+	dist_node_count = nodes;
+	dist_size = sizeof(*dist) +
+	    (dist_node_count - 1) * sizeof(dist->held[0]);
+
+#if DIST_MPI
+	if (mpi_p > 1) {
+		void *base;
+
+		dist = mem_calloc(dist_size);
+		if (MPI_Win_allocate(mpi_id ? 0 : dist_size, 1, MPI_INFO_NULL,
+		    MPI_COMM_WORLD, &base, &dist_win) != MPI_SUCCESS) {
+			MEM_FREE(dist);
+			dist_win = MPI_WIN_NULL;
+			log_event("- Dynamic work distribution not available");
+			return;
+		}
+		if (!mpi_id) {
+			dist_lock();
+			memset(dist, 0, dist_size);
+			if (rec_restoring_now)
+				dist->pending = dist_node_count;
+			dist_unlock();
+		}
+		MPI_Barrier(MPI_COMM_WORLD);
+
+		dist_active = 1;
+		log_event("- Distributing work across nodes dynamically");
+		return;
+	}
+#endif
+
+#if DIST_FORK
+	dist = mmap(NULL, dist_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (dist == MAP_FAILED) {
+		dist = NULL;
+		log_event("- Dynamic work distribution not available");
+		return;
+	}
+
+	memset(dist, 0, dist_size);
+	if (rec_restoring_now)
+		dist->pending = dist_node_count;
+
+	dist_active = 1;
+	log_event("- Distributing work across nodes dynamically");
+#endif
+#endif
+}
+
+void dist_done(void)
+{
+#if DIST_MPI
+	if (dist_win != MPI_WIN_NULL) {
+		MPI_Win_free(&dist_win);
+		MEM_FREE(dist);
+		dist_active = 0;
+	}
+#endif
+}
+
+void dist_restore(struct dist_chunk *held, struct dist_chunk *next)
+{
+#if DIST_SHARED
+	if (!dist_active)
+		return;
+
+	dist_lock();
+	if (!dist->have_next || dist_cmp(next, &dist->next) < 0)
+		dist->next = *next;
+	dist->have_next = 1;
+	if ((dist->held[dist_node()].valid = held != NULL))
+		dist->held[dist_node()].chunk = *held;
+	if (dist->pending)
+		dist->pending--;
+	dist_unlock();
+
+	dist_seen = *next;
+#endif
+}
+
+void dist_leave(void)
+{
+#if DIST_SHARED
+	if (!dist_active)
+		return;
+
+	dist_lock();
+	if (dist->pending)
+		dist->pending--;
+	dist_unlock();
+#endif
+}
+
+#if DIST_SHARED
+/*
+ * Called with the lock held, and returns with it held.
+ */
+static void dist_wait(void)
+{
+	time_t start;
+
+	if (!dist->pending)
+		return;
+
+	start = time(NULL);
+	while (dist->pending) {
+		if (time(NULL) - start > DIST_RESTORE_WAIT) {
+			log_event("! Not all nodes registered their restored "
+			    "state, proceeding anyway");
+			dist->pending = 0;
+			break;
+		}
+		dist_unlock();
+		usleep(10000);
+		dist_lock();
+	}
+}
+#endif
+
+void dist_next(struct dist_chunk *chunk)
+{
+#if DIST_SHARED
+	int i, held;
+
+	dist_lock();
+	dist_wait();
+/*
+ * Restored chunks stay marked even once their node is done with them, since
+ * the counter may not have reached them yet and must still skip them.
+ */
+	do {
+		*chunk = dist->next;
+		dist->next.minor++;
+		held = 0;
+		for (i = 0; i < dist_node_count; i++)
+		if (dist->held[i].valid &&
+		    !dist_cmp(&dist->held[i].chunk, chunk)) {
+			held = 1;
+			break;
+		}
+	} while (held);
+	dist_seen = dist->next;
+	dist_unlock();
+#else
+	memset(chunk, 0, sizeof(*chunk));
+#endif
+}
+
+void dist_end_major(unsigned int major)
+{
+#if DIST_SHARED
+	dist_lock();
+	if (dist->next.major == major) {
+		dist->next.major++;
+		dist->next.minor = 0;
+	}
+	dist_unlock();
+#endif
+}
+
+void dist_get_next(struct dist_chunk *next)
+{
+#if DIST_SHARED
+	*next = dist_seen;
+#else
+	memset(next, 0, sizeof(*next));
+#endif
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of John the Ripper password cracker.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted.
+ *
+ * There's ABSOLUTELY NO WARRANTY, express or implied.
+ */
+
+/*
+ * Dynamic distribution of work across --fork'ed or MPI nodes.
+ *
+ * Rather than having each node take every node_count'th candidate, a
+ * cracking mode cuts its keyspace into chunks numbered (major, minor) in
+ * the order it would produce them, and nodes claim the next unclaimed chunk
+ * from a shared counter (in shared memory with --fork, or hosted by rank 0
+ * with MPI).  A node that is slow (or that gets a chunk of rejected rules or
+ * short words) simply claims fewer chunks.
+ *
+ * Each node records the chunk it was working on and a snapshot of the shared
+ * counter in its .rec file.  On restore, the counter resumes from the lowest
+ * snapshot of all nodes, skipping over chunks that some node will resume on
+ * its own; anything that may have been in flight is handed out again.
+ */
+
+#ifndef _JOHN_DIST_H
+#define _JOHN_DIST_H
+
+struct dist_chunk {
+	unsigned int major;
+	unsigned long long minor;
+};
+
+/*
+ * Non-zero if this process takes part in a dynamic distribution.  Modes
+ * that can use it test this, and may clear it (in all nodes alike) to fall
+ * back to the static round-robin split, e.g. for a crash recovery file
+ * written by a version without dynamic distribution.
+ */
+extern int dist_active;
+
+/*
+ * Sets up the shared work queue for a --fork or MPI session, if the mode and
+ * node range allow for it.  Must be called before forking, or by all MPI
+ * nodes before they adjust their node numbers.
+ */
+extern void dist_init(void);
+
+/*
+ * Releases the shared work queue where this needs all nodes' participation
+ * (MPI).  Called at teardown by all nodes.
+ */
+extern void dist_done(void);
+
+/*
+ * Registers this node's restored state: the chunk it will resume (NULL if
+ * none) and the snapshot of the shared counter it had saved.  Claiming waits
+ * until all nodes have registered or left.
+ */
+extern void dist_restore(struct dist_chunk *held, struct dist_chunk *next);
+
+/*
+ * Tells the other nodes not to wait for this one's restored state (it has
+ * nothing left to do).
+ */
+extern void dist_leave(void);
+
+/*
+ * Claims the next chunk for this node.
+ */
+extern void dist_next(struct dist_chunk *chunk);
+
+/*
+ * Marks all chunks from the current position through the end of major as
+ * done (e.g. end of wordlist for a rule, or a rejected rule).
+ */
+extern void dist_end_major(unsigned int major);
+
+/*
+ * Returns a snapshot of the shared counter (as of this node's last claim),
+ * for saving along with the node's own position.
+ */
+extern void dist_get_next(struct dist_chunk *next);
+
+#endif
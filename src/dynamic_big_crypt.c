@@ -44,6 +44,15 @@
 #include "dynamic.h"
 #include "johnswap.h"
 #include "sse-intrinsics.h"
+#ifdef __SSE2__
+// sse-intrinsics.h hides __m128i behind void for its prototypes; the base-16
+// and base-64 output helpers want the real type.
+#undef __m128i
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#endif
 
 #if OPENSSL_VERSION_NUMBER >= 0x10000000
 #include "openssl/whrlpool.h"
@@ -128,8 +137,38 @@ void DynamicFunc__LargeHash_OUTMode_raw(DYNA_OMP_PARAMS) {
  *****  helpers.  Doing things like this will reduce the size of the large hash
  *****  primative functions.
  ******************************************************************************/
+#ifdef __SSE2__
+// Converts 8 bytes at a time into 16 hex digits in one SSE2 register. The
+// nibbles are split and interleaved, then '0' is added to each, plus the extra
+// distance to 'a' (or 'A') for those above 9.  The tail is left to the caller.
+static inline unsigned char *hex_out_buf_sse2(unsigned char **pcpi, unsigned char *cpo, int *in_byte_cnt, unsigned char a) {
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i alpha = _mm_set1_epi8(a-'0'-10);
+	unsigned char *cpi = *pcpi;
+	__m128i in, hi, lo, x;
+
+	while (*in_byte_cnt >= 8) {
+		in = _mm_loadl_epi64((__m128i*)cpi);
+		hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+		lo = _mm_and_si128(in, mask);
+		x = _mm_unpacklo_epi8(hi, lo);
+		x = _mm_add_epi8(_mm_add_epi8(x, zero), _mm_and_si128(_mm_cmpgt_epi8(x, nine), alpha));
+		_mm_storeu_si128((__m128i*)cpo, x);
+		cpi += 8;
+		cpo += 16;
+		*in_byte_cnt -= 8;
+	}
+	*pcpi = cpi;
+	return cpo;
+}
+#endif
 static inline unsigned char *hex_out_buf(unsigned char *cpi, unsigned char *cpo, int in_byte_cnt) {
 	int j;
+#ifdef __SSE2__
+	cpo = hex_out_buf_sse2(&cpi, cpo, &in_byte_cnt, dynamic_itoa16[10]);
+#endif
 	for (j = 0; j < in_byte_cnt; ++j) {
 #if ARCH_ALLOWS_UNALIGNED
 		*((unsigned short*)cpo) = itoa16_w2[*cpi++];
@@ -145,6 +184,9 @@ static inline unsigned char *hex_out_buf(unsigned char *cpi, unsigned char *cpo,
 // NOTE, cpo must be at least in_byte_cnt*2 bytes of buffer
 static inline unsigned char *hexu_out_buf(unsigned char *cpi, unsigned char *cpo, int in_byte_cnt) {
 	int j;
+#ifdef __SSE2__
+	cpo = hex_out_buf_sse2(&cpi, cpo, &in_byte_cnt, 'A');
+#endif
 	for (j = 0; j < in_byte_cnt; ++j) {
 #if ARCH_ALLOWS_UNALIGNED
 		*((unsigned short*)cpo) = itoa16_w2_u[*cpi++];
@@ -175,10 +217,47 @@ static inline unsigned char *raw_out_buf(unsigned char *cpi, unsigned char *cpo,
 #endif
 }
 
+#ifdef __SSSE3__
+// Converts 12 bytes at a time into 16 base-64 digits.  Each 3 byte group is
+// spread over a 32 bit lane, the four 6 bit indices are moved into their own
+// bytes with two multiplies, and a small pshufb table gives the offset from
+// each index to its character.  The tail is left to the caller.
+static inline unsigned char *base64_out_buf_ssse3(unsigned char **pcpi, unsigned char *cpo, int *in_byte_cnt) {
+	const __m128i spread = _mm_set_epi8(10,11,9,10, 7,8,6,7, 4,5,3,4, 1,2,0,1);
+	const __m128i offset = _mm_setr_epi8('a'-26, '0'-52, '0'-52, '0'-52,
+		'0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52,
+		'+'-62, '/'-63, 'A', 0, 0);
+	unsigned char *cpi = *pcpi;
+	__m128i in, idx, x;
+	uint32_t tail;
+
+	while (*in_byte_cnt >= 12) {
+		memcpy(&tail, cpi + 8, 4);
+		in = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)cpi), _mm_cvtsi32_si128(tail));
+		in = _mm_shuffle_epi8(in, spread);
+		idx = _mm_or_si128(
+			_mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040)),
+			_mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010)));
+		// 0..25 -> 13, 26..51 -> 0, 52..63 -> 1..12
+		x = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+		x = _mm_or_si128(x, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+		x = _mm_add_epi8(idx, _mm_shuffle_epi8(offset, x));
+		_mm_storeu_si128((__m128i*)cpo, x);
+		cpi += 12;
+		cpo += 16;
+		*in_byte_cnt -= 12;
+	}
+	*pcpi = cpi;
+	return cpo;
+}
+#endif
 // compatible 'standard' MIME base-64 encoding.
 static inline unsigned char *base64_out_buf(unsigned char *cpi, unsigned char *cpo, int in_byte_cnt, int add_eq) {
 	static char *_itoa64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+#ifdef __SSSE3__
+	cpo = base64_out_buf_ssse3(&cpi, cpo, &in_byte_cnt);
+#endif
 	while (in_byte_cnt > 2) {
 		*cpo++ = _itoa64[(cpi[0] & 0xfc) >> 2];
 		*cpo++ = _itoa64[((cpi[0] & 0x03) << 4) + ((cpi[1] & 0xf0) >> 4)];
@@ -1481,7 +1560,7 @@ static void DoSHA256_crypt_f_sse(void *in, int len[MMX_COEF_SHA256], void *out,
 		for (i = 0; i < MMX_COEF_SHA256; ++i) {
 			if (cnt == loops[i]) {
 				for (j = 0; j < 4; ++j) {
-					((ARCH_WORD_32*)out)[(i<<2)+j] = JOHNSWAP(a[(j<<2)+i]);
+					((ARCH_WORD_32*)out)[(i<<2)+j] = JOHNSWAP(a[j*MMX_COEF_SHA256+i]);
 				}
 			} else if (cnt < loops[i])
 				bMore = 1;
@@ -1508,7 +1587,7 @@ static void DoSHA256_crypt_sse(void *in, int ilen[MMX_COEF_SHA256], void *out[MM
 		for (i = 0; i < MMX_COEF_SHA256; ++i) {
 			if (cnt == loops[i]) {
 				for (j = 0; j < 8; ++j) {
-					y.a[j] =JOHNSWAP(a[(j<<2)+i]);
+					y.a[j] =JOHNSWAP(a[j*MMX_COEF_SHA256+i]);
 				}
 				*(tot_len+i) += large_hash_output(y.u, &(((unsigned char*)out[i])[*(tot_len+i)]), isSHA256?32:28, tid);
 			} else if (cnt < loops[i])
@@ -2124,11 +2203,118 @@ void DynamicFunc__SHA256_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
 /********************************************************************
  ****  Here are the SHA384 and SHA512 functions!!!
  *******************************************************************/
-void DynamicFunc__SHA384_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
+#ifdef MMX_COEF_SHA512
+
+static const int sha512_inc = MMX_COEF_SHA512;
+
+// Each lane is copied into a private 2 block (256 byte) buffer, and padded
+// there, so the input buffers are left exactly as the CTX code leaves them.
+// A lane too long to fit in 2 blocks is simply done with the CTX code.
+#define SHA512_SSE_MAX_LEN (256-17)
+
+static inline uint32_t DoSHA512_FixBufferLen64(unsigned char *cp, unsigned char *input_buf, int total_len) {
+	uint32_t ret = (total_len / 128) + 1;
+	if (total_len % 128 > 111)
+		++ret;
+	memcpy(cp, input_buf, total_len);
+	cp[total_len] = 0x80;
+	memset(&cp[total_len+1], 0, (ret<<7)-8-(total_len+1));
+	((ARCH_WORD_64 *)cp)[(ret*16)-1] = JOHNSWAP64((ARCH_WORD_64)total_len<<3);
+	return ret;
+}
+static void DoSHA512_sse(unsigned char *in, int len[MMX_COEF_SHA512], ARCH_WORD_64 crypt_out[MMX_COEF_SHA512][8], int isSHA512) {
+	ALIGN(16) ARCH_WORD_64 buf[(256*MMX_COEF_SHA512)/sizeof(ARCH_WORD_64)];
+	ALIGN(16) ARCH_WORD_64 a[(64*MMX_COEF_SHA512)/sizeof(ARCH_WORD_64)];
+	unsigned int i, j, loops[MMX_COEF_SHA512], bMore, cnt;
+	unsigned char *cp = (unsigned char*)buf;
+	for (i = 0; i < MMX_COEF_SHA512; ++i) {
+		if (len[i] > SHA512_SSE_MAX_LEN) {
+			SHA512_CTX ctx;
+			if (isSHA512)
+				SHA512_Init(&ctx);
+			else
+				SHA384_Init(&ctx);
+			SHA512_Update(&ctx, in, len[i]);
+			SHA512_Final((unsigned char*)crypt_out[i], &ctx);
+			loops[i] = 0;
+		} else
+			loops[i] = DoSHA512_FixBufferLen64(cp, in, len[i]);
+		in += sizeof(MD5_IN)>>MD5_X2;
+		cp += 256;
+	}
+	cp = (unsigned char*)buf;
+	bMore = 1;
+	cnt = 1;
+	while (bMore) {
+		SSESHA512body((__m128i*)cp, a, a, SSEi_FLAT_IN|(isSHA512?0:SSEi_CRYPT_SHA384)|SSEi_2BUF_INPUT_FIRST_BLK|(cnt==1?0:SSEi_RELOAD));
+		bMore = 0;
+		for (i = 0; i < MMX_COEF_SHA512; ++i) {
+			if (cnt == loops[i]) {
+				for (j = 0; j < 8; ++j)
+					crypt_out[i][j] = JOHNSWAP64(a[j*MMX_COEF_SHA512+i]);
+			} else if (cnt < loops[i])
+				bMore = 1;
+		}
+		cp += 128;
+		++cnt;
+	}
+}
+static void DoSHA512_crypt_f_sse(void *in, int len[MMX_COEF_SHA512], void *out, int isSHA512) {
+	ARCH_WORD_64 crypt_out[MMX_COEF_SHA512][8];
+	unsigned int i;
+	DoSHA512_sse((unsigned char*)in, len, crypt_out, isSHA512);
+	// see the comment in DoSHA512_crypt_f about only keeping 16 bytes
+	for (i = 0; i < MMX_COEF_SHA512; ++i)
+		memcpy(&((unsigned char*)out)[i<<4], crypt_out[i], 16);
+}
+static void DoSHA512_crypt_sse(void *in, int ilen[MMX_COEF_SHA512], void *out[MMX_COEF_SHA512], unsigned int *tot_len, int isSHA512, int tid) {
+	ARCH_WORD_64 crypt_out[MMX_COEF_SHA512][8];
+	unsigned int i;
+	DoSHA512_sse((unsigned char*)in, ilen, crypt_out, isSHA512);
+	for (i = 0; i < MMX_COEF_SHA512; ++i)
+		*(tot_len+i) += large_hash_output((unsigned char*)crypt_out[i], &(((unsigned char*)out[i])[*(tot_len+i)]), isSHA512?64:48, tid);
+}
+#else
+
+static const int sha512_inc = 1;
+
+static void DoSHA512_crypt_f(void *in, int len, void *out, int isSHA512) {
 	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
-	int i, til;
+	unsigned char *crypt_out=u.u;
 	SHA512_CTX ctx;
+	if (isSHA512)
+		SHA512_Init(&ctx);
+	else
+		SHA384_Init(&ctx);
+	SHA512_Update(&ctx, in, len);
+	SHA512_Final(crypt_out, &ctx);
+
+	// Only copies the first 16 out of 48/64 bytes.  Thus we do not have
+	// the entire SHA384/512. It would NOT be valid to continue from here. However
+	// it is valid (and 128 bit safe), to simply check the first 128 bits
+	// of the hash (vs the whole 384/512 bits), with cmp_all/cmp_one, and if it
+	// matches, then we can 'assume' we have a hit.
+	// That is why the name of the function is *_FINAL()  it is meant to be
+	// something like sha1(md5($p))  and then we simply compare 16 bytes
+	// of hash (instead of the full 48/64).
+	memcpy(out, crypt_out, 16);
+}
+static void DoSHA512_crypt(void *in, int ilen, void *out, unsigned int *tot_len, int isSHA512, int tid) {
+	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
+	unsigned char *crypt_out=u.u;
+	SHA512_CTX ctx;
+	if (isSHA512)
+		SHA512_Init(&ctx);
+	else
+		SHA384_Init(&ctx);
+	SHA512_Update(&ctx, in, ilen);
+	SHA512_Final(crypt_out, &ctx);
+	*tot_len += large_hash_output(crypt_out, &(((unsigned char*)out)[*tot_len]), isSHA512?64:48, tid);
+}
+#endif
+
+void DynamicFunc__SHA384_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
+	int i, til;
 
 #ifdef _OPENMP
 	i = first;
@@ -2138,28 +2324,32 @@ void DynamicFunc__SHA384_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = &(input_buf2_X86[i>>MD5_X2].x2.B2[total_len2_X86[i]]);
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, &(total_len2_X86[i]), 0, tid);
+#else
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &(total_len2_X86[i]), 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &(total_len2_X86[i]), 0, tid);
 #endif
-		{
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = &(input_buf2_X86[i>>MD5_X2].x1.B[total_len2_X86[i]]);
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len2_X86[i] += large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
 void DynamicFunc__SHA512_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2169,28 +2359,32 @@ void DynamicFunc__SHA512_crypt_input1_append_input2(DYNA_OMP_PARAMS) {
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = &(input_buf2_X86[i>>MD5_X2].x2.B2[total_len2_X86[i]]);
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, &(total_len2_X86[i]), 1, tid);
+#else
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &(total_len2_X86[i]), 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &(total_len2_X86[i]), 1, tid);
 #endif
-		{
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = &(input_buf2_X86[i>>MD5_X2].x1.B[total_len2_X86[i]]);
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len2_X86[i] += large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
 void DynamicFunc__SHA384_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2200,28 +2394,32 @@ void DynamicFunc__SHA384_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = &(input_buf_X86[i>>MD5_X2].x2.B2[total_len_X86[i]]);
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, &(total_len_X86[i]), 0, tid);
+#else
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &(total_len_X86[i]), 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &(total_len_X86[i]), 0, tid);
 #endif
-		{
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = &(input_buf_X86[i>>MD5_X2].x1.B[total_len_X86[i]]);
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len_X86[i] += large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
 void DynamicFunc__SHA512_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2231,28 +2429,32 @@ void DynamicFunc__SHA512_crypt_input2_append_input1(DYNA_OMP_PARAMS) {
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = &(input_buf_X86[i>>MD5_X2].x2.B2[total_len_X86[i]]);
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, &(total_len_X86[i]), 1, tid);
+#else
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &(total_len_X86[i]), 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &(total_len_X86[i]), 1, tid);
 #endif
-		{
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = &(input_buf_X86[i>>MD5_X2].x1.B[total_len_X86[i]]);
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len_X86[i] += large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
-void DynamicFunc__SHA384_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA384_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2262,28 +2464,38 @@ void DynamicFunc__SHA384_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &x, 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &x, 0, tid);
+		total_len_X86[i] = x;
 #endif
-		{
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x1.B;
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len_X86[i] = large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
-void DynamicFunc__SHA512_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA512_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2293,28 +2505,38 @@ void DynamicFunc__SHA512_crypt_input1_overwrite_input1(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &x, 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &x, 1, tid);
+		total_len_X86[i] = x;
 #endif
-		{
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x1.B;
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len_X86[i] = large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
-void DynamicFunc__SHA384_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA384_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2324,28 +2546,38 @@ void DynamicFunc__SHA384_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len2_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &x, 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &x, 0, tid);
+		total_len2_X86[i] = x;
 #endif
-		{
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x1.B;
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len2_X86[i] = large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
-void DynamicFunc__SHA512_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA512_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2355,28 +2587,38 @@ void DynamicFunc__SHA512_crypt_input1_overwrite_input2(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len2_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &x, 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &x, 1, tid);
+		total_len2_X86[i] = x;
 #endif
-		{
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x1.B;
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len2_X86[i] = large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
-void DynamicFunc__SHA384_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA384_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2386,28 +2628,38 @@ void DynamicFunc__SHA384_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &x, 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &x, 0, tid);
+		total_len_X86[i] = x;
 #endif
-		{
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x1.B;
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len_X86[i] = large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
-void DynamicFunc__SHA512_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA512_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2417,28 +2669,38 @@ void DynamicFunc__SHA512_crypt_input2_overwrite_input1(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x2.b2, &x, 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf_X86[i>>MD5_X2].x1.b, &x, 1, tid);
+		total_len_X86[i] = x;
 #endif
-		{
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = input_buf_X86[i>>MD5_X2].x1.B;
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len_X86[i] = large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
-void DynamicFunc__SHA384_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[56]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA384_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2448,28 +2710,38 @@ void DynamicFunc__SHA384_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 0, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len2_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &x, 0, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &x, 0, tid);
+		total_len2_X86[i] = x;
 #endif
-		{
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x1.B;
-		}
-		SHA384_Final(crypt_out, &ctx);
-		total_len2_X86[i] = large_hash_output(crypt_out, cpo, 48, tid);
 	}
 }
-void DynamicFunc__SHA512_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u, *cpo;
+void DynamicFunc__SHA512_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS) {
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2479,28 +2751,38 @@ void DynamicFunc__SHA512_crypt_input2_overwrite_input2(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1) {
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x2.B2;
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+		int len[MMX_COEF_SHA512], j;
+		unsigned int x[MMX_COEF_SHA512];
+		void *out[MMX_COEF_SHA512];
+		for (j = 0; j < MMX_COEF_SHA512; ++j) {
+			len[j] = total_len2_X86[i+j];
+			#if (MD5_X2)
+			if (j&1)
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x2.b2;
+			else
+			#endif
+				out[j] = input_buf2_X86[(i+j)>>MD5_X2].x1.b;
+			x[j] = 0;
 		}
+		DoSHA512_crypt_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, out, x, 1, tid);
+		for (j = 0; j < MMX_COEF_SHA512; ++j)
+			total_len2_X86[i+j] = x[j];
+#else
+		unsigned int x = 0;
+		#if (MD5_X2)
+		if (i & 1)
+			DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], input_buf2_X86[i>>MD5_X2].x2.b2, &x, 1, tid);
 		else
+		#endif
+		DoSHA512_crypt(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], input_buf2_X86[i>>MD5_X2].x1.b, &x, 1, tid);
+		total_len2_X86[i] = x;
 #endif
-		{
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-			cpo = input_buf2_X86[i>>MD5_X2].x1.B;
-		}
-		SHA512_Final(crypt_out, &ctx);
-		total_len2_X86[i] = large_hash_output(crypt_out, cpo, 64, tid);
 	}
 }
 void DynamicFunc__SHA384_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2509,37 +2791,24 @@ void DynamicFunc__SHA384_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1)
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-		else
-#endif
-			SHA384_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-		SHA384_Final(crypt_out, &ctx);
-
-		// Only copies the first 16 out of 28 bytes.  Thus we do not have
-		// the entire SHA384. It would NOT be valid to continue from here. However
-		// it is valid (and 128 bit safe), to simply check the first 128 bits
-		// of SHA384 hash (vs the whole 384 bits), with cmp_all/cmp_one, and if it
-		// matches, then we can 'assume' we have a hit.
-		// That is why the name of the function is *_FINAL()  it is meant to be
-		// something like sha1(md5($p))  and then we simply compare 16 bytes
-		// of hash (instead of the full 28).
-#if (MD5_X2)
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+	int len[MMX_COEF_SHA512], j;
+	for (j = 0; j < MMX_COEF_SHA512; ++j)
+		len[j] = total_len_X86[i+j];
+	DoSHA512_crypt_f_sse(input_buf_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 0);
+#else
+	#if (MD5_X2)
 		if (i & 1)
-			memcpy(crypt_key_X86[i>>MD5_X2].x2.b2, crypt_out, 16);
+			DoSHA512_crypt_f(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], crypt_key_X86[i>>MD5_X2].x2.b2, 0);
 		else
+	#endif
+		DoSHA512_crypt_f(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], crypt_key_X86[i>>MD5_X2].x1.b, 0);
 #endif
-			memcpy(crypt_key_X86[i>>MD5_X2].x1.b, crypt_out, 16);
 	}
 }
 void DynamicFunc__SHA512_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2548,37 +2817,24 @@ void DynamicFunc__SHA512_crypt_input1_to_output1_FINAL(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1)
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i]);
-		else
-#endif
-			SHA512_Update(&ctx, input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i]);
-		SHA512_Final(crypt_out, &ctx);
-
-		// Only copies the first 16 out of 32 bytes.  Thus we do not have
-		// the entire SHA512. It would NOT be valid to continue from here. However
-		// it is valid (and 128 bit safe), to simply check the first 128 bits
-		// of SHA512 hash (vs the whole 512 bits), with cmp_all/cmp_one, and if it
-		// matches, then we can 'assume' we have a hit.
-		// That is why the name of the function is *_FINAL()  it is meant to be
-		// something like sha1(md5($p))  and then we simply compare 16 bytes
-		// of hash (instead of the full 32).
-#if (MD5_X2)
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+	int len[MMX_COEF_SHA512], j;
+	for (j = 0; j < MMX_COEF_SHA512; ++j)
+		len[j] = total_len_X86[i+j];
+	DoSHA512_crypt_f_sse(input_buf_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 1);
+#else
+	#if (MD5_X2)
 		if (i & 1)
-			memcpy(crypt_key_X86[i>>MD5_X2].x2.b2, crypt_out, 16);
+			DoSHA512_crypt_f(input_buf_X86[i>>MD5_X2].x2.b2, total_len_X86[i], crypt_key_X86[i>>MD5_X2].x2.b2, 1);
 		else
+	#endif
+		DoSHA512_crypt_f(input_buf_X86[i>>MD5_X2].x1.b, total_len_X86[i], crypt_key_X86[i>>MD5_X2].x1.b, 1);
 #endif
-			memcpy(crypt_key_X86[i>>MD5_X2].x1.b, crypt_out, 16);
 	}
 }
 void DynamicFunc__SHA384_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2587,37 +2843,24 @@ void DynamicFunc__SHA384_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA384_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1)
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-		else
-#endif
-			SHA384_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-		SHA384_Final(crypt_out, &ctx);
-
-		// Only copies the first 16 out of 28 bytes.  Thus we do not have
-		// the entire SHA384. It would NOT be valid to continue from here. However
-		// it is valid (and 128 bit safe), to simply check the first 128 bits
-		// of SHA384 hash (vs the whole 384 bits), with cmp_all/cmp_one, and if it
-		// matches, then we can 'assume' we have a hit.
-		// That is why the name of the function is *_FINAL()  it is meant to be
-		// something like sha1(md5($p))  and then we simply compare 16 bytes
-		// of hash (instead of the full 28).
-#if (MD5_X2)
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+	int len[MMX_COEF_SHA512], j;
+	for (j = 0; j < MMX_COEF_SHA512; ++j)
+		len[j] = total_len2_X86[i+j];
+	DoSHA512_crypt_f_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 0);
+#else
+	#if (MD5_X2)
 		if (i & 1)
-			memcpy(crypt_key_X86[i>>MD5_X2].x2.b2, crypt_out, 16);
+			DoSHA512_crypt_f(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], crypt_key_X86[i>>MD5_X2].x2.b2, 0);
 		else
+	#endif
+		DoSHA512_crypt_f(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], crypt_key_X86[i>>MD5_X2].x1.b, 0);
 #endif
-			memcpy(crypt_key_X86[i>>MD5_X2].x1.b, crypt_out, 16);
 	}
 }
 void DynamicFunc__SHA512_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
-	union xx { unsigned char u[64]; ARCH_WORD a[64/sizeof(ARCH_WORD)]; } u;
-	unsigned char *crypt_out=u.u;
 	int i, til;
-	SHA512_CTX ctx;
 
 #ifdef _OPENMP
 	i = first;
@@ -2626,30 +2869,20 @@ void DynamicFunc__SHA512_crypt_input2_to_output1_FINAL(DYNA_OMP_PARAMS){
 	i = 0;
 	til = m_count;
 #endif
-	for (; i < til; ++i) {
-		SHA512_Init(&ctx);
-#if (MD5_X2)
-		if (i & 1)
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i]);
-		else
-#endif
-			SHA512_Update(&ctx, input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i]);
-		SHA512_Final(crypt_out, &ctx);
-
-		// Only copies the first 16 out of 32 bytes.  Thus we do not have
-		// the entire SHA512. It would NOT be valid to continue from here. However
-		// it is valid (and 128 bit safe), to simply check the first 128 bits
-		// of SHA512 hash (vs the whole 512 bits), with cmp_all/cmp_one, and if it
-		// matches, then we can 'assume' we have a hit.
-		// That is why the name of the function is *_FINAL()  it is meant to be
-		// something like sha1(md5($p))  and then we simply compare 16 bytes
-		// of hash (instead of the full 32).
-#if (MD5_X2)
+	for (; i < til; i += sha512_inc) {
+#ifdef MMX_COEF_SHA512
+	int len[MMX_COEF_SHA512], j;
+	for (j = 0; j < MMX_COEF_SHA512; ++j)
+		len[j] = total_len2_X86[i+j];
+	DoSHA512_crypt_f_sse(input_buf2_X86[i>>MD5_X2].x1.b, len, crypt_key_X86[i>>MD5_X2].x1.b, 1);
+#else
+	#if (MD5_X2)
 		if (i & 1)
-			memcpy(crypt_key_X86[i>>MD5_X2].x2.b2, crypt_out, 16);
+			DoSHA512_crypt_f(input_buf2_X86[i>>MD5_X2].x2.b2, total_len2_X86[i], crypt_key_X86[i>>MD5_X2].x2.b2, 1);
 		else
+	#endif
+		DoSHA512_crypt_f(input_buf2_X86[i>>MD5_X2].x1.b, total_len2_X86[i], crypt_key_X86[i>>MD5_X2].x1.b, 1);
 #endif
-			memcpy(crypt_key_X86[i>>MD5_X2].x1.b, crypt_out, 16);
 	}
 }
 
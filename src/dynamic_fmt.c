@@ -128,6 +128,12 @@ static int m_ompt;
 
 #ifdef MMX_COEF
 #include "sse-intrinsics.h"
+#ifdef __SSE2__
+// sse-intrinsics.h hides __m128i behind void for its prototypes; the fused
+// scripts want the real type.
+#undef __m128i
+#include <emmintrin.h>
+#endif
 #endif
 
 #include "dynamic_types.h"
@@ -242,6 +248,8 @@ unsigned int *total_len_X86;
 unsigned int *total_len2_X86;
 
 static int keys_dirty;
+// m_count the key prologue snapshot was taken with (0 if there is none)
+static int key_snap_count;
 // We store the salt here
 static unsigned char *cursalt;
 // length of salt (so we don't have to call strlen() all the time.
@@ -1448,6 +1456,185 @@ static int cmp_one_64_4x6(void *binary, int index)
 	return 0;
 }
 
+// fused scripts (see dynamic_Compile_Fused) for all the x86-64 SIMD builds,
+// SSE2 through AVX-512, which all use 4 lane interleaved input buffers.
+#if defined (MMX_COEF) && MMX_COEF==4 && defined (MD5_SSE_PARA) && defined (__SSE2__) && ARCH_LITTLE_ENDIAN
+#define DYNA_FUSED 1
+static void dynamic_run_fused(struct DYNAMIC_Fused_Op *ops, unsigned first, unsigned last);
+#endif
+
+// Runs a script over all m_count keys.  fused is the script's compiled form
+// (or NULL), used whenever we are in SSE mode at this point.
+static void dynamic_run_script(DYNAMIC_primitive_funcp *funcs, struct DYNAMIC_Fused_Op *fused)
+{
+#ifdef _OPENMP
+	int j;
+	int inc = (m_count+m_ompt-1) / m_ompt;
+#ifndef MMX_COEF
+	inc = ((inc+OMP_INC-1)/OMP_INC)*OMP_INC;
+#else
+	if ((curdat.pSetup->flags& MGF_NOTSSE2Safe) == MGF_NOTSSE2Safe)
+		inc = ((inc+OMP_INC-1)/OMP_INC)*OMP_INC;
+	else
+		// NOTE, we will likely want to know to use OMP_MD5_INC, OMP_MD4_INC
+		// but for now, this works.
+		inc = ((inc+OMP_MD5_INC-1)/OMP_MD5_INC)*OMP_MD5_INC;
+#endif
+#ifdef DYNA_FUSED
+	if (dynamic_use_sse!=1)
+		fused = NULL;
+#endif
+#pragma omp parallel for shared(curdat, inc, m_count)
+	for (j = 0; j < m_count; j += inc) {
+		int i;
+		int top=j+inc;
+		if (top > m_count)
+			top = m_count;
+#ifdef DYNA_FUSED
+		if (fused) {
+			dynamic_run_fused(fused, j, top);
+			continue;
+		}
+#endif
+		// we now run a full script in this thread, using only a subset of
+		// the data, from [j,top)  The next thread will run from [top,top+inc)
+		// each thread will take the next inc values, until we get to m_count
+		for (i = 0; funcs[i]; ++i)
+			(*(funcs[i]))(j,top,omp_get_thread_num());
+	}
+#else
+	int i;
+#ifdef DYNA_FUSED
+	if (fused && dynamic_use_sse==1) {
+		dynamic_run_fused(fused, 0, m_count);
+		return;
+	}
+#endif
+	for (i = 0; funcs[i]; ++i) {
+		(*(funcs[i]))();
+#if 0
+		// Dump state (for debugging help)
+		printf ("\nState after function: %s\n", dynamic_Find_Function_Name(funcs[i]));
+		// dump input 1
+#ifdef MMX_COEF
+		dump_stuff_mmx_msg("input_buf[0]", input_buf[0].c, 64, 0);
+		dump_stuff_mmx_msg("input_buf[1]", input_buf[0].c, 64, 1);
+		dump_stuff_mmx_msg("input_buf[2]", input_buf[0].c, 64, 2);
+		dump_stuff_mmx_msg("input_buf[3]", input_buf[0].c, 64, 3);
+#endif
+		printf ("input_buf86[0] : %*.*s\n", total_len_X86[0],total_len_X86[0],input_buf_X86[0].x1.b);
+		printf ("input_buf86[1] : %*.*s\n", total_len_X86[1],total_len_X86[1],input_buf_X86[1].x1.b);
+		printf ("input_buf86[2] : %*.*s\n", total_len_X86[2],total_len_X86[2],input_buf_X86[2].x1.b);
+		printf ("input_buf86[3] : %*.*s\n", total_len_X86[3],total_len_X86[3],input_buf_X86[3].x1.b);
+		// dump crypt 1
+#ifdef MMX_COEF
+		dump_stuff_mmx_msg("crypt_key[0]", crypt_key[0].c, 16, 0);
+		dump_stuff_mmx_msg("crypt_key[1]", crypt_key[0].c, 16, 1);
+		dump_stuff_mmx_msg("crypt_key[2]", crypt_key[0].c, 16, 2);
+		dump_stuff_mmx_msg("crypt_key[3]", crypt_key[0].c, 16, 3);
+#endif
+		dump_stuff_be_msg("crypt_key_X86[0]", crypt_key_X86[0].x1.b, 16);
+		dump_stuff_be_msg("crypt_key_X86[1]", crypt_key_X86[1].x1.b, 16);
+		dump_stuff_be_msg("crypt_key_X86[2]", crypt_key_X86[2].x1.b, 16);
+		dump_stuff_be_msg("crypt_key_X86[3]", crypt_key_X86[3].x1.b, 16);
+		// dump input 2
+#ifdef MMX_COEF
+		dump_stuff_mmx_msg("input_buf2[0]", input_buf2[0].c, 64, 0);
+		dump_stuff_mmx_msg("input_buf2[1]", input_buf2[0].c, 64, 1);
+		dump_stuff_mmx_msg("input_buf2[2]", input_buf2[0].c, 64, 2);
+		dump_stuff_mmx_msg("input_buf2[3]", input_buf2[0].c, 64, 3);
+#endif
+		printf ("input2_buf86[0] : %*.*s\n", total_len2_X86[0],total_len2_X86[0],input_buf2_X86[0].x1.b);
+		printf ("input2_buf86[1] : %*.*s\n", total_len2_X86[1],total_len2_X86[1],input_buf2_X86[1].x1.b);
+		printf ("input2_buf86[2] : %*.*s\n", total_len2_X86[2],total_len2_X86[2],input_buf2_X86[2].x1.b);
+		printf ("input2_buf86[3] : %*.*s\n", total_len2_X86[3],total_len2_X86[3],input_buf2_X86[3].x1.b);
+		// dump crypt 2
+#ifdef MMX_COEF
+		dump_stuff_mmx_msg("crypt_key2[0]", crypt_key2[0].c, 16, 0);
+		dump_stuff_mmx_msg("crypt_key2[1]", crypt_key2[0].c, 16, 1);
+		dump_stuff_mmx_msg("crypt_key2[2]", crypt_key2[0].c, 16, 2);
+		dump_stuff_mmx_msg("crypt_key2[3]", crypt_key2[0].c, 16, 3);
+#endif
+		dump_stuff_be_msg("crypt_key2_X86[0]", crypt_key2_X86[0].x1.b, 16);
+		dump_stuff_be_msg("crypt_key2_X86[1]", crypt_key2_X86[1].x1.b, 16);
+		dump_stuff_be_msg("crypt_key2_X86[2]", crypt_key2_X86[2].x1.b, 16);
+		dump_stuff_be_msg("crypt_key2_X86[3]", crypt_key2_X86[3].x1.b, 16);
+#endif
+	}
+#endif
+}
+
+// The buffers a script works in (see dynamic_Compile_Key_Prologue)
+#define DYNA_BUF_IN1   1
+#define DYNA_BUF_IN2   2
+#define DYNA_BUF_OUT1  4
+#define DYNA_BUF_OUT2  8
+#define DYNA_BUF_ALL   15
+
+// Finds the live copy of one of the DYNA_BUF_* buffers, as used by the first
+// count keys, in whichever layout (SSE or flat) we are currently running.
+static void dynamic_key_buffer(int buf, int count, void **data, size_t *data_sz, unsigned int **len, size_t *len_sz)
+{
+	size_t n;
+#ifdef MMX_COEF
+	if (dynamic_use_sse==1) {
+		n = (count+MMX_COEF-1)/MMX_COEF;
+		*len_sz = n*sizeof(unsigned int);
+		switch (buf) {
+			case DYNA_BUF_IN1:  *data = input_buf;  *data_sz = n*sizeof(input_buf[0]);  *len = total_len;  return;
+			case DYNA_BUF_IN2:  *data = input_buf2; *data_sz = n*sizeof(input_buf2[0]); *len = total_len2; return;
+			case DYNA_BUF_OUT1: *data = crypt_key;  *data_sz = n*sizeof(crypt_key[0]);  *len = NULL;       return;
+			default:            *data = crypt_key2; *data_sz = n*sizeof(crypt_key2[0]); *len = NULL;       return;
+		}
+	}
+#endif
+	n = (count+MD5_X2)>>MD5_X2;
+	*len_sz = count*sizeof(unsigned int);
+	switch (buf) {
+		case DYNA_BUF_IN1:  *data = input_buf_X86;  *data_sz = n*sizeof(input_buf_X86[0]);  *len = total_len_X86;  return;
+		case DYNA_BUF_IN2:  *data = input_buf2_X86; *data_sz = n*sizeof(input_buf2_X86[0]); *len = total_len2_X86; return;
+		case DYNA_BUF_OUT1: *data = crypt_key_X86;  *data_sz = n*sizeof(crypt_key_X86[0]);  *len = NULL;           return;
+		default:            *data = crypt_key2_X86; *data_sz = n*sizeof(crypt_key2_X86[0]); *len = NULL;           return;
+	}
+}
+
+// Saves (restore==0) or puts back (restore==1) the buffers the key prologue
+// left behind, which the rest of the script needs to see again for each salt.
+static void dynamic_key_snapshot(int restore)
+{
+	// [sse][buffer][data, lengths]
+	static void *snap[2][4][2];
+	int b, sse = 0;
+
+#ifdef MMX_COEF
+	sse = dynamic_use_sse==1;
+#endif
+	for (b = 0; b < 4; ++b) {
+		void *data;
+		unsigned int *len;
+		size_t data_sz, len_sz;
+
+		if (!(curdat.dynamic_KEY_RESTORE & (1<<b)))
+			continue;
+		if (!snap[sse][b][0]) {
+			dynamic_key_buffer(1<<b, EFFECTIVE_MKPC, &data, &data_sz, &len, &len_sz);
+			snap[sse][b][0] = mem_alloc_tiny(data_sz, MEM_ALIGN_SIMD);
+			if (len)
+				snap[sse][b][1] = mem_alloc_tiny(len_sz, MEM_ALIGN_WORD);
+		}
+		dynamic_key_buffer(1<<b, m_count, &data, &data_sz, &len, &len_sz);
+		if (restore) {
+			memcpy(data, snap[sse][b][0], data_sz);
+			if (len)
+				memcpy(len, snap[sse][b][1], len_sz);
+		} else {
+			memcpy(snap[sse][b][0], data, data_sz);
+			if (len)
+				memcpy(snap[sse][b][1], len, len_sz);
+		}
+	}
+}
+
 /*********************************************************************************
  *********************************************************************************
  *  This is the real 'engine'.  It simply calls functions one
@@ -1568,89 +1755,18 @@ static void crypt_all(int count)
 	//   nConsts                     (const)
 	//   Consts[], ConstsLen[]       (const)
 
-	// Since this array is in a structure, we assign a simple pointer to it
-	// before walking.  Trivial improvement, but every cycle counts :)
-	{
-#ifdef _OPENMP
-	int j;
-	int inc = (m_count+m_ompt-1) / m_ompt;
-#ifndef MMX_COEF
-	inc = ((inc+OMP_INC-1)/OMP_INC)*OMP_INC;
-#else
-	if ((curdat.pSetup->flags& MGF_NOTSSE2Safe) == MGF_NOTSSE2Safe)
-		inc = ((inc+OMP_INC-1)/OMP_INC)*OMP_INC;
-	else
-		// NOTE, we will likely want to know to use OMP_MD5_INC, OMP_MD4_INC
-		// but for now, this works.
-		inc = ((inc+OMP_MD5_INC-1)/OMP_MD5_INC)*OMP_MD5_INC;
-#endif
-#pragma omp parallel for shared(curdat, inc, m_count)
-	for (j = 0; j < m_count; j += inc) {
-		int i;
-		int top=j+inc;
-		if (top > m_count)
-			top = m_count;
-		// we now run a full script in this thread, using only a subset of
-		// the data, from [j,top)  The next thread will run from [top,top+inc)
-		// each thread will take the next inc values, until we get to m_count
-		for (i = 0; curdat.dynamic_FUNCTIONS[i]; ++i)
-			(*(curdat.dynamic_FUNCTIONS[i]))(j,top,omp_get_thread_num());
-	}
-#else
-	int i;
-	for (i = 0; curdat.dynamic_FUNCTIONS[i]; ++i) {
-		(*(curdat.dynamic_FUNCTIONS[i]))();
-#if 0
-		// Dump state (for debugging help)
-		printf ("\nState after function: %s\n", dynamic_Find_Function_Name(curdat.dynamic_FUNCTIONS[i]));
-		// dump input 1
-#ifdef MMX_COEF
-		dump_stuff_mmx_msg("input_buf[0]", input_buf[0].c, 64, 0);
-		dump_stuff_mmx_msg("input_buf[1]", input_buf[0].c, 64, 1);
-		dump_stuff_mmx_msg("input_buf[2]", input_buf[0].c, 64, 2);
-		dump_stuff_mmx_msg("input_buf[3]", input_buf[0].c, 64, 3);
-#endif
-		printf ("input_buf86[0] : %*.*s\n", total_len_X86[0],total_len_X86[0],input_buf_X86[0].x1.b);
-		printf ("input_buf86[1] : %*.*s\n", total_len_X86[1],total_len_X86[1],input_buf_X86[1].x1.b);
-		printf ("input_buf86[2] : %*.*s\n", total_len_X86[2],total_len_X86[2],input_buf_X86[2].x1.b);
-		printf ("input_buf86[3] : %*.*s\n", total_len_X86[3],total_len_X86[3],input_buf_X86[3].x1.b);
-		// dump crypt 1
-#ifdef MMX_COEF
-		dump_stuff_mmx_msg("crypt_key[0]", crypt_key[0].c, 16, 0);
-		dump_stuff_mmx_msg("crypt_key[1]", crypt_key[0].c, 16, 1);
-		dump_stuff_mmx_msg("crypt_key[2]", crypt_key[0].c, 16, 2);
-		dump_stuff_mmx_msg("crypt_key[3]", crypt_key[0].c, 16, 3);
-#endif
-		dump_stuff_be_msg("crypt_key_X86[0]", crypt_key_X86[0].x1.b, 16);
-		dump_stuff_be_msg("crypt_key_X86[1]", crypt_key_X86[1].x1.b, 16);
-		dump_stuff_be_msg("crypt_key_X86[2]", crypt_key_X86[2].x1.b, 16);
-		dump_stuff_be_msg("crypt_key_X86[3]", crypt_key_X86[3].x1.b, 16);
-		// dump input 2
-#ifdef MMX_COEF
-		dump_stuff_mmx_msg("input_buf2[0]", input_buf2[0].c, 64, 0);
-		dump_stuff_mmx_msg("input_buf2[1]", input_buf2[0].c, 64, 1);
-		dump_stuff_mmx_msg("input_buf2[2]", input_buf2[0].c, 64, 2);
-		dump_stuff_mmx_msg("input_buf2[3]", input_buf2[0].c, 64, 3);
-#endif
-		printf ("input2_buf86[0] : %*.*s\n", total_len2_X86[0],total_len2_X86[0],input_buf2_X86[0].x1.b);
-		printf ("input2_buf86[1] : %*.*s\n", total_len2_X86[1],total_len2_X86[1],input_buf2_X86[1].x1.b);
-		printf ("input2_buf86[2] : %*.*s\n", total_len2_X86[2],total_len2_X86[2],input_buf2_X86[2].x1.b);
-		printf ("input2_buf86[3] : %*.*s\n", total_len2_X86[3],total_len2_X86[3],input_buf2_X86[3].x1.b);
-		// dump crypt 2
-#ifdef MMX_COEF
-		dump_stuff_mmx_msg("crypt_key2[0]", crypt_key2[0].c, 16, 0);
-		dump_stuff_mmx_msg("crypt_key2[1]", crypt_key2[0].c, 16, 1);
-		dump_stuff_mmx_msg("crypt_key2[2]", crypt_key2[0].c, 16, 2);
-		dump_stuff_mmx_msg("crypt_key2[3]", crypt_key2[0].c, 16, 3);
-#endif
-		dump_stuff_be_msg("crypt_key2_X86[0]", crypt_key2_X86[0].x1.b, 16);
-		dump_stuff_be_msg("crypt_key2_X86[1]", crypt_key2_X86[1].x1.b, 16);
-		dump_stuff_be_msg("crypt_key2_X86[2]", crypt_key2_X86[2].x1.b, 16);
-		dump_stuff_be_msg("crypt_key2_X86[3]", crypt_key2_X86[3].x1.b, 16);
-#endif
-	}
-#endif
+	// Key-only work at the start of the script is only done when the keys
+	// change.  For the other salts, just put back what it left behind.
+	if (curdat.dynamic_KEY_FUNCTIONS) {
+		if (keys_dirty || key_snap_count != m_count) {
+			keys_dirty = 0;
+			dynamic_run_script(curdat.dynamic_KEY_FUNCTIONS, curdat.dynamic_KEY_FUSED);
+			dynamic_key_snapshot(0);
+			key_snap_count = m_count;
+		} else
+			dynamic_key_snapshot(1);
 	}
+	dynamic_run_script(curdat.dynamic_FUNCTIONS, curdat.dynamic_FUSED);
 
 #if FMT_MAIN_VERSION > 10
 	return m_count;
@@ -2111,6 +2227,8 @@ static void *salt(char *ciphertext)
 		unsigned char Buf[16];
 		unsigned char *cpo, *cpi, i;
 		unsigned slen=strlen(Salt);
+		// crypt_all() has not set dynamic_itoa16 for this format yet
+		const char *hex = curdat.dynamic_base16_upcase ? itoa16u : itoa16;
 		MD5_Init(&ctx);
 		if (curdat.dynamic_salt_as_hex & 0x100)
 		{
@@ -2137,8 +2255,8 @@ static void *salt(char *ciphertext)
 		cpi = Buf;
 		for (i = 0; i < 16; ++i)
 		{
-			*cpo++ = dynamic_itoa16[(*cpi)>>4];
-			*cpo++ = dynamic_itoa16[(*cpi)&0xF];
+			*cpo++ = hex[(*cpi)>>4];
+			*cpo++ = hex[(*cpi)&0xF];
 			++cpi;
 		}
 		*cpo = 0;
@@ -6696,6 +6814,749 @@ static int isLargeHashFinalFunc(DYNAMIC_primitive_funcp p) {
 	return 0;
 }
 
+/*
+ * Key prologue compiler.  Many scripts start out with work that depends on
+ * nothing but the keys (and the format constants), e.g. md5($s.md5($p)) builds
+ * and hashes md5($p) before the salt is ever touched.  john calls crypt_all()
+ * once per salt with unchanged keys, so that work was being redone for every
+ * salt.  Here we split the script into its longest key-only prefix, which
+ * crypt_all() runs once per set of keys, and the salt dependent remainder.
+ * The buffers the prefix leaves behind are snapshotted, and restored before
+ * each later salt, so the remainder always starts from the exact state the
+ * full script would have given it.
+ */
+#define DYNA_USE_KEYS  1	// depends only upon the keys and constants
+#define DYNA_USE_HASH  2	// does real hashing work (worth hoisting)
+#define DYNA_USE_CLEAN 4	// in SSE mode, fully resets the buffers it touches
+#define DYNA_USE_FLAT  8	// only works on the flat (x86) buffers
+
+typedef struct DYNAMIC_Func_Use {
+	DYNAMIC_primitive_funcp func;
+	int bufs;
+	int flags;
+} DYNAMIC_Func_Use;
+
+#define LARGE_HASH_USE(H) \
+	{ DynamicFunc__##H##_crypt_input1_append_input2,           DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_append_input2_base16,    DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_append_input1,           DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_append_input1_base16,    DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_overwrite_input1,        DYNA_BUF_IN1,              DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_overwrite_input1_base16, DYNA_BUF_IN1,              DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_overwrite_input2,        DYNA_BUF_IN2,              DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_overwrite_input2_base16, DYNA_BUF_IN2,              DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_overwrite_input2,        DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_overwrite_input2_base16, DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_overwrite_input1,        DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_overwrite_input1_base16, DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input1_to_output1_FINAL,        DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }, \
+	{ DynamicFunc__##H##_crypt_input2_to_output1_FINAL,        DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH|DYNA_USE_FLAT }
+
+// The buffers each primitive reads or writes.  Any function not listed here
+// (mode switches, unicode, the special crypt functions, ...) is assumed to
+// touch everything, and ends the key-only prefix.  The crypt functions also
+// write to their input (length fixups), so they count as touching it.
+static DYNAMIC_Func_Use dynamic_Func_Use[] = {
+	{ DynamicFunc__clean_input,       DYNA_BUF_IN1, DYNA_USE_KEYS|DYNA_USE_CLEAN },
+	{ DynamicFunc__clean_input2,      DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_CLEAN },
+	{ DynamicFunc__clean_input_full,  DYNA_BUF_IN1, DYNA_USE_KEYS|DYNA_USE_CLEAN },
+	{ DynamicFunc__clean_input2_full, DYNA_BUF_IN2, DYNA_USE_KEYS|DYNA_USE_CLEAN },
+	{ DynamicFunc__clean_input_kwik,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__clean_input2_kwik, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_keys,       DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_keys2,      DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__crypt_md5,            DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt_md4,            DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt2_md5,           DYNA_BUF_IN2|DYNA_BUF_OUT2, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt2_md4,           DYNA_BUF_IN2|DYNA_BUF_OUT2, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt_md5_in1_to_out2, DYNA_BUF_IN1|DYNA_BUF_OUT2, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt_md4_in1_to_out2, DYNA_BUF_IN1|DYNA_BUF_OUT2, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt_md5_in2_to_out1, DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__crypt_md4_in2_to_out1, DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS|DYNA_USE_HASH },
+	{ DynamicFunc__append_from_last_output_as_base16,                   DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__overwrite_from_last_output_as_base16_no_size_fix,    DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_from_last_output2_as_base16,                  DYNA_BUF_IN2|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__overwrite_from_last_output2_as_base16_no_size_fix,   DYNA_BUF_IN2|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_from_last_output_to_input2_as_base16,         DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__overwrite_from_last_output_to_input2_as_base16_no_size_fix, DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_from_last_output2_to_input1_as_base16,        DYNA_BUF_IN1|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__overwrite_from_last_output2_to_input1_as_base16_no_size_fix, DYNA_BUF_IN1|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_from_last_output2_as_raw,  DYNA_BUF_IN1|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__append2_from_last_output2_as_raw, DYNA_BUF_IN2|DYNA_BUF_OUT2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_from_last_output1_as_raw,  DYNA_BUF_IN1|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__append2_from_last_output1_as_raw, DYNA_BUF_IN2|DYNA_BUF_OUT1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input_from_input,   DYNA_BUF_IN1,              DYNA_USE_KEYS },
+	{ DynamicFunc__append_input_from_input2,  DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_input,  DYNA_BUF_IN1|DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_input2, DYNA_BUF_IN2,              DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_16,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_20,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_32,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_40,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_64,  DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input_len_100, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input2_len_16, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input2_len_20, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input2_len_32, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input2_len_40, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__set_input2_len_64, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST1, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST2, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST3, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST4, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST5, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST6, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST7, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input1_from_CONST8, DYNA_BUF_IN1, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST1, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST2, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST3, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST4, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST5, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST6, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST7, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	{ DynamicFunc__append_input2_from_CONST8, DYNA_BUF_IN2, DYNA_USE_KEYS },
+	// salt and field functions never go in the prefix, but knowing what they
+	// touch keeps the restore set small.
+	{ DynamicFunc__append_salt,   DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_salt2,  DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append_2nd_salt,  DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_2nd_salt2, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append_userid,  DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_userid2, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__overwrite_salt_to_input1_no_size_fix, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__overwrite_salt_to_input2_no_size_fix, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append_fld0, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld1, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld2, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld3, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld4, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld5, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld6, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld7, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld8, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append_fld9, DYNA_BUF_IN1, 0 },
+	{ DynamicFunc__append2_fld0, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld1, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld2, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld3, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld4, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld5, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld6, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld7, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld8, DYNA_BUF_IN2, 0 },
+	{ DynamicFunc__append2_fld9, DYNA_BUF_IN2, 0 },
+	LARGE_HASH_USE(MD5),
+	LARGE_HASH_USE(MD4),
+	LARGE_HASH_USE(SHA1),
+	LARGE_HASH_USE(SHA224),
+	LARGE_HASH_USE(SHA256),
+	LARGE_HASH_USE(SHA384),
+	LARGE_HASH_USE(SHA512),
+	LARGE_HASH_USE(GOST),
+	LARGE_HASH_USE(WHIRLPOOL),
+	LARGE_HASH_USE(Tiger),
+	LARGE_HASH_USE(RIPEMD128),
+	LARGE_HASH_USE(RIPEMD160),
+	LARGE_HASH_USE(RIPEMD256),
+	LARGE_HASH_USE(RIPEMD320),
+	{ NULL, 0, 0 }
+};
+
+static DYNAMIC_Func_Use *dynamic_Find_Func_Use(DYNAMIC_primitive_funcp p) {
+	static DYNAMIC_Func_Use unknown = { NULL, DYNA_BUF_ALL, 0 };
+	int i;
+	for (i = 0; dynamic_Func_Use[i].func; ++i)
+		if (dynamic_Func_Use[i].func == p)
+			return &dynamic_Func_Use[i];
+	return &unknown;
+}
+
+// Splits curdat.dynamic_FUNCTIONS (already built) into a key-only prologue
+// and the per-salt remainder.  Leaves the script untouched if nothing is
+// gained, or if the format does its own key precompute.
+static void dynamic_Compile_Key_Prologue(DYNAMIC_Setup *Setup) {
+	DYNAMIC_primitive_funcp *f = curdat.dynamic_FUNCTIONS;
+	int i, n, hashed = 0, flat = 0, written = 0, restore = 0, settled = 0, sse = 0;
+
+	curdat.dynamic_KEY_FUNCTIONS = NULL;
+	curdat.dynamic_KEY_RESTORE = 0;
+	if (!f || (Setup->flags&MGF_SALTED) == 0 || curdat.store_keys_in_input ||
+	    curdat.store_keys_in_input_unicode_convert ||
+	    curdat.store_keys_normal_but_precompute_md5_to_output2)
+		return;
+#ifdef MMX_COEF
+	if (curdat.md5_startup_in_x86)
+		return;
+	sse = curdat.dynamic_use_sse != 0;
+#endif
+	for (i = 0; f[i]; ++i)
+		flat |= dynamic_Find_Func_Use(f[i])->flags&DYNA_USE_FLAT;
+	// LargeHash always works from the flat buffers, so an SSE script which
+	// mixes in one of them juggles two copies of each buffer.  Leave it be.
+	if (sse && flat)
+		return;
+
+	for (n = 0; f[n]; ++n) {
+		DYNAMIC_Func_Use *u = dynamic_Find_Func_Use(f[n]);
+		if (!(u->flags&DYNA_USE_KEYS))
+			break;
+		hashed |= u->flags&DYNA_USE_HASH;
+		written |= u->bufs;
+	}
+	if (!hashed || !f[n])
+		return;
+
+	// Any buffer the prologue wrote, and the rest of the script looks at
+	// before fully clearing it, has to be put back before each salt.
+	for (i = n; f[i]; ++i) {
+		DYNAMIC_Func_Use *u = dynamic_Find_Func_Use(f[i]);
+		if (sse && (u->flags&DYNA_USE_CLEAN))
+			settled |= u->bufs & ~restore;
+		else
+			restore |= u->bufs & ~settled;
+	}
+
+	curdat.dynamic_KEY_FUNCTIONS = mem_alloc_tiny((n+1)*sizeof(DYNAMIC_primitive_funcp), MEM_ALIGN_WORD);
+	memcpy(curdat.dynamic_KEY_FUNCTIONS, f, n*sizeof(DYNAMIC_primitive_funcp));
+	curdat.dynamic_KEY_FUNCTIONS[n] = NULL;
+	curdat.dynamic_FUNCTIONS = &f[n];
+	curdat.dynamic_KEY_RESTORE = restore & written;
+}
+
+/*
+ * Fused scripts.  In SSE mode the interpreter runs each step over the whole
+ * batch of keys before it moves on to the next one, so every step walks all
+ * of input_buf[], input_buf2[] and the crypt_key[]s again, and each buffer is
+ * built one append at a time, a byte or a word per lane.  Nearly every SSE
+ * script is made of the few kinds of steps below, and each of those only
+ * looks at a key's own SIMD block.  So we compile such a script into a list
+ * of fused steps, and run the whole list on one group of MD5_SSE_PARA blocks
+ * at a time, while the group is still in L1:
+ *
+ *  - a clean followed by appends to the same input is a single BUILD step.
+ *    It lays each lane's message out flat (base-16 of a digest is done with
+ *    SIMD), and transposes the four lanes into the interleaved block.
+ *  - base-16 of an output into an input at the same aligned offset in all
+ *    lanes goes straight from the interleaved digest words to the input
+ *    words, with no per lane work at all.
+ *  - md5/md4 hash the group as soon as it is built.
+ *
+ * The buffers end up as the interpreter leaves them (for the keys in use),
+ * so the key prologue snapshot, and anything reading them later, work as
+ * before.  A script using any other step runs through the interpreter.
+ *
+ * This needs the 4 lane interleaved input buffers (MMX_COEF==4).  The AVX2
+ * and AVX-512 x86-64 builds keep that layout for dynamic and only run more
+ * of those blocks per md5/md4 call, so they use the fused steps as well.  A
+ * build with any other MMX_COEF, or without SSE2, always uses the
+ * interpreter.
+ */
+#ifdef DYNA_FUSED
+#define DYNA_FOP_END     0
+#define DYNA_FOP_BUILD   1	// clean buf, then the next arg steps are appended to it
+#define DYNA_FOP_KEYS    2	// append the keys to buf
+#define DYNA_FOP_SALT    3	// append the salt to buf
+#define DYNA_FOP_CONST   4	// append constant number arg to buf
+#define DYNA_FOP_HEX     5	// append base-16 of output src to buf
+#define DYNA_FOP_HEX_OVR 6	// base-16 of output src over the start of buf (no size fix)
+#define DYNA_FOP_LEN32   7	// set the length of buf to 32
+#define DYNA_FOP_KWIK    8	// set the length of buf to 0, but leave its contents
+#define DYNA_FOP_MD5     9	// md5 of buf into output src (arg set: lengths are already in buf)
+#define DYNA_FOP_MD4    10	// md4 of buf into output src (arg set: lengths are already in buf)
+
+typedef struct DYNAMIC_Fused_Op {
+	unsigned char op, buf, src, arg;
+} DYNAMIC_Fused_Op;
+
+#define FUSED_CONST(n) \
+	{ DynamicFunc__append_input1_from_CONST##n, { DYNA_FOP_CONST, DYNA_BUF_IN1, 0, n-1 } }, \
+	{ DynamicFunc__append_input2_from_CONST##n, { DYNA_FOP_CONST, DYNA_BUF_IN2, 0, n-1 } }
+
+static struct {
+	DYNAMIC_primitive_funcp func;
+	DYNAMIC_Fused_Op op;
+} dynamic_Fused_Funcs[] = {
+	{ DynamicFunc__clean_input,  { DYNA_FOP_BUILD, DYNA_BUF_IN1, 0, 0 } },
+	{ DynamicFunc__clean_input2, { DYNA_FOP_BUILD, DYNA_BUF_IN2, 0, 0 } },
+	{ DynamicFunc__clean_input_kwik,  { DYNA_FOP_KWIK, DYNA_BUF_IN1, 0, 0 } },
+	{ DynamicFunc__clean_input2_kwik, { DYNA_FOP_KWIK, DYNA_BUF_IN2, 0, 0 } },
+	{ DynamicFunc__append_keys,  { DYNA_FOP_KEYS, DYNA_BUF_IN1, 0, 0 } },
+	{ DynamicFunc__append_keys2, { DYNA_FOP_KEYS, DYNA_BUF_IN2, 0, 0 } },
+	{ DynamicFunc__append_salt,  { DYNA_FOP_SALT, DYNA_BUF_IN1, 0, 0 } },
+	{ DynamicFunc__append_salt2, { DYNA_FOP_SALT, DYNA_BUF_IN2, 0, 0 } },
+	FUSED_CONST(1), FUSED_CONST(2), FUSED_CONST(3), FUSED_CONST(4),
+	FUSED_CONST(5), FUSED_CONST(6), FUSED_CONST(7), FUSED_CONST(8),
+	{ DynamicFunc__append_from_last_output_as_base16,            { DYNA_FOP_HEX, DYNA_BUF_IN1, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__append_from_last_output_to_input2_as_base16,  { DYNA_FOP_HEX, DYNA_BUF_IN2, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__append_from_last_output2_as_base16,           { DYNA_FOP_HEX, DYNA_BUF_IN2, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__append_from_last_output2_to_input1_as_base16, { DYNA_FOP_HEX, DYNA_BUF_IN1, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__overwrite_from_last_output_as_base16_no_size_fix,            { DYNA_FOP_HEX_OVR, DYNA_BUF_IN1, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__overwrite_from_last_output_to_input2_as_base16_no_size_fix,  { DYNA_FOP_HEX_OVR, DYNA_BUF_IN2, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__overwrite_from_last_output2_as_base16_no_size_fix,           { DYNA_FOP_HEX_OVR, DYNA_BUF_IN2, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__overwrite_from_last_output2_to_input1_as_base16_no_size_fix, { DYNA_FOP_HEX_OVR, DYNA_BUF_IN1, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__set_input_len_32,  { DYNA_FOP_LEN32, DYNA_BUF_IN1, 0, 0 } },
+	{ DynamicFunc__set_input2_len_32, { DYNA_FOP_LEN32, DYNA_BUF_IN2, 0, 0 } },
+	{ DynamicFunc__crypt_md5,             { DYNA_FOP_MD5, DYNA_BUF_IN1, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__crypt2_md5,            { DYNA_FOP_MD5, DYNA_BUF_IN2, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__crypt_md5_in1_to_out2, { DYNA_FOP_MD5, DYNA_BUF_IN1, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__crypt_md5_in2_to_out1, { DYNA_FOP_MD5, DYNA_BUF_IN2, DYNA_BUF_OUT1, 0 } },
+#if defined (MD4_SSE_PARA) && MD4_SSE_PARA==MD5_SSE_PARA
+	{ DynamicFunc__crypt_md4,             { DYNA_FOP_MD4, DYNA_BUF_IN1, DYNA_BUF_OUT1, 0 } },
+	{ DynamicFunc__crypt2_md4,            { DYNA_FOP_MD4, DYNA_BUF_IN2, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__crypt_md4_in1_to_out2, { DYNA_FOP_MD4, DYNA_BUF_IN1, DYNA_BUF_OUT2, 0 } },
+	{ DynamicFunc__crypt_md4_in2_to_out1, { DYNA_FOP_MD4, DYNA_BUF_IN2, DYNA_BUF_OUT1, 0 } },
+#endif
+	{ NULL, { DYNA_FOP_END, 0, 0, 0 } }
+};
+
+// Transposes four rows of four 32 bit words: r[i] gets column i.
+static inline void dynamic_fused_transpose(__m128i *r)
+{
+	__m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+	__m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+	__m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+	__m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+
+	r[0] = _mm_unpacklo_epi64(t0, t1);
+	r[1] = _mm_unpackhi_epi64(t0, t1);
+	r[2] = _mm_unpacklo_epi64(t2, t3);
+	r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+// Base-16 of the 16 bytes of v: bytes 0 to 7 end up in *lo, 8 to 15 in *hi.
+static inline void dynamic_fused_base16(__m128i v, __m128i *lo, __m128i *hi)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i alpha = _mm_set1_epi8(curdat.dynamic_base16_upcase ? 'A'-'0'-10 : 'a'-'0'-10);
+	__m128i h = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	__m128i l = _mm_and_si128(v, mask);
+	__m128i a = _mm_unpacklo_epi8(h, l);
+	__m128i b = _mm_unpackhi_epi8(h, l);
+
+	*lo = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+	*hi = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+}
+
+// Base-16 of an interleaved digest into the 8 interleaved input rows at row.
+static void dynamic_fused_base16_rows(__m128i *row, const __m128i *cry)
+{
+	int r;
+
+	for (r = 0; r < 4; ++r) {
+		__m128i a, b;
+
+		dynamic_fused_base16(_mm_load_si128(&cry[r]), &a, &b);
+		// a: lane 0 words 0 1, lane 1 words 0 1.  b: the same for lanes 2 and 3
+		a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0));
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0));
+		_mm_store_si128(&row[2*r], _mm_unpacklo_epi64(a, b));
+		_mm_store_si128(&row[2*r+1], _mm_unpackhi_epi64(a, b));
+	}
+}
+
+// Appends to a lane laid out flat.  Past 55 bytes the SSE code does not give
+// correct hashes anyway, so all we care about there is staying in bounds.
+static inline void dynamic_fused_copy(unsigned char *flat, unsigned *pos, const void *p, unsigned len)
+{
+	if (*pos + len > 64)
+		len = 64 - *pos;
+	memcpy(&flat[*pos], p, len);
+	*pos += len;
+}
+
+// Appends p[0..len) and a 0x80 at offset ip in all lanes of an interleaved
+// block, one row (the same word for every lane) at a time.
+static void dynamic_fused_append_rows(unsigned char *in, unsigned ip, const unsigned char *p, unsigned len)
+{
+	unsigned end = ip + len, q, b;
+
+	for (q = ip/4; q <= end/4; ++q) {
+		ARCH_WORD_32 w = 0, m = 0;
+		__m128i *row = (__m128i*)&in[q*4*MMX_COEF];
+
+		for (b = 0; b < 4; ++b) {
+			unsigned at = q*4 + b;
+
+			if (at < ip || at > end)
+				continue;
+			w |= (ARCH_WORD_32)(at < end ? p[at-ip] : 0x80) << (8*b);
+			m |= 0xFFU << (8*b);
+		}
+		_mm_store_si128(row, _mm_or_si128(_mm_andnot_si128(_mm_set1_epi32(m), _mm_load_si128(row)), _mm_set1_epi32(w)));
+	}
+}
+
+// DYNA_FOP_BUILD of one block, with op->arg appends following it in ops[].
+static void dynamic_fused_build(const DYNAMIC_Fused_Op *op, unsigned blk, unsigned lanes)
+{
+	ALIGN(16) unsigned char flat[MMX_COEF][128];
+	__m128i r[MMX_COEF];
+	__m128i *in = (__m128i*)(op->buf == DYNA_BUF_IN1 ? input_buf[blk].c : input_buf2[blk].c);
+	unsigned *len = op->buf == DYNA_BUF_IN1 ? &total_len[blk] : &total_len2[blk];
+	unsigned pos[MMX_COEF] = { 0 }, tl = 0, k = blk*MMX_COEF, i, j, n = op->arg;
+
+	for (j = 0; j < MMX_COEF; ++j)
+		for (i = 0; i < 64; i += 16)
+			_mm_store_si128((__m128i*)&flat[j][i], _mm_setzero_si128());
+
+	for (++op; n--; ++op) {
+		switch (op->op) {
+		case DYNA_FOP_KEYS:
+			for (j = 0; j < lanes; ++j)
+				dynamic_fused_copy(flat[j], &pos[j], saved_key[k+j], saved_key_len[k+j]);
+			break;
+		case DYNA_FOP_SALT:
+			for (j = 0; j < lanes; ++j)
+				dynamic_fused_copy(flat[j], &pos[j], cursalt, saltlen);
+			break;
+		case DYNA_FOP_CONST:
+			for (j = 0; j < lanes; ++j)
+				dynamic_fused_copy(flat[j], &pos[j], curdat.Consts[op->arg], curdat.ConstsLen[op->arg]);
+			break;
+		case DYNA_FOP_HEX: {
+			__m128i *cry = (__m128i*)(op->src == DYNA_BUF_OUT1 ? crypt_key[blk].c : crypt_key2[blk].c);
+
+			for (j = 0; j < MMX_COEF; ++j)
+				r[j] = _mm_load_si128(&cry[j]);
+			dynamic_fused_transpose(r);
+			for (j = 0; j < lanes; ++j) {
+				__m128i lo, hi;
+
+				dynamic_fused_base16(r[j], &lo, &hi);
+				_mm_storeu_si128((__m128i*)&flat[j][pos[j]], lo);
+				_mm_storeu_si128((__m128i*)&flat[j][pos[j]+16], hi);
+				pos[j] = pos[j] + 32 > 64 ? 64 : pos[j] + 32;
+			}
+			break;
+		}
+		}
+	}
+
+	// Every append leaves a 0x80 after itself, a bare clean leaves nothing
+	for (j = 0; j < lanes; ++j) {
+		if (op[-1].op != DYNA_FOP_BUILD)
+			flat[j][pos[j]] = 0x80;
+		tl |= pos[j] << (8*j);
+	}
+	for (i = 0; i < 16; i += 4) {
+		for (j = 0; j < MMX_COEF; ++j)
+			r[j] = _mm_load_si128((__m128i*)&flat[j][i*4]);
+		dynamic_fused_transpose(r);
+		for (j = 0; j < MMX_COEF; ++j)
+			_mm_store_si128(&in[i+j], r[j]);
+	}
+	*len = tl;
+}
+
+// Any other single step on one block (just as the interpreter does it).
+static void dynamic_fused_step(const DYNAMIC_Fused_Op *op, unsigned blk, unsigned lanes)
+{
+	unsigned char *in = op->buf == DYNA_BUF_IN1 ? input_buf[blk].c : input_buf2[blk].c;
+	unsigned char *cry = op->src == DYNA_BUF_OUT1 ? crypt_key[blk].c : crypt_key2[blk].c;
+	unsigned *len = op->buf == DYNA_BUF_IN1 ? &total_len[blk] : &total_len2[blk];
+	unsigned k = blk*MMX_COEF, i, j;
+
+	switch (op->op) {
+	case DYNA_FOP_KEYS:
+	case DYNA_FOP_SALT:
+	case DYNA_FOP_CONST:
+		i = *len & 0xFF;
+		if (op->op != DYNA_FOP_KEYS && lanes == MMX_COEF && *len == i * 0x01010101) {
+			unsigned char *p = op->op == DYNA_FOP_SALT ? cursalt : curdat.Consts[op->arg];
+			unsigned n = op->op == DYNA_FOP_SALT ? saltlen : curdat.ConstsLen[op->arg];
+
+			if (i + n < 64) {
+				dynamic_fused_append_rows(in, i, p, n);
+				*len += n * 0x01010101;
+				return;
+			}
+		}
+		for (j = 0; j < lanes; ++j) {
+			unsigned char *p = cursalt;
+			unsigned n = saltlen;
+
+			if (op->op == DYNA_FOP_KEYS) {
+				p = (unsigned char*)saved_key[k+j];
+				n = saved_key_len[k+j];
+			} else if (op->op == DYNA_FOP_CONST) {
+				p = curdat.Consts[op->arg];
+				n = curdat.ConstsLen[op->arg];
+			}
+			__SSE_append_string_to_input(in, j, p, n, (*len >> (8*j)) & 0xFF, 1);
+			*len += n << (8*j);
+		}
+		return;
+	case DYNA_FOP_HEX:
+		i = *len & 0xFF;
+		if (lanes == MMX_COEF && *len == i * 0x01010101 && !(i&3) && i <= 32) {
+			dynamic_fused_base16_rows((__m128i*)&in[i*MMX_COEF], (__m128i*)cry);
+			for (j = 0; j < MMX_COEF; ++j)
+				in[GETPOS(i+32, j)] = 0x80;
+			*len += 0x20202020;
+			return;
+		}
+		for (j = 0; j < lanes; ++j) {
+			unsigned ip = (*len >> (8*j)) & 0xFF;
+
+			for (i = 0; i < 16; ++i) {
+				unsigned char v = cry[GETPOS(i, j)];
+				in[GETPOS(ip+(i<<1), j)] = dynamic_itoa16[v>>4];
+				in[GETPOS(ip+(i<<1)+1, j)] = dynamic_itoa16[v&0xF];
+			}
+			in[GETPOS(ip+32, j)] = 0x80;
+			*len += 32 << (8*j);
+		}
+		return;
+	case DYNA_FOP_HEX_OVR:
+		if (lanes == MMX_COEF) {
+			dynamic_fused_base16_rows((__m128i*)in, (__m128i*)cry);
+			return;
+		}
+		for (j = 0; j < lanes; ++j)
+			for (i = 0; i < 16; ++i) {
+				unsigned char v = cry[GETPOS(i, j)];
+				in[GETPOS(i<<1, j)] = dynamic_itoa16[v>>4];
+				in[GETPOS((i<<1)+1, j)] = dynamic_itoa16[v&0xF];
+			}
+		return;
+	case DYNA_FOP_LEN32:
+		for (j = 0; j < MMX_COEF; ++j)
+			in[GETPOS(32, j)] = 0x80;
+		*len = 0x20202020;
+		return;
+	case DYNA_FOP_KWIK:
+		*len = 0;
+		return;
+	}
+}
+
+static void dynamic_run_fused(DYNAMIC_Fused_Op *ops, unsigned first, unsigned last)
+{
+	unsigned i = first/MMX_COEF, til = (last+MMX_COEF-1)/MMX_COEF;
+
+	for (; i < til; i += MD5_SSE_PARA) {
+		unsigned top = i+MD5_SSE_PARA < til ? i+MD5_SSE_PARA : til;
+		DYNAMIC_Fused_Op *op;
+
+		for (op = ops; op->op != DYNA_FOP_END; ++op) {
+			unsigned char *in = op->buf == DYNA_BUF_IN1 ? input_buf[i].c : input_buf2[i].c;
+			ARCH_WORD_32 *out = op->src == DYNA_BUF_OUT1 ? crypt_key[i].w : crypt_key2[i].w;
+			unsigned b;
+
+			switch (op->op) {
+			case DYNA_FOP_MD5:
+				if (!op->arg)
+					SSE_Intrinsics_LoadLens(op->buf == DYNA_BUF_IN2, i);
+				SSEmd5body(in, out, NULL, SSEi_MIXED_IN);
+				break;
+#if defined (MD4_SSE_PARA) && MD4_SSE_PARA==MD5_SSE_PARA
+			case DYNA_FOP_MD4:
+				if (!op->arg)
+					SSE_Intrinsics_LoadLens(op->buf == DYNA_BUF_IN2, i);
+				SSEmd4body(in, out, NULL, SSEi_MIXED_IN);
+				break;
+#endif
+			case DYNA_FOP_BUILD:
+				for (b = i; b < top; ++b)
+					dynamic_fused_build(op, b, last-b*MMX_COEF < MMX_COEF ? last-b*MMX_COEF : MMX_COEF);
+				op += op->arg;
+				break;
+			default:
+				for (b = i; b < top; ++b)
+					dynamic_fused_step(op, b, last-b*MMX_COEF < MMX_COEF ? last-b*MMX_COEF : MMX_COEF);
+			}
+		}
+	}
+}
+
+// Compiles a script into fused steps, or returns NULL if it uses anything
+// we do not handle (or is nothing but hashing, so there is nothing to fuse).
+static DYNAMIC_Fused_Op *dynamic_Compile_Fused(DYNAMIC_primitive_funcp *f) {
+	DYNAMIC_Fused_Op *ops;
+	int i, k, n, build = -1, hashed = 0, other = 0;
+
+	if (!f || !curdat.dynamic_use_sse || curdat.md5_startup_in_x86)
+		return NULL;
+	for (n = 0; f[n]; ++n) {
+		for (k = 0; dynamic_Fused_Funcs[k].func && dynamic_Fused_Funcs[k].func != f[n]; ++k)
+			;
+		if (!dynamic_Fused_Funcs[k].func)
+			return NULL;
+		if (dynamic_Fused_Funcs[k].op.op >= DYNA_FOP_MD5)
+			hashed = 1;
+		else
+			other = 1;
+	}
+	if (!hashed || !other)
+		return NULL;
+
+	ops = mem_alloc_tiny((n+1)*sizeof(DYNAMIC_Fused_Op), MEM_ALIGN_WORD);
+	for (i = 0; i < n; ++i) {
+		for (k = 0; dynamic_Fused_Funcs[k].func != f[i]; ++k)
+			;
+		ops[i] = dynamic_Fused_Funcs[k].op;
+		switch (ops[i].op) {
+		case DYNA_FOP_BUILD:
+			build = i;
+			break;
+		case DYNA_FOP_KEYS:
+		case DYNA_FOP_SALT:
+		case DYNA_FOP_CONST:
+		case DYNA_FOP_HEX:
+			if (build >= 0 && ops[build].buf == ops[i].buf) {
+				ops[build].arg++;
+				break;
+			}
+			// fall through
+		default:
+			build = -1;
+			// keys stored in input 1 by set_key() already carry their lengths
+			if (ops[i].op >= DYNA_FOP_MD5 && ops[i].buf == DYNA_BUF_IN1 && curdat.store_keys_in_input)
+				ops[i].arg = 1;
+		}
+	}
+	ops[n].op = DYNA_FOP_END;
+	return ops;
+}
+#endif
+
+/*
+ * Salt-only subexpressions.  A script such as md5(md5($s).$p) starts by
+ * hashing the salt on its own, and crypt_all() redid that for every batch of
+ * keys.  If md5($s) is the only way the script uses the salt, we instead
+ * hash it once in salt() (exactly what MGF_SALT_AS_HEX does), so the salt
+ * blob already holds the hex, and the script just appends it.
+ */
+static struct {
+	DYNAMIC_primitive_funcp func;
+	int in, out;
+} dynamic_Salt_Crypts[] = {
+	{ DynamicFunc__crypt_md5,             DYNA_BUF_IN1, DYNA_BUF_OUT1 },
+	{ DynamicFunc__crypt_md5_in1_to_out2, DYNA_BUF_IN1, DYNA_BUF_OUT2 },
+	{ DynamicFunc__crypt2_md5,            DYNA_BUF_IN2, DYNA_BUF_OUT2 },
+	{ DynamicFunc__crypt_md5_in2_to_out1, DYNA_BUF_IN2, DYNA_BUF_OUT1 },
+	// LargeHash puts the base16 straight into the other input
+	{ DynamicFunc__MD5_crypt_input1_append_input2,        DYNA_BUF_IN1, DYNA_BUF_IN2 },
+	{ DynamicFunc__MD5_crypt_input1_append_input2_base16, DYNA_BUF_IN1, DYNA_BUF_IN2 },
+	{ DynamicFunc__MD5_crypt_input2_append_input1,        DYNA_BUF_IN2, DYNA_BUF_IN1 },
+	{ DynamicFunc__MD5_crypt_input2_append_input1_base16, DYNA_BUF_IN2, DYNA_BUF_IN1 },
+	{ NULL, 0, 0 }
+};
+
+static struct {
+	DYNAMIC_primitive_funcp func;
+	int out, in;
+} dynamic_Base16_Appends[] = {
+	{ DynamicFunc__append_from_last_output_as_base16,           DYNA_BUF_OUT1, DYNA_BUF_IN1 },
+	{ DynamicFunc__append_from_last_output_to_input2_as_base16, DYNA_BUF_OUT1, DYNA_BUF_IN2 },
+	{ DynamicFunc__append_from_last_output2_as_base16,          DYNA_BUF_OUT2, DYNA_BUF_IN2 },
+	{ DynamicFunc__append_from_last_output2_to_input1_as_base16, DYNA_BUF_OUT2, DYNA_BUF_IN1 },
+	{ NULL, 0, 0 }
+};
+
+static int dynamic_Is_Salt_Func(DYNAMIC_primitive_funcp p) {
+	return p == DynamicFunc__append_salt || p == DynamicFunc__append_salt2 ||
+	       p == DynamicFunc__overwrite_salt_to_input1_no_size_fix ||
+	       p == DynamicFunc__overwrite_salt_to_input2_no_size_fix;
+}
+
+// returns the input buffer the base16 of output 'out' is appended to, or 0
+static int dynamic_Base16_Append_To(DYNAMIC_primitive_funcp p, int out) {
+	int i;
+	for (i = 0; dynamic_Base16_Appends[i].func; ++i)
+		if (dynamic_Base16_Appends[i].func == p && dynamic_Base16_Appends[i].out == out)
+			return dynamic_Base16_Appends[i].in;
+	return 0;
+}
+
+#define SALT_APPEND(in) ((in) == DYNA_BUF_IN1 ? DynamicFunc__append_salt : DynamicFunc__append_salt2)
+
+// Looks for [clean inputN, append_saltN, md5 of inputN] in the script, and if
+// that is the only use of the salt, rewrites the script to use the salt as hex.
+static void dynamic_Compile_Salt_Hex(DYNAMIC_Setup *Setup) {
+	DYNAMIC_primitive_funcp *f = curdat.dynamic_FUNCTIONS, *nf;
+	int i, j, k, n, in = 0, out = 0, stop, uses = 0;
+
+	if (!f || (Setup->flags&MGF_SALTED) == 0 || curdat.dynamic_salt_as_hex ||
+	    curdat.b2Salts || curdat.nUserName || curdat.FldMask ||
+	    curdat.dynamic_hdaa_salt || curdat.dynamic_base16_upcase)
+		return;
+
+	for (i = 0; f[i] && f[i+1] && f[i+2]; ++i) {
+		if (f[i+1] == DynamicFunc__append_salt &&
+		    (f[i] == DynamicFunc__clean_input || f[i] == DynamicFunc__clean_input_kwik || f[i] == DynamicFunc__clean_input_full))
+			in = DYNA_BUF_IN1;
+		else if (f[i+1] == DynamicFunc__append_salt2 &&
+		    (f[i] == DynamicFunc__clean_input2 || f[i] == DynamicFunc__clean_input2_kwik || f[i] == DynamicFunc__clean_input2_full))
+			in = DYNA_BUF_IN2;
+		else
+			continue;
+		for (k = 0; dynamic_Salt_Crypts[k].func; ++k)
+			if (dynamic_Salt_Crypts[k].func == f[i+2] && dynamic_Salt_Crypts[k].in == in)
+				out = dynamic_Salt_Crypts[k].out;
+		if (out)
+			break;
+	}
+	if (!out)
+		return;
+
+	// Nothing else may use the raw salt, and we must know what every step does.
+	for (j = 0; f[j]; ++j) {
+		if (j >= i && j < i+3)
+			continue;
+		if (!dynamic_Find_Func_Use(f[j])->func || dynamic_Is_Salt_Func(f[j]))
+			return;
+	}
+	// The input the salt was built in must be fully cleaned before its next use.
+	for (j = i+3; f[j]; ++j) {
+		DYNAMIC_Func_Use *u = dynamic_Find_Func_Use(f[j]);
+		if (!(u->bufs&in))
+			continue;
+		if (u->flags&DYNA_USE_CLEAN)
+			break;
+		return;
+	}
+	// For an md5 left in an output buffer, everything that reads it before it
+	// is overwritten must be a base16 append (which becomes a salt append).
+	stop = i+3;
+	if (out&(DYNA_BUF_OUT1|DYNA_BUF_OUT2)) {
+		for (; f[stop]; ++stop) {
+			DYNAMIC_Func_Use *u = dynamic_Find_Func_Use(f[stop]);
+			if (dynamic_Base16_Append_To(f[stop], out)) {
+				++uses;
+				continue;
+			}
+			if (!(u->bufs&out))
+				continue;
+			if (u->flags&DYNA_USE_HASH)
+				break;
+			return;
+		}
+		if (!uses || !f[stop])
+			return;
+	}
+
+	for (n = 0; f[n]; ++n)
+		;
+	nf = mem_alloc_tiny((n+1)*sizeof(DYNAMIC_primitive_funcp), MEM_ALIGN_WORD);
+	for (j = k = 0; j < n; ++j) {
+		if (j == i+2 && !(out&(DYNA_BUF_OUT1|DYNA_BUF_OUT2)))
+			nf[k++] = SALT_APPEND(out);
+		else if (j >= i && j < i+3)
+			continue;
+		else if (j < stop && dynamic_Base16_Append_To(f[j], out))
+			nf[k++] = SALT_APPEND(dynamic_Base16_Append_To(f[j], out));
+		else
+			nf[k++] = f[j];
+	}
+	nf[k] = NULL;
+	curdat.dynamic_FUNCTIONS = nf;
+	curdat.dynamic_salt_as_hex = 1;
+}
+
 // XXX fix me at some point!
 ATTRIBUTE_NO_ADDRESS_SAFETY_ANALYSIS
 int dynamic_SETUP(DYNAMIC_Setup *Setup, struct fmt_main *pFmt)
@@ -6987,7 +7848,7 @@ int dynamic_SETUP(DYNAMIC_Setup *Setup, struct fmt_main *pFmt)
 		pFmt->params.algorithm_name = "64/64 " SSE_type " 96x2";
 		pFmt->params.max_keys_per_crypt = 96*2;
 #elif defined (MD5_SSE_PARA)
-		pFmt->params.algorithm_name = "128/128 " SSE_type " 96x4x" STRINGIZE(MD5_SSE_PARA);
+		pFmt->params.algorithm_name = SIMD_WIDTH_STR " " SSE_type " 96x4x" STRINGIZE(MD5_SSE_PARA);
 		pFmt->params.max_keys_per_crypt = 96*MD5_SSE_PARA;
 #else
 		pFmt->params.algorithm_name = "128/128 " SSE_type " 96x4";
@@ -7007,7 +7868,7 @@ int dynamic_SETUP(DYNAMIC_Setup *Setup, struct fmt_main *pFmt)
 		pFmt->params.algorithm_name = "64/64 " SSE_type " 8x2";
 		pFmt->params.max_keys_per_crypt = 16;
 #elif defined (MD5_SSE_PARA)
-		pFmt->params.algorithm_name = "128/128 " SSE_type " 4x4x" STRINGIZE(MD5_SSE_PARA);
+		pFmt->params.algorithm_name = SIMD_WIDTH_STR " " SSE_type " 4x4x" STRINGIZE(MD5_SSE_PARA);
 		pFmt->params.max_keys_per_crypt = 16*MD5_SSE_PARA;
 #else
 		pFmt->params.algorithm_name = "128/128 " SSE_type " 4x4";
@@ -7209,6 +8070,12 @@ int dynamic_SETUP(DYNAMIC_Setup *Setup, struct fmt_main *pFmt)
 			}
 		}
 		curdat.dynamic_FUNCTIONS[j] = NULL;
+		dynamic_Compile_Salt_Hex(Setup);
+		dynamic_Compile_Key_Prologue(Setup);
+#ifdef DYNA_FUSED
+		curdat.dynamic_FUSED = dynamic_Compile_Fused(curdat.dynamic_FUNCTIONS);
+		curdat.dynamic_KEY_FUSED = dynamic_Compile_Fused(curdat.dynamic_KEY_FUNCTIONS);
+#endif
 	}
 	if (!Setup->pPreloads || Setup->pPreloads[0].ciphertext == NULL)
 	{
@@ -7422,6 +8289,7 @@ static void dynamic_RESET(struct fmt_main *fmt)
 	memset(&curdat, 0, sizeof(curdat));
 	m_count = 0;
 	keys_dirty = 0;
+	key_snap_count = 0;
 	cursalt=cursalt2=username=0;
 	saltlen=saltlen2=usernamelen=0;
 	// make 'sure' we startout with blank inputs.
@@ -1555,7 +1555,7 @@ static DYNAMIC_primitive_funcp _Funcs_70[] =
 {
 	//MGF_KEYS_INPUT
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__SHA384_crypt_input1_to_output1_FINAL,
 	NULL
 };
@@ -1573,7 +1573,7 @@ static DYNAMIC_primitive_funcp _Funcs_71[] =
 {
 	//MGF_INPUT_48_BYTE
 	//MGF_SALTED
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__clean_input,
 	DynamicFunc__append_salt,
 	DynamicFunc__append_keys,
@@ -1594,7 +1594,7 @@ static DYNAMIC_primitive_funcp _Funcs_72[] =
 {
 	//MGF_INPUT_48_BYTE
 	//MGF_SALTED
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__clean_input,
 	DynamicFunc__append_keys,
 	DynamicFunc__append_salt,
@@ -1613,7 +1613,7 @@ MTL({"$dynamic_72$1335f3a1f6ab2377626104b8d44240cda5007038649c213123f9396da561bd
 static DYNAMIC_primitive_funcp _Funcs_73[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 
 	//DynamicFunc__clean_input2,
@@ -1636,7 +1636,7 @@ MTL({"$dynamic_73$9e189929de1bcb799b5f7e05a22519802ec5c8f7a9b7bfba8a2595ed60b9c9
 static DYNAMIC_primitive_funcp _Funcs_74[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__LargeHash_OUTMode_raw,
 	DynamicFunc__SHA384_crypt_input1_overwrite_input2,
@@ -1656,7 +1656,7 @@ MTL({"$dynamic_74$53b669f5196c753fa5d5a4f47ef29ef51187282ecd9cf66a46a84e3069d456
 static DYNAMIC_primitive_funcp _Funcs_75[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__SHA384_crypt_input1_overwrite_input2,
@@ -1677,7 +1677,7 @@ MTL({"$dynamic_75$e426d3a4379f33151256f4cd6f599b548ccf48db6863b286827ff6bb30a7d8
 static DYNAMIC_primitive_funcp _Funcs_76[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2,
@@ -1699,7 +1699,7 @@ MTL({"$dynamic_76$a977ec504a3ca5263fcc89755e4f9c5c1789ac7f86db1e8b89078882ccdef6
 static DYNAMIC_primitive_funcp _Funcs_77[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2,
@@ -1722,7 +1722,7 @@ MTL({"$dynamic_77$85d10001dfa0bf76ebe23c11fdd423ba166f5974fdec7ba1cac2b8bb13e7df
 static DYNAMIC_primitive_funcp _Funcs_78[] =
 {
 	//MGF_INPUT_48_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2_kwik,
 	DynamicFunc__SHA384_crypt_input1_append_input2,
@@ -1744,7 +1744,7 @@ static DYNAMIC_primitive_funcp _Funcs_80[] =
 {
 	//MGF_KEYS_INPUT
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__SHA512_crypt_input1_to_output1_FINAL,
 	NULL
 };
@@ -1762,7 +1762,7 @@ static DYNAMIC_primitive_funcp _Funcs_81[] =
 {
 	//MGF_INPUT_64_BYTE
 	//MGF_SALTED
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__clean_input,
 	DynamicFunc__append_salt,
 	DynamicFunc__append_keys,
@@ -1783,7 +1783,7 @@ static DYNAMIC_primitive_funcp _Funcs_82[] =
 {
 	//MGF_INPUT_64_BYTE
 	//MGF_SALTED
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	DynamicFunc__clean_input,
 	DynamicFunc__append_keys,
 	DynamicFunc__append_salt,
@@ -1802,7 +1802,7 @@ MTL({"$dynamic_82$767b68910d853970a83200bec78ad8c45cf2ba8d2a6d3cb73c4c12c95c3dc6
 static DYNAMIC_primitive_funcp _Funcs_83[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 
 	//DynamicFunc__clean_input2,
@@ -1825,7 +1825,7 @@ MTL({"$dynamic_83$d531d9558d29f908dfa18fc9e4ed266e7e976b57af87fe6aa1e3a0e2922afe
 static DYNAMIC_primitive_funcp _Funcs_84[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__LargeHash_OUTMode_raw,
 	DynamicFunc__SHA512_crypt_input1_overwrite_input2,
@@ -1845,7 +1845,7 @@ MTL({"$dynamic_84$592419e9c5b56f1aee6cc03e5c5a3ea7bae17f71e42a67f584424798db45e6
 static DYNAMIC_primitive_funcp _Funcs_85[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__SHA512_crypt_input1_overwrite_input2,
@@ -1866,7 +1866,7 @@ MTL({"$dynamic_85$6502c0e21305cfff28829a3bdbab3fc1d82b516f7bf1a06b40dffdbd8bac88
 static DYNAMIC_primitive_funcp _Funcs_86[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2,
@@ -1888,7 +1888,7 @@ MTL({"$dynamic_86$aba2ed0a61430a2eb16edc25630163f1ca217005947a120985451290f30a05
 static DYNAMIC_primitive_funcp _Funcs_87[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_SALTED
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2,
@@ -1911,7 +1911,7 @@ MTL({"$dynamic_87$be992a7f9fe520e366936f8755cc433cb0a67d0fea233ac8b14b8819e93a6d
 static DYNAMIC_primitive_funcp _Funcs_88[] =
 {
 	//MGF_INPUT_64_BYTE
-	//MGF_NOTSSE2Safe
+	//MGF_FLAT_BUFFERS
 	//MGF_KEYS_IN_INPUT
 	DynamicFunc__clean_input2_kwik,
 	DynamicFunc__SHA512_crypt_input1_append_input2,
@@ -3334,25 +3334,25 @@ static DYNAMIC_Setup Setups[] =
 	{ "dynamic_67: sha256(sha256($s).sha256($p))",_Funcs_67,_Preloads_67,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_32_BYTE, -20 },
 	{ "dynamic_68: sha256(sha256($p).sha256($p))",_Funcs_68,_Preloads_68,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_32_BYTE },
 	// Try to group sha384 here (from dyna-70 to dyna-79)
-	{ "dynamic_70: sha384($p)",                  _Funcs_70,_Preloads_70,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
-	{ "dynamic_71: sha384($s.$p)",               _Funcs_71,_Preloads_71,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_INPUT_48_BYTE, -20 },
-	{ "dynamic_72: sha384($p.$s)",               _Funcs_72,_Preloads_72,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_INPUT_48_BYTE, -20 },
-	{ "dynamic_73: sha384(sha384($p))",          _Funcs_73,_Preloads_73,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
-	{ "dynamic_74: sha384(sha384_raw($p))",      _Funcs_74,_Preloads_74,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
-	{ "dynamic_75: sha384(sha384($p).$s)",       _Funcs_75,_Preloads_75,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
-	{ "dynamic_76: sha384($s.sha384($p))",       _Funcs_76,_Preloads_76,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
-	{ "dynamic_77: sha384(sha384($s).sha384($p))",_Funcs_77,_Preloads_77,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
-	{ "dynamic_78: sha384(sha384($p).sha384($p))",_Funcs_78,_Preloads_78,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
+	{ "dynamic_70: sha384($p)",                  _Funcs_70,_Preloads_70,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
+	{ "dynamic_71: sha384($s.$p)",               _Funcs_71,_Preloads_71,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_INPUT_48_BYTE, -20 },
+	{ "dynamic_72: sha384($p.$s)",               _Funcs_72,_Preloads_72,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_INPUT_48_BYTE, -20 },
+	{ "dynamic_73: sha384(sha384($p))",          _Funcs_73,_Preloads_73,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
+	{ "dynamic_74: sha384(sha384_raw($p))",      _Funcs_74,_Preloads_74,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
+	{ "dynamic_75: sha384(sha384($p).$s)",       _Funcs_75,_Preloads_75,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
+	{ "dynamic_76: sha384($s.sha384($p))",       _Funcs_76,_Preloads_76,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
+	{ "dynamic_77: sha384(sha384($s).sha384($p))",_Funcs_77,_Preloads_77,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE, -20 },
+	{ "dynamic_78: sha384(sha384($p).sha384($p))",_Funcs_78,_Preloads_78,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_48_BYTE },
 	// Try to group sha512 here (from dyna-80 to dyna-89)
-	{ "dynamic_80: sha512($p)",                  _Funcs_80,_Preloads_80,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
-	{ "dynamic_81: sha512($s.$p)",               _Funcs_81,_Preloads_81,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_INPUT_64_BYTE, -20 },
-	{ "dynamic_82: sha512($p.$s)",               _Funcs_82,_Preloads_82,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_INPUT_64_BYTE, -20 },
-	{ "dynamic_83: sha512(sha512($p))",          _Funcs_83,_Preloads_83,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
-	{ "dynamic_84: sha512(sha512_raw($p))",      _Funcs_84,_Preloads_84,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
-	{ "dynamic_85: sha512(sha512($p).$s)",       _Funcs_85,_Preloads_85,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
-	{ "dynamic_86: sha512($s.sha512($p))",       _Funcs_86,_Preloads_86,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
-	{ "dynamic_87: sha512(sha512($s).sha512($p))",_Funcs_87,_Preloads_87,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
-	{ "dynamic_88: sha512(sha512($p).sha512($p))",_Funcs_88,_Preloads_88,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
+	{ "dynamic_80: sha512($p)",                  _Funcs_80,_Preloads_80,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
+	{ "dynamic_81: sha512($s.$p)",               _Funcs_81,_Preloads_81,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_INPUT_64_BYTE, -20 },
+	{ "dynamic_82: sha512($p.$s)",               _Funcs_82,_Preloads_82,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_INPUT_64_BYTE, -20 },
+	{ "dynamic_83: sha512(sha512($p))",          _Funcs_83,_Preloads_83,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
+	{ "dynamic_84: sha512(sha512_raw($p))",      _Funcs_84,_Preloads_84,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
+	{ "dynamic_85: sha512(sha512($p).$s)",       _Funcs_85,_Preloads_85,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
+	{ "dynamic_86: sha512($s.sha512($p))",       _Funcs_86,_Preloads_86,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
+	{ "dynamic_87: sha512(sha512($s).sha512($p))",_Funcs_87,_Preloads_87,_ConstDefault, MGF_SALTED|MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE, -20 },
+	{ "dynamic_88: sha512(sha512($p).sha512($p))",_Funcs_88,_Preloads_88,_ConstDefault, MGF_FLAT_BUFFERS, MGF_KEYS_INPUT|MGF_INPUT_64_BYTE },
 	// Try to group GOST here (from dyna-90 to dyna-99)
 	{ "dynamic_90: GOST($p)",                    _Funcs_90,_Preloads_90,_ConstDefault, MGF_NOTSSE2Safe, MGF_KEYS_INPUT|MGF_INPUT_32_BYTE },
 	{ "dynamic_91: GOST($s.$p)",                 _Funcs_91,_Preloads_91,_ConstDefault, MGF_SALTED|MGF_NOTSSE2Safe, MGF_INPUT_32_BYTE, -20 },
@@ -135,6 +135,15 @@ typedef struct private_subformat_data
 	int dynamic_SALT_OFFSET;
 	int dynamic_HASH_OFFSET;
 	DYNAMIC_primitive_funcp *dynamic_FUNCTIONS;
+	// key-only start of the script, run once per set of keys rather than once
+	// per salt (NULL if the format has none).  dynamic_KEY_RESTORE is the mask
+	// of buffers put back from its snapshot before each of the later salts.
+	DYNAMIC_primitive_funcp *dynamic_KEY_FUNCTIONS;
+	int dynamic_KEY_RESTORE;
+	// the two scripts above compiled into fused SSE steps (NULL if they use
+	// anything the fused code does not handle).  See dynamic_Compile_Fused().
+	struct DYNAMIC_Fused_Op *dynamic_FUSED;
+	struct DYNAMIC_Fused_Op *dynamic_KEY_FUSED;
 	DYNAMIC_Setup *pSetup;
 	struct fmt_main *pFmtMain;
 
@@ -197,19 +206,19 @@ typedef struct private_subformat_data
 # define LOOP_STR
 # if MMX_COEF == 4
 #  ifdef MD5_SSE_PARA
-#   define ALGORITHM_NAME		"128/128 " MD5_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD5_SSE_PARA)
+#   define ALGORITHM_NAME		SIMD_WIDTH_STR " " MD5_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD5_SSE_PARA)
 #   define BSD_BLKS (MD5_SSE_PARA)
 #  else
 #   define ALGORITHM_NAME		"128/128 " MD5_SSE_type  " " STRINGIZE(BY_X) "x4"
 #   define BSD_BLKS 1
 #  endif
 #  ifdef SHA1_SSE_PARA
-#   define ALGORITHM_NAME_S		"128/128 " SHA1_SSE_type " " STRINGIZE(BY_X) "x4x" STRINGIZE(SHA1_SSE_PARA)
+#   define ALGORITHM_NAME_S		SIMD_WIDTH_STR " " SHA1_SSE_type " " STRINGIZE(BY_X) "x4x" STRINGIZE(SHA1_SSE_PARA)
 #  else
 #   define ALGORITHM_NAME_S		"128/128 " SHA1_SSE_type " " STRINGIZE(BY_X) "x4"
 #  endif
 #  ifdef MD4_SSE_PARA
-#   define ALGORITHM_NAME_4		"128/128 " MD4_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD4_SSE_PARA)
+#   define ALGORITHM_NAME_4		SIMD_WIDTH_STR " " MD4_SSE_type  " " STRINGIZE(BY_X) "x4x" STRINGIZE(MD4_SSE_PARA)
 #  else
 #   define ALGORITHM_NAME_4		"128/128 " MD4_SSE_type  " " STRINGIZE(BY_X) "x4"
 #  endif
@@ -243,8 +252,8 @@ typedef struct private_subformat_data
 #define ALGORITHM_NAME_X86_S	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1"
 #define ALGORITHM_NAME_X86_4	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1"
 
-#define ALGORITHM_NAME_S2_256		"128/128 "CPU_NAME" 4x"
-#define ALGORITHM_NAME_S2_512		"128/128 "CPU_NAME" 2x"
+#define ALGORITHM_NAME_S2_256		SHA2_WIDTH_STR" "CPU_NAME" "STRINGIZE(MMX_COEF_SHA256)"x"
+#define ALGORITHM_NAME_S2_512		SHA2_WIDTH_STR" "CPU_NAME" "STRINGIZE(MMX_COEF_SHA512)"x"
 #if defined (COMMON_DIGEST_FOR_OPENSSL)
 #define ALGORITHM_NAME_X86_S2_256	ARCH_BITS_STR"/"ARCH_BITS_STR" "STRINGIZE(X86_BLOCK_LOOPS) "x1 CommonCrypto"
 #define ALGORITHM_NAME_X86_S2_512	ARCH_BITS_STR"/64 "STRINGIZE(X86_BLOCK_LOOPS) "x1 CommonCrypto"
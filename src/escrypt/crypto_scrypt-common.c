@@ -102,18 +102,11 @@ static const uint8_t * decode64_uint32(uint32_t * dst, uint32_t dstbits,
 	return src;
 }
 
-uint8_t *
-escrypt_r(escrypt_local_t * local,
-    const uint8_t * passwd, size_t passwdlen,
-    const uint8_t * setting,
-    uint8_t * buf, size_t buflen)
+static const uint8_t *
+decode_setting(const uint8_t * setting, uint64_t * N, uint32_t * r,
+    uint32_t * p, const uint8_t ** salt, size_t * saltlen)
 {
-	uint8_t hash[HASH_SIZE];
-	const uint8_t * src, * salt;
-	uint8_t * dst;
-	size_t prefixlen, saltlen, need;
-	uint64_t N;
-	uint32_t r, p;
+	const uint8_t * src;
 
 	if (setting[0] != '$' || setting[1] != '7' || setting[2] != '$')
 		return NULL;
@@ -124,40 +117,39 @@ escrypt_r(escrypt_local_t * local,
 		if (decode64_one(&N_log2, *src))
 			return NULL;
 		src++;
-		N = (uint64_t)1 << N_log2;
+		*N = (uint64_t)1 << N_log2;
 	}
 
-	src = decode64_uint32(&r, 30, src);
+	src = decode64_uint32(r, 30, src);
 	if (!src)
 		return NULL;
 
-	src = decode64_uint32(&p, 30, src);
+	src = decode64_uint32(p, 30, src);
 	if (!src)
 		return NULL;
 
-	prefixlen = src - setting;
-
-	salt = src;
-	src = (uint8_t *)strrchr((char *)salt, '$');
+	*salt = src;
+	src = (uint8_t *)strrchr((char *)*salt, '$');
 	if (src)
-		saltlen = src - salt;
+		*saltlen = src - *salt;
 	else
-		saltlen = strlen((char *)salt);
+		*saltlen = strlen((char *)*salt);
 
-	need = prefixlen + saltlen + 1 + HASH_LEN + 1;
-	if (need > buflen || need < saltlen)
-		return NULL;
+	return *salt;
+}
 
-	if (escrypt_kdf(local, passwd, passwdlen, salt, saltlen,
-	    N, r, p, hash, sizeof(hash)))
-		return NULL;
+static uint8_t *
+encode_result(const uint8_t * setting, size_t settinglen,
+    const uint8_t * hash, uint8_t * buf, size_t buflen)
+{
+	uint8_t * dst;
 
 	dst = buf;
-	memcpy(dst, setting, prefixlen + saltlen);
-	dst += prefixlen + saltlen;
+	memcpy(dst, setting, settinglen);
+	dst += settinglen;
 	*dst++ = '$';
 
-	dst = encode64(dst, buflen - (dst - buf), hash, sizeof(hash));
+	dst = encode64(dst, buflen - (dst - buf), hash, HASH_SIZE);
 	/* Could zeroize hash[] here, but escrypt_kdf() doesn't zeroize its
 	 * memory allocations yet anyway. */
 	if (!dst || dst >= buf + buflen) /* Can't happen */
@@ -168,6 +160,82 @@ escrypt_r(escrypt_local_t * local,
 	return buf;
 }
 
+uint8_t *
+escrypt_r(escrypt_local_t * local,
+    const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * setting,
+    uint8_t * buf, size_t buflen)
+{
+	uint8_t hash[HASH_SIZE];
+	const uint8_t * salt;
+	size_t prefixlen, saltlen, need;
+	uint64_t N;
+	uint32_t r, p;
+
+	if (!decode_setting(setting, &N, &r, &p, &salt, &saltlen))
+		return NULL;
+	prefixlen = salt - setting;
+
+	need = prefixlen + saltlen + 1 + HASH_LEN + 1;
+	if (need > buflen || need < saltlen)
+		return NULL;
+
+	if (escrypt_kdf(local, passwd, passwdlen, salt, saltlen,
+	    N, r, p, hash, sizeof(hash)))
+		return NULL;
+
+	return encode_result(setting, prefixlen + saltlen, hash, buf, buflen);
+}
+
+#if ESCRYPT_LANES > 1
+/**
+ * escrypt_r_multi(local, count, passwd, passwdlen, setting, buf, buflen):
+ * Like escrypt_r(), but for count <= ESCRYPT_LANES passwords sharing one
+ * setting, computed together.  Each buf[i] must be buflen bytes long.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+escrypt_r_multi(escrypt_local_t * local, unsigned int count,
+    const uint8_t * const * passwd, const size_t * passwdlen,
+    const uint8_t * setting,
+    uint8_t * const * buf, size_t buflen)
+{
+	uint8_t hash[ESCRYPT_LANES][HASH_SIZE];
+	uint8_t * hashp[ESCRYPT_LANES];
+	const uint8_t * salt;
+	size_t prefixlen, saltlen, need;
+	uint64_t N;
+	uint32_t r, p;
+	unsigned int i;
+
+	if (!count || count > ESCRYPT_LANES)
+		return -1;
+
+	if (!decode_setting(setting, &N, &r, &p, &salt, &saltlen))
+		return -1;
+	prefixlen = salt - setting;
+
+	need = prefixlen + saltlen + 1 + HASH_LEN + 1;
+	if (need > buflen || need < saltlen)
+		return -1;
+
+	for (i = 0; i < count; i++)
+		hashp[i] = hash[i];
+
+	if (escrypt_kdf_multi(local, count, passwd, passwdlen, salt, saltlen,
+	    N, r, p, hashp, HASH_SIZE))
+		return -1;
+
+	for (i = 0; i < count; i++)
+		if (!encode_result(setting, prefixlen + saltlen, hash[i],
+		    buf[i], buflen))
+			return -1;
+
+	return 0;
+}
+#endif
+
 uint8_t *
 escrypt(const uint8_t * passwd, const uint8_t * setting)
 {
@@ -32,6 +32,9 @@
 #ifdef __XOP__
 #include <x86intrin.h>
 #endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include <errno.h>
 #include <stdint.h>
@@ -293,28 +296,13 @@ smix(uint8_t * B, size_t r, uint32_t N, void * V, void * XY)
 }
 
 /**
- * escrypt_kdf(local, passwd, passwdlen, salt, saltlen,
- *     N, r, p, buf, buflen):
- * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
- * p, buflen) and write the result into buf.  The parameters r, p, and buflen
- * must satisfy r * p < 2^30 and buflen <= (2^32 - 1) * 32.  The parameter N
- * must be a power of 2 greater than 1.
- *
- * Return 0 on success; or -1 on error.
+ * check_params(N, r, p, buflen):
+ * Return 0 if the parameters are acceptable to escrypt_kdf(); or -1 with
+ * errno set otherwise.
  */
-int
-escrypt_kdf(escrypt_local_t * local,
-    const uint8_t * passwd, size_t passwdlen,
-    const uint8_t * salt, size_t saltlen,
-    uint64_t N, uint32_t r, uint32_t p,
-    uint8_t * buf, size_t buflen)
+static int
+check_params(uint64_t N, uint32_t r, uint32_t p, size_t buflen)
 {
-	size_t B_size, V_size, XY_size, need;
-	uint8_t * B;
-	uint32_t * V, * XY;
-	uint32_t i;
-
-	/* Sanity-check parameters. */
 #if SIZE_MAX > UINT32_MAX
 	if (buflen > (((uint64_t)(1) << 32) - 1) * 32) {
 		errno = EFBIG;
@@ -341,6 +329,34 @@ escrypt_kdf(escrypt_local_t * local,
 		errno = ENOMEM;
 		return -1;
 	}
+	return 0;
+}
+
+/**
+ * escrypt_kdf(local, passwd, passwdlen, salt, saltlen,
+ *     N, r, p, buf, buflen):
+ * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
+ * p, buflen) and write the result into buf.  The parameters r, p, and buflen
+ * must satisfy r * p < 2^30 and buflen <= (2^32 - 1) * 32.  The parameter N
+ * must be a power of 2 greater than 1.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+escrypt_kdf(escrypt_local_t * local,
+    const uint8_t * passwd, size_t passwdlen,
+    const uint8_t * salt, size_t saltlen,
+    uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * buf, size_t buflen)
+{
+	size_t B_size, V_size, XY_size, need;
+	uint8_t * B;
+	uint32_t * V, * XY;
+	uint32_t i;
+
+	/* Sanity-check parameters. */
+	if (check_params(N, r, p, buflen))
+		return -1;
 
 	/* Allocate memory. */
 	B_size = (size_t)128 * r * p;
@@ -381,3 +397,322 @@ escrypt_kdf(escrypt_local_t * local,
 	/* Success! */
 	return 0;
 }
+
+#if ESCRYPT_LANES > 1
+/*
+ * Multi-lane SMix: ESCRYPT_LANES independent SMix computations, each one in
+ * its own 128-bit lane of the vectors below, laid out within the lane exactly
+ * as smix() lays out its single computation in an __m128i.  V and XY are
+ * interleaved by lane, so the first loop writes whole vectors; the second
+ * loop's V_j reads are assembled from each lane's own j.  Besides doing more
+ * work per instruction, this overlaps the lanes' dependency chains and their
+ * random accesses to V.
+ */
+#if ESCRYPT_LANES == 4
+typedef __m512i lanes_t;
+#define LXOR(a, b)	_mm512_xor_si512((a), (b))
+#define LADD(a, b)	_mm512_add_epi32((a), (b))
+#define LROL(a, s)	_mm512_rol_epi32((a), (s))
+#define LSHUF(a, imm)	_mm512_shuffle_epi32((a), (_MM_PERM_ENUM)(imm))
+#define LGATHER(Vj, q) \
+	_mm512_inserti32x4(_mm512_inserti32x4(_mm512_inserti32x4( \
+	    _mm512_castsi128_si512((Vj)[0][(q) * 4]), \
+	    (Vj)[1][(q) * 4], 1), (Vj)[2][(q) * 4], 2), (Vj)[3][(q) * 4], 3)
+#define LSTORE(p, a)	_mm512_store_si512((void *)(p), (a))
+#else
+typedef __m256i lanes_t;
+#define LXOR(a, b)	_mm256_xor_si256((a), (b))
+#define LADD(a, b)	_mm256_add_epi32((a), (b))
+#define LROL(a, s) \
+	_mm256_or_si256(_mm256_slli_epi32((a), (s)), \
+	    _mm256_srli_epi32((a), 32 - (s)))
+#define LSHUF(a, imm)	_mm256_shuffle_epi32((a), (imm))
+#define LGATHER(Vj, q) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256((Vj)[0][(q) * 2]), \
+	    (Vj)[1][(q) * 2], 1)
+#define LSTORE(p, a)	_mm256_store_si256((lanes_t *)(p), (a))
+#endif
+
+#define ARX(out, in1, in2, s) \
+	out = LXOR(out, LROL(LADD(in1, in2), s));
+
+#define SALSA20_2ROUNDS \
+	/* Operate on "columns". */ \
+	ARX(X1, X0, X3, 7) \
+	ARX(X2, X1, X0, 9) \
+	ARX(X3, X2, X1, 13) \
+	ARX(X0, X3, X2, 18) \
+\
+	/* Rearrange data. */ \
+	X1 = LSHUF(X1, 0x93); \
+	X2 = LSHUF(X2, 0x4E); \
+	X3 = LSHUF(X3, 0x39); \
+\
+	/* Operate on "rows". */ \
+	ARX(X3, X0, X1, 7) \
+	ARX(X2, X3, X0, 9) \
+	ARX(X1, X2, X3, 13) \
+	ARX(X0, X1, X2, 18) \
+\
+	/* Rearrange data. */ \
+	X1 = LSHUF(X1, 0x39); \
+	X2 = LSHUF(X2, 0x4E); \
+	X3 = LSHUF(X3, 0x93);
+
+#define SALSA20_8_XOR(in, out) \
+	{ \
+		lanes_t Y0 = X0 = LXOR(X0, (in)[0]); \
+		lanes_t Y1 = X1 = LXOR(X1, (in)[1]); \
+		lanes_t Y2 = X2 = LXOR(X2, (in)[2]); \
+		lanes_t Y3 = X3 = LXOR(X3, (in)[3]); \
+		SALSA20_2ROUNDS \
+		SALSA20_2ROUNDS \
+		SALSA20_2ROUNDS \
+		SALSA20_2ROUNDS \
+		(out)[0] = X0 = LADD(X0, Y0); \
+		(out)[1] = X1 = LADD(X1, Y1); \
+		(out)[2] = X2 = LADD(X2, Y2); \
+		(out)[3] = X3 = LADD(X3, Y3); \
+	}
+
+static inline void
+blockmix_salsa8_lanes(const lanes_t * Bin, lanes_t * Bout, size_t r)
+{
+	lanes_t X0, X1, X2, X3;
+	size_t i;
+
+	X0 = Bin[8 * r - 4];
+	X1 = Bin[8 * r - 3];
+	X2 = Bin[8 * r - 2];
+	X3 = Bin[8 * r - 1];
+
+	SALSA20_8_XOR(Bin, Bout)
+
+	r--;
+	for (i = 0; i < r;) {
+		SALSA20_8_XOR(&Bin[i * 8 + 4], &Bout[(r + i) * 4 + 4])
+
+		i++;
+
+		SALSA20_8_XOR(&Bin[i * 8], &Bout[i * 4])
+	}
+
+	SALSA20_8_XOR(&Bin[i * 8 + 4], &Bout[(r + i) * 4 + 4])
+}
+
+#define XOR4_GATHER(Bin1, Vj, q) \
+	X0 = LXOR(X0, (Bin1)[(q)]); \
+	X1 = LXOR(X1, (Bin1)[(q) + 1]); \
+	X2 = LXOR(X2, (Bin1)[(q) + 2]); \
+	X3 = LXOR(X3, (Bin1)[(q) + 3]); \
+	Z[0] = LGATHER(Vj, (q)); \
+	Z[1] = LGATHER(Vj, (q) + 1); \
+	Z[2] = LGATHER(Vj, (q) + 2); \
+	Z[3] = LGATHER(Vj, (q) + 3);
+
+/*
+ * Vj[lane] points to that lane's first 128 bits of V_j, with rows
+ * ESCRYPT_LANES __m128i's apart.  Returns each lane's Integerify(X) in j[].
+ */
+static inline void
+blockmix_salsa8_xor_lanes(const lanes_t * Bin1, __m128i * const * Vj,
+    lanes_t * Bout, size_t r, uint32_t * j)
+{
+	lanes_t X0, X1, X2, X3, Z[4];
+	uint32_t X32[ESCRYPT_LANES * 4] __attribute__ ((aligned (64)));
+	size_t i;
+	unsigned int l;
+
+	X0 = LXOR(Bin1[8 * r - 4], LGATHER(Vj, 8 * r - 4));
+	X1 = LXOR(Bin1[8 * r - 3], LGATHER(Vj, 8 * r - 3));
+	X2 = LXOR(Bin1[8 * r - 2], LGATHER(Vj, 8 * r - 2));
+	X3 = LXOR(Bin1[8 * r - 1], LGATHER(Vj, 8 * r - 1));
+
+	XOR4_GATHER(Bin1, Vj, 0)
+	SALSA20_8_XOR(Z, Bout)
+
+	r--;
+	for (i = 0; i < r;) {
+		XOR4_GATHER(Bin1, Vj, i * 8 + 4)
+		SALSA20_8_XOR(Z, &Bout[(r + i) * 4 + 4])
+
+		i++;
+
+		XOR4_GATHER(Bin1, Vj, i * 8)
+		SALSA20_8_XOR(Z, &Bout[i * 4])
+	}
+
+	XOR4_GATHER(Bin1, Vj, i * 8 + 4)
+	SALSA20_8_XOR(Z, &Bout[(r + i) * 4 + 4])
+
+	LSTORE(X32, X0);
+	for (l = 0; l < ESCRYPT_LANES; l++)
+		j[l] = X32[l * 4];
+}
+
+#undef ARX
+#undef SALSA20_2ROUNDS
+#undef SALSA20_8_XOR
+#undef XOR4_GATHER
+
+/**
+ * smix_lanes(B, r, N, V, XY):
+ * Compute B[l] = SMix_r(B[l], N) for each of the ESCRYPT_LANES lanes l.
+ * Each B[l] must be 128r bytes in length; V must be 128rN * ESCRYPT_LANES
+ * bytes and XY 256r * ESCRYPT_LANES bytes, both aligned to a multiple of 64.
+ */
+static void
+smix_lanes(uint8_t * const * B, size_t r, uint32_t N, lanes_t * V,
+    lanes_t * XY)
+{
+	size_t s = 8 * r;
+	lanes_t * X = V, * Y;
+	uint32_t * X32 = (uint32_t *)V;
+	__m128i * Vj[ESCRYPT_LANES];
+	uint32_t i, j[ESCRYPT_LANES];
+	unsigned int l;
+	size_t k;
+
+	/* 1: X <-- B */
+	/* 3: V_i <-- X */
+	for (l = 0; l < ESCRYPT_LANES; l++)
+	for (k = 0; k < 2 * r; k++) {
+		for (i = 0; i < 16; i++) {
+			X32[((k * 4 + i / 4) * ESCRYPT_LANES + l) * 4 + i % 4] =
+			    le32dec(&B[l][(k * 16 + (i * 5 % 16)) * 4]);
+		}
+	}
+
+	/* 2: for i = 0 to N - 1 do */
+	for (i = 1; i < N - 1; i += 2) {
+		Y = &V[i * s];
+		blockmix_salsa8_lanes(X, Y, r);
+
+		X = &V[(i + 1) * s];
+		blockmix_salsa8_lanes(Y, X, r);
+	}
+
+	Y = &V[i * s];
+	blockmix_salsa8_lanes(X, Y, r);
+
+	X = XY;
+	blockmix_salsa8_lanes(Y, X, r);
+
+	X32 = (uint32_t *)XY;
+	Y = &XY[s];
+
+	/* 7: j <-- Integerify(X) mod N */
+	for (l = 0; l < ESCRYPT_LANES; l++)
+		j[l] = X32[((2 * r - 1) * 4 * ESCRYPT_LANES + l) * 4] & (N - 1);
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i += 2) {
+		for (l = 0; l < ESCRYPT_LANES; l++) {
+			Vj[l] = (__m128i *)&V[j[l] * s] + l;
+		}
+		blockmix_salsa8_xor_lanes(X, Vj, Y, r, j);
+
+		for (l = 0; l < ESCRYPT_LANES; l++) {
+			j[l] &= N - 1;
+			Vj[l] = (__m128i *)&V[j[l] * s] + l;
+		}
+		blockmix_salsa8_xor_lanes(Y, Vj, X, r, j);
+		for (l = 0; l < ESCRYPT_LANES; l++)
+			j[l] &= N - 1;
+	}
+
+	/* 10: B' <-- X */
+	for (l = 0; l < ESCRYPT_LANES; l++)
+	for (k = 0; k < 2 * r; k++) {
+		for (i = 0; i < 16; i++) {
+			le32enc(&B[l][(k * 16 + (i * 5 % 16)) * 4],
+			    X32[((k * 4 + i / 4) * ESCRYPT_LANES + l) * 4 +
+			    i % 4]);
+		}
+	}
+}
+
+/**
+ * escrypt_kdf_multi(local, count, passwd, passwdlen, salt, saltlen,
+ *     N, r, p, buf, buflen):
+ * Compute scrypt(passwd[i], salt, N, r, p, buflen) into buf[i] for each i
+ * below count, count <= ESCRYPT_LANES, running the SMix computations of all
+ * passwords side by side.  Unused lanes repeat the last password.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int
+escrypt_kdf_multi(escrypt_local_t * local, unsigned int count,
+    const uint8_t * const * passwd, const size_t * passwdlen,
+    const uint8_t * salt, size_t saltlen,
+    uint64_t N, uint32_t r, uint32_t p,
+    uint8_t * const * buf, size_t buflen)
+{
+	size_t B_size, V_size, XY_size, need;
+	uint8_t * B[ESCRYPT_LANES], * Bi[ESCRYPT_LANES];
+	lanes_t * V, * XY;
+	unsigned int l;
+	uint32_t i;
+
+	if (!count || count > ESCRYPT_LANES) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Sanity-check parameters. */
+	if (check_params(N, r, p, buflen))
+		return -1;
+
+	/* Allocate memory. */
+	B_size = (size_t)128 * r * p;
+	V_size = (size_t)128 * r * N;
+	need = B_size + V_size;
+	if (need < V_size) {
+		errno = ENOMEM;
+		return -1;
+	}
+	XY_size = (size_t)256 * r;
+	need += XY_size;
+	if (need < XY_size || need > SIZE_MAX / ESCRYPT_LANES) {
+		errno = ENOMEM;
+		return -1;
+	}
+	need *= ESCRYPT_LANES;
+	if (local->size < need) {
+		if (free_region(local))
+			return -1;
+		if (!alloc_region(local, need))
+			return -1;
+	}
+	V = (lanes_t *)local->aligned;
+	XY = (lanes_t *)((uint8_t *)V + V_size * ESCRYPT_LANES);
+	B[0] = (uint8_t *)XY + XY_size * ESCRYPT_LANES;
+	for (l = 1; l < ESCRYPT_LANES; l++)
+		B[l] = B[l - 1] + B_size;
+
+	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
+	for (l = 0; l < ESCRYPT_LANES; l++) {
+		if (l < count)
+			PBKDF2_SHA256(passwd[l], passwdlen[l], salt, saltlen,
+			    1, B[l], B_size);
+		else
+			memcpy(B[l], B[count - 1], B_size);
+	}
+
+	/* 2: for i = 0 to p - 1 do */
+	for (i = 0; i < p; i++) {
+		/* 3: B_i <-- MF(B_i, N) */
+		for (l = 0; l < ESCRYPT_LANES; l++)
+			Bi[l] = &B[l][(size_t)128 * i * r];
+		smix_lanes(Bi, r, N, V, XY);
+	}
+
+	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
+	for (l = 0; l < count; l++)
+		PBKDF2_SHA256(passwd[l], passwdlen[l], B[l], B_size, 1,
+		    buf[l], buflen);
+
+	/* Success! */
+	return 0;
+}
+#endif
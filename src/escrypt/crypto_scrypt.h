@@ -53,6 +53,20 @@ typedef struct {
 
 typedef escrypt_region_t escrypt_local_t;
 
+/**
+ * ESCRYPT_LANES:
+ * Number of independent scrypt computations (same salt and parameters,
+ * different passwords) that escrypt_kdf_multi() interleaves in the 128-bit
+ * lanes of one set of SIMD registers.
+ */
+#if defined(__AVX512F__)
+#define ESCRYPT_LANES 4
+#elif defined(__AVX2__)
+#define ESCRYPT_LANES 2
+#else
+#define ESCRYPT_LANES 1
+#endif
+
 extern int escrypt_init_local(escrypt_local_t * __local);
 
 extern int escrypt_free_local(escrypt_local_t * __local);
@@ -68,6 +82,19 @@ extern uint8_t * escrypt_r(escrypt_local_t * __local,
     const uint8_t * __setting,
     uint8_t * __buf, size_t __buflen);
 
+#if ESCRYPT_LANES > 1
+extern int escrypt_kdf_multi(escrypt_local_t * __local, unsigned int __count,
+    const uint8_t * const * __passwd, const size_t * __passwdlen,
+    const uint8_t * __salt, size_t __saltlen,
+    uint64_t __N, uint32_t __r, uint32_t __p,
+    uint8_t * const * __buf, size_t __buflen);
+
+extern int escrypt_r_multi(escrypt_local_t * __local, unsigned int __count,
+    const uint8_t * const * __passwd, const size_t * __passwdlen,
+    const uint8_t * __setting,
+    uint8_t * const * __buf, size_t __buflen);
+#endif
+
 extern uint8_t * escrypt(const uint8_t * __passwd, const uint8_t * __setting);
 
 extern uint8_t * escrypt_gensalt_r(
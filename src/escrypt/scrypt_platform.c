@@ -26,18 +26,46 @@
 
 #include "scrypt_platform.h"
 
+#ifdef MAP_NOCORE
+#define MAP_FLAGS (MAP_ANON | MAP_PRIVATE | MAP_NOCORE)
+#else
+#define MAP_FLAGS (MAP_ANON | MAP_PRIVATE)
+#endif
+
+/*
+ * V is accessed at random, so with 4 KB pages nearly every block lookup is
+ * also a TLB miss.  Regions of at least this size are backed by huge pages
+ * when the system lets us: explicitly reserved ones (MAP_HUGETLB) if there
+ * are enough, or else transparent ones (MADV_HUGEPAGE).
+ */
+#define HUGEPAGE_SIZE ((size_t)2 << 20)
+
 static void *
 alloc_region(escrypt_region_t * region, size_t size)
 {
 	uint8_t * base, * aligned;
 #ifdef MAP_ANON
-	if ((base = mmap(NULL, size, PROT_READ | PROT_WRITE,
-#ifdef MAP_NOCORE
-	    MAP_ANON | MAP_PRIVATE | MAP_NOCORE,
-#else
-	    MAP_ANON | MAP_PRIVATE,
+	base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (size >= HUGEPAGE_SIZE &&
+	    size + (HUGEPAGE_SIZE - 1) > size) {
+		size_t huge_size = (size + (HUGEPAGE_SIZE - 1)) &
+		    ~(HUGEPAGE_SIZE - 1);
+		base = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+		    MAP_FLAGS | MAP_HUGETLB, -1, 0);
+		if (base != MAP_FAILED)
+			size = huge_size;
+	}
 #endif
-	    -1, 0)) == MAP_FAILED)
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_FLAGS,
+		    -1, 0);
+#ifdef MADV_HUGEPAGE
+		if (base != MAP_FAILED && size >= HUGEPAGE_SIZE)
+			madvise(base, size, MADV_HUGEPAGE);
+#endif
+	}
+	if (base == MAP_FAILED)
 		base = NULL;
 	aligned = base;
 #elif defined(HAVE_POSIX_MEMALIGN)
@@ -94,6 +94,7 @@ void *f_filter = NULL;
 static struct cfg_list *ext_source;
 static struct cfg_line *ext_line;
 static int ext_pos;
+static int ext_native;
 static int progress = -1;
 static int maxlen = PLAINTEXT_BUFFER_SIZE - 1;
 
@@ -149,6 +150,9 @@ void ext_init(char *mode, struct db_main *db)
 	if (db != NULL && db->format != NULL) {
 		/* This is second time we are called, just update max length */
 		ext_cipher_limit = maxlen = db->format->params.plaintext_length;
+		/* The first call happens before log_init() */
+		if (ext_native)
+			log_event("- Translated external mode to native code");
 		return;
 	} else
 		ext_cipher_limit = options.length;
@@ -178,6 +182,9 @@ void ext_init(char *mode, struct db_main *db)
 		error();
 	}
 
+	if (cfg_get_bool(SECTION_OPTIONS, NULL, "ExternalNative", 1))
+		ext_native = c_native();
+
 	ext_word[0] = 0;
 	c_execute(c_lookup("init"));
 
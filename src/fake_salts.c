@@ -88,6 +88,7 @@ void build_fake_salts_for_regen_lost(struct db_salt *salts) {
 		fake_salts[i].next = NULL;
 		fake_salts[i].count = sp->count;
 		fake_salts[i].hash = sp->hash;
+		fake_salts[i].table = sp->table;
 		fake_salts[i].hash_size = sp->hash_size;
 		fake_salts[i].index = sp->index;
 		fake_salts[i].keys = sp->keys;
@@ -128,8 +128,69 @@ static char *longcand(int index, int ml)
 	return out;
 }
 
+#ifndef BENCH_BUILD
+/*
+ * Checks set_key_range() against set_key().  All keys are first set to long
+ * candidates, so that stale data left in the key buffers shows up.
+ */
+static char *fmt_test_key_range(struct fmt_main *format, int ml)
+{
+	static char chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	char key[8];
+	int max = format->params.max_keys_per_crypt;
+	int *ref, count, size, len, pos, i, n;
+	char *retval = NULL;
+
+	size = PASSWORD_HASH_SIZES - 1;
+	while (size && !format->methods.binary_hash[size])
+		size--;
+
+	len = ml < 5 ? ml : 5;
+	memcpy(key, "range", len);
+	key[len] = 0;
+	pos = len - 1;
+
+	ref = mem_alloc(max * sizeof(*ref));
+	format->methods.clear_keys();
+	for (i = 0; i < max; i++) {
+		key[pos] = chars[i % (sizeof(chars) - 1)];
+		format->methods.set_key(key, i);
+	}
+	count = max;
+	format->methods.crypt_all(&count, NULL);
+	for (i = 0; i < max; i++)
+		ref[i] = format->methods.get_hash[size](i);
+
+	format->methods.clear_keys();
+	for (i = 0; i < max; i++)
+		format->methods.set_key(longcand(i, ml), i);
+	key[pos] = '*';
+	for (i = 0; i < max; i += n) {
+		n = max - i;
+		if (n > sizeof(chars) - 1)
+			n = sizeof(chars) - 1;
+		format->methods.set_key_range(key, pos, chars, n, i);
+	}
+	count = max;
+	format->methods.crypt_all(&count, NULL);
+	for (i = 0; i < max; i++) {
+		key[pos] = chars[i % (sizeof(chars) - 1)];
+		if (strcmp(format->methods.get_key(i), key) ||
+		    format->methods.get_hash[size](i) != ref[i]) {
+			retval = "set_key_range";
+			break;
+		}
+	}
+
+	MEM_FREE(ref);
+	format->methods.clear_keys();
+
+	return retval;
+}
+#endif
+
 static char *fmt_self_test_body(struct fmt_main *format,
-    void *binary_copy, void *salt_copy)
+    void *binary_copy, void *salt_copy, int **hashes)
 {
 	static char s_size[100];
 	struct fmt_tests *current;
@@ -235,6 +296,10 @@ static char *fmt_self_test_body(struct fmt_main *format,
 	    format->params.min_keys_per_crypt)
 		return "max < min keys per crypt";
 
+	if (format->methods.get_hashes)
+		*hashes = mem_alloc(format->params.max_keys_per_crypt *
+		    sizeof(**hashes));
+
 	if (!(current = format->params.tests)) return NULL;
 	ntests = 0;
 	while ((current++)->ciphertext)
@@ -374,6 +439,13 @@ static char *fmt_self_test_body(struct fmt_main *format,
 					return s_size;
 				}
 			}
+
+			/* 4. Check set_key_range(), if any */
+			if (format->methods.set_key_range) {
+				char *err = fmt_test_key_range(format, ml);
+				if (err)
+					return err;
+			}
 		}
 #endif
 
@@ -400,6 +472,18 @@ static char *fmt_self_test_body(struct fmt_main *format,
 			return s_size;
 		}
 
+		if (format->methods.get_hashes)
+		for (size = 0; size < PASSWORD_HASH_SIZES; size++)
+		if (format->methods.binary_hash[size]) {
+			format->methods.get_hashes(size, index + 1, *hashes);
+			for (i = 0; i <= index; i++)
+			if ((*hashes)[i] != format->methods.get_hash[size](i)) {
+				sprintf(s_size, "get_hashes(%d, %d)", size,
+				    index + 1);
+				return s_size;
+			}
+		}
+
 		if (!format->methods.cmp_all(binary, index + 1)) {
 			sprintf(s_size, "cmp_all(%d)", index + 1);
 			return s_size;
@@ -497,6 +581,7 @@ char *fmt_self_test(struct fmt_main *format)
 	char *retval;
 	void *binary_alloc, *salt_alloc;
 	void *binary_copy, *salt_copy;
+	int *hashes = NULL;
 
 	binary_copy = alloc_binary(&binary_alloc,
 	    format->params.binary_size, format->params.binary_align);
@@ -507,10 +592,11 @@ char *fmt_self_test(struct fmt_main *format)
 	 * while self-test is running. */
 	bench_running = 1;
 
-	retval = fmt_self_test_body(format, binary_copy, salt_copy);
+	retval = fmt_self_test_body(format, binary_copy, salt_copy, &hashes);
 
 	bench_running = 0;
 
+	MEM_FREE(hashes);
 	MEM_FREE(salt_alloc);
 	MEM_FREE(binary_alloc);
 
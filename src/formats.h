@@ -250,6 +250,22 @@ struct fmt_methods {
 
 /* Compares an ASCII ciphertext against a particular crypt_all() output */
 	int (*cmp_exact)(char *source, int index);
+
+/* Optional.  Stores get_hash[size]() values for crypt_all() method outputs
+ * 0 to count - 1 into hash[], all in one call.  Formats where this is cheap
+ * (such as fast SIMD ones) may implement it to save the cracker a function
+ * call per candidate.  When NULL (the default if a format's initializer
+ * simply ends after cmp_exact), get_hash[size]() is called per index. */
+	void (*get_hashes)(int size, int count, int *hash);
+
+/* Optional.  Sets count keys starting at index, all equal to key except for
+ * the character at position pos, which is taken from chars[] in turn.  The
+ * key fits in plaintext_length and pos is below its length.  Formats with
+ * SIMD key buffers may implement this by patching one byte per key, which
+ * lets mask mode skip the per-candidate set_key() call for its rightmost
+ * range.  When NULL, set_key() is used for every candidate. */
+	void (*set_key_range)(char *key, int pos, char *chars, int count,
+	    int index);
 };
 
 /*
@@ -263,7 +279,7 @@ struct fmt_private {
 /*
  * A structure to keep a list of supported ciphertext formats.
  */
-#define FMT_MAIN_VERSION 11		/* change if structure changes */
+#define FMT_MAIN_VERSION 13		/* change if structure changes */
 struct fmt_main {
 	struct fmt_params params;
 	struct fmt_methods methods;
@@ -28,6 +28,7 @@
 #include "cracker.h"
 #include "john.h"
 #include "options.h"
+#include "dist.h"
 
 extern struct fmt_main fmt_LM;
 extern struct fmt_main fmt_NETLM;
@@ -77,6 +78,14 @@ static int counts[CHARSET_LENGTH][CHARSET_LENGTH];
 static unsigned int real_count, real_minc, real_min, real_max, real_size;
 static unsigned char real_chars[CHARSET_SIZE];
 
+/*
+ * Dynamic distribution (--fork or MPI): each chunk is one entry of the
+ * charset file's order, the same unit the static split hands out in turn.
+ * dist_held is set once dist_cur is ours to work on.
+ */
+static struct dist_chunk dist_cur, rec_dist_next;
+static int dist_held, rec_dist_held;
+
 static void save_state(FILE *file)
 {
 	unsigned int pos;
@@ -84,6 +93,9 @@ static void save_state(FILE *file)
 	fprintf(file, "%u\n2\n%u\n", rec_entry, rec_length + 1);
 	for (pos = 0; pos <= rec_length; pos++)
 		fprintf(file, "%u\n", (unsigned int)rec_numbers[pos]);
+	if (dist_active)
+		fprintf(file, "%d %u %llu\n", rec_dist_held,
+		    rec_dist_next.major, rec_dist_next.minor);
 }
 
 static int restore_state(FILE *file)
@@ -107,6 +119,22 @@ static int restore_state(FILE *file)
 		rec_numbers[pos] = number;
 	}
 
+	if (dist_active) {
+/* A session saved without dynamic distribution keeps the static split */
+		if (fscanf(file, "%d %u %llu\n", &rec_dist_held,
+		    &rec_dist_next.major, &rec_dist_next.minor) != 3) {
+			dist_leave();
+			dist_active = 0;
+		} else if (rec_dist_held) {
+/* The entry we were in is the chunk we hold */
+			dist_cur.major = 0;
+			dist_cur.minor = rec_entry;
+			dist_held = 1;
+			dist_restore(&dist_cur, &rec_dist_next);
+		} else
+			dist_restore(NULL, &rec_dist_next);
+	}
+
 	return 0;
 }
 
@@ -115,6 +143,11 @@ static void fix_state(void)
 	rec_entry = entry;
 	rec_length = length;
 	memcpy(rec_numbers, numbers, length);
+
+	if (dist_active) {
+		rec_dist_held = dist_held;
+		dist_get_next(&rec_dist_next);
+	}
 }
 
 static void inc_format_error(char *charset)
@@ -692,7 +725,26 @@ void do_incremental_crack(struct db_main *db, char *mode)
 	entry--;
 	while (ptr < &header->order[sizeof(header->order) - 1]) {
 		int skip = 0;
-		if (options.node_count) {
+		if (dist_active) {
+			unsigned int next = entry + 1;
+
+			if (!dist_held || dist_cur.minor < next) {
+				dist_next(&dist_cur);
+				dist_held = 1;
+/*
+ * After a restore, the chunk may be one another node left behind us.  The
+ * counts and tables depend on all entries before it, so start over.
+ */
+				if (dist_cur.minor < next) {
+					ptr = header->order;
+					entry = ~0U;
+					memset(counts, 0, sizeof(counts));
+					last_count = last_length = -1;
+					continue;
+				}
+			}
+			skip = dist_cur.minor != next;
+		} else if (options.node_count) {
 			int for_node = entry % options.node_count + 1;
 			skip = for_node < options.node_min ||
 			    for_node > options.node_max;
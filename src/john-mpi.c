@@ -8,11 +8,68 @@
 #include "john-mpi.h"
 #include "john.h"
 #include "memory.h"
+#include "dist.h"
 
 int mpi_p, mpi_id;
 char mpi_name[MPI_MAX_PROCESSOR_NAME + 1];
 MPI_Request **mpi_req;
 
+/* Sends by mpi_send_others() that may still be using their buffer */
+static struct mpi_send {
+	struct mpi_send *next;
+	MPI_Request *req;
+	char *buf;
+} *mpi_sends;
+
+static void mpi_reap_sends(void)
+{
+	struct mpi_send **p = &mpi_sends, *send;
+	int done;
+
+	while ((send = *p)) {
+		MPI_Testall(mpi_p, send->req, &done, MPI_STATUSES_IGNORE);
+		if (done) {
+			*p = send->next;
+			MEM_FREE(send->buf);
+			MEM_FREE(send->req);
+			MEM_FREE(send);
+		} else
+			p = &send->next;
+	}
+}
+
+void mpi_progress(void)
+{
+	int flag;
+
+	MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag,
+	           MPI_STATUS_IGNORE);
+}
+
+void mpi_send_others(int tag, void *buf, int len)
+{
+	struct mpi_send *send;
+	int i;
+
+	mpi_reap_sends();
+
+	send = mem_alloc(sizeof(*send));
+	send->req = mem_alloc(mpi_p * sizeof(MPI_Request));
+	send->buf = mem_alloc(len);
+	memcpy(send->buf, buf, len);
+
+	for (i = 0; i < mpi_p; i++) {
+		if (i == mpi_id)
+			send->req[i] = MPI_REQUEST_NULL;
+		else
+			MPI_Isend(send->buf, len, MPI_CHAR, i, tag,
+			          MPI_COMM_WORLD, &send->req[i]);
+	}
+
+	send->next = mpi_sends;
+	mpi_sends = send;
+}
+
 void mpi_teardown(void)
 {
 	static int finalized = 0;
@@ -25,6 +82,7 @@ void mpi_teardown(void)
 		if (nice(20) == -1)
 			perror("nice");
 		MPI_Barrier(MPI_COMM_WORLD);
+		dist_done();
 	}
 
 	MPI_Finalize();
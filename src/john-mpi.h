@@ -4,6 +4,7 @@
 #include <mpi.h>
 
 #define JOHN_MPI_RELOAD	1
+#define JOHN_MPI_CRACKED	2
 
 extern int mpi_p, mpi_id;
 extern char mpi_name[MPI_MAX_PROCESSOR_NAME + 1];
@@ -15,4 +16,10 @@ extern void mpi_teardown(void);
 /* MPI initialization stuff, registers atexit() as well */
 extern void mpi_setup(int argc, char **argv);
 
+/* Give MPI a chance to serve other nodes' requests (e.g. one-sided ones) */
+extern void mpi_progress(void);
+
+/* Send a copy of buf to all other nodes, without waiting for completion */
+extern void mpi_send_others(int tag, void *buf, int len);
+
 #endif
@@ -71,6 +71,7 @@ static int john_omp_threads_new;
 #include "inc.h"
 #include "mask.h"
 #include "mkv.h"
+#include "dist.h"
 #include "external.h"
 #include "batch.h"
 #include "dynamic.h"
@@ -662,6 +663,10 @@ static void john_fork(void)
  */
 	mpi_teardown();
 #endif
+
+/* The work queue needs to be shared, so set it up before forking */
+	dist_init();
+
 /*
  * It may cost less memory to reset john_main_process to 0 before fork()'ing
  * the children than to do it in every child process individually (triggering
@@ -745,6 +750,9 @@ static void john_fork(void)
 #ifdef HAVE_MPI
 static void john_set_mpi(void)
 {
+/* Collective, and needs the node numbers as given for the whole session */
+	dist_init();
+
 	options.node_min += mpi_id;
 	options.node_max = options.node_min;
 
@@ -987,7 +995,8 @@ static void john_load(void)
 
 		ldr_init_database(&database, &options.loader);
 
-		if ((current = options.passwd->head))
+		if (!ldr_load_snapshot(&database) &&
+		    (current = options.passwd->head))
 		do {
 			ldr_load_pw_file(&database, current->data);
 		} while ((current = current->next));
@@ -1054,6 +1063,7 @@ static void john_load(void)
 
 		total = database.password_count;
 		ldr_load_pot_file(&database, options.loader.activepot);
+		ldr_update_snapshot(&database);
 		ldr_fix_database(&database);
 
 		if (!database.password_count) {
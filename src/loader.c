@@ -7,12 +7,22 @@
 
 #define LDR_WARN_AMBIGUOUS
 
+#define NEED_OS_FORK
+#include "os.h"
+
 #include <stdio.h>
 #include <sys/stat.h>
-#include "os.h"
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if OS_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+#if HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #ifdef _MSC_VER
 #define S_ISDIR(a) ((a) & _S_IFDIR)
 #endif
@@ -36,7 +46,11 @@
 #include "fake_salts.h"
 #include "john.h"
 #include "cracker.h"
+#include "crc32.h"
 #include "logger.h" /* Beware: log_init() happens after most functions here */
+#ifdef HAVE_MPI
+#include "john-mpi.h"
+#endif
 
 #ifdef HAVE_CRYPT
 extern struct fmt_main fmt_crypt;
@@ -62,6 +76,12 @@ int ldr_in_pot = 0;
 static char *no_username = "?";
 static int pristine_gecos;
 
+/*
+ * Where to start reading john.pot, past the entries that a hash snapshot
+ * already accounts for.
+ */
+static long ldr_pot_start;
+
 static void read_file(struct db_main *db, char *name, int flags,
 	void (*process_line)(struct db_main *db, char *line))
 {
@@ -83,6 +103,10 @@ static void read_file(struct db_main *db, char *name, int flags,
 		pexit("fopen: %s", path_expand(name));
 	}
 
+	if (name == options.loader.activepot && ldr_pot_start &&
+	    fseek(file, ldr_pot_start, SEEK_SET))
+		pexit("fseek");
+
 	while (fgets(line, sizeof(line), file)) {
 		process_line(db, line);
 		check_abort(0);
@@ -151,6 +175,23 @@ static void ldr_init_password_hash(struct db_main *db)
 
 	if (size > 0 && mem_saving_level >= 2)
 		size--;
+	else if (options.passwd) {
+/* With the default size, a huge hash file would make for long bucket chains */
+		struct list_entry *current;
+		struct stat file_stat;
+		long long total = 0;
+
+		if ((current = options.passwd->head))
+		do {
+			if (!stat(path_expand(current->data), &file_stat))
+				total += file_stat.st_size;
+		} while ((current = current->next));
+
+		while (size < PASSWORD_HASH_SIZE_FOR_LDR_MAX &&
+		    (long long)password_hash_sizes[size] *
+		    LDR_HASH_BYTES_PER_BUCKET < total)
+			size++;
+	}
 
 	do {
 		func = db->format->methods.binary_hash[size];
@@ -222,6 +263,20 @@ static int ldr_check_shells(struct list_main *list, char *shell)
 	return 0;
 }
 
+static void ldr_warn_other_type(struct fmt_main *format, struct fmt_main *alt)
+{
+	alt->params.flags |= FMT_WARNED;
+	if (john_main_process)
+	fprintf(stderr,
+	    "Warning: only loading hashes of type "
+	    "\"%s\", but also saw type \"%s\"\n"
+	    "Use the \"--format=%s\" option to force "
+	    "loading hashes of that type instead\n",
+	    format->params.label,
+	    alt->params.label,
+	    alt->params.label);
+}
+
 static int ldr_split_line(char **login, char **ciphertext,
 	char **gecos, char **home,
 	char *source, struct fmt_main **format,
@@ -375,16 +430,7 @@ static int ldr_split_line(char **login, char **ciphertext,
 #endif
 			prepared = alt->methods.prepare(fields, alt);
 			if (alt->methods.valid(prepared, alt)) {
-				alt->params.flags |= FMT_WARNED;
-				if (john_main_process)
-				fprintf(stderr,
-				    "Warning: only loading hashes of type "
-				    "\"%s\", but also saw type \"%s\"\n"
-				    "Use the \"--format=%s\" option to force "
-				    "loading hashes of that type instead\n",
-				    (*format)->params.label,
-				    alt->params.label,
-				    alt->params.label);
+				ldr_warn_other_type(*format, alt);
 				break;
 			}
 		} while ((alt = alt->next));
@@ -494,12 +540,38 @@ static struct list_main *ldr_init_words(char *login, char *gecos, char *home)
 	return words;
 }
 
-static void ldr_load_pw_line(struct db_main *db, char *line)
+/*
+ * Sizes of the password and salt entries, which lack the fields we won't use.
+ */
+static void ldr_struct_sizes(struct db_main *db,
+	size_t *pw_size, size_t *salt_size)
+{
+	if (db->options->flags & DB_WORDS) {
+		*pw_size = sizeof(struct db_password);
+		*salt_size = sizeof(struct db_salt);
+	} else {
+		if (db->options->flags & DB_LOGIN)
+			*pw_size = sizeof(struct db_password) -
+				sizeof(struct list_main *);
+		else
+			*pw_size = sizeof(struct db_password) -
+				(sizeof(char *) + sizeof(struct list_main *));
+		*salt_size = sizeof(struct db_salt) -
+			sizeof(struct db_keys *);
+	}
+}
+
+/*
+ * Adds the count hashes of a line that ldr_split_line() accepted.  These are
+ * either split() from ciphertext here, or were split() earlier (by a loader
+ * child process) and are passed in pieces[].
+ */
+static void ldr_load_pw_split(struct db_main *db, int count,
+	char *ciphertext, char **pieces, char *login, char *gecos, char *home)
 {
 	static int skip_dupe_checking = 0;
 	struct fmt_main *format;
-	int index, count;
-	char *login, *ciphertext, *gecos, *home;
+	int index;
 	char *piece;
 	void *binary, *salt;
 	int salt_hash, pw_hash;
@@ -508,28 +580,13 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 	struct list_main *words;
 	size_t pw_size, salt_size;
 
-	count = ldr_split_line(&login, &ciphertext, &gecos, &home,
-		NULL, &db->format, db->options, line);
-	if (count <= 0) return;
 	if (count >= 2) db->options->flags |= DB_SPLIT;
 
 	format = db->format;
 
 	words = NULL;
 
-	if (db->options->flags & DB_WORDS) {
-		pw_size = sizeof(struct db_password);
-		salt_size = sizeof(struct db_salt);
-	} else {
-		if (db->options->flags & DB_LOGIN)
-			pw_size = sizeof(struct db_password) -
-				sizeof(struct list_main *);
-		else
-			pw_size = sizeof(struct db_password) -
-				(sizeof(char *) + sizeof(struct list_main *));
-		salt_size = sizeof(struct db_salt) -
-			sizeof(struct db_keys *);
-	}
+	ldr_struct_sizes(db, &pw_size, &salt_size);
 
 	if (!db->password_hash) {
 		ldr_init_password_hash(db);
@@ -543,7 +600,10 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 	}
 
 	for (index = 0; index < count; index++) {
-		piece = format->methods.split(ciphertext, index, format);
+		if (pieces)
+			piece = pieces[index];
+		else
+			piece = format->methods.split(ciphertext, index, format);
 
 		binary = format->methods.binary(piece);
 		pw_hash = db->password_hash_func(binary);
@@ -626,6 +686,7 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 			current_salt->bitmap = NULL;
 			current_salt->list = NULL;
 			current_salt->hash = &current_salt->list;
+			current_salt->table = NULL;
 			current_salt->hash_size = -1;
 
 			current_salt->count = 0;
@@ -686,180 +747,1551 @@ static void ldr_load_pw_line(struct db_main *db, char *line)
 	}
 }
 
-void ldr_load_pw_file(struct db_main *db, char *name)
+static void ldr_load_pw_line(struct db_main *db, char *line)
 {
-	read_file(db, name, RF_ALLOW_DIR, ldr_load_pw_line);
-}
+	char *login, *ciphertext, *gecos, *home;
+	int count;
 
-static void ldr_load_pot_line(struct db_main *db, char *line)
-{
-	struct fmt_main *format = db->format;
-	char *ciphertext;
-	void *binary;
-	int hash;
-	struct db_password *current;
+	count = ldr_split_line(&login, &ciphertext, &gecos, &home,
+		NULL, &db->format, db->options, line);
+	if (count <= 0) return;
 
-	ciphertext = ldr_get_field(&line, db->options->field_sep_char);
-	if (format->methods.valid(ciphertext, format) != 1) return;
+	ldr_load_pw_split(db, count, ciphertext, NULL, login, gecos, home);
+}
 
-	ciphertext = format->methods.split(ciphertext, 0, format);
-	binary = format->methods.binary(ciphertext);
-	hash = db->password_hash_func(binary);
+#if OS_FORK
+/*
+ * Parallel loading of large hash files.  The file is cut into byte ranges of
+ * whole lines, and a child process per range does the part of the work that
+ * doesn't need the database: parsing the lines and having the format
+ * prepare(), valid() and split() them.  Each child writes its results to a
+ * temporary "shard" file, which the parent then reads back in file order,
+ * adding the hashes exactly as it would have added the lines themselves.  So
+ * the resulting database, including which duplicates got dropped, is the
+ * same as with a serial load.  We use processes rather than threads because
+ * format methods return static buffers and allocate memory unlocked.
+ */
+static FILE *ldr_shard;
 
-	if ((current = db->password_hash[hash]))
-	do {
-		if (options.regen_lost_salts)
-			ldr_pot_possible_fixup_salt(current->source,
-			                            ciphertext);
-		if (!current->binary) /* already marked for removal */
-			continue;
-		if (memcmp(binary, current->binary, format->params.binary_size))
-			continue;
-		if (strcmp(ciphertext,
-		    format->methods.source(current->source, current->binary)))
-			continue;
-		current->binary = NULL; /* mark for removal */
-	} while ((current = current->next_hash));
+static void ldr_put_string(char *s)
+{
+	unsigned int length = s ? strlen(s) : ~0U;
+
+	fwrite(&length, sizeof(length), 1, ldr_shard);
+	if (s)
+		fwrite(s, 1, length, ldr_shard);
 }
 
-void ldr_load_pot_file(struct db_main *db, char *name)
+static void ldr_shard_pw_line(struct db_main *db, char *line)
 {
-	if (db->format && !(db->format->params.flags & FMT_NOT_EXACT)) {
-#ifdef HAVE_CRYPT
-		ldr_in_pot = 1;
-#endif
-		read_file(db, name, RF_ALLOW_MISSING, ldr_load_pot_line);
-#ifdef HAVE_CRYPT
-		ldr_in_pot = 0;
-#endif
+	char *login, *ciphertext, *gecos, *home;
+	int index, count;
+
+	count = ldr_split_line(&login, &ciphertext, &gecos, &home,
+		NULL, &db->format, db->options, line);
+	if (count <= 0) return;
+
+	fwrite(&count, sizeof(count), 1, ldr_shard);
+	ldr_put_string(login == no_username ? NULL : login);
+	if (db->options->flags & DB_WORDS) {
+		ldr_put_string(gecos);
+		ldr_put_string(home);
 	}
+	for (index = 0; index < count; index++)
+		ldr_put_string(db->format->methods.split(ciphertext, index,
+		    db->format));
 }
 
 /*
- * The following are several functions called by ldr_fix_database().
- * They assume that the per-salt hash tables have not yet been initialized.
+ * Reads and processes the lines starting in [start, end), in the same pieces
+ * that read_file() would.
  */
+static void ldr_read_range(struct db_main *db, FILE *file,
+	long start, long end,
+	void (*process_line)(struct db_main *db, char *line))
+{
+	char line[LINE_BUFFER_SIZE];
+	size_t length;
+	long pos;
+
+	if (fseek(file, start, SEEK_SET)) pexit("fseek");
+
+	pos = start;
+	while (pos < end && fgets(line, sizeof(line), file)) {
+		length = strlen(line);
+		if (length && line[length - 1] == '\n')
+			pos += length;
+		else
+			pos = ftell(file);
+		process_line(db, line);
+		check_abort(0);
+	}
+
+	if (ferror(file)) pexit("fgets");
+}
 
 /*
- * Glue the salt_hash[] buckets together and into the salts list.  The loader
- * needs the hash table, but then we free it and the cracker uses the list.
+ * Returns the offset of the first line that starts at or after pos.
  */
-static void ldr_init_salts(struct db_main *db)
+static long ldr_next_line(FILE *file, long pos)
 {
-	struct db_salt **tail, *current;
-	int hash, ctr = 0;
+	char line[LINE_BUFFER_SIZE];
+	size_t length;
 
-	for (hash = 0, tail = &db->salts; hash < SALT_HASH_SIZE; hash++)
-	if ((current = db->salt_hash[hash])) {
-		*tail = current;
-		ctr = 0;
-		do {
-			current -> sequential_id = ctr++;
-			tail = &current->next;
-		} while ((current = current->next));
-#ifdef DEBUG_HASH
-		if (ctr)
-			printf("salt hash %08x, %d salts\n", hash, ctr);
-#endif
+	if (fseek(file, pos - 1, SEEK_SET)) pexit("fseek");
+
+	while (fgets(line, sizeof(line), file)) {
+		length = strlen(line);
+		if (length && line[length - 1] == '\n')
+			break;
 	}
+
+	if (ferror(file)) pexit("fgets");
+
+	return ftell(file);
 }
 
-/* #define DEBUG_SALT_SORT */
+static void ldr_shard_child(struct db_main *db, char *name,
+	long start, long end)
+{
+	FILE *file;
+	struct fmt_main *alt;
+	int i;
 
-/*
- * this will be the salt_compare() method we stick into
- * wpapsk_fmt.c (and cuda/opencl)
- */
-int salt_compare(const void *x, const void *y)
+/* Warnings are up to the parent, which knows if it has printed them yet */
+	john_main_process = 0;
+
+	if (!(file = fopen(path_expand(name), "r")))
+		_exit(1);
+
+	ldr_read_range(db, file, start, end, ldr_shard_pw_line);
+
+/* A zero count ends the records; then come the formats we've warned about */
+	i = 0;
+	fwrite(&i, sizeof(i), 1, ldr_shard);
+	for (alt = fmt_list; alt; alt = alt->next, i++)
+	if (alt->params.flags & FMT_WARNED)
+		fwrite(&i, sizeof(i), 1, ldr_shard);
+	i = -1;
+	fwrite(&i, sizeof(i), 1, ldr_shard);
+
+	if (fflush(ldr_shard) || ferror(ldr_shard))
+		_exit(1);
+	_exit(0);
+}
+
+static void ldr_get(void *data, size_t size, FILE *file)
 {
-	/* this is all that is needed in wpapsk salt_compare() */
-	return strncmp((const char*)x, (const char*)y, 36);
+	if (fread(data, 1, size, file) != size) {
+		if (ferror(file)) pexit("fread");
+		fprintf(stderr, "Loader shard file truncated\n");
+		error();
+	}
 }
 
-/*
- * This was done as a structure to allow more data to be
- * placed into it, beyond just the simple pointer. The
- * pointer is really all that is needed.  However, when
- * building with the structure containing just a pointer,
- * we get no (or very little) degredation over just an
- * array of pointers.  The compiler treats them the same.
- * so for ease of debugging, I have left this as a simple
- * structure
- */
-typedef struct salt_cmp_s
+static void ldr_merge_shard(struct db_main *db, FILE *file)
 {
-	struct db_salt *p;
-#ifdef DEBUG_SALT_SORT
-	/* used by JimF in debugging.  Left in for now */
-	int org_idx;
-	char str[36];
-#endif
-} salt_cmp_t;
+	static char *data;
+	static size_t data_size;
+	static size_t *offsets;
+	static char **strings;
+	static int strings_count;
+	size_t used;
+	unsigned int length;
+	int count, i, n;
+	struct fmt_main *alt;
 
-/*
- * there is no way to pass this pointer to the sort function, so
- * we set it before calling sort. Right now, we do not use it,
- * but later we will use salt_sort_db->format->methods.salt_compare()
- * we actually could just harvest off the function pointer to the
- * salt_compare function, instead (TBD), instead of the db_main*
- */
-static struct db_main *salt_sort_db;
+	if (fseek(file, 0, SEEK_SET)) pexit("fseek");
 
-/*
- * This helper function will stay in loader.  It is what the qsort
- * function calls.  This function is smart enough to know how to
- * parse a salt_cmp_t. It does that, to find the real salt values,
- * and then calls the formats salt_compare passing in just the salts.
- * It is an extra layer of indirection, but keeps the function from
- * having to know about our structure, or the db_salt structure. There
- * is very little additional overhead, in this 2nd layer of indirection
- * since qsort is pretty quick, and does not call compare any more than
- * is needed to partition sort the data.
- */
-static int ldr_salt_cmp(const void *x, const void *y) {
-	salt_cmp_t *X = (salt_cmp_t *)x;
-	salt_cmp_t *Y = (salt_cmp_t *)y;
-	int cmp = salt_compare(X->p->salt, Y->p->salt);
-	return cmp;
+	for (;;) {
+		ldr_get(&count, sizeof(count), file);
+		if (count <= 0)
+			break;
+
+		n = count + ((db->options->flags & DB_WORDS) ? 3 : 1);
+		if (n > strings_count) {
+			MEM_FREE(offsets);
+			MEM_FREE(strings);
+			offsets = mem_alloc(n * sizeof(*offsets));
+			strings = mem_alloc(n * sizeof(*strings));
+			strings_count = n;
+		}
+
+/* Strings go to data[] one after another, NUL-terminated */
+		used = 0;
+		for (i = 0; i < n; i++) {
+			ldr_get(&length, sizeof(length), file);
+			if (length == ~0U) {
+				offsets[i] = ~(size_t)0;
+				continue;
+			}
+			if (used + length + 1 > data_size) {
+				char *new_data;
+
+				data_size = (used + length + 1) * 2;
+				new_data = mem_alloc(data_size);
+				if (used)
+					memcpy(new_data, data, used);
+				MEM_FREE(data);
+				data = new_data;
+			}
+			ldr_get(data + used, length, file);
+			data[used + length] = 0;
+			offsets[i] = used;
+			used += length + 1;
+		}
+
+		for (i = 0; i < n; i++)
+			strings[i] = offsets[i] == ~(size_t)0 ?
+			    no_username : data + offsets[i];
+
+		if (db->options->flags & DB_WORDS)
+			ldr_load_pw_split(db, count, NULL, &strings[3],
+			    strings[0], strings[1], strings[2]);
+		else
+			ldr_load_pw_split(db, count, NULL, &strings[1],
+			    strings[0], "", "/");
+
+		check_abort(0);
+	}
+
+	for (;;) {
+		ldr_get(&i, sizeof(i), file);
+		if (i < 0)
+			break;
+		for (alt = fmt_list; alt && i; alt = alt->next)
+			i--;
+		if (alt && !(alt->params.flags & FMT_WARNED))
+			ldr_warn_other_type(db->format, alt);
+	}
 }
 
 /*
- * If there are more than 1 salt, AND the format exports a salt_compare
- * function, then we reorder the salt array, into the order the format
- * wants them in.  Reasons for this, are usually that the format can
- * gain a lot of speed, if some of the salts are grouped together, so
- * that the group is run one after the other.  This was first done for
- * the WPAPSK format, so that the format could group all ESSID's in
- * the salts, so that the PBKDF2 is computed once (for the first
- * instance of the ESSID), then all of the other salts which are
- * different salts, but  * which have the exact same ESSID will not
- * have to perform the very costly PBKDF2.  The format is designed
- * to work that way, IFF the salts come to it in the right order.
- * This function gets them into that order
+ * Returns zero if the file should be loaded with read_file() instead.
  */
-static void ldr_sort_salts(struct db_main *db)
+static int ldr_load_pw_file_parallel(struct db_main *db, char *name)
 {
-	int i;
-	struct db_salt *s;
-#ifndef DEBUG_SALT_SORT
-	salt_cmp_t *ar;
-#else
-	salt_cmp_t ar[100];  /* array is easier to debug in VC */
+	struct stat file_stat;
+	FILE *file, **shard;
+	pid_t *pid;
+	long pos, size, *range;
+	int i, n, status;
+
+#ifdef HAVE_MPI
+/* The nodes are already loading in parallel */
+	if (mpi_p > 1)
+		return 0;
 #endif
-	/*
-	 * NOTE, later we will use a new format method (salt_compare) to
-	 * determine when to do this sorting.  For now, we will compute
-	 * when (based on format name), and we have the salt_compare()
-	 * in this file, so that we can utilize this functionality prior
-	 * to getting this method out to every format.
-	 */
-	if (db->salt_count < 2 ||
-		strncasecmp(db->format->params.label, "wpapsk", 6))
-		return;
 
-	log_event("Sorting salts, for \"same salt\" emulation");
+	n = cfg_get_int(SECTION_OPTIONS, NULL, "LoaderProcesses");
+#ifdef _SC_NPROCESSORS_ONLN
+	if (n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (n > LDR_PROCESSES_MAX)
+		n = LDR_PROCESSES_MAX;
+	if (n < 2)
+		return 0;
 
-	salt_sort_db = db;
+	if (stat(path_expand(name), &file_stat) ||
+	    !S_ISREG(file_stat.st_mode) ||
+	    file_stat.st_size < LDR_PARALLEL_MIN)
+		return 0;
+
+	if (!(file = fopen(path_expand(name), "r")))
+		return 0;
+
+/* Load serially until we know the format and have the dupe checking table */
+	if (!db->password_hash) {
+		char line[LINE_BUFFER_SIZE];
+
+		while (!db->password_hash && fgets(line, sizeof(line), file)) {
+			ldr_load_pw_line(db, line);
+			check_abort(0);
+		}
+		if (ferror(file)) pexit("fgets");
+	}
+
+	pos = ftell(file);
+	size = file_stat.st_size;
+
+	if (!db->password_hash || size - pos < LDR_PARALLEL_MIN) {
+		ldr_read_range(db, file, pos, size, ldr_load_pw_line);
+		if (fclose(file)) pexit("fclose");
+		return 1;
+	}
+
+	range = mem_alloc((n + 1) * sizeof(*range));
+	shard = mem_alloc(n * sizeof(*shard));
+	pid = mem_alloc(n * sizeof(*pid));
+
+	range[0] = pos;
+	for (i = 1; i < n; i++) {
+		range[i] = ldr_next_line(file, pos + (size - pos) / n * i);
+		if (range[i] < range[i - 1])
+			range[i] = range[i - 1];
+	}
+	range[n] = size;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < n; i++) {
+		pid[i] = -1;
+		if (range[i] >= range[i + 1] || !(shard[i] = tmpfile()))
+			continue;
+		ldr_shard = shard[i];
+		if (!(pid[i] = fork()))
+			ldr_shard_child(db, name, range[i], range[i + 1]);
+		if (pid[i] < 0)
+			fclose(shard[i]);
+	}
+
+/* Merge the shards in order, loading any ranges we couldn't fork for */
+	for (i = 0; i < n; i++) {
+		if (pid[i] < 0) {
+			if (range[i] < range[i + 1])
+				ldr_read_range(db, file, range[i], range[i + 1],
+				    ldr_load_pw_line);
+			continue;
+		}
+
+		while (waitpid(pid[i], &status, 0) < 0)
+		if (errno != EINTR) pexit("waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			check_abort(0);
+			fprintf(stderr, "Loader process %d failed\n", i + 1);
+			error();
+		}
+
+		ldr_merge_shard(db, shard[i]);
+		if (fclose(shard[i])) pexit("fclose");
+	}
+
+	MEM_FREE(pid);
+	MEM_FREE(shard);
+	MEM_FREE(range);
+
+	if (fclose(file)) pexit("fclose");
+
+	return 1;
+}
+#endif
+
+void ldr_load_pw_file(struct db_main *db, char *name)
+{
+#if OS_FORK
+	if (ldr_load_pw_file_parallel(db, name))
+		return;
+#endif
+	read_file(db, name, RF_ALLOW_DIR, ldr_load_pw_line);
+}
+
+#if HAVE_SYS_MMAN_H
+/*
+ * Hash snapshots.  Loading a huge hash file takes a while, mostly because
+ * every line gets prepare()d, valid()ated, split() and binary()d, and checked
+ * for duplicates.  With HashSnapshot enabled in john.conf, we save the result
+ * (the hashes that were still left after reading john.pot) to a file next to
+ * the first hash file, and a later session with the same hash files, format
+ * and loader options maps that instead.  The snapshot records how far into
+ * john.pot it was taken, so only the entries appended since then are read.
+ * The bitmaps and per-salt hash tables aren't saved: they are cheap to build
+ * and depend on options that may change between sessions.
+ */
+#define LDR_SNAP_SUFFIX			".snap"
+#define LDR_SNAP_MAGIC			"JtRSnap1"
+#define LDR_ORDER			0x0102030405060708ULL
+#define LDR_POT_CRC_SIZE		0x1000
+
+struct ldr_snap_header {
+	char magic[8];
+	unsigned long long order;
+	unsigned long long size;
+	unsigned long long pot_pos;
+	unsigned int pot_crc;
+	unsigned int flags;
+	unsigned int key_size;
+	unsigned int salt_count;
+	unsigned int password_count;
+	unsigned int reserved;
+};
+
+static char *ldr_snap_name;
+static int ldr_snap_restored;
+
+#define LDR_ALIGN(pos, align) \
+	(((pos) + ((align) - 1)) & ~(unsigned long long)((align) - 1))
+
+/*
+ * Returns non-zero if hash snapshots may be used for this database, and sets
+ * ldr_snap_name.  We only bother for large hash files.
+ */
+static int ldr_snap_enabled(struct db_main *db)
+{
+	struct list_entry *current;
+	struct stat file_stat;
+	long long total = 0;
+	char *name;
+
+	if ((db->options->flags & (DB_WORDS | DB_CRACKED)) ||
+	    options.regen_lost_salts || !options.passwd ||
+	    !cfg_get_bool(SECTION_OPTIONS, NULL, "HashSnapshot", 0))
+		return 0;
+
+	if ((current = options.passwd->head))
+	do {
+		if (stat(path_expand(current->data), &file_stat) ||
+		    !S_ISREG(file_stat.st_mode))
+			return 0;
+		total += file_stat.st_size;
+	} while ((current = current->next));
+
+	if (total < LDR_SNAPSHOT_MIN)
+		return 0;
+
+	if (!ldr_snap_name) {
+		name = path_expand(options.passwd->head->data);
+		ldr_snap_name = mem_alloc_tiny(strlen(name) +
+		    sizeof(LDR_SNAP_SUFFIX), MEM_ALIGN_NONE);
+		strcpy(ldr_snap_name, name);
+		strcat(ldr_snap_name, LDR_SNAP_SUFFIX);
+	}
+
+	return 1;
+}
+
+static void ldr_key_add(char **key, size_t *len, size_t *size, char *s)
+{
+	size_t n = strlen(s);
+
+	if (*len + n + 2 > *size) {
+		char *old = *key;
+
+		*size = (*len + n + 2) * 2;
+		*key = mem_alloc(*size);
+		if (old) {
+			memcpy(*key, old, *len);
+			MEM_FREE(old);
+		}
+	}
+	memcpy(*key + *len, s, n);
+	*len += n;
+	(*key)[(*len)++] = '\n';
+	(*key)[*len] = 0;
+}
+
+static void ldr_key_list(char **key, size_t *len, size_t *size,
+	struct list_main *list)
+{
+	struct list_entry *current;
+
+	if (list && (current = list->head))
+	do {
+		ldr_key_add(key, len, size, current->data);
+	} while ((current = current->next));
+	ldr_key_add(key, len, size, "");
+}
+
+/*
+ * Everything that a format's binaries depend on, as text.
+ */
+static void ldr_key_format(char **key, size_t *len, size_t *size,
+	struct db_main *db, struct fmt_main *format)
+{
+	char buf[LINE_BUFFER_SIZE];
+
+	sprintf(buf, "%s %d", JOHN_VERSION, ARCH_BITS);
+	ldr_key_add(key, len, size, buf);
+	ldr_key_add(key, len, size, format->params.label);
+	ldr_key_add(key, len, size, format->params.algorithm_name);
+	sprintf(buf, "%d %d %d %d %d",
+	    format->params.binary_size, format->params.binary_align,
+	    format->params.salt_size, format->params.salt_align,
+	    db->options->field_sep_char);
+	ldr_key_add(key, len, size, buf);
+	ldr_key_add(key, len, size,
+	    options.encodingStr ? options.encodingStr : "");
+}
+
+/*
+ * Everything that the loaded hashes depend on, as text.  A snapshot is only
+ * used if its key is the same.
+ */
+static char *ldr_snap_key(struct db_main *db, struct fmt_main *format)
+{
+	struct list_entry *current;
+	struct stat file_stat;
+	char *key = NULL, buf[LINE_BUFFER_SIZE];
+	size_t len = 0, size = 0;
+
+	ldr_key_format(&key, &len, &size, db, format);
+	sprintf(buf, "%d %d %d %d",
+	    format->methods.source == fmt_default_source,
+	    db->options->flags & DB_LOGIN,
+	    !!(options.flags & FLG_REJECT_PRINTABLE),
+	    cfg_get_bool(SECTION_OPTIONS, NULL, "NoLoaderDupeCheck", 0));
+	ldr_key_add(&key, &len, &size, buf);
+	ldr_key_add(&key, &len, &size,
+	    options.format ? options.format : "");
+	ldr_key_list(&key, &len, &size, db->options->users);
+	ldr_key_list(&key, &len, &size, db->options->groups);
+	ldr_key_list(&key, &len, &size, db->options->shells);
+
+	if ((current = options.passwd->head))
+	do {
+		if (stat(path_expand(current->data), &file_stat))
+			file_stat.st_size = file_stat.st_mtime = 0;
+		snprintf(buf, sizeof(buf), "%s %llu %llu",
+		    path_expand(current->data),
+		    (unsigned long long)file_stat.st_size,
+		    (unsigned long long)file_stat.st_mtime);
+		ldr_key_add(&key, &len, &size, buf);
+	} while ((current = current->next));
+
+	ldr_key_add(&key, &len, &size,
+	    path_expand(options.loader.activepot));
+
+	return key;
+}
+
+/*
+ * CRC-32 of the pot file's bytes right before pos.  Returns non-zero if the
+ * pot file is at least that long.
+ */
+static int ldr_pot_crc(unsigned long long pos, unsigned int *crc)
+{
+	unsigned char buf[LDR_POT_CRC_SIZE];
+	size_t n = pos < sizeof(buf) ? pos : sizeof(buf);
+	CRC32_t value;
+	FILE *file;
+
+	CRC32_Init(&value);
+	*crc = value;
+	if (!pos)
+		return 1;
+
+	if (!(file = fopen(path_expand(options.loader.activepot), "rb")))
+		return 0;
+	if (fseek(file, (long)(pos - n), SEEK_SET) ||
+	    fread(buf, 1, n, file) != n) {
+		fclose(file);
+		return 0;
+	}
+	fclose(file);
+
+	CRC32_Update(&value, buf, n);
+	*crc = value;
+	return 1;
+}
+
+/*
+ * Walks the salt and password records in [p, end), and if build is set, adds
+ * them to the database.  Returns non-zero if they are consistent with the
+ * header.
+ */
+static int ldr_snap_records(struct db_main *db, int build,
+	struct fmt_main *format, struct ldr_snap_header *hdr, char *p, char *end)
+{
+	int source = format->methods.source == fmt_default_source;
+	int login = db->options->flags & DB_LOGIN;
+	unsigned long long pos = p - (char *)hdr, size = end - (char *)hdr;
+	unsigned int salt_index, passwords = 0, count, index;
+	struct db_salt **tails = NULL, *current_salt = NULL;
+	struct db_password *current_pw, *last_pw, *pws = NULL;
+	size_t pw_size = 0, salt_size = 0;
+	char *binary, *s, *z;
+	void *salt;
+	int salt_hash, pw_hash;
+
+	if (build) {
+		ldr_struct_sizes(db, &pw_size, &salt_size);
+		ldr_init_password_hash(db);
+		tails = mem_calloc(SALT_HASH_SIZE * sizeof(*tails));
+		pws = mem_alloc_tiny(pw_size * hdr->password_count,
+		    MEM_ALIGN_WORD);
+	}
+
+	for (salt_index = 0; salt_index < hdr->salt_count; salt_index++) {
+		pos = LDR_ALIGN(pos, sizeof(count));
+		if (pos + sizeof(count) > size)
+			return 0;
+		memcpy(&count, (char *)hdr + pos, sizeof(count));
+		pos += sizeof(count);
+		if (!count || count > hdr->password_count - passwords)
+			return 0;
+		passwords += count;
+
+		last_pw = NULL;
+		for (index = 0; index < count; index++) {
+			pos = LDR_ALIGN(pos, format->params.binary_align);
+			if (pos + format->params.binary_size > size)
+				return 0;
+			binary = (char *)hdr + pos;
+			pos += format->params.binary_size;
+
+			if (build) {
+				current_pw = pws;
+				pws = (struct db_password *)
+				    ((char *)pws + pw_size);
+				current_pw->next = NULL;
+				if (!source && sizeof(current_pw->source) >=
+				    format->params.binary_size)
+					current_pw->binary = memcpy(
+					    &current_pw->source, binary,
+					    format->params.binary_size);
+				else
+					current_pw->binary = binary;
+			}
+
+			if (source) {
+				s = (char *)hdr + pos;
+				if (!(z = memchr(s, 0, size - pos)))
+					return 0;
+				pos += z - s + 1;
+				if (build)
+					current_pw->source = s;
+			}
+
+			if (login) {
+				s = (char *)hdr + pos;
+				if (!(z = memchr(s, 0, size - pos)))
+					return 0;
+				pos += z - s + 1;
+				if (build)
+					current_pw->login = s;
+			}
+
+			if (!build)
+				continue;
+
+			if (!index) {
+				salt = format->methods.salt(
+				    format->methods.source(current_pw->source,
+				    current_pw->binary));
+				salt_hash = format->methods.salt_hash(salt);
+
+				current_salt = mem_alloc_tiny(salt_size,
+				    MEM_ALIGN_WORD);
+				current_salt->next = NULL;
+				if (tails[salt_hash])
+					tails[salt_hash]->next = current_salt;
+				else
+					db->salt_hash[salt_hash] = current_salt;
+				tails[salt_hash] = current_salt;
+
+				current_salt->salt = mem_alloc_copy(salt,
+					format->params.salt_size,
+					format->params.salt_align);
+
+				current_salt->index = fmt_dummy_hash;
+				current_salt->bitmap = NULL;
+				current_salt->list = current_pw;
+				current_salt->hash = &current_salt->list;
+				current_salt->table = NULL;
+				current_salt->hash_size = -1;
+
+				current_salt->count = count;
+			} else
+				last_pw->next = current_pw;
+			last_pw = current_pw;
+
+			pw_hash = db->password_hash_func(current_pw->binary);
+			current_pw->next_hash = db->password_hash[pw_hash];
+			db->password_hash[pw_hash] = current_pw;
+		}
+	}
+
+	if (build) {
+		MEM_FREE(tails);
+		db->salt_count = hdr->salt_count;
+		db->password_count = hdr->password_count;
+		db->options->flags |= hdr->flags;
+	}
+
+	return passwords == hdr->password_count && pos <= size;
+}
+
+int ldr_load_snapshot(struct db_main *db)
+{
+	struct ldr_snap_header *hdr;
+	struct fmt_main *format;
+	struct stat file_stat;
+	unsigned int pot_crc;
+	char *map, *label, *key;
+	int fd, ok;
+
+	if (!ldr_snap_enabled(db))
+		return 0;
+
+	if ((fd = open(ldr_snap_name, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &file_stat) ||
+	    file_stat.st_size < (off_t)sizeof(struct ldr_snap_header)) {
+		close(fd);
+		return 0;
+	}
+
+/* Private and writable, in case anyone modifies the strings in place */
+	map = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	hdr = (struct ldr_snap_header *)map;
+	label = map + sizeof(*hdr);
+	if (memcmp(hdr->magic, LDR_SNAP_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->order != LDR_ORDER ||
+	    hdr->size != (unsigned long long)file_stat.st_size ||
+	    !hdr->password_count ||
+	    !memchr(label, 0, file_stat.st_size - sizeof(*hdr)))
+		goto out;
+
+	if ((format = fmt_list))
+	do {
+		if (!strcmp(format->params.label, label))
+			break;
+	} while ((format = format->next));
+	if (!format)
+		goto out;
+
+#ifdef HAVE_OPENCL
+	if (!(options.gpu_devices->count && options.fork))
+#endif
+	fmt_init(format);
+
+	key = ldr_snap_key(db, format);
+	ok = hdr->key_size == strlen(key) + 1 &&
+	    label + strlen(label) + 1 + hdr->key_size <= map + hdr->size &&
+	    !memcmp(label + strlen(label) + 1, key, hdr->key_size);
+	MEM_FREE(key);
+	if (!ok)
+		goto out;
+
+	if (!ldr_pot_crc(hdr->pot_pos, &pot_crc) ||
+	    pot_crc != hdr->pot_crc)
+		goto out;
+
+	label += strlen(label) + 1 + hdr->key_size;
+	if (!ldr_snap_records(db, 0, format, hdr, label, map + hdr->size)) {
+		if (john_main_process)
+			fprintf(stderr, "Warning: hash snapshot %s is damaged, "
+			    "not using it\n", ldr_snap_name);
+		goto out;
+	}
+
+	db->format = format;
+	ldr_snap_records(db, 1, format, hdr, label, map + hdr->size);
+	ldr_pot_start = hdr->pot_pos;
+	ldr_snap_restored = 1;
+	return 1;
+
+out:
+	munmap(map, file_stat.st_size);
+	return 0;
+}
+
+static int ldr_file_write(FILE *file, unsigned long long *pos,
+	void *data, size_t size)
+{
+	*pos += size;
+	return !size || fwrite(data, size, 1, file) == 1;
+}
+
+static int ldr_file_pad(FILE *file, unsigned long long *pos, size_t align)
+{
+	static char zero[MEM_ALIGN_PAGE];
+	size_t size = LDR_ALIGN(*pos, align) - *pos;
+
+	return size <= sizeof(zero) && ldr_file_write(file, pos, zero, size);
+}
+
+/*
+ * Writes the salt and password records for the hashes not marked as cracked.
+ * Returns non-zero on success.
+ */
+static int ldr_save_records(struct db_main *db, FILE *file,
+	unsigned long long *pos, struct ldr_snap_header *hdr)
+{
+	struct fmt_main *format = db->format;
+	struct db_salt *current_salt;
+	struct db_password *current_pw;
+	unsigned int count;
+	int hash;
+
+	for (hash = 0; hash < SALT_HASH_SIZE; hash++)
+	if ((current_salt = db->salt_hash[hash]))
+	do {
+		count = 0;
+		if ((current_pw = current_salt->list))
+		do {
+			if (current_pw->binary)
+				count++;
+		} while ((current_pw = current_pw->next));
+		if (!count)
+			continue;
+
+		hdr->salt_count++;
+		hdr->password_count += count;
+		if (!ldr_file_pad(file, pos, sizeof(count)) ||
+		    !ldr_file_write(file, pos, &count, sizeof(count)))
+			return 0;
+
+		current_pw = current_salt->list;
+		do {
+			if (!current_pw->binary)
+				continue;
+			if (!ldr_file_pad(file, pos,
+			    format->params.binary_align) ||
+			    !ldr_file_write(file, pos, current_pw->binary,
+			    format->params.binary_size))
+				return 0;
+			if (format->methods.source == fmt_default_source &&
+			    !ldr_file_write(file, pos, current_pw->source,
+			    strlen(current_pw->source) + 1))
+				return 0;
+			if ((db->options->flags & DB_LOGIN) &&
+			    !ldr_file_write(file, pos, current_pw->login,
+			    strlen(current_pw->login) + 1))
+				return 0;
+		} while ((current_pw = current_pw->next));
+	} while ((current_salt = current_salt->next));
+
+	return 1;
+}
+
+static void ldr_save_snapshot(struct db_main *db)
+{
+	struct ldr_snap_header hdr;
+	unsigned long long pos = 0;
+	char *key, *tmp;
+	FILE *file;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LDR_SNAP_MAGIC, sizeof(hdr.magic));
+	hdr.order = LDR_ORDER;
+	hdr.pot_pos = crk_pot_pos;
+	hdr.flags = db->options->flags & (DB_SPLIT | DB_NODUP);
+	if (!ldr_pot_crc(hdr.pot_pos, &hdr.pot_crc))
+		return;
+
+	key = ldr_snap_key(db, db->format);
+	hdr.key_size = strlen(key) + 1;
+
+	tmp = mem_alloc(strlen(ldr_snap_name) + 16);
+	sprintf(tmp, "%s.%u", ldr_snap_name, (unsigned int)getpid());
+	if (!(file = fopen(tmp, "wb"))) {
+		log_event("- Can't save hash snapshot to %.100s",
+		    ldr_snap_name);
+		MEM_FREE(tmp);
+		MEM_FREE(key);
+		return;
+	}
+
+	ok = ldr_file_write(file, &pos, &hdr, sizeof(hdr)) &&
+	    ldr_file_write(file, &pos, db->format->params.label,
+	    strlen(db->format->params.label) + 1) &&
+	    ldr_file_write(file, &pos, key, hdr.key_size) &&
+	    ldr_save_records(db, file, &pos, &hdr);
+	MEM_FREE(key);
+
+/* Now that we know the counts and size, rewrite the header */
+	hdr.size = pos;
+	if (ok)
+		ok = !fseek(file, 0, SEEK_SET) &&
+		    fwrite(&hdr, sizeof(hdr), 1, file) == 1;
+	if (fclose(file))
+		ok = 0;
+	if (!hdr.password_count)
+		ok = 0;
+
+	if (ok && !rename(tmp, ldr_snap_name)) {
+		log_event("- Saved hash snapshot (%u hashes) to %.100s",
+		    hdr.password_count, ldr_snap_name);
+	} else {
+		if (hdr.password_count)
+			log_event("- Can't save hash snapshot to %.100s",
+			    ldr_snap_name);
+		unlink(tmp);
+	}
+	MEM_FREE(tmp);
+}
+
+void ldr_update_snapshot(struct db_main *db)
+{
+	struct db_salt *current_salt;
+	struct db_password *current_pw;
+	int hash, marked = 0;
+
+	if (ldr_snap_restored)
+		log_event("- Loaded hashes from snapshot %.100s",
+		    ldr_snap_name);
+
+	if (!john_main_process || !db->format || !db->password_count ||
+	    !ldr_snap_enabled(db))
+		return;
+
+/* A snapshot we've just used only needs updating if john.pot had news */
+	if (ldr_snap_restored) {
+		for (hash = 0; hash < SALT_HASH_SIZE && !marked; hash++)
+		if ((current_salt = db->salt_hash[hash]))
+		do {
+			current_pw = current_salt->list;
+			do {
+				if (!current_pw->binary)
+					marked = 1;
+			} while (!marked && (current_pw = current_pw->next));
+		} while (!marked && (current_salt = current_salt->next));
+		if (!marked)
+			return;
+	}
+
+	ldr_save_snapshot(db);
+}
+/*
+ * Pot file indices.  Removing the hashes that are in the pot file means
+ * reading all of it and having the format valid()ate, split() and binary()
+ * every line, which gets slow as the pot file grows over the years.  With
+ * PotIndex enabled, a large pot file gets an index for each format it's used
+ * with, next to it.  The index maps a hash of each valid line's binary to the
+ * line's offset, sorted by that hash (with a fan-out table to narrow down the
+ * search, much like git's pack indices).  Removing the cracked hashes, and
+ * --show with a --format, then look up each loaded hash and only read the
+ * pot lines that may match, processing them exactly as a full read would.
+ * Lines appended to the pot file since the index was written are indexed in
+ * memory, and once there are enough of them we write a new index.
+ */
+#define LDR_POT_IDX_MAGIC		"JtRPotI1"
+#define LDR_POT_IDX_SUFFIX		".idx"
+#define LDR_POT_IDX_FANOUT		0x10000
+
+/*
+ * Write a new index once the pot file has grown by this fraction of what the
+ * current one covers.
+ */
+#define LDR_POT_IDX_MERGE		64
+
+struct ldr_pot_idx_header {
+	char magic[8];
+	unsigned long long order;
+	unsigned long long pot_pos;
+	unsigned long long count;
+	unsigned int pot_crc;
+	unsigned int key_size;
+};
+
+struct ldr_pot_idx_entry {
+	unsigned long long hash;
+	unsigned long long offset;
+};
+
+static struct {
+	struct fmt_main *format;
+	FILE *pot;
+	unsigned long long pos;
+	char *map;
+	size_t map_size;
+	unsigned long long *fanout;
+	struct ldr_pot_idx_entry *entries;
+	unsigned long long count;
+	struct ldr_pot_idx_entry *tail;
+	size_t tail_count;
+} ldr_pot_idx;
+
+static unsigned long long ldr_pot_idx_hash(struct fmt_main *format,
+	void *binary)
+{
+	unsigned char *p = binary;
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < format->params.binary_size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Hashes the binary of a pot line, if it's valid for the format.  This needs
+ * to match what ldr_load_pot_line() does with the line.
+ */
+static int ldr_pot_idx_line(struct db_main *db, struct fmt_main *format,
+	char *line, unsigned long long *hash)
+{
+	char *ciphertext;
+
+	ciphertext = ldr_get_field(&line, db->options->field_sep_char);
+	if (format->methods.valid(ciphertext, format) != 1)
+		return 0;
+
+	ciphertext = format->methods.split(ciphertext, 0, format);
+	*hash = ldr_pot_idx_hash(format, format->methods.binary(ciphertext));
+	return 1;
+}
+
+static int ldr_pot_idx_cmp(const void *x, const void *y)
+{
+	const struct ldr_pot_idx_entry *a = x, *b = y;
+
+	if (a->hash != b->hash)
+		return a->hash < b->hash ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+static char *ldr_pot_idx_name(struct fmt_main *format)
+{
+	char *pot = path_expand(options.loader.activepot);
+	char *name, *p;
+
+	name = mem_alloc(strlen(pot) + strlen(format->params.label) +
+	    sizeof(LDR_POT_IDX_SUFFIX) + 1);
+	sprintf(name, "%s.", pot);
+	p = name + strlen(name);
+	strcpy(p, format->params.label);
+	for (; *p; p++)
+	if (!isalnum(ARCH_INDEX(*p)) && *p != '-' && *p != '_')
+		*p = '_';
+	strcat(name, LDR_POT_IDX_SUFFIX);
+
+	return name;
+}
+
+static int ldr_pot_idx_put(FILE *file, unsigned long long *fanout,
+	struct ldr_pot_idx_entry *entry)
+{
+	if (fanout) {
+		fanout[entry->hash >> 48]++;
+		return 1;
+	}
+	return fwrite(entry, sizeof(*entry), 1, file) == 1;
+}
+
+/*
+ * Merges the mapped index and the in-memory tail, either counting the entries
+ * into the fan-out table, or writing them out.
+ */
+static int ldr_pot_idx_merge(FILE *file, unsigned long long *fanout)
+{
+	unsigned long long i = 0;
+	size_t j = 0;
+	int ok = 1;
+
+	while (ok && (i < ldr_pot_idx.count || j < ldr_pot_idx.tail_count)) {
+		if (j >= ldr_pot_idx.tail_count ||
+		    (i < ldr_pot_idx.count &&
+		    ldr_pot_idx_cmp(&ldr_pot_idx.entries[i],
+		    &ldr_pot_idx.tail[j]) <= 0))
+			ok = ldr_pot_idx_put(file, fanout,
+			    &ldr_pot_idx.entries[i++]);
+		else
+			ok = ldr_pot_idx_put(file, fanout,
+			    &ldr_pot_idx.tail[j++]);
+	}
+
+	return ok;
+}
+
+static void ldr_pot_idx_save(char *name, char *key)
+{
+	struct ldr_pot_idx_header hdr;
+	unsigned long long *fanout, pos = 0;
+	char *tmp;
+	FILE *file;
+	int i, ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LDR_POT_IDX_MAGIC, sizeof(hdr.magic));
+	hdr.order = LDR_ORDER;
+	hdr.pot_pos = ldr_pot_idx.pos;
+	hdr.count = ldr_pot_idx.count + ldr_pot_idx.tail_count;
+	hdr.key_size = strlen(key) + 1;
+	if (!ldr_pot_crc(hdr.pot_pos, &hdr.pot_crc))
+		return;
+
+	fanout = mem_calloc(LDR_POT_IDX_FANOUT * sizeof(*fanout));
+	ldr_pot_idx_merge(NULL, fanout);
+	for (i = 1; i < LDR_POT_IDX_FANOUT; i++)
+		fanout[i] += fanout[i - 1];
+
+	tmp = mem_alloc(strlen(name) + 16);
+	sprintf(tmp, "%s.%u", name, (unsigned int)getpid());
+	if (!(file = fopen(tmp, "wb"))) {
+		log_event("- Can't save pot file index to %.100s", name);
+		MEM_FREE(tmp);
+		MEM_FREE(fanout);
+		return;
+	}
+
+	ok = ldr_file_write(file, &pos, &hdr, sizeof(hdr)) &&
+	    ldr_file_write(file, &pos, key, hdr.key_size) &&
+	    ldr_file_pad(file, &pos, sizeof(*fanout)) &&
+	    ldr_file_write(file, &pos, fanout,
+	    LDR_POT_IDX_FANOUT * sizeof(*fanout)) &&
+	    ldr_pot_idx_merge(file, NULL);
+	if (fclose(file))
+		ok = 0;
+	MEM_FREE(fanout);
+
+	if (ok && !rename(tmp, name)) {
+		log_event("- Saved pot file index (%llu entries) to %.100s",
+		    hdr.count, name);
+	} else {
+		log_event("- Can't save pot file index to %.100s", name);
+		unlink(tmp);
+	}
+	MEM_FREE(tmp);
+}
+
+/*
+ * Maps the format's index for the pot file, and indexes what has been added
+ * to the pot file since.  Returns non-zero if the index can be used.
+ */
+static int ldr_pot_idx_open(struct db_main *db, struct fmt_main *format)
+{
+	struct ldr_pot_idx_header *hdr;
+	struct stat file_stat;
+	char line[LINE_BUFFER_SIZE], *name, *key = NULL;
+	size_t key_len = 0, key_size = 0, tail_size = 0;
+	unsigned long long data, indexed, hash;
+	unsigned int pot_crc;
+	long next;
+	int fd;
+
+	if (ldr_pot_idx.format)
+		return ldr_pot_idx.format == format;
+
+	if (options.regen_lost_salts || format->params.binary_size < 4 ||
+	    !cfg_get_bool(SECTION_OPTIONS, NULL, "PotIndex", 0))
+		return 0;
+
+	if (!(ldr_pot_idx.pot = fopen(path_expand(options.loader.activepot),
+	    "r")))
+		return 0;
+	if (fstat(fileno(ldr_pot_idx.pot), &file_stat) ||
+	    file_stat.st_size < LDR_POT_INDEX_MIN) {
+		fclose(ldr_pot_idx.pot);
+		ldr_pot_idx.pot = NULL;
+		return 0;
+	}
+
+	ldr_key_format(&key, &key_len, &key_size, db, format);
+	name = ldr_pot_idx_name(format);
+
+	if ((fd = open(name, O_RDONLY)) >= 0) {
+		if (!fstat(fd, &file_stat) &&
+		    file_stat.st_size >= (off_t)sizeof(*hdr)) {
+			ldr_pot_idx.map_size = file_stat.st_size;
+			ldr_pot_idx.map = mmap(NULL, ldr_pot_idx.map_size,
+			    PROT_READ, MAP_SHARED, fd, 0);
+			if (ldr_pot_idx.map == MAP_FAILED)
+				ldr_pot_idx.map = NULL;
+		}
+		close(fd);
+	}
+
+	if ((hdr = (struct ldr_pot_idx_header *)ldr_pot_idx.map)) {
+		data = LDR_ALIGN(sizeof(*hdr) + hdr->key_size,
+		    sizeof(unsigned long long));
+		if (memcmp(hdr->magic, LDR_POT_IDX_MAGIC, sizeof(hdr->magic)) ||
+		    hdr->order != LDR_ORDER ||
+		    hdr->key_size != key_len + 1 ||
+		    hdr->count > ldr_pot_idx.map_size ||
+		    data + LDR_POT_IDX_FANOUT * sizeof(unsigned long long) +
+		    hdr->count * sizeof(struct ldr_pot_idx_entry) !=
+		    ldr_pot_idx.map_size ||
+		    memcmp(ldr_pot_idx.map + sizeof(*hdr), key, hdr->key_size) ||
+		    !ldr_pot_crc(hdr->pot_pos, &pot_crc) ||
+		    pot_crc != hdr->pot_crc) {
+			log_event("- Pot file index %.100s is out of date, "
+			    "rebuilding it", name);
+			munmap(ldr_pot_idx.map, ldr_pot_idx.map_size);
+			ldr_pot_idx.map = NULL;
+		} else {
+			ldr_pot_idx.fanout = (unsigned long long *)
+			    (ldr_pot_idx.map + data);
+			ldr_pot_idx.entries = (struct ldr_pot_idx_entry *)
+			    (ldr_pot_idx.fanout + LDR_POT_IDX_FANOUT);
+			ldr_pot_idx.count = hdr->count;
+			ldr_pot_idx.pos = hdr->pot_pos;
+		}
+	}
+	indexed = ldr_pot_idx.pos;
+
+/* Index the complete lines added since */
+	if (fseek(ldr_pot_idx.pot, (long)ldr_pot_idx.pos, SEEK_SET))
+		pexit("fseek");
+	while (fgets(line, sizeof(line), ldr_pot_idx.pot)) {
+		if (!strchr(line, '\n') && feof(ldr_pot_idx.pot))
+			break;
+		if ((next = ftell(ldr_pot_idx.pot)) < 0)
+			pexit("ftell");
+		if (ldr_pot_idx_line(db, format, line, &hash)) {
+			if (ldr_pot_idx.tail_count >= tail_size) {
+				struct ldr_pot_idx_entry *old = ldr_pot_idx.tail;
+
+				tail_size = tail_size ? tail_size * 2 : 0x1000;
+				ldr_pot_idx.tail = mem_alloc(tail_size *
+				    sizeof(*ldr_pot_idx.tail));
+				if (old) {
+					memcpy(ldr_pot_idx.tail, old,
+					    ldr_pot_idx.tail_count *
+					    sizeof(*old));
+					MEM_FREE(old);
+				}
+			}
+			ldr_pot_idx.tail[ldr_pot_idx.tail_count].hash = hash;
+			ldr_pot_idx.tail[ldr_pot_idx.tail_count++].offset =
+			    ldr_pot_idx.pos;
+		}
+		ldr_pot_idx.pos = next;
+		check_abort(0);
+	}
+	if (ferror(ldr_pot_idx.pot)) pexit("fgets");
+
+	if (ldr_pot_idx.tail_count)
+		qsort(ldr_pot_idx.tail, ldr_pot_idx.tail_count,
+		    sizeof(*ldr_pot_idx.tail), ldr_pot_idx_cmp);
+
+	ldr_pot_idx.format = format;
+
+	if (john_main_process && ldr_pot_idx.pos > indexed &&
+	    (ldr_pot_idx.pos - indexed) * LDR_POT_IDX_MERGE >= indexed)
+		ldr_pot_idx_save(name, key);
+
+	MEM_FREE(name);
+	MEM_FREE(key);
+
+	return 1;
+}
+
+/*
+ * The first of the count entries with the given hash, or past them.
+ */
+static unsigned long long ldr_pot_idx_first(struct ldr_pot_idx_entry *entries,
+	unsigned long long lo, unsigned long long hi, unsigned long long hash)
+{
+	unsigned long long mid;
+
+	while (lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		if (entries[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void ldr_pot_idx_read(struct db_main *db, unsigned long long offset,
+	void (*process_line)(struct db_main *db, char *line))
+{
+	char line[LINE_BUFFER_SIZE];
+
+	if (fseek(ldr_pot_idx.pot, (long)offset, SEEK_SET))
+		pexit("fseek");
+	if (fgets(line, sizeof(line), ldr_pot_idx.pot))
+		process_line(db, line);
+}
+
+/*
+ * Passes the pot lines that may be for this binary to process_line().
+ */
+static void ldr_pot_idx_find(struct db_main *db, void *binary,
+	void (*process_line)(struct db_main *db, char *line))
+{
+	unsigned long long hash, i, end;
+	unsigned int top;
+
+	hash = ldr_pot_idx_hash(ldr_pot_idx.format, binary);
+
+	if (ldr_pot_idx.count) {
+		top = hash >> 48;
+		end = ldr_pot_idx.fanout[top];
+		i = ldr_pot_idx_first(ldr_pot_idx.entries,
+		    top ? ldr_pot_idx.fanout[top - 1] : 0, end, hash);
+		for (; i < end && ldr_pot_idx.entries[i].hash == hash; i++)
+			ldr_pot_idx_read(db, ldr_pot_idx.entries[i].offset,
+			    process_line);
+	}
+
+	i = ldr_pot_idx_first(ldr_pot_idx.tail, 0, ldr_pot_idx.tail_count,
+	    hash);
+	for (; i < ldr_pot_idx.tail_count &&
+	    ldr_pot_idx.tail[i].hash == hash; i++)
+		ldr_pot_idx_read(db, ldr_pot_idx.tail[i].offset,
+		    process_line);
+}
+
+/*
+ * Removes the cracked hashes from the database by looking each one up in the
+ * pot file index.  Returns zero if there's no index to use, in which case the
+ * caller should read the pot file instead.
+ */
+static int ldr_pot_idx_remove(struct db_main *db, char *name,
+	void (*process_line)(struct db_main *db, char *line))
+{
+	struct db_salt *current_salt;
+	struct db_password *current_pw;
+	int hash;
+
+/* After restoring a snapshot, only the new entries are read anyway */
+	if (name != options.loader.activepot || ldr_snap_restored ||
+	    !ldr_pot_idx_open(db, db->format))
+		return 0;
+
+	for (hash = 0; hash < SALT_HASH_SIZE; hash++)
+	if ((current_salt = db->salt_hash[hash]))
+	do {
+		if ((current_pw = current_salt->list))
+		do {
+			if (current_pw->binary)
+				ldr_pot_idx_find(db, current_pw->binary,
+				    process_line);
+		} while ((current_pw = current_pw->next));
+		check_abort(0);
+	} while ((current_salt = current_salt->next));
+
+	crk_pot_pos = (long)ldr_pot_idx.pos;
+	return 1;
+}
+
+/*
+ * For --show with a --format, sets up looking the hashes up in the pot file
+ * index as they are read, rather than reading the whole pot file up front.
+ */
+static int ldr_pot_idx_show_init(struct db_main *db, char *name)
+{
+	if (!(options.flags & FLG_SHOW_CHK) || fmt_list->next ||
+	    name != options.loader.activepot ||
+	    (db->options->flags & DB_PLAINTEXTS))
+		return 0;
+
+	fmt_init(fmt_list);
+	return ldr_pot_idx_open(db, fmt_list);
+}
+
+static int ldr_pot_idx_active(struct fmt_main *format)
+{
+	return format && ldr_pot_idx.format == format;
+}
+
+static void ldr_pot_idx_show(struct db_main *db, struct fmt_main *format,
+	char *piece, void (*process_line)(struct db_main *db, char *line))
+{
+	if (ldr_pot_idx_active(format))
+		ldr_pot_idx_find(db, format->methods.binary(piece),
+		    process_line);
+}
+#else
+int ldr_load_snapshot(struct db_main *db)
+{
+	return 0;
+}
+
+void ldr_update_snapshot(struct db_main *db)
+{
+}
+
+static int ldr_pot_idx_remove(struct db_main *db, char *name,
+	void (*process_line)(struct db_main *db, char *line))
+{
+	return 0;
+}
+
+static int ldr_pot_idx_show_init(struct db_main *db, char *name)
+{
+	return 0;
+}
+
+static int ldr_pot_idx_active(struct fmt_main *format)
+{
+	return 0;
+}
+
+static void ldr_pot_idx_show(struct db_main *db, struct fmt_main *format,
+	char *piece, void (*process_line)(struct db_main *db, char *line))
+{
+}
+#endif
+
+static void ldr_load_pot_line(struct db_main *db, char *line)
+{
+	struct fmt_main *format = db->format;
+	char *ciphertext;
+	void *binary;
+	int hash;
+	struct db_password *current;
+
+	ciphertext = ldr_get_field(&line, db->options->field_sep_char);
+	if (format->methods.valid(ciphertext, format) != 1) return;
+
+	ciphertext = format->methods.split(ciphertext, 0, format);
+	binary = format->methods.binary(ciphertext);
+	hash = db->password_hash_func(binary);
+
+	if ((current = db->password_hash[hash]))
+	do {
+		if (options.regen_lost_salts)
+			ldr_pot_possible_fixup_salt(current->source,
+			                            ciphertext);
+		if (!current->binary) /* already marked for removal */
+			continue;
+		if (memcmp(binary, current->binary, format->params.binary_size))
+			continue;
+		if (strcmp(ciphertext,
+		    format->methods.source(current->source, current->binary)))
+			continue;
+		current->binary = NULL; /* mark for removal */
+	} while ((current = current->next_hash));
+}
+
+void ldr_load_pot_file(struct db_main *db, char *name)
+{
+	if (db->format && !(db->format->params.flags & FMT_NOT_EXACT)) {
+#ifdef HAVE_CRYPT
+		ldr_in_pot = 1;
+#endif
+		if (!ldr_pot_idx_remove(db, name, ldr_load_pot_line))
+			read_file(db, name, RF_ALLOW_MISSING,
+			    ldr_load_pot_line);
+#ifdef HAVE_CRYPT
+		ldr_in_pot = 0;
+#endif
+	}
+}
+
+/*
+ * The following are several functions called by ldr_fix_database().
+ * They assume that the per-salt hash tables have not yet been initialized.
+ */
+
+/*
+ * Glue the salt_hash[] buckets together and into the salts list.  The loader
+ * needs the hash table, but then we free it and the cracker uses the list.
+ */
+static void ldr_init_salts(struct db_main *db)
+{
+	struct db_salt **tail, *current;
+	int hash, ctr = 0;
+
+	for (hash = 0, tail = &db->salts; hash < SALT_HASH_SIZE; hash++)
+	if ((current = db->salt_hash[hash])) {
+		*tail = current;
+		ctr = 0;
+		do {
+			current -> sequential_id = ctr++;
+			tail = &current->next;
+		} while ((current = current->next));
+#ifdef DEBUG_HASH
+		if (ctr)
+			printf("salt hash %08x, %d salts\n", hash, ctr);
+#endif
+	}
+}
+
+/* #define DEBUG_SALT_SORT */
+
+/*
+ * this will be the salt_compare() method we stick into
+ * wpapsk_fmt.c (and cuda/opencl)
+ */
+int salt_compare(const void *x, const void *y)
+{
+	/* this is all that is needed in wpapsk salt_compare() */
+	return strncmp((const char*)x, (const char*)y, 36);
+}
+
+/*
+ * This was done as a structure to allow more data to be
+ * placed into it, beyond just the simple pointer. The
+ * pointer is really all that is needed.  However, when
+ * building with the structure containing just a pointer,
+ * we get no (or very little) degredation over just an
+ * array of pointers.  The compiler treats them the same.
+ * so for ease of debugging, I have left this as a simple
+ * structure
+ */
+typedef struct salt_cmp_s
+{
+	struct db_salt *p;
+#ifdef DEBUG_SALT_SORT
+	/* used by JimF in debugging.  Left in for now */
+	int org_idx;
+	char str[36];
+#endif
+} salt_cmp_t;
+
+/*
+ * there is no way to pass this pointer to the sort function, so
+ * we set it before calling sort. Right now, we do not use it,
+ * but later we will use salt_sort_db->format->methods.salt_compare()
+ * we actually could just harvest off the function pointer to the
+ * salt_compare function, instead (TBD), instead of the db_main*
+ */
+static struct db_main *salt_sort_db;
+
+/*
+ * This helper function will stay in loader.  It is what the qsort
+ * function calls.  This function is smart enough to know how to
+ * parse a salt_cmp_t. It does that, to find the real salt values,
+ * and then calls the formats salt_compare passing in just the salts.
+ * It is an extra layer of indirection, but keeps the function from
+ * having to know about our structure, or the db_salt structure. There
+ * is very little additional overhead, in this 2nd layer of indirection
+ * since qsort is pretty quick, and does not call compare any more than
+ * is needed to partition sort the data.
+ */
+static int ldr_salt_cmp(const void *x, const void *y) {
+	salt_cmp_t *X = (salt_cmp_t *)x;
+	salt_cmp_t *Y = (salt_cmp_t *)y;
+	int cmp = salt_compare(X->p->salt, Y->p->salt);
+	return cmp;
+}
+
+/*
+ * If there are more than 1 salt, AND the format exports a salt_compare
+ * function, then we reorder the salt array, into the order the format
+ * wants them in.  Reasons for this, are usually that the format can
+ * gain a lot of speed, if some of the salts are grouped together, so
+ * that the group is run one after the other.  This was first done for
+ * the WPAPSK format, so that the format could group all ESSID's in
+ * the salts, so that the PBKDF2 is computed once (for the first
+ * instance of the ESSID), then all of the other salts which are
+ * different salts, but  * which have the exact same ESSID will not
+ * have to perform the very costly PBKDF2.  The format is designed
+ * to work that way, IFF the salts come to it in the right order.
+ * This function gets them into that order
+ */
+static void ldr_sort_salts(struct db_main *db)
+{
+	int i;
+	struct db_salt *s;
+#ifndef DEBUG_SALT_SORT
+	salt_cmp_t *ar;
+#else
+	salt_cmp_t ar[100];  /* array is easier to debug in VC */
+#endif
+	/*
+	 * NOTE, later we will use a new format method (salt_compare) to
+	 * determine when to do this sorting.  For now, we will compute
+	 * when (based on format name), and we have the salt_compare()
+	 * in this file, so that we can utilize this functionality prior
+	 * to getting this method out to every format.
+	 */
+	if (db->salt_count < 2 ||
+		strncasecmp(db->format->params.label, "wpapsk", 6))
+		return;
+
+	log_event("Sorting salts, for \"same salt\" emulation");
+
+	salt_sort_db = db;
 #ifndef DEBUG_SALT_SORT
 	ar = (salt_cmp_t *)mem_alloc(sizeof(salt_cmp_t)*db->salt_count);
 #endif
@@ -1005,6 +2437,65 @@ static void ldr_filter_salts(struct db_main *db)
  * Allocate memory for and initialize the hash table for this salt if needed.
  * Also initialize salt->count (the number of password hashes for this salt).
  */
+/*
+ * Builds the compact lookup table for a salt with many hashes, see loader.h.
+ * The binaries are moved to a packed array, in the order of the list.
+ */
+static void ldr_init_table_for_salt(struct db_main *db, struct db_salt *salt)
+{
+	struct fmt_main *format = db->format;
+	struct db_table *table;
+	struct db_password *current;
+	int (*hash_func)(void *binary);
+	unsigned int bits, hash, slot, index;
+	size_t size, align;
+
+	table = salt->table = mem_alloc_tiny(sizeof(*table), MEM_ALIGN_WORD);
+
+/* At most 3/4 full, so that probe sequences stay short */
+	bits = 1;
+	while (bits < 32 && ((size_t)1 << bits) * 3 / 4 < (size_t)salt->count)
+		bits++;
+	size = (size_t)1 << bits;
+	table->mask = size - 1;
+	table->shift = 32 - bits;
+	table->entries = mem_alloc_tiny(size * sizeof(*table->entries),
+	    MEM_ALIGN_CACHE);
+	memset(table->entries, 0xff, size * sizeof(*table->entries));
+
+	align = format->params.binary_align;
+	if (align < 1)
+		align = 1;
+	table->binary_stride = (format->params.binary_size + align - 1) /
+	    align * align;
+	table->binaries = mem_alloc_tiny(table->binary_stride * salt->count,
+	    align > MEM_ALIGN_WORD ? align : MEM_ALIGN_WORD);
+	table->passwords = mem_alloc_tiny(
+	    salt->count * sizeof(*table->passwords), MEM_ALIGN_WORD);
+
+	hash_func = format->methods.binary_hash[salt->hash_size];
+
+	index = 0;
+	if ((current = salt->list))
+	do {
+		current->next_hash = NULL; /* unused */
+		current->binary = memcpy(table->binaries +
+		    index * table->binary_stride, current->binary,
+		    format->params.binary_size);
+		table->passwords[index] = current;
+
+		hash = hash_func(current->binary);
+		salt->bitmap[hash / (sizeof(*salt->bitmap) * 8)] |=
+		    1U << (hash % (sizeof(*salt->bitmap) * 8));
+
+		slot = DB_TABLE_SLOT(table, hash);
+		while (table->entries[slot].index != DB_TABLE_EMPTY)
+			slot = (slot + 1) & table->mask;
+		table->entries[slot].hash = hash;
+		table->entries[slot].index = index++;
+	} while ((current = current->next));
+}
+
 static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 {
 	struct db_password *current;
@@ -1032,6 +2523,16 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 		memset(salt->bitmap, 0, size);
 	}
 
+	salt->index = db->format->methods.get_hash[salt->hash_size];
+
+/* The table needs about as many hash values as there are hashes */
+	if (salt->count >= PASSWORD_TABLE_THRESHOLD && mem_saving_level < 2 &&
+	    (bitmap_size >= salt->count ||
+	    salt->hash_size == PASSWORD_HASH_SIZES - 1)) {
+		ldr_init_table_for_salt(db, salt);
+		return;
+	}
+
 	hash_size = bitmap_size >> PASSWORD_HASH_SHR;
 	if (hash_size > 1) {
 		size_t size = hash_size * sizeof(struct db_password *);
@@ -1039,8 +2540,6 @@ static void ldr_init_hash_for_salt(struct db_main *db, struct db_salt *salt)
 		memset(salt->hash, 0, size);
 	}
 
-	salt->index = db->format->methods.get_hash[salt->hash_size];
-
 	hash_func = db->format->methods.binary_hash[salt->hash_size];
 
 	salt->count = 0;
@@ -1201,7 +2700,8 @@ void ldr_show_pot_file(struct db_main *db, char *name)
 #ifdef HAVE_CRYPT
 	ldr_in_pot = 1;
 #endif
-	read_file(db, name, RF_ALLOW_MISSING, ldr_show_pot_line);
+	if (!ldr_pot_idx_show_init(db, name))
+		read_file(db, name, RF_ALLOW_MISSING, ldr_show_pot_line);
 #ifdef HAVE_CRYPT
 	ldr_in_pot = 0;
 #endif
@@ -1213,7 +2713,7 @@ static void ldr_show_pw_line(struct db_main *db, char *line)
 	char source[LINE_BUFFER_SIZE];
 	struct fmt_main *format;
 	char *(*split)(char *ciphertext, int index, struct fmt_main *self);
-	int index, count, unify;
+	int index, count, unify, copy;
 	char *login, *ciphertext, *gecos, *home;
 	char *piece;
 	int pass, found, chars;
@@ -1246,6 +2746,7 @@ static void ldr_show_pw_line(struct db_main *db, char *line)
 		count = 1;
 		unify = 0;
 	}
+	copy = unify || ldr_pot_idx_active(format);
 
 	if (!options.utf8 && !options.store_utf8 && options.report_utf8) {
 		login = (char*)enc_to_utf8_r(login, utf8login,
@@ -1264,9 +2765,13 @@ static void ldr_show_pw_line(struct db_main *db, char *line)
 	for (found = pass = 0; pass == 0 || (pass == 1 && found); pass++)
 	for (index = 0; index < count; index++) {
 		piece = split(ciphertext, index, format);
-		if (unify)
+		if (copy)
 			piece = strcpy(mem_alloc(strlen(piece) + 1), piece);
 
+/* With a pot file index, fetch this hash's pot lines now */
+		if (!pass)
+			ldr_pot_idx_show(db, format, piece, ldr_show_pot_line);
+
 		hash = ldr_cracked_hash(piece);
 
 		if ((current = db->cracked_hash[hash]))
@@ -1284,7 +2789,7 @@ static void ldr_show_pw_line(struct db_main *db, char *line)
 				break;
 		} while ((current = current->next));
 
-		if (unify)
+		if (copy)
 			MEM_FREE(piece);
 
 		if (pass) {
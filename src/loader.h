@@ -100,6 +100,33 @@ struct db_keys {
 	char buffer[1];
 };
 
+/*
+ * Compact lookup table for salts with many hashes, used instead of the hash
+ * table of lists.  The entries hold a hash value and an index into arrays of
+ * the binaries (packed binary_stride bytes apart) and of the passwords.  With
+ * open addressing, a lookup usually touches just one cache line, plus one
+ * for the binary if the hash value matches.
+ */
+#define DB_TABLE_EMPTY			0xffffffffU
+#define DB_TABLE_REMOVED		0xfffffffeU
+
+struct db_table_entry {
+	unsigned int hash;
+	unsigned int index;
+};
+
+struct db_table {
+	struct db_table_entry *entries;
+	unsigned int mask, shift;
+	char *binaries;
+	size_t binary_stride;
+	struct db_password **passwords;
+};
+
+/* First slot to probe for a hash value */
+#define DB_TABLE_SLOT(table, hash) \
+	(((unsigned int)(hash) * 0x9e3779b1U) >> (table)->shift)
+
 /*
  * Salt list entry.
  */
@@ -126,6 +153,9 @@ struct db_salt {
 /* Password hash table for this salt, or a pointer to the list field */
 	struct db_password **hash;
 
+/* Compact lookup table used instead of the hash table above, or NULL */
+	struct db_table *table;
+
 /* Hash table size code, negative for none */
 	int hash_size;
 
@@ -241,6 +271,20 @@ extern void ldr_load_pw_file(struct db_main *db, char *name);
  */
 extern void ldr_load_pot_file(struct db_main *db, char *name);
 
+/*
+ * Restores the hashes loaded by an earlier session from a snapshot, if
+ * HashSnapshot is enabled and the hash files and loader options are the same.
+ * Returns non-zero if it did, in which case the hash files needn't be read.
+ */
+extern int ldr_load_snapshot(struct db_main *db);
+
+/*
+ * Saves a snapshot of the loaded hashes, or updates the one we've restored if
+ * the pot file had entries for some of them.  Called after the pot file has
+ * been loaded, but before the database is fixed.
+ */
+extern void ldr_update_snapshot(struct db_main *db);
+
 /*
  * Fixes the database after loading.
  */
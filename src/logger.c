@@ -10,7 +10,7 @@
  * There's ABSOLUTELY NO WARRANTY, express or implied.
  */
 
-#define _XOPEN_SOURCE /* for fileno(3) and fsync(2) */
+#define _XOPEN_SOURCE 500 /* for fileno(3), fsync(2) and recursive mutexes */
 
 #define NEED_OS_FLOCK
 #include "os.h"
@@ -53,6 +53,32 @@
 #include "cracker.h"
 #include "signals.h"
 
+#ifdef CRK_PIPELINE
+#include <pthread.h>
+
+/*
+ * log_guess() runs on the candidate pipeline's hashing thread while the
+ * cracking mode may log events on the main thread.  The lock is recursive
+ * because of log_*() -> ... -> pexit() -> ... -> log_event().
+ */
+static pthread_mutex_t log_mutex;
+static int log_mutex_ready;
+
+#define log_lock() \
+	do { \
+		if (log_mutex_ready) \
+			pthread_mutex_lock(&log_mutex); \
+	} while (0)
+#define log_unlock() \
+	do { \
+		if (log_mutex_ready) \
+			pthread_mutex_unlock(&log_mutex); \
+	} while (0)
+#else
+#define log_lock() do { } while (0)
+#define log_unlock() do { } while (0)
+#endif
+
 static int cfg_beep;
 static int cfg_log_passwords;
 static int cfg_showcand;
@@ -130,23 +156,8 @@ static void log_file_flush(struct log_file *f)
 	   after it's actually written to the pot file. That is, now. */
 	if (f == &pot && !event_abort && options.reload_at_crack) {
 #ifdef HAVE_MPI
-		if (mpi_p > 1) {
-			int i;
-
-			for (i = 0; i < mpi_p; i++) {
-				if (i == mpi_id)
-					continue;
-				if (mpi_req[i] == NULL)
-					mpi_req[i] = mem_alloc_tiny(
-						sizeof(MPI_Request),
-						MEM_ALIGN_WORD);
-				else
-					if (*mpi_req[i] != MPI_REQUEST_NULL)
-						continue;
-				MPI_Isend("r", 1, MPI_CHAR, i, JOHN_MPI_RELOAD,
-				          MPI_COMM_WORLD, mpi_req[i]);
-			}
-		} else
+		/* MPI nodes get our cracks from the cracker right away */
+		if (mpi_p == 1)
 #endif
 			raise(SIGUSR2);
 	}
@@ -219,6 +230,17 @@ static int log_time(void)
 
 void log_init(char *log_name, char *pot_name, char *session)
 {
+#ifdef CRK_PIPELINE
+	if (!log_mutex_ready) {
+		pthread_mutexattr_t attr;
+
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutex_init(&log_mutex, &attr);
+		pthread_mutexattr_destroy(&attr);
+		log_mutex_ready = 1;
+	}
+#endif
 	in_logger = 1;
 
 	if (log_name && log.fd < 0) {
@@ -277,6 +299,8 @@ void log_guess(char *login, char *ciphertext, char *rep_plain, char *store_plain
 	char spacer[] = "                ";
 	char *secret = "";
 
+	log_lock();
+
 	// This is because printf("%-16s") does not line up multibyte UTF-8.
 	// We need to count characters, not octets.
 	if (options.utf8 || options.report_utf8)
@@ -350,6 +374,8 @@ void log_guess(char *login, char *ciphertext, char *rep_plain, char *store_plain
 
 	in_logger = 0;
 
+	log_unlock();
+
 	if (cfg_beep)
 		write_loop(fileno(stderr), "\007", 1);
 }
@@ -369,11 +395,16 @@ void log_event(const char *format, ...)
 
 	if (log.fd < 0) return;
 
+	log_lock();
+
 /*
  * Handle possible recursion:
  * log_*() -> ... -> pexit() -> ... -> log_event()
  */
-	if (in_logger) return;
+	if (in_logger) {
+		log_unlock();
+		return;
+	}
 	in_logger = 1;
 
 	count1 = log_time();
@@ -396,6 +427,8 @@ void log_event(const char *format, ...)
 	}
 
 	in_logger = 0;
+
+	log_unlock();
 }
 
 void log_discard(void)
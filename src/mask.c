@@ -10,6 +10,7 @@
  */
 
 #include <stdio.h> /* for fprintf(stderr, ...) */
+#include <string.h>
 
 #include "misc.h" /* for error() */
 #include "logger.h"
@@ -22,6 +23,7 @@
 #include "external.h"
 #include "cracker.h"
 #include "john.h"
+#include "dist.h"
 #include "mask.h"
 
 static struct rpp_context ctx, rec_ctx;
@@ -34,6 +36,16 @@ static struct rpp_context ctx, rec_ctx;
 static unsigned int seq, rec_seq;
 static unsigned long long cand;
 
+/*
+ * Dynamic distribution (--fork): chunks of dist_size candidates, numbered
+ * by dist_seq (which must not overflow).  The current chunk covers sequence
+ * numbers dist_start to dist_end - 1.
+ */
+static unsigned long long dist_seq, rec_dist_seq;
+static unsigned long long dist_size, dist_start, dist_end, rec_dist_minor;
+static struct dist_chunk dist_cur, rec_dist_next;
+static int rec_dist_held;
+
 static int get_progress(int *hundth_perc)
 {
 	int hundredXpercent, percent;
@@ -69,6 +81,10 @@ static void save_state(FILE *file)
 	fprintf(file, "%d\n", rec_ctx.count);
 	for (i = 0; i < rec_ctx.count; i++)
 		fprintf(file, "%d\n", rec_ctx.ranges[i].index);
+	if (dist_active)
+		fprintf(file, "%llu %d %llu %u %llu\n", rec_dist_seq,
+		    rec_dist_held, rec_dist_minor,
+		    rec_dist_next.major, rec_dist_next.minor);
 }
 
 static int restore_state(FILE *file)
@@ -84,6 +100,23 @@ static int restore_state(FILE *file)
 	for (i = 0; i < ctx.count; i++)
 		if (fscanf(file, "%d\n", &ctx.ranges[i].index) != 1)
 			return 1;
+
+	if (dist_active) {
+/* A session saved without dynamic distribution keeps the static split */
+		if (fscanf(file, "%llu %d %llu %u %llu\n", &dist_seq,
+		    &rec_dist_held, &dist_cur.minor, &rec_dist_next.major,
+		    &rec_dist_next.minor) != 5) {
+			dist_leave();
+			dist_active = 0;
+		} else if (rec_dist_held) {
+			dist_cur.major = 0;
+			dist_start = dist_cur.minor * dist_size;
+			dist_end = dist_start + dist_size;
+			dist_restore(&dist_cur, &rec_dist_next);
+		} else
+			dist_restore(NULL, &rec_dist_next);
+	}
+
 	return 0;
 }
 
@@ -91,11 +124,49 @@ static void fix_state(void)
 {
 	rec_seq = seq;
 	rec_ctx = ctx;
+
+	if (dist_active) {
+		rec_dist_seq = dist_seq;
+		rec_dist_held = 1;
+		rec_dist_minor = dist_cur.minor;
+		dist_get_next(&rec_dist_next);
+	}
+}
+
+/*
+ * Returns the rightmost range if its candidates may be handed to the format
+ * all at once through crk_process_key_range(), or NULL.  A static --node or
+ * --fork split hands out a block of (usually) one word per node in turn, so
+ * a node never gets a whole range; the chunk queue's chunks are contiguous,
+ * and ranges that fit in the current chunk are used with it.
+ */
+static struct rpp_range *key_range(struct db_main *db)
+{
+	struct rpp_range *range;
+	int i;
+
+	if (f_filter || (options.node_count && !dist_active))
+		return NULL;
+
+	if (ctx.count <= 0 || ctx.refs_count)
+		return NULL;
+
+	for (i = 0; i < ctx.count; i++)
+		if (ctx.ranges[i].flag_p)
+			return NULL;
+
+	range = &ctx.ranges[ctx.count - 1];
+	if (range->count < 2 ||
+	    strlen(ctx.output) > db->format->params.plaintext_length)
+		return NULL;
+
+	return range;
 }
 
 void do_mask_crack(struct db_main *db, char *mask)
 {
 	char *word;
+	struct rpp_range *range;
 	int my_words, their_words;
 	int i;
 
@@ -114,6 +185,17 @@ void do_mask_crack(struct db_main *db, char *mask)
 	status_init(&get_progress, 0);
 
 	rpp_process_rule(&ctx);
+
+	if (dist_active) {
+		dist_size = 1;
+		for (i = 0; i < ctx.count; i++)
+			dist_size *= ctx.ranges[i].count;
+		dist_size /= options.node_count * 256;
+		if (!dist_size)
+			dist_size = 1;
+		dist_seq = dist_end = 0;
+	}
+
 	rec_restore_mode(restore_state);
 	rec_init(db, save_state);
 
@@ -143,8 +225,27 @@ void do_mask_crack(struct db_main *db, char *mask)
 		cand /= options.node_count;
 	}
 
+	range = key_range(db);
+
 	while ((word = rpp_next(&ctx))) {
-		if (options.node_count) {
+		if (dist_active) {
+			if (dist_seq >= dist_end) {
+				dist_next(&dist_cur);
+				if (dist_cur.major)
+					break;
+				dist_start = dist_cur.minor * dist_size;
+				dist_end = dist_start + dist_size;
+/* After a restore, the chunk may be one another node left behind us */
+				if (dist_start < dist_seq) {
+					rpp_init_mask(&ctx, mask);
+					rpp_process_rule(&ctx);
+					dist_seq = 0;
+					continue;
+				}
+			}
+			if (dist_seq++ < dist_start)
+				continue;
+		} else if (options.node_count) {
 			seq++;
 			if (their_words) {
 				their_words--;
@@ -156,11 +257,35 @@ void do_mask_crack(struct db_main *db, char *mask)
 				their_words = options.node_count - my_words;
 			}
 		}
+/*
+ * When the rightmost range has just been reset, let the format set all but
+ * its last character in one go.  rpp_next() then produces that last one and
+ * carries into the ranges to the left as usual.
+ */
+		if (range && range->index == 1 && (!dist_active ||
+		    dist_seq + range->count - 2 <= dist_end)) {
+			int done = crk_process_key_range(word,
+			    range->pos - ctx.output, range->chars,
+			    range->count - 1);
+			if (done > 0)
+				break;
+			if (!done) {
+				range->index = range->count - 1;
+				if (dist_active)
+					dist_seq += range->count - 2;
+				continue;
+			}
+			range = NULL;
+		}
 		if (ext_filter(word))
 			if (crk_process_key(word))
 				break;
 	}
 
+/* Let other nodes know there's nothing more to claim */
+	if (dist_active && !word && !event_abort)
+		dist_end_major(0);
+
 	// Ensure we report DONE
 	if (!event_abort)
 		cand = ((unsigned long long)status.cands.hi << 32) +
@@ -26,6 +26,7 @@
 #include "cracker.h"
 #include "options.h"
 #include "john.h"
+#include "dist.h"
 #include "mkv.h"
 
 #if defined (__MINGW32__) || defined (_MSC_VER)
@@ -44,21 +45,54 @@ extern struct fmt_main fmt_LM;
 
 static long long tidx;
 
+/*
+ * Dynamic distribution (--fork or MPI): chunks of dist_size candidate
+ * indices, chunk n starting at gstart + n * dist_size.  gend is then the
+ * last index of the current chunk, and mkv_last that of the whole range.
+ */
+static unsigned long long dist_size, mkv_last, rec_dist_minor;
+static struct dist_chunk dist_cur, rec_dist_next;
+static int dist_held, rec_dist_held;
+
 static void save_state(FILE *file)
 {
 	fprintf(file, LLd"\n", tidx);
+	if (dist_active)
+		fprintf(file, "%d %llu %u %llu\n", rec_dist_held,
+		    rec_dist_minor, rec_dist_next.major, rec_dist_next.minor);
 }
 
 static int restore_state(FILE *file)
 {
 	if (fscanf(file, LLd"\n", &gidx) != 1) return 1;
 
+	if (dist_active) {
+/* A session saved without dynamic distribution keeps the static split */
+		if (fscanf(file, "%d %llu %u %llu\n", &rec_dist_held,
+		    &dist_cur.minor, &rec_dist_next.major,
+		    &rec_dist_next.minor) != 4) {
+			dist_leave();
+			dist_active = 0;
+		} else if (rec_dist_held) {
+			dist_cur.major = 0;
+			dist_held = 1;
+			dist_restore(&dist_cur, &rec_dist_next);
+		} else
+			dist_restore(NULL, &rec_dist_next);
+	}
+
 	return 0;
 }
 
 static void fix_state(void)
 {
 	tidx = gidx;
+
+	if (dist_active) {
+		rec_dist_held = dist_held;
+		rec_dist_minor = dist_cur.minor;
+		dist_get_next(&rec_dist_next);
+	}
 }
 
 static int show_pwd_rnbs(struct s_pwd * pwd)
@@ -232,7 +266,7 @@ static int get_progress(int *hundth_perc)
 	lltmp = gidx;
 	lltmp -= gstart;
 	lltmp *= 10000;
-	lltmp /= (gend-gstart);
+	lltmp /= ((dist_active ? mkv_last : gend)-gstart);
 
 	hun = (unsigned)lltmp;
 	per = (int)(hun/100);
@@ -604,7 +638,7 @@ void do_markov_crack(struct db_main *db, char *mkv_param)
 		        options.node_count > 1 ? " split over nodes" : "");
 	}
 
-	if (options.node_count > 1) {
+	if (options.node_count > 1 && !dist_active) {
 		unsigned long long mkv_size;
 
 		mkv_size = mkv_end - mkv_start + 1;
@@ -626,7 +660,37 @@ void do_markov_crack(struct db_main *db, char *mkv_param)
 	log_event("- Length: %d - %d", mkv_minlen, mkv_maxlen);
 	log_event("- Start-End: "LLd" - "LLd, mkv_start, mkv_end);
 
-	show_pwd(mkv_start);
+	if (dist_active) {
+		dist_size = (mkv_end - mkv_start + 1) / (options.node_count * 256);
+		if (!dist_size)
+			dist_size = 1;
+		mkv_last = gend;
+
+		while (1) {
+			unsigned long long start;
+
+			if (!dist_held) {
+				dist_next(&dist_cur);
+				dist_held = 1;
+				gidx = 0;
+			}
+			start = gstart + dist_cur.minor * dist_size;
+			if (dist_cur.major || start > mkv_last)
+				break;
+			gend = start + dist_size - 1;
+			if (gend > mkv_last)
+				gend = mkv_last;
+/* show_pwd() resumes from gidx if it is set (a restored chunk) */
+			if (!gidx)
+				gidx = start;
+
+			if (!show_pwd(start) || gidx <= gend || event_abort)
+				break;
+			dist_held = 0;
+		}
+		gend = mkv_last;
+	} else
+		show_pwd(mkv_start);
 
 	if (!event_abort)
 		gidx = gend; // For reporting DONE properly
@@ -105,5 +105,11 @@
 #define HAVE_STRINGS_H		1
 #endif
 
+#if defined (_MSC_VER) || defined(__MINGW32__) || defined(__DJGPP__)
+#define HAVE_SYS_MMAN_H		0
+#else
+#define HAVE_SYS_MMAN_H		1
+#endif
+
 
 #endif
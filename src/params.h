@@ -184,6 +184,13 @@
  */
 #define PASSWORD_HASH_SIZE_FOR_LDR	4
 
+/*
+ * ...except that when the hash files add up to more than this many bytes per
+ * bucket, it picks a larger one, up to the size below.
+ */
+#define LDR_HASH_BYTES_PER_BUCKET	0x100
+#define PASSWORD_HASH_SIZE_FOR_LDR_MAX	5
+
 /*
  * Hash table sizes.  These may also be hardcoded into the hash functions.
  */
@@ -225,6 +232,12 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
  */
 #define PASSWORD_HASH_SHR		2
 
+/*
+ * Salts with at least this many hashes get a compact open-addressed table,
+ * with the binaries packed together, instead of the hash table of lists.
+ */
+#define PASSWORD_TABLE_THRESHOLD	PASSWORD_HASH_THRESHOLD_5
+
 /*
  * Cracked password hash size, used while loading.
  */
@@ -258,6 +271,8 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
 #define UNIQUE_HASH_LOG			21
 #define UNIQUE_HASH_SIZE		(1 << UNIQUE_HASH_LOG)
 #define UNIQUE_BUFFER_SIZE		0x8000000
+/* Default number of bucket files for unique -disk */
+#define UNIQUE_DISK_PARTS		64
 
 /*
  * Maximum number of GECOS words per password to load.
@@ -271,6 +286,25 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
  */
 #define LDR_HASH_COLLISIONS_MAX		1000
 
+/*
+ * Hash files of at least this size are parsed by several processes at once
+ * (as set with LoaderProcesses in john.conf), using up to this many.
+ */
+#define LDR_PARALLEL_MIN		0x1000000
+#define LDR_PROCESSES_MAX		64
+
+/*
+ * Hash files totalling at least this size get a snapshot of the loaded hashes
+ * saved next to them (if HashSnapshot is enabled in john.conf).
+ */
+#define LDR_SNAPSHOT_MIN		0x1000000
+
+/*
+ * Pot files of at least this size get indexed (if PotIndex is enabled in
+ * john.conf).
+ */
+#define LDR_POT_INDEX_MIN		0x1000000
+
 /*
  * Maximum number of GECOS words to try in pairs.
  */
@@ -312,6 +346,11 @@ extern int password_hash_thresholds[PASSWORD_HASH_SIZES];
  */
 #define RULE_WORD_SIZE			0x80
 
+/*
+ * Number of words mangled at once by rules_apply_block().
+ */
+#define RULE_BLOCK_SIZE			0x40
+
 /*
  * Buffer size for plaintext passwords.
  */
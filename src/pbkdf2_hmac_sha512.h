@@ -288,7 +288,7 @@ static void pbkdf2_sha512_sse(const unsigned char *K[MMX_COEF_SHA512], int KL[MM
 			for (k = 0; k < SSE_GROUP_SZ_SHA512; k++) {
 				ARCH_WORD_64 *p = &o1[(k/MMX_COEF_SHA512)*MMX_COEF_SHA512*SHA512_BUF_SIZ + (k&(MMX_COEF_SHA512-1))];
 				for(j = 0; j < (SHA512_DIGEST_LENGTH/sizeof(ARCH_WORD_64)); j++)
-					dgst[k][j] ^= p[(j<<(MMX_COEF_SHA512>>1))];
+					dgst[k][j] ^= p[(j*MMX_COEF_SHA512)];
 			}
 		}
 
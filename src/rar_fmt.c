@@ -72,12 +72,18 @@
 #include "options.h"
 #include "unicode.h"
 #include "johnswap.h"
+#include "sse-intrinsics.h"
 #include "unrar.h"
 #include "config.h"
 
 #define FORMAT_LABEL		"rar"
 #define FORMAT_NAME		"RAR3"
+#ifdef SHA1_SSE_PARA
+#define NBKEYS			(MMX_COEF * SHA1_SSE_PARA)
+#define ALGORITHM_NAME		"SHA1 AES " SHA1_ALGORITHM_NAME
+#else
 #define ALGORITHM_NAME		"SHA1 AES 32/" ARCH_BITS_STR
+#endif
 
 #ifdef DEBUG
 #define BENCHMARK_COMMENT	" (1-16 characters)"
@@ -93,7 +99,11 @@
 #define SALT_SIZE		sizeof(rarfile)
 #define SALT_ALIGN		sizeof(unsigned long long)
 #define MIN_KEYS_PER_CRYPT	1
+#ifdef SHA1_SSE_PARA
+#define MAX_KEYS_PER_CRYPT	NBKEYS
+#else
 #define MAX_KEYS_PER_CRYPT	1
+#endif
 
 #define ROUNDS			0x40000
 
@@ -111,6 +121,7 @@ static pthread_mutex_t *lockarray;
 #endif
 
 static int omp_t = 1;
+static int max_crypts;
 static unsigned char *saved_salt;
 static unsigned char *saved_key;
 static int (*cracked);
@@ -350,13 +361,15 @@ static void init(struct fmt_main *self)
 	if (options.utf8)
 		self->params.plaintext_length = MIN(125, 3 * PLAINTEXT_LENGTH);
 
+	/* one extra key slot, used for the unused tail lanes of a SIMD group */
+	max_crypts = self->params.max_keys_per_crypt;
 	unpack_data = mem_calloc_tiny(sizeof(unpack_data_t) * omp_t, MEM_ALIGN_WORD);
-	cracked = mem_calloc_tiny(sizeof(*cracked) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
-	saved_key = mem_calloc_tiny(UNICODE_LENGTH * self->params.max_keys_per_crypt, MEM_ALIGN_NONE);
-	saved_len = mem_calloc_tiny(sizeof(*saved_len) * self->params.max_keys_per_crypt, MEM_ALIGN_WORD);
+	cracked = mem_calloc_tiny(sizeof(*cracked) * (max_crypts + 1), MEM_ALIGN_WORD);
+	saved_key = mem_calloc_tiny(UNICODE_LENGTH * (max_crypts + 1), MEM_ALIGN_NONE);
+	saved_len = mem_calloc_tiny(sizeof(*saved_len) * (max_crypts + 1), MEM_ALIGN_WORD);
 	saved_salt = mem_calloc_tiny(8, MEM_ALIGN_NONE);
-	aes_key = mem_calloc_tiny(16 * self->params.max_keys_per_crypt, MEM_ALIGN_NONE);
-	aes_iv = mem_calloc_tiny(16 * self->params.max_keys_per_crypt, MEM_ALIGN_NONE);
+	aes_key = mem_calloc_tiny(16 * (max_crypts + 1), MEM_ALIGN_NONE);
+	aes_iv = mem_calloc_tiny(16 * (max_crypts + 1), MEM_ALIGN_NONE);
 
 #ifdef DEBUG
 	self->params.benchmark_comment = " (1-16 characters)";
@@ -593,11 +606,181 @@ static MAYBE_INLINE int check_huffman(unsigned char *next) {
 	return 1; /* Passed this check! */
 }
 
+#ifdef SHA1_SSE_PARA
+/*
+ * Lane-parallel version of the key derivation in crypt_all().  The hashed
+ * stream is ROUNDS repeats of (password || salt || 24-bit LE round number),
+ * which apart from the round numbers repeats every lcm(len, 64) bytes.  Each
+ * lane lays out that period once as whole 64 byte blocks, so building a
+ * block is a fixed size copy plus patching in the round numbers at their
+ * known offsets, and SSESHA1body runs NBKEYS such blocks at a time.  The 16
+ * IV bytes need a SHA1_Final of the state so far; that is done with a scalar
+ * SHA1 seeded from the lane's last SIMD state and its partial block, which
+ * is cheap compared to the ROUNDS updates in between.
+ */
+typedef struct {
+	unsigned char *tmpl;	/* one period of the stream, round numbers 0 */
+	unsigned int ulen;	/* bytes per round */
+	unsigned int nblk;	/* blocks per period */
+	unsigned int ivr;	/* next round to take an IV byte after */
+	unsigned long long len;	/* stream length */
+	int state;	/* 0 = data, 2 = length only, 3 = done */
+} rar_lane;
+
+/* last byte of the SHA1_Final of lane's state after blk blocks + part[n] */
+static unsigned char rar_iv_byte(ARCH_WORD_32 *sse_out, int lane,
+                                 unsigned int blk, unsigned char *part, int n)
+{
+	SHA_CTX ctx;
+	unsigned char out[20];
+
+	SHA1_Init(&ctx);
+	if (blk) {
+		ARCH_WORD_32 *st = &sse_out[(lane / MMX_COEF) * 20 + (lane & (MMX_COEF - 1))];
+		unsigned long long bits = (unsigned long long)blk << 9;
+
+		ctx.h0 = st[0];
+		ctx.h1 = st[MMX_COEF];
+		ctx.h2 = st[2 * MMX_COEF];
+		ctx.h3 = st[3 * MMX_COEF];
+		ctx.h4 = st[4 * MMX_COEF];
+		ctx.Nl = (unsigned int)bits;
+		ctx.Nh = (unsigned int)(bits >> 32);
+	}
+	SHA1_Update(&ctx, part, n);
+	SHA1_Final(out, &ctx);
+	return out[19];
+}
+
+/* build block blk of a lane's stream, returns 1 if it is the last one */
+static int rar_fill(rar_lane *l, unsigned char *block, ARCH_WORD_32 *sse_out,
+                    int lane, unsigned int blk, unsigned char *iv)
+{
+	unsigned long long off = (unsigned long long)blk << 6;
+	int n = 0, i;
+
+	if (off < l->len) {
+		unsigned long long pos;
+		unsigned int r;
+
+		n = (l->len - off < 64) ? l->len - off : 64;
+		memcpy(block, &l->tmpl[(blk % l->nblk) << 6], 64);
+		/* patch in the round numbers ending in (or straddling) this block */
+		for (r = off / l->ulen; (pos = (unsigned long long)r * l->ulen) < off + n; r++) {
+			long p = (long)(pos + l->ulen - 3 - off);
+
+			for (i = 0; i < 3; i++, p++)
+				if (p >= 0 && p < n)
+					block[p] = (unsigned char)(r >> (i * 8));
+		}
+		if (l->ivr < ROUNDS &&
+		    (pos = (unsigned long long)(l->ivr + 1) * l->ulen) <= off + n) {
+			iv[l->ivr / (ROUNDS / 16)] =
+				rar_iv_byte(sse_out, lane, blk, block, pos - off);
+			l->ivr += ROUNDS / 16;
+		}
+		if (n == 64)
+			return 0;
+	}
+	if (l->state == 0) {
+		block[n++] = 0x80;
+		l->state = 2;
+	}
+	memset(block + n, 0, 64 - n);
+	if (n > 56)
+		return 0;
+	{
+		unsigned long long bits = l->len << 3;
+
+		for (i = 63; i > 55; i--, bits >>= 8)
+			block[i] = (unsigned char)bits;
+	}
+	l->state = 3;
+	return 1;
+}
+
+static void rar_kdf(int *keys)
+{
+	rar_lane lanes[NBKEYS];
+	ALIGN(16) unsigned char buf[NBKEYS * 128];
+	ALIGN(16) ARCH_WORD_32 sse_out[NBKEYS * 5];
+	unsigned int blk = 0;
+	int i, j, todo = NBKEYS;
+
+	for (i = 0; i < NBKEYS; i++) {
+		rar_lane *l = &lanes[i];
+		unsigned char unit[UNICODE_LENGTH + 8 + 3];
+		unsigned int len = saved_len[keys[i]], g, k;
+
+		memcpy(unit, &saved_key[UNICODE_LENGTH * keys[i]], len);
+		memcpy(unit + len, saved_salt, 8);
+		memset(unit + len + 8, 0, 3);
+		l->ulen = len + 8 + 3;
+		for (g = 64, k = l->ulen; k; ) {	/* gcd(ulen, 64) */
+			unsigned int t = g % k;
+			g = k;
+			k = t;
+		}
+		l->nblk = l->ulen / g;
+		l->tmpl = mem_alloc(l->nblk << 6);
+		for (k = 0; k < l->nblk << 6; k += l->ulen)
+			memcpy(&l->tmpl[k], unit, l->ulen);
+		l->ivr = 0;
+		l->len = (unsigned long long)ROUNDS * l->ulen;
+		l->state = 0;
+	}
+
+	while (todo) {
+		unsigned int done = 0;
+
+		for (i = 0; i < NBKEYS; i++)
+			if (lanes[i].state != 3 &&
+			    rar_fill(&lanes[i], &buf[i * 128], sse_out, i, blk,
+			             &aes_iv[keys[i] * 16]))
+				done |= 1U << i;
+		SSESHA1body((__m128i *)buf, sse_out, sse_out,
+		            SSEi_FLAT_IN | SSEi_2BUF_INPUT_FIRST_BLK |
+		            (blk++ ? SSEi_RELOAD : 0));
+		for (i = 0; done; i++, done >>= 1)
+			if (done & 1) {
+				ARCH_WORD_32 *st = &sse_out[(i / MMX_COEF) * 20 + (i & (MMX_COEF - 1))];
+				unsigned char *key = &aes_key[keys[i] * 16];
+
+				for (j = 0; j < 16; j++)
+					key[j] = (unsigned char)(st[(j >> 2) * MMX_COEF] >> ((j & 3) * 8));
+				todo--;
+			}
+	}
+	for (i = 0; i < NBKEYS; i++)
+		MEM_FREE(lanes[i].tmpl);
+}
+#endif
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
 	int index = 0;
+#ifdef SHA1_SSE_PARA
+	int *MixOrder, tot_todo = 0, len;
+
+	/* order the keys by length, so the lanes of a group run the same
+	   number of SHA-1 blocks.  Tail lanes point at the spare slot. */
+	MixOrder = mem_alloc(sizeof(int) * (count + NBKEYS));
+	saved_len[max_crypts] = 0;
+	for (len = 0; len <= UNICODE_LENGTH; len += 2)
+		for (index = 0; index < count; index++)
+			if (saved_len[index] == len)
+				MixOrder[tot_todo++] = index;
+	while (tot_todo % NBKEYS)
+		MixOrder[tot_todo++] = max_crypts;
 
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (index = 0; index < tot_todo; index += NBKEYS)
+		rar_kdf(&MixOrder[index]);
+	MEM_FREE(MixOrder);
+#else
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
@@ -664,6 +847,7 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 			for (j = 0; j < 4; j++)
 				aes_key[i16 + i * 4 + j] = (unsigned char)(digest[i] >> (j * 8));
 	}
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel for
@@ -172,6 +172,19 @@ static int get_hash_5(int index) { return crypt_key[index][0] & 0xffffff; }
 static int get_hash_6(int index) { return crypt_key[index][0] & 0x7ffffff; }
 #endif
 
+static void get_hashes(int size, int count, int *hash)
+{
+	ARCH_WORD_32 mask = password_hash_sizes[size] - 1;
+	int index;
+
+	for (index = 0; index < count; index++)
+#ifdef MMX_COEF
+		hash[index] = crypt_key[index/NBKEYS][HASH_OFFSET] & mask;
+#else
+		hash[index] = crypt_key[index][0] & mask;
+#endif
+}
+
 #ifdef MMX_COEF
 static void set_key(char *_key, int index)
 {
@@ -230,6 +243,36 @@ static void set_key(char *key, int index)
 }
 #endif
 
+static void set_key_range(char *key, int pos, char *chars, int count,
+    int index)
+{
+#ifdef MMX_COEF
+	const ARCH_WORD_32 *src = &((ARCH_WORD_32*)saved_key)[(index&(MMX_COEF-1)) + (index>>(MMX_COEF>>1))*MD5_BUF_SIZ*MMX_COEF];
+	int words, i, j;
+
+	set_key(key, index);
+	words = (src[14*MMX_COEF] >> 5) + 1;
+
+	for (i = 0; i < count; i++, index++) {
+		if (i) {
+			ARCH_WORD_32 *keybuffer = &((ARCH_WORD_32*)saved_key)[(index&(MMX_COEF-1)) + (index>>(MMX_COEF>>1))*MD5_BUF_SIZ*MMX_COEF];
+
+			for (j = 0; j < words; j++)
+				keybuffer[j*MMX_COEF] = src[j*MMX_COEF];
+			while (keybuffer[j*MMX_COEF])
+				keybuffer[j++*MMX_COEF] = 0;
+			keybuffer[14*MMX_COEF] = src[14*MMX_COEF];
+		}
+		((unsigned char*)saved_key)[GETPOS(pos, index)] = chars[i];
+	}
+#else
+	while (count--) {
+		set_key(key, index);
+		saved_key[index++][pos] = *chars++;
+	}
+#endif
+}
+
 #ifdef MMX_COEF
 static char *get_key(int index)
 {
@@ -377,6 +420,8 @@ struct fmt_main fmt_rawMD5 = {
 		},
 		cmp_all,
 		cmp_one,
-		cmp_exact
+		cmp_exact,
+		get_hashes,
+		set_key_range
 	}
 };
@@ -98,7 +98,7 @@ static struct fmt_tests tests[] = {
 };
 
 #ifdef MMX_LOAD
-#define GETPOS(i, index)		( (index&(MMX_COEF_SHA512-1))*8 + ((i)&(0xffffffff-7))*MMX_COEF_SHA512 + (7-((i)&7)) + (index>>(MMX_COEF_SHA512>>1))*MMX_LOAD*MMX_COEF_SHA512*8 )
+#define GETPOS(i, index)		( (index&(MMX_COEF_SHA512-1))*8 + ((i)&(0xffffffff-7))*MMX_COEF_SHA512 + (7-((i)&7)) + (index/MMX_COEF_SHA512)*MMX_LOAD*MMX_COEF_SHA512*8 )
 static ARCH_WORD_64 (*saved_key)[SHA512_BUF_SIZ*MMX_COEF_SHA512];
 #else
 static uint64_t (*saved_key)[16];
@@ -205,18 +205,18 @@ static void *get_binary (char *ciphertext)
     return (void *) out;
 }
 
-static int get_hash_0 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xf; }
-static int get_hash_1 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xff; }
-static int get_hash_2 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xfff; }
-static int get_hash_3 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xffff; }
-static int get_hash_4 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xfffff; }
-static int get_hash_5 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0xffffff; }
-static int get_hash_6 (int index) { return crypt_key[index>>(MMX_COEF_SHA512>>1)][index&(MMX_COEF_SHA512-1)] & 0x7ffffff; }
+static int get_hash_0 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xf; }
+static int get_hash_1 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xff; }
+static int get_hash_2 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xfff; }
+static int get_hash_3 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xffff; }
+static int get_hash_4 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xfffff; }
+static int get_hash_5 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0xffffff; }
+static int get_hash_6 (int index) { return crypt_key[index/MMX_COEF_SHA512][index&(MMX_COEF_SHA512-1)] & 0x7ffffff; }
 
 #ifdef MMX_LOAD
 static void set_key(char *key, int index) {
 	const ARCH_WORD_64 *wkey = (ARCH_WORD_64*)key;
-	ARCH_WORD_64 *keybuffer = &((ARCH_WORD_64 *)saved_key)[(index&(MMX_COEF_SHA512-1)) + (index>>(MMX_COEF_SHA512>>1))*SHA512_BUF_SIZ*MMX_COEF_SHA512];
+	ARCH_WORD_64 *keybuffer = &((ARCH_WORD_64 *)saved_key)[(index&(MMX_COEF_SHA512-1)) + (index/MMX_COEF_SHA512)*SHA512_BUF_SIZ*MMX_COEF_SHA512];
 	ARCH_WORD_64 *keybuf_word = keybuffer;
 	unsigned int len;
 	ARCH_WORD_64 temp;
@@ -306,7 +306,7 @@ static char *get_key(int index) {
 	static char out[MAXLEN + 1];
 	unsigned char *wucp = (unsigned char*)saved_key;
 
-	s = ((ARCH_WORD_64 *)saved_key)[15*MMX_COEF_SHA512 + (index&(MMX_COEF_SHA512-1)) + (index>>((MMX_COEF_SHA512>>1)))*SHA512_BUF_SIZ*MMX_COEF_SHA512] >> 3;
+	s = ((ARCH_WORD_64 *)saved_key)[15*MMX_COEF_SHA512 + (index&(MMX_COEF_SHA512-1)) + (index/MMX_COEF_SHA512)*SHA512_BUF_SIZ*MMX_COEF_SHA512] >> 3;
 	for(i=0;i<(unsigned)s;i++)
 		out[i] = wucp[ GETPOS(i, index) ];
 	out[i] = 0;
@@ -384,7 +384,7 @@ static int cmp_all (void *binary, int count)
     int i;
 
     for (i = 0; i < count; i++)
-        if (((uint64_t *) binary)[0] == crypt_key[i>>(MMX_COEF_SHA512>>1)][i&(MMX_COEF_SHA512-1)])
+        if (((uint64_t *) binary)[0] == crypt_key[i/MMX_COEF_SHA512][i&(MMX_COEF_SHA512-1)])
              return 1;
     return 0;
 }
@@ -395,7 +395,7 @@ static int cmp_one (void *binary, int index)
     int i;
 
     for (i = 0; i < BINARY_SIZE/sizeof(ARCH_WORD_64); i++)
-        if (((uint64_t *) binary)[i] != crypt_key[index>>(MMX_COEF_SHA512>>1)][(index&(MMX_COEF_SHA512-1))+i*MMX_COEF_SHA512])
+        if (((uint64_t *) binary)[i] != crypt_key[index/MMX_COEF_SHA512][(index&(MMX_COEF_SHA512-1))+i*MMX_COEF_SHA512])
             return 0;
 
     return 1;
@@ -52,6 +52,7 @@ extern int ftruncate(int fd, size_t length);
 #include "status.h"
 #include "recovery.h"
 #include "john.h"
+#include "dist.h"
 #ifdef HAVE_MPI
 #include "john-mpi.h"
 #include "signals.h"
@@ -300,6 +301,7 @@ void rec_restore_args(int lock)
 			if (options.flags & FLG_STATUS_CHK)
 				return;
 			log_event("No crash recovery file, terminating");
+			dist_leave();
 			log_done();
 #ifdef HAVE_MPI
 			mpi_teardown();
@@ -722,10 +722,1069 @@ static void rules_init_length(int max_length)
 	rules_vars['z'] = INFINITE_LENGTH;
 }
 
+/*
+ * Finishes a mangled word: applies the length limits and the comparison
+ * against the previous mangled word (see rules_apply() in rules.h).
+ */
+static MAYBE_INLINE char *rules_finish(char *in, int length, char *last)
+{
+	in[rules_max_length] = 0;
+	if (minlength)
+		if (length < minlength)
+			return NULL;
+	/* --maxlength will skip, not truncate */
+	if (maxlength)
+		if (length > maxlength)
+			return NULL;
+	if (last) {
+		if (length > rules_max_length)
+			length = rules_max_length;
+		if (length >= ARCH_SIZE - 1) {
+			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
+				return in;
+			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
+				return in;
+			return NULL;
+		}
+		if (last[length])
+			return in;
+		if (memcmp(in, last, length))
+			return in;
+		return NULL;
+	}
+	return in;
+}
+
+/*
+ * Compiled rules.  rules_reject() compiles each rule it accepts (when called
+ * for actual cracking) into an array of commands with their positions,
+ * character classes and strings already decoded, and runs of '$', '^', '['
+ * and ']' merged into one command each.  rules_apply() then runs that array
+ * instead of parsing the rule text again for every word.  The commands do
+ * exactly what the interpreter in rules_apply() does, and rules that can't be
+ * compiled (the "single crack" mode word pair commands, or anything that would
+ * be an error) are simply left to the interpreter.
+ */
+#define RULES_OP_APPEND			0x01	/* $ run */
+#define RULES_OP_PREPEND		0x02	/* ^ run, reversed */
+#define RULES_OP_DELETE_FIRST		0x03	/* [ run */
+#define RULES_OP_DELETE_LAST		0x04	/* ] run */
+
+/* Longest run merged into one command, must be below RULE_WORD_SIZE - 1 */
+#define RULES_OP_RUN_MAX		0x40
+
+struct rules_op {
+	char cmd;
+/* Run or 'A' string length */
+	int count;
+/* Character value (or the literal character of a class), and a second one
+ * for the 's' command */
+	char value, value2;
+/* Decoded positions, or variable names (0 for constants) */
+	unsigned char pos[3], var[3];
+/* Character class lookup table, or NULL to compare against value */
+	char *class;
+/* Merged run or 'A' command string */
+	char *string;
+};
+
+static struct {
+/* Rule text the commands below were compiled from, or NULL */
+	char *rule;
+	struct rules_op *end;
+	struct rules_op ops[RULE_BUFFER_SIZE];
+	char strings[RULE_BUFFER_SIZE];
+/* Whether rules_apply_block() may be used, and for which word lengths */
+	int block, block_min, block_max;
+} rules_compiled;
+
+/*
+ * Decodes a position code the way POSITION() does.  Only 'l', 'm', 'p' and
+ * the numeric variables may change while a rule is being applied, so the
+ * rest become constants.  Returns 0 on error.
+ */
+static int rules_compile_position(struct rules_op *op, int n, char c)
+{
+	unsigned char var = ARCH_INDEX(c);
+
+	if (c == 'l' || c == 'm' || c == 'p' || (c >= 'a' && c <= 'k')) {
+		op->var[n] = var;
+		return 1;
+	}
+
+	op->var[n] = 0;
+	op->pos[n] = rules_vars[var];
+	return c && op->pos[n] != INVALID_LENGTH;
+}
+
+static char *rules_compile_class(struct rules_op *op, char *rule)
+{
+	if ((op->value = *rule++) == '?') {
+		if (!(op->class = rules_classes[ARCH_INDEX(*rule++)]))
+			return NULL;
+	} else {
+		if (!op->value)
+			return NULL;
+		op->class = NULL;
+	}
+
+	return rule;
+}
+
+/*
+ * Checks whether the compiled rule may be applied by rules_apply_block(), and
+ * computes the word lengths for which its commands neither truncate nor
+ * reject the word.
+ */
+static void rules_compile_block(void)
+{
+	struct rules_op *op;
+	int delta = 0;
+
+	rules_compiled.block = 1;
+	rules_compiled.block_min = rules_compiled.ops < rules_compiled.end;
+	rules_compiled.block_max = RULE_WORD_SIZE - 2;
+
+	for (op = rules_compiled.ops; op < rules_compiled.end; op++)
+	switch (op->cmd) {
+	case 'l': case 'u': case 'c': case 'C': case 't': case 'r':
+		break;
+
+	case RULES_OP_APPEND:
+	case RULES_OP_PREPEND:
+		delta += op->count;
+		if (rules_compiled.block_max > RULE_WORD_SIZE - 2 - delta)
+			rules_compiled.block_max = RULE_WORD_SIZE - 2 - delta;
+		break;
+
+	case RULES_OP_DELETE_FIRST:
+	case RULES_OP_DELETE_LAST:
+		if (rules_compiled.block_min < op->count - delta + 1)
+			rules_compiled.block_min = op->count - delta + 1;
+		delta -= op->count;
+		break;
+
+	default:
+		rules_compiled.block = 0;
+		return;
+	}
+}
+
+/*
+ * Compiles the rule into rules_compiled.  Returns zero if it should be left
+ * to the interpreter.
+ */
+static int rules_compile(char *rule)
+{
+	struct rules_op *op = rules_compiled.ops;
+	char *string = rules_compiled.strings;
+
+	while (*rule) {
+		char cmd = *rule++;
+
+		switch (cmd) {
+		case ':':
+		case ' ':
+		case '\t':
+			continue;
+
+		case 'l': case 'u': case 'c': case 'r': case 'd': case 'f':
+		case 'p': case 'C': case 't': case '{': case '}': case 'S':
+		case 'V': case 'R': case 'L': case 'P': case 'I': case 'M':
+		case 'Q':
+			break;
+
+		case '_': case '<': case '>': case '\'': case 'T': case 'D':
+			if (!rules_compile_position(op, 0, *rule++))
+				return 0;
+			break;
+
+		case 'x':
+			if (!rules_compile_position(op, 0, *rule++) ||
+			    !rules_compile_position(op, 1, *rule++))
+				return 0;
+			break;
+
+		case 'X':
+			if (!rules_compile_position(op, 0, *rule++) ||
+			    !rules_compile_position(op, 1, *rule++) ||
+			    !rules_compile_position(op, 2, *rule++))
+				return 0;
+			break;
+
+		case 'i':
+		case 'o':
+			if (!rules_compile_position(op, 0, *rule++) ||
+			    !(op->value = *rule++))
+				return 0;
+			break;
+
+		case 's':
+			if (!(rule = rules_compile_class(op, rule)) ||
+			    !(op->value2 = *rule++))
+				return 0;
+			break;
+
+		case '@': case '!': case '/': case '(': case ')':
+			if (!(rule = rules_compile_class(op, rule)))
+				return 0;
+			break;
+
+		case '=':
+		case '%':
+			if (!rules_compile_position(op, 0, *rule++) ||
+			    !(rule = rules_compile_class(op, rule)))
+				return 0;
+			break;
+
+		case 'v':
+			op->value = *rule++;
+			if (op->value < 'a' || op->value > 'k' ||
+			    !rules_compile_position(op, 0, *rule++) ||
+			    !rules_compile_position(op, 1, *rule++))
+				return 0;
+			break;
+
+		case 'A':
+			if (!rules_compile_position(op, 0, *rule++) ||
+			    !(op->value = *rule++))
+				return 0;
+			op->string = string;
+			while (*rule != op->value) {
+				if (!*rule)
+					return 0;
+				*string++ = *rule++;
+			}
+			rule++;
+			op->count = string - op->string;
+			*string++ = 0;
+			break;
+
+		case '$':
+		case '^':
+		case '[':
+		case ']':
+			op->string = string;
+			op->count = 0;
+			rule--;
+			do {
+				if (*rule == '$' || *rule == '^') {
+					if (!rule[1])
+						return 0;
+					*string++ = rule[1];
+					rule++;
+				}
+				rule++;
+			} while (++op->count < RULES_OP_RUN_MAX && *rule == cmd);
+			if (cmd == '^') {
+				char *p = op->string, *q = string - 1;
+				while (p < q) {
+					char c = *p;
+					*p++ = *q;
+					*q-- = c;
+				}
+			}
+			switch (cmd) {
+			case '$':
+				cmd = RULES_OP_APPEND;
+				break;
+			case '^':
+				cmd = RULES_OP_PREPEND;
+				break;
+			case '[':
+				cmd = RULES_OP_DELETE_FIRST;
+				break;
+			default:
+				cmd = RULES_OP_DELETE_LAST;
+			}
+			break;
+
+		default:
+			return 0;
+		}
+
+		(op++)->cmd = cmd;
+	}
+
+	rules_compiled.end = op;
+	rules_compile_block();
+	return 1;
+}
+
+#define OP_POSITION(to, n) { \
+	if (((to) = op->var[n] ? rules_vars[op->var[n]] : op->pos[n]) == \
+	    INVALID_LENGTH) \
+		goto out_ERROR_POSITION; \
+}
+
+#define OP_CLASS_export_pos(start, true, false) { \
+	char *class; \
+	if ((class = op->class)) { \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (class[ARCH_INDEX(in[pos])]) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} else { \
+		char value = op->value; \
+		for (pos = (start); ARCH_INDEX(in[pos]); pos++) \
+		if (in[pos] == value) { \
+			true; \
+		} else { \
+			false; \
+		} \
+	} \
+}
+
+#define OP_CLASS(start, true, false) { \
+	int pos; \
+	OP_CLASS_export_pos(start, true, false); \
+}
+
+/*
+ * Applies the compiled rule to a word, see rules_apply().
+ */
+static MAYBE_INLINE char *rules_apply_compiled(char *word, char *last)
+{
+	struct rules_op *op = rules_compiled.ops, *end = rules_compiled.end;
+	char *in, *alt, *memory = word;
+	int length;
+
+	in = buffer[0];
+	if (in == last)
+		in = buffer[2];
+
+	length = 0;
+	while (length < RULE_WORD_SIZE - 1) {
+		if (!(in[length] = word[length]))
+			break;
+		length++;
+	}
+
+	if (op == end)
+		return rules_finish(in, length, last);
+
+	if (!length)
+		return NULL;
+
+	alt = buffer[1];
+	if (alt == last)
+		alt = buffer[2];
+
+	rules_vars['l'] = length;
+	rules_vars['m'] = (unsigned char)length - 1;
+
+	do {
+		in[RULE_WORD_SIZE - 1] = 0;
+
+		switch (op->cmd) {
+		case RULES_OP_APPEND:
+			if (length + op->count < RULE_WORD_SIZE) {
+				char *p = op->string, *q = &in[length];
+				length += op->count;
+				do {
+					*q++ = *p++;
+				} while (q < &in[length]);
+				*q = 0;
+			} else {
+				char *p = op->string;
+				int count = op->count;
+				in[length++] = *p++;
+				in[length] = 0;
+				while (--count) {
+					in[RULE_WORD_SIZE - 1] = 0;
+					in[length++] = *p++;
+					in[length] = 0;
+				}
+			}
+			break;
+
+		case RULES_OP_PREPEND:
+/*
+ * The interpreter swaps buffers once per command, so for an even count
+ * we work in place to end up in the very same buffer as it would.
+ */
+			if (length + op->count < RULE_WORD_SIZE) {
+				if (op->count & 1) {
+					char *out;
+					GET_OUT
+					memcpy(out, op->string, op->count);
+					strcpy(&out[op->count], in);
+					in = out;
+				} else {
+					memmove(&in[op->count], in, length + 1);
+					memcpy(in, op->string, op->count);
+				}
+				length += op->count;
+			} else {
+				char *p = &op->string[op->count];
+				int count = op->count;
+				do {
+					char *out;
+					in[RULE_WORD_SIZE - 1] = 0;
+					GET_OUT
+					out[0] = *--p;
+					strcpy(&out[1], in);
+					in = out;
+					length++;
+				} while (--count);
+			}
+			break;
+
+		case RULES_OP_DELETE_FIRST:
+			if (length > op->count && length < RULE_WORD_SIZE) {
+				if (op->count & 1) {
+					char *out;
+					GET_OUT
+					strcpy(out, &in[op->count]);
+					in = out;
+				} else
+					memmove(in, &in[op->count],
+					    length - op->count + 1);
+				length -= op->count;
+			} else {
+				int count = op->count;
+				do {
+					in[RULE_WORD_SIZE - 1] = 0;
+					if (length) {
+						char *out;
+						GET_OUT
+						strcpy(out, &in[1]);
+						length--;
+						in = out;
+					} else
+						in[0] = 0;
+				} while (--count);
+			}
+			break;
+
+		case RULES_OP_DELETE_LAST:
+			if (length > op->count && length < RULE_WORD_SIZE)
+				in[length -= op->count] = 0;
+			else {
+				int count = op->count;
+				do {
+					in[RULE_WORD_SIZE - 1] = 0;
+					if (length)
+						in[--length] = 0;
+				} while (--count);
+			}
+			break;
+
+		case '_':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (length != pos) return NULL;
+			}
+			break;
+
+		case '<':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (length >= pos) return NULL;
+			}
+			break;
+
+		case '>':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (length <= pos) return NULL;
+			}
+			break;
+
+		case 'l':
+			CONV(conv_tolower)
+			break;
+
+		case 'u':
+			CONV(conv_toupper)
+			break;
+
+		case 'c':
+			{
+				int pos = 0;
+				if ((in[0] = conv_toupper[ARCH_INDEX(in[0])]))
+				while (in[++pos])
+					in[pos] =
+					    conv_tolower[ARCH_INDEX(in[pos])];
+				in[pos] = 0;
+			}
+			if (in[0] != 'M' || in[1] != 'c')
+				break;
+			in[2] = conv_toupper[ARCH_INDEX(in[2])];
+			break;
+
+		case 'r':
+			{
+				char *out;
+				GET_OUT
+				*(out += length) = 0;
+				while (*in)
+					*--out = *in++;
+				in = out;
+			}
+			break;
+
+		case 'd':
+			memcpy(in + length, in, length);
+			in[length <<= 1] = 0;
+			break;
+
+		case 'f':
+			{
+				int pos;
+				in[pos = (length <<= 1)] = 0;
+				{
+					char *p = in;
+					while (*p)
+						in[--pos] = *p++;
+				}
+			}
+			break;
+
+		case 'p':
+			if (length < 2) break;
+			{
+				int pos = length - 1;
+				if (strchr("sxz", in[pos]) ||
+				    (pos > 1 && in[pos] == 'h' &&
+				    (in[pos - 1] == 'c' || in[pos - 1] == 's')))
+					strcat(in, "es");
+				else
+				if (in[pos] == 'f' && in[pos - 1] != 'f')
+					strcpy(&in[pos], "ves");
+				else
+				if (pos > 1 &&
+				    in[pos] == 'e' && in[pos - 1] == 'f')
+					strcpy(&in[pos - 1], "ves");
+				else
+				if (pos > 1 && in[pos] == 'y') {
+					if (strchr("aeiou", in[pos - 1]))
+						strcat(in, "s");
+					else
+						strcpy(&in[pos], "ies");
+				} else
+					strcat(in, "s");
+			}
+			length = strlen(in);
+			break;
+
+		case 'x':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos < length) {
+					char *out;
+					GET_OUT
+					in += pos;
+					OP_POSITION(pos, 1)
+					strnzcpy(out, in, pos + 1);
+					length = strlen(in = out);
+					break;
+				}
+				OP_POSITION(pos, 1)
+				in[length = 0] = 0;
+			}
+			break;
+
+		case 'i':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos < length) {
+					char *p = in + pos;
+					memmove(p + 1, p, length++ - pos);
+					*p = op->value;
+					in[length] = 0;
+					break;
+				}
+			}
+			in[length++] = op->value;
+			in[length] = 0;
+			break;
+
+		case 'o':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos < length)
+					in[pos] = op->value;
+			}
+			break;
+
+		case 's':
+			{
+				char to = op->value2;
+				OP_CLASS(0, in[pos] = to, {})
+			}
+			break;
+
+		case '@':
+			length = 0;
+			OP_CLASS(0, {}, in[length++] = in[pos])
+			in[length] = 0;
+			break;
+
+		case '!':
+			OP_CLASS(0, return NULL, {})
+			break;
+
+		case '/':
+			{
+				int pos;
+				OP_CLASS_export_pos(0, break, {})
+				rules_vars['p'] = pos;
+				if (in[pos]) break;
+			}
+			return NULL;
+
+		case '=':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos >= length)
+					return NULL;
+				OP_CLASS_export_pos(pos, break, return NULL)
+			}
+			break;
+
+		case 'C':
+			{
+				int pos = 0;
+				if ((in[0] = conv_tolower[ARCH_INDEX(in[0])]))
+				while (in[++pos])
+					in[pos] =
+					    conv_toupper[ARCH_INDEX(in[pos])];
+				in[pos] = 0;
+			}
+			if (in[0] == 'm' && in[1] == 'C')
+				in[2] = conv_tolower[ARCH_INDEX(in[2])];
+			break;
+
+		case 't':
+			CONV(conv_invert)
+			break;
+
+		case '(':
+			OP_CLASS(0, break, return NULL)
+			break;
+
+		case ')':
+			OP_CLASS(length - 1, break, return NULL)
+			break;
+
+		case '\'':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos < length)
+					in[length = pos] = 0;
+			}
+			break;
+
+		case '%':
+			{
+				int count = 0, required, pos;
+				OP_POSITION(required, 0)
+				OP_CLASS_export_pos(0,
+				    if (++count >= required) break, {})
+				if (count < required) return NULL;
+				rules_vars['p'] = pos;
+			}
+			break;
+
+		case 'A':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos >= length) { /* append */
+					int count = op->count;
+					if (count > RULE_WORD_SIZE - 1 - length)
+						count = RULE_WORD_SIZE - 1 -
+						    length;
+					if (count > 0) {
+						memcpy(&in[length], op->string,
+						    count);
+						length += count;
+					}
+					in[length] = 0;
+					break;
+				}
+				/* insert or prepend */
+				{
+					char *out;
+					int count = op->count;
+					GET_OUT
+					memcpy(out, in, pos);
+					if (count > RULE_WORD_SIZE - 1 - pos)
+						count = RULE_WORD_SIZE - 1 -
+						    pos;
+					if (count < 0)
+						count = 0;
+					memcpy(&out[pos], op->string, count);
+					strcpy(&out[pos + count], &in[pos]);
+					length += count;
+					in = out;
+				}
+			}
+			break;
+
+		case 'T':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				in[pos] = conv_invert[ARCH_INDEX(in[pos])];
+			}
+			break;
+
+		case 'D':
+			{
+				int pos;
+				OP_POSITION(pos, 0)
+				if (pos < length) {
+					char *out;
+					GET_OUT
+					memcpy(out, in, pos);
+					strcpy(&out[pos], &in[pos + 1]);
+					length--;
+					in = out;
+				}
+			}
+			break;
+
+		case '{':
+			{
+				char *out;
+				GET_OUT
+				strcpy(out, &in[1]);
+				in[1] = 0;
+				strcat(out, in);
+				in = out;
+			}
+			break;
+
+		case '}':
+			{
+				char *out;
+				int pos;
+				GET_OUT
+				out[0] = in[pos = length - 1];
+				in[pos] = 0;
+				strcpy(&out[1], in);
+				in = out;
+			}
+			break;
+
+		case 'S':
+			CONV(conv_shift);
+			break;
+
+		case 'V':
+			CONV(conv_vowels);
+			break;
+
+		case 'R':
+			CONV(conv_right);
+			break;
+
+		case 'L':
+			CONV(conv_left);
+			break;
+
+		case 'P':
+			{
+				int pos;
+				if ((pos = length - 1) < 2) break;
+				if (in[pos] == 'd' && in[pos - 1] == 'e') break;
+				if (in[pos] == 'y') in[pos] = 'i'; else
+				if (strchr("bgp", in[pos]) &&
+				    !strchr("bgp", in[pos - 1])) {
+					in[pos + 1] = in[pos];
+					in[pos + 2] = 0;
+				}
+				if (in[pos] == 'e')
+					strcat(in, "d");
+				else
+					strcat(in, "ed");
+			}
+			length = strlen(in);
+			break;
+
+		case 'I':
+			{
+				int pos;
+				if ((pos = length - 1) < 2) break;
+				if (in[pos] == 'g' && in[pos - 1] == 'n' &&
+				    in[pos - 2] == 'i') break;
+				if (strchr("aeiou", in[pos]))
+					strcpy(&in[pos], "ing");
+				else {
+					if (strchr("bgp", in[pos]) &&
+					    !strchr("bgp", in[pos - 1])) {
+						in[pos + 1] = in[pos];
+						in[pos + 2] = 0;
+					}
+					strcat(in, "ing");
+				}
+			}
+			length = strlen(in);
+			break;
+
+		case 'M':
+			memory = memory_buffer;
+			strnfcpy(memory_buffer, in, rules_max_length);
+			rules_vars['m'] = (unsigned char)length - 1;
+			break;
+
+		case 'Q':
+			if (!strncmp(memory, in, rules_max_length))
+				return NULL;
+			break;
+
+		case 'X':
+			{
+				int mpos, count, ipos, mleft;
+				char *inp;
+				const char *mp;
+				OP_POSITION(mpos, 0)
+				OP_POSITION(count, 1)
+				OP_POSITION(ipos, 2)
+				mleft = (int)(rules_vars['m'] + 1) - mpos;
+				if (count > mleft)
+					count = mleft;
+				if (count <= 0)
+					break;
+				mp = memory + mpos;
+				if (ipos >= length) {
+					memcpy(&in[length], mp, count);
+					in[length += count] = 0;
+					break;
+				}
+				inp = in + ipos;
+				memmove(inp + count, inp, length - ipos);
+				in[length += count] = 0;
+				memcpy(inp, mp, count);
+			}
+			break;
+
+		case 'v':
+			{
+				unsigned char a, s;
+				rules_vars['l'] = length;
+				OP_POSITION(a, 0)
+				OP_POSITION(s, 1)
+				rules_vars[ARCH_INDEX(op->value)] = a - s;
+			}
+			break;
+		}
+
+		if (!length)
+			return NULL;
+	} while (++op < end);
+
+	return rules_finish(in, length, last);
+
+out_ERROR_POSITION:
+	rules_errno = RULES_ERROR_POSITION;
+	return NULL;
+}
+
+/*
+ * Block mode.  A compiled rule made of simple commands only (case conversion,
+ * reversal, and appending, prepending or deleting characters) can be applied
+ * to many words at once: each command is applied to all of the words, which
+ * are kept at a fixed stride, before moving on to the next one.  As long as
+ * the words' lengths stay within the bounds computed by rules_compile_block(),
+ * these commands never truncate or reject a word, so they reduce to plain
+ * memory moves, and case conversion of ASCII text is done a machine word at a
+ * time.  Words outside of the bounds take the usual rules_apply() route.
+ */
+#define ONES				((~(unsigned ARCH_WORD)0) / 0xFF)
+#define HIGHS				(ONES << 7)
+
+/* Whether conv_tolower, conv_toupper and conv_invert are plain ASCII ones
+ * for the 7-bit characters */
+static int rules_conv_ascii;
+
+static void rules_init_block(void)
+{
+	int c;
+
+	rules_conv_ascii = 1;
+	for (c = 1; c < 0x80; c++) {
+		int lower = c, upper = c, invert = c;
+
+		if (c >= 'A' && c <= 'Z')
+			invert = lower = c | 0x20;
+		if (c >= 'a' && c <= 'z')
+			invert = upper = c & ~0x20;
+		if (conv_tolower[c] != lower || conv_toupper[c] != upper ||
+		    conv_invert[c] != invert)
+			rules_conv_ascii = 0;
+	}
+}
+
+/* Does what CONV() does for a word in a block.  mask_lower and mask_upper
+ * select which of the ASCII letters get their case bit flipped. */
+static MAYBE_INLINE void rules_block_conv(char *in, int length, char *conv,
+	int mask_lower, int mask_upper)
+{
+	unsigned ARCH_WORD *p = (unsigned ARCH_WORD *)in;
+	unsigned ARCH_WORD *end = (unsigned ARCH_WORD *)&in[length + 1];
+
+	do {
+		unsigned ARCH_WORD x = *p, mask;
+
+		if (!rules_conv_ascii || (x & HIGHS)) {
+			char *q = (char *)p;
+			int n = ARCH_SIZE;
+
+			do {
+				*q = conv[ARCH_INDEX(*q)];
+				q++;
+			} while (--n);
+			continue;
+		}
+
+		mask = 0;
+		if (mask_upper)
+			mask |= (x + (0x80 - 'A') * ONES) &
+			    ~(x + (0x7F - 'Z') * ONES);
+		if (mask_lower)
+			mask |= (x + (0x80 - 'a') * ONES) &
+			    ~(x + (0x7F - 'z') * ONES);
+		*p = x ^ ((mask & HIGHS) >> 2);
+	} while (++p < end);
+}
+
+int rules_apply_block(char **words, int count, char *rule, char **out,
+	char *last)
+{
+	static union {
+		char rows[RULE_BLOCK_SIZE + 1][RULE_WORD_SIZE];
+		ARCH_WORD dummy;
+	} block;
+	int lengths[RULE_BLOCK_SIZE];
+	struct rules_op *op;
+	int i, min, max;
+
+	if (rule != rules_compiled.rule || rules_pass || !rules_compiled.block)
+		return -1;
+
+	if (count > RULE_BLOCK_SIZE)
+		count = RULE_BLOCK_SIZE;
+
+/* The previous block, or rules_apply()'s buffers, may get overwritten */
+	if (last)
+		last = strnzcpy(block.rows[RULE_BLOCK_SIZE], last,
+		    RULE_WORD_SIZE);
+
+	min = rules_compiled.block_min;
+	max = rules_compiled.block_max;
+	for (i = 0; i < count; i++) {
+		int length = strlen(words[i]);
+
+		if (length > max || length < min)
+			length = -1;
+		else
+			memcpy(block.rows[i], words[i], length + 1);
+		lengths[i] = length;
+	}
+
+	for (op = rules_compiled.ops; op < rules_compiled.end; op++)
+	for (i = 0; i < count; i++) {
+		char *in = block.rows[i];
+		int length = lengths[i];
+
+		if (length < 0)
+			continue;
+
+		switch (op->cmd) {
+		case 'l':
+			rules_block_conv(in, length, conv_tolower, 0, 1);
+			break;
+
+		case 'u':
+			rules_block_conv(in, length, conv_toupper, 1, 0);
+			break;
+
+		case 't':
+			rules_block_conv(in, length, conv_invert, 1, 1);
+			break;
+
+		case 'c':
+			{
+				char first = in[0];
+				rules_block_conv(in, length, conv_tolower, 0, 1);
+				in[0] = conv_toupper[ARCH_INDEX(first)];
+			}
+			if (in[0] == 'M' && in[1] == 'c')
+				in[2] = conv_toupper[ARCH_INDEX(in[2])];
+			break;
+
+		case 'C':
+			{
+				char first = in[0];
+				rules_block_conv(in, length, conv_toupper, 1, 0);
+				in[0] = conv_tolower[ARCH_INDEX(first)];
+			}
+			if (in[0] == 'm' && in[1] == 'C')
+				in[2] = conv_tolower[ARCH_INDEX(in[2])];
+			break;
+
+		case 'r':
+			{
+				char *p = in, *q = &in[length - 1];
+				while (p < q) {
+					char c = *p;
+					*p++ = *q;
+					*q-- = c;
+				}
+			}
+			break;
+
+		case RULES_OP_APPEND:
+			memcpy(&in[length], op->string, op->count);
+			in[lengths[i] = length + op->count] = 0;
+			break;
+
+		case RULES_OP_PREPEND:
+			memmove(&in[op->count], in, length + 1);
+			memcpy(in, op->string, op->count);
+			lengths[i] = length + op->count;
+			break;
+
+		case RULES_OP_DELETE_FIRST:
+			memmove(in, &in[op->count], length - op->count + 1);
+			lengths[i] = length - op->count;
+			break;
+
+		case RULES_OP_DELETE_LAST:
+			in[lengths[i] = length - op->count] = 0;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (lengths[i] >= 0)
+			out[i] = rules_finish(block.rows[i], lengths[i], last);
+		else if ((out[i] = rules_apply_compiled(words[i], last)))
+			out[i] = strcpy(block.rows[i], out[i]);
+		if (out[i])
+			last = out[i];
+	}
+
+	return count;
+}
+
 void rules_init(int max_length)
 {
 	rules_pass = 0;
 	rules_errno = RULES_ERROR_NONE;
+	rules_compiled.rule = NULL;
 
 	if (max_length > RULE_WORD_SIZE - 1)
 		max_length = RULE_WORD_SIZE - 1;
@@ -735,6 +1794,7 @@ void rules_init(int max_length)
 	if (!rules_max_length) {
 		rules_init_classes();
 		rules_init_convs();
+		rules_init_block();
 	}
 	rules_init_length(max_length);
 	minlength = (options.force_minlength >= 0) ?
@@ -872,11 +1932,15 @@ char *rules_reject(char *rule, int split, char *last, struct db_main *db)
 	}
 
 accept:
+	rules_compiled.rule = NULL;
 	rules_pass--;
 	strnzcpy(out_rule, rule - 1, sizeof(out_rule));
 	rules_apply("", out_rule, split, last);
 	rules_pass++;
 
+	if (!rules_pass && !rules_errno && rules_compile(out_rule))
+		rules_compiled.rule = out_rule;
+
 	return out_rule;
 }
 
@@ -886,6 +1950,9 @@ char *rules_apply(char *word, char *rule, int split, char *last)
 	int length;
 	int which;
 
+	if (rule == rules_compiled.rule && !rules_pass)
+		return rules_apply_compiled(word, last);
+
 	in = buffer[0];
 	if (in == last)
 		in = buffer[2];
@@ -1478,31 +2545,7 @@ char *rules_apply(char *word, char *rule, int split, char *last)
 		goto out_which;
 
 out_OK:
-	in[rules_max_length] = 0;
-	if (minlength)
-		if (length < minlength)
-			return NULL;
-	/* --maxlength will skip, not truncate */
-	if (maxlength)
-		if (length > maxlength)
-			return NULL;
-	if (last) {
-		if (length > rules_max_length)
-			length = rules_max_length;
-		if (length >= ARCH_SIZE - 1) {
-			if (*(ARCH_WORD *)in != *(ARCH_WORD *)last)
-				return in;
-			if (strcmp(&in[ARCH_SIZE - 1], &last[ARCH_SIZE - 1]))
-				return in;
-			return NULL;
-		}
-		if (last[length])
-			return in;
-		if (memcmp(in, last, length))
-			return in;
-		return NULL;
-	}
-	return in;
+	return rules_finish(in, length, last);
 
 out_which:
 	if (which == 1) {
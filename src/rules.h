@@ -48,6 +48,17 @@ extern char *rules_reject(char *rule, int split, char *last,
  */
 extern char *rules_apply(char *word, char *rule, int split, char *last);
 
+/*
+ * Applies rule to up to RULE_BLOCK_SIZE words at once, with the same results
+ * as calling rules_apply() for each of them in turn (with split < 0, and last
+ * updated to each word that is not rejected).  The mangled words, or NULL for
+ * the rejected ones, are stored in out, and stay valid until the next call.
+ * Returns the number of words processed, or -1 if the rule isn't made of
+ * simple commands only, in which case rules_apply() should be used instead.
+ */
+extern int rules_apply_block(char **words, int count, char *rule, char **out,
+	char *last);
+
 /*
  * Similar to rules_check(), but displays a message and does not return on
  * error.  Also performs 'dupe' rule removal, and lists if any rules were removed.
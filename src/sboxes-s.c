@@ -23,7 +23,9 @@
  */
 
 #undef regs
-#if defined(__x86_64__) && defined(__XOP__)
+#if defined(__x86_64__) && defined(__AVX512F__)
+#define regs 32
+#elif defined(__x86_64__) && defined(__XOP__)
 #define regs 16
 #elif defined(__x86_64__)
 #define regs 15
@@ -24,7 +24,11 @@
 
 #define FORMAT_LABEL			"scrypt"
 #define FORMAT_NAME			""
-#ifdef __XOP__
+#if ESCRYPT_LANES == 4
+#define ALGORITHM_NAME			"Salsa20/8 512/512 AVX512F"
+#elif ESCRYPT_LANES == 2
+#define ALGORITHM_NAME			"Salsa20/8 256/256 AVX2"
+#elif defined(__XOP__)
 #define ALGORITHM_NAME			"Salsa20/8 128/128 XOP"
 #elif defined(__AVX__)
 #define ALGORITHM_NAME			"Salsa20/8 128/128 AVX"
@@ -44,8 +48,8 @@
 #define SALT_SIZE			BINARY_SIZE
 #define SALT_ALIGN			1
 
-#define MIN_KEYS_PER_CRYPT		1
-#define MAX_KEYS_PER_CRYPT		1
+#define MIN_KEYS_PER_CRYPT		ESCRYPT_LANES
+#define MAX_KEYS_PER_CRYPT		ESCRYPT_LANES
 
 static struct fmt_tests tests[] = {
 	{"$7$C6..../....SodiumChloride$"
@@ -243,6 +247,43 @@ static char *get_key(int index)
 	return buffer[index].key;
 }
 
+/*
+ * Hashes the keys from index on, as many as fit in the SIMD lanes (just the
+ * one when there's a single lane).  Returns NULL on failure.
+ */
+static uint8_t *hash_keys(escrypt_local_t *local, int index, int count)
+{
+#if ESCRYPT_LANES > 1
+	const uint8_t *passwd[ESCRYPT_LANES];
+	size_t passwdlen[ESCRYPT_LANES];
+	uint8_t *out[ESCRYPT_LANES];
+	int i, n;
+
+	n = count - index;
+	if (n > ESCRYPT_LANES)
+		n = ESCRYPT_LANES;
+
+	for (i = 0; i < n; i++) {
+		passwd[i] = (const uint8_t *)buffer[index + i].key;
+		passwdlen[i] = strlen(buffer[index + i].key);
+		out[i] = (uint8_t *)buffer[index + i].out;
+	}
+
+	if (escrypt_r_multi(local, n, passwd, passwdlen,
+	    (const uint8_t *)saved_salt, out, sizeof(buffer[index].out)))
+		return NULL;
+
+	return out[0];
+#else
+	return escrypt_r(local,
+	    (const uint8_t *)buffer[index].key,
+	    strlen(buffer[index].key),
+	    (const uint8_t *)saved_salt,
+	    (uint8_t *)&buffer[index].out,
+	    sizeof(buffer[index].out));
+#endif
+}
+
 static int crypt_all(int *pcount, struct db_salt *salt)
 {
 	int count = *pcount;
@@ -251,9 +292,9 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 #ifdef _OPENMP
 	int failed = 0;
 
-#pragma omp parallel for default(none) private(index) shared(count, failed, max_threads, local, saved_salt, buffer)
+#pragma omp parallel for default(none) private(index) shared(count, failed, max_threads, local, buffer)
 #endif
-	for (index = 0; index < count; index++) {
+	for (index = 0; index < count; index += ESCRYPT_LANES) {
 		uint8_t *hash;
 #ifdef _OPENMP
 		int t = omp_get_thread_num();
@@ -261,22 +302,12 @@ static int crypt_all(int *pcount, struct db_salt *salt)
 		const int t = 0;
 #endif
 		if (t < max_threads) {
-			hash = escrypt_r(&local[t],
-			    (const uint8_t *)buffer[index].key,
-			    strlen(buffer[index].key),
-			    (const uint8_t *)saved_salt,
-			    (uint8_t *)&buffer[index].out,
-			    sizeof(buffer[index].out));
+			hash = hash_keys(&local[t], index, count);
 		} else { /* should not happen */
 			escrypt_local_t local;
 			hash = NULL;
 			if (escrypt_init_local(&local) == 0) {
-				hash = escrypt_r(&local,
-				    (const uint8_t *)buffer[index].key,
-				    strlen(buffer[index].key),
-				    (const uint8_t *)saved_salt,
-				    (uint8_t *)&buffer[index].out,
-				    sizeof(buffer[index].out));
+				hash = hash_keys(&local, index, count);
 				escrypt_free_local(&local);
 			}
 		}
@@ -45,6 +45,8 @@
 #include <emmintrin.h>
 #ifdef __XOP__
 #include <x86intrin.h>
+#elif defined __AVX2__
+#include <immintrin.h>
 #elif defined __SSE4_1__
 #include <smmintrin.h>
 #elif defined __SSSE3__
@@ -178,59 +180,165 @@ _inline __m128i _mm_set1_epi64x(long long a)
 #endif
 #define GATHER64(x,y,z)		{x = _mm_set_epi64x (y[1][z], y[0][z]);}
 
+/*
+ * Vector width abstraction.  The kernels below are written against vtype
+ * and the v* helpers.  On AVX2 builds vtype is a 256-bit register, which
+ * holds two MMX_COEF-wide interleaved groups side by side (the low 128 bits
+ * are group 2n, the high 128 bits are group 2n+1).  The in-memory layout
+ * the formats see is unchanged; only the number of groups per register is.
+ */
+#ifdef __AVX2__
+#define vtype				__m256i
+#define VWIDTH				8
+
+#define vadd_epi32			_mm256_add_epi32
+#define vand				_mm256_and_si256
+#define vandnot				_mm256_andnot_si256
+#define vor					_mm256_or_si256
+#define vxor				_mm256_xor_si256
+#define vset1_epi32			_mm256_set1_epi32
+#define vslli_epi32			_mm256_slli_epi32
+#define vsrli_epi32			_mm256_srli_epi32
+
+#define vcmov(y,z,x)		vxor(z, vand(x, vxor(y,z)))
+#define vroti_epi32(a, s)												\
+	((s) < 0 ?															\
+		vor(vsrli_epi32((a), -(s)), vslli_epi32((a), 32+(s)))			\
+	:																	\
+		vor(vslli_epi32((a), (s)), vsrli_epi32((a), 32-(s))))
+#define rot16_mask256											\
+	_mm256_set_epi32(0x0d0c0f0e, 0x09080b0a, 0x05040706, 0x01000302,	\
+	                 0x0d0c0f0e, 0x09080b0a, 0x05040706, 0x01000302)
+#define vroti16_epi32(a, s)	_mm256_shuffle_epi8((a), rot16_mask256)
+#define swap_endian_mask256										\
+	_mm256_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203,	\
+	                 0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203)
+#define vswap_endian(n)		(n = _mm256_shuffle_epi8(n, swap_endian_mask256))
+
+/* The formats' buffers are only guaranteed MEM_ALIGN_SIMD (16) aligned */
+#define vload(p)			_mm256_loadu_si256((vtype *)(p))
+#define vstore(p, x)		_mm256_storeu_si256((vtype *)(p), (x))
+#define vload2(p0, p1)													\
+	_mm256_inserti128_si256(_mm256_castsi128_si256(						\
+		_mm_load_si128((__m128i *)(p0))), _mm_load_si128((__m128i *)(p1)), 1)
+#define vstore2(p0, p1, x)												\
+	{																	\
+		_mm_store_si128((__m128i *)(p0), _mm256_castsi256_si128(x));	\
+		_mm_store_si128((__m128i *)(p1), _mm256_extracti128_si256(x, 1));	\
+	}
+#else
+#define vtype				__m128i
+#define VWIDTH				4
+
+#define vadd_epi32			_mm_add_epi32
+#define vand				_mm_and_si128
+#define vandnot				_mm_andnot_si128
+#define vor					_mm_or_si128
+#define vxor				_mm_xor_si128
+#define vset1_epi32			_mm_set1_epi32
+#define vslli_epi32			_mm_slli_epi32
+#define vsrli_epi32			_mm_srli_epi32
+
+#define vcmov				_mm_cmov_si128
+#define vroti_epi32			_mm_roti_epi32
+#define vroti16_epi32		_mm_roti16_epi32
+#define vswap_endian		SWAP_ENDIAN
+
+#define vload(p)			_mm_load_si128((vtype *)(p))
+#define vstore(p, x)		_mm_store_si128((vtype *)(p), (x))
+#define vload2(p0, p1)		vload(p0)
+#define vstore2(p0, p1, x)	vstore(p0, x)
+#endif
 
 #ifndef MMX_COEF
 #define MMX_COEF 4
 #endif
 
+/* number of MMX_COEF interleaved groups held by one vtype */
+#define VGROUPS				(VWIDTH/MMX_COEF)
+
+/* load/store the 'off' word row of vector i, from a per-group state array */
+#define vload_state(p, i, stride, off)									\
+	vload2(&(p)[((i)*VGROUPS)*(stride)+(off)],							\
+	       &(p)[((i)*VGROUPS+1)*(stride)+(off)])
+#define vstore_state(p, i, stride, off, x)								\
+	vstore2(&(p)[((i)*VGROUPS)*(stride)+(off)],							\
+	        &(p)[((i)*VGROUPS+1)*(stride)+(off)], x)
+
+#if VGROUPS > 1
+/* pack 'words' rows of pairs of interleaved groups into vectors */
+static MAYBE_INLINE vtype *vpack_groups(vtype *dst, __m128i *src, unsigned int words, unsigned int vpara)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < vpara; i++)
+		for (j = 0; j < words; j++)
+			dst[i*words+j] = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(src[(2*i)*words+j]),
+				src[(2*i+1)*words+j], 1);
+	return dst;
+}
+#define VPACK_DECL(n)		vtype vpacked[n];
+#define VPACK(src, words, vpara)	vpack_groups(vpacked, src, words, vpara)
+#else
+#define VPACK_DECL(n)
+#define VPACK(src, words, vpara)	(src)
+#endif
+
 #ifdef MD5_SSE_PARA
 #define MD5_SSE_NUM_KEYS	(MMX_COEF*MD5_SSE_PARA)
 #define MD5_PARA_DO(x)	for((x)=0;(x)<MD5_SSE_PARA;(x)++)
+#define MD5_VPARA		(MD5_SSE_PARA/VGROUPS)
+#define MD5_VPARA_DO(x)	for((x)=0;(x)<MD5_VPARA;(x)++)
+#if MD5_SSE_PARA % VGROUPS
+#error MD5_SSE_PARA must be a multiple of the number of SIMD groups per vector
+#endif
 
 #define MD5_F(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	MD5_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define MD5_G(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_cmov_si128((x[i]),(y[i]),(z[i]));
+	MD5_VPARA_DO(i) tmp[i] = vcmov((x[i]),(y[i]),(z[i]));
 
 #define MD5_H(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	MD5_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	MD5_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #define MD5_I(x,y,z) \
-	MD5_PARA_DO(i) tmp[i] = _mm_andnot_si128((z[i]), mask); \
-	MD5_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]),(x[i])); \
-	MD5_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(y[i]));
+	MD5_VPARA_DO(i) tmp[i] = vandnot((z[i]), mask); \
+	MD5_VPARA_DO(i) tmp[i] = vor((tmp[i]),(x[i])); \
+	MD5_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(y[i]));
 
 #define MD5_STEP(f, a, b, c, d, x, t, s) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], _mm_set_epi32(t,t,t,t) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vset1_epi32(t) ); \
 	f((b),(c),(d)) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD5_PARA_DO(i) a[i] = _mm_roti_epi32( a[i], (s) ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], b[i] );
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], data[i*16+x] ); \
+	MD5_VPARA_DO(i) a[i] = vroti_epi32( a[i], (s) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], b[i] );
 
 #define MD5_STEP_r16(f, a, b, c, d, x, t, s) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], _mm_set_epi32(t,t,t,t) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], vset1_epi32(t) ); \
 	f((b),(c),(d)) \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD5_PARA_DO(i) a[i] = _mm_roti16_epi32( a[i], (s) ); \
-	MD5_PARA_DO(i) a[i] = _mm_add_epi32( a[i], b[i] );
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], data[i*16+x] ); \
+	MD5_VPARA_DO(i) a[i] = vroti16_epi32( a[i], (s) ); \
+	MD5_VPARA_DO(i) a[i] = vadd_epi32( a[i], b[i] );
 
 void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*MD5_SSE_PARA];
-	__m128i a[MD5_SSE_PARA];
-	__m128i b[MD5_SSE_PARA];
-	__m128i c[MD5_SSE_PARA];
-	__m128i d[MD5_SSE_PARA];
-	__m128i tmp[MD5_SSE_PARA];
-	__m128i mask;
+	VPACK_DECL(16*MD5_VPARA)
+	vtype a[MD5_VPARA];
+	vtype b[MD5_VPARA];
+	vtype c[MD5_VPARA];
+	vtype d[MD5_VPARA];
+	vtype tmp[MD5_VPARA];
+	vtype mask;
 	unsigned int i;
-	__m128i *data;
+	vtype *data;
 
-	mask = _mm_set1_epi32(0Xffffffff);
+	mask = vset1_epi32(0Xffffffff);
 
 	if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -279,40 +387,40 @@ void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state,
 		}
 #endif
 		// now set our data pointer to point to this 'mixed' data.
-		data = w;
+		data = VPACK(w, 16, MD5_VPARA);
 	} else
-		data = _data;
+		data = VPACK(_data, 16, MD5_VPARA);
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
+				a[i] = vload_state(reload_state, i, 16*4, 0);
+				b[i] = vload_state(reload_state, i, 16*4, 4);
+				c[i] = vload_state(reload_state, i, 16*4, 8);
+				d[i] = vload_state(reload_state, i, 16*4, 12);
 			}
 		}
 		else
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16+12]);
+				a[i] = vload_state(reload_state, i, 16, 0);
+				b[i] = vload_state(reload_state, i, 16, 4);
+				c[i] = vload_state(reload_state, i, 16, 8);
+				d[i] = vload_state(reload_state, i, 16, 12);
 			}
 		}
 	}
@@ -391,55 +499,55 @@ void SSEmd5body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state,
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 16*4, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 16*4, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 16*4, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 16*4, 12));
 			}
 		}
 		else
 		{
-			MD5_PARA_DO(i)
+			MD5_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16+12]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 16, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 16, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 16, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 16, 12));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
+			vstore_state(out, i, 16*4, 0, a[i]);
+			vstore_state(out, i, 16*4, 4, b[i]);
+			vstore_state(out, i, 16*4, 8, c[i]);
+			vstore_state(out, i, 16*4, 12, d[i]);
 		}
 	}
 	else
 	{
-		MD5_PARA_DO(i)
+		MD5_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16+12], d[i]);
+			vstore_state(out, i, 16, 0, a[i]);
+			vstore_state(out, i, 16, 4, b[i]);
+			vstore_state(out, i, 16, 8, c[i]);
+			vstore_state(out, i, 16, 12, d[i]);
 		}
 	}
 }
@@ -679,39 +787,45 @@ void md5cryptsse(unsigned char pwd[MD5_SSE_NUM_KEYS][16], unsigned char * salt,
 #ifdef MD4_SSE_PARA
 #define MD4_SSE_NUM_KEYS	(MMX_COEF*MD4_SSE_PARA)
 #define MD4_PARA_DO(x)	for((x)=0;(x)<MD4_SSE_PARA;(x)++)
+#define MD4_VPARA		(MD4_SSE_PARA/VGROUPS)
+#define MD4_VPARA_DO(x)	for((x)=0;(x)<MD4_VPARA;(x)++)
+#if MD4_SSE_PARA % VGROUPS
+#error MD4_SSE_PARA must be a multiple of the number of SIMD groups per vector
+#endif
 
 #define MD4_F(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	MD4_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define MD4_G(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_or_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp2[i] = _mm_and_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_and_si128((tmp[i]),(x[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]), (tmp2[i]) );
+	MD4_VPARA_DO(i) tmp[i] = vor((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp2[i] = vand((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vand((tmp[i]),(x[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vor((tmp[i]), (tmp2[i]) );
 
 #define MD4_H(x,y,z) \
-	MD4_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	MD4_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	MD4_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	MD4_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #define MD4_STEP(f, a, b, c, d, x, t, s) \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], t ); \
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], t ); \
 	f((b),(c),(d)) \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], tmp[i] ); \
-	MD4_PARA_DO(i) a[i] = _mm_add_epi32( a[i], data[i*16+x] ); \
-	MD4_PARA_DO(i) a[i] = _mm_roti_epi32( a[i], (s) );
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], tmp[i] ); \
+	MD4_VPARA_DO(i) a[i] = vadd_epi32( a[i], data[i*16+x] ); \
+	MD4_VPARA_DO(i) a[i] = vroti_epi32( a[i], (s) );
 
 void SSEmd4body(__m128i* _data, unsigned int * out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*MD4_SSE_PARA];
-	__m128i a[MD4_SSE_PARA];
-	__m128i b[MD4_SSE_PARA];
-	__m128i c[MD4_SSE_PARA];
-	__m128i d[MD4_SSE_PARA];
-	__m128i tmp[MD4_SSE_PARA];
-	__m128i tmp2[MD4_SSE_PARA];
-	__m128i	cst;
+	VPACK_DECL(16*MD4_VPARA)
+	vtype a[MD4_VPARA];
+	vtype b[MD4_VPARA];
+	vtype c[MD4_VPARA];
+	vtype d[MD4_VPARA];
+	vtype tmp[MD4_VPARA];
+	vtype tmp2[MD4_VPARA];
+	vtype cst;
 	unsigned int i;
-	__m128i *data;
+	vtype *data;
 
 if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -760,47 +874,47 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 		}
 #endif
 		// now set our data pointer to point to this 'mixed' data.
-		data = w;
+		data = VPACK(w, 16, MD4_VPARA);
 	} else
-		data = _data;
+		data = VPACK(_data, 16, MD4_VPARA);
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
+				a[i] = vload_state(reload_state, i, 16*4, 0);
+				b[i] = vload_state(reload_state, i, 16*4, 4);
+				c[i] = vload_state(reload_state, i, 16*4, 8);
+				d[i] = vload_state(reload_state, i, 16*4, 12);
 			}
 		}
 		else
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16+12]);
+				a[i] = vload_state(reload_state, i, 16, 0);
+				b[i] = vload_state(reload_state, i, 16, 4);
+				c[i] = vload_state(reload_state, i, 16, 8);
+				d[i] = vload_state(reload_state, i, 16, 12);
 			}
 		}
 	}
 
 
 /* Round 1 */
-		cst = _mm_set_epi32(0,0,0,0);
+		cst = vset1_epi32(0);
 		MD4_STEP(MD4_F, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_F, d, a, b, c, 1, cst, 7)
 		MD4_STEP(MD4_F, c, d, a, b, 2, cst, 11)
@@ -819,7 +933,7 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 		MD4_STEP(MD4_F, b, c, d, a, 15, cst, 19)
 
 /* Round 2 */
-		cst = _mm_set_epi32(0x5A827999L,0x5A827999L,0x5A827999L,0x5A827999L);
+		cst = vset1_epi32(0x5A827999L);
 		MD4_STEP(MD4_G, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_G, d, a, b, c, 4, cst, 5)
 		MD4_STEP(MD4_G, c, d, a, b, 8, cst, 9)
@@ -838,7 +952,7 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 		MD4_STEP(MD4_G, b, c, d, a, 15, cst, 13)
 
 /* Round 3 */
-		cst = _mm_set_epi32(0x6ED9EBA1L,0x6ED9EBA1L,0x6ED9EBA1L,0x6ED9EBA1L);
+		cst = vset1_epi32(0x6ED9EBA1L);
 		MD4_STEP(MD4_H, a, b, c, d, 0, cst, 3)
 		MD4_STEP(MD4_H, d, a, b, c, 8, cst, 9)
 		MD4_STEP(MD4_H, c, d, a, b, 4, cst, 11)
@@ -859,55 +973,55 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 16*4, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 16*4, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 16*4, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 16*4, 12));
 			}
 		}
 		else
 		{
-			MD4_PARA_DO(i)
+			MD4_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16+12]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 16, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 16, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 16, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 16, 12));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
+			vstore_state(out, i, 16*4, 0, a[i]);
+			vstore_state(out, i, 16*4, 4, b[i]);
+			vstore_state(out, i, 16*4, 8, c[i]);
+			vstore_state(out, i, 16*4, 12, d[i]);
 		}
 	}
 	else
 	{
-		MD4_PARA_DO(i)
+		MD4_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16+12], d[i]);
+			vstore_state(out, i, 16, 0, a[i]);
+			vstore_state(out, i, 16, 4, b[i]);
+			vstore_state(out, i, 16, 8, c[i]);
+			vstore_state(out, i, 16, 12, d[i]);
 		}
 	}
 }
@@ -917,25 +1031,30 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 #ifdef SHA1_SSE_PARA
 #define SHA1_SSE_NUM_KEYS	(MMX_COEF*SHA1_SSE_PARA)
 #define SHA1_PARA_DO(x)		for((x)=0;(x)<SHA1_SSE_PARA;(x)++)
+#define SHA1_VPARA		(SHA1_SSE_PARA/VGROUPS)
+#define SHA1_VPARA_DO(x)	for((x)=0;(x)<SHA1_VPARA;(x)++)
+#if SHA1_SSE_PARA % VGROUPS
+#error SHA1_SSE_PARA must be a multiple of the number of SIMD groups per vector
+#endif
 
 #define SHA1_F(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_cmov_si128((y[i]),(z[i]),(x[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vcmov((y[i]),(z[i]),(x[i]));
 
 #define SHA1_G(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((y[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(x[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vxor((y[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(x[i]));
 
 #ifdef __XOP__
 #define SHA1_H(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_cmov_si128((x[i]),(y[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_andnot_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128((tmp[i]),(tmp2[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vcmov((x[i]),(y[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vandnot((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor((tmp[i]),(tmp2[i]));
 #else
 #define SHA1_H(x,y,z) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_and_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_or_si128((x[i]),(y[i])); \
-	SHA1_PARA_DO(i) tmp2[i] = _mm_and_si128((tmp2[i]),(z[i])); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_or_si128((tmp[i]),(tmp2[i]));
+	SHA1_VPARA_DO(i) tmp[i] = vand((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vor((x[i]),(y[i])); \
+	SHA1_VPARA_DO(i) tmp2[i] = vand((tmp2[i]),(z[i])); \
+	SHA1_VPARA_DO(i) tmp[i] = vor((tmp[i]),(tmp2[i]));
 #endif
 
 #define SHA1_I(x,y,z) SHA1_G(x,y,z)
@@ -943,6 +1062,9 @@ if(SSEi_flags & SSEi_FLAT_IN) {
 #if SHA_BUF_SIZ == 80
 
 // Bartavelle's original code, using 80x4 words of buffer
+#if VGROUPS > 1
+#error SHA_BUF_SIZ 80 is only implemented for 128-bit vectors
+#endif
 
 #define SHA1_EXPAND(t) \
 	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( data[i*80+t-3], data[i*80+t-8] ); \
@@ -1165,101 +1287,102 @@ void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, u
 // JimF's code, using 16x4 words of buffer just like MD4/5
 
 #define SHA1_EXPAND2a(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( data[i*16+t-3], data[i*16+t-8] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( data[i*16+t-3], data[i*16+t-8] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2b(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], data[i*16+t-8] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], data[i*16+t-8] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2c(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-14] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-14] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2d(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], data[i*16+t-16] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], data[i*16+t-16] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 #define SHA1_EXPAND2(t) \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_xor_si128( tmp[i], tmpR[i*16+((t-16)&0xF)] ); \
-	SHA1_PARA_DO(i) tmpR[i*16+((t)&0xF)] = _mm_roti_epi32(tmp[i], 1);
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmpR[i*16+((t-3)&0xF)], tmpR[i*16+((t-8)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-14)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vxor( tmp[i], tmpR[i*16+((t-16)&0xF)] ); \
+	SHA1_VPARA_DO(i) tmpR[i*16+((t)&0xF)] = vroti_epi32(tmp[i], 1);
 
 #define SHA1_ROUND2a(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2a(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], data[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2b(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2b(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], data[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2c(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2c(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], data[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2d(a,b,c,d,e,F,t) \
 	SHA1_EXPAND2d(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], data[i*16+t] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], data[i*16+t] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2(a,b,c,d,e,F,t) \
-	SHA1_PARA_DO(i) tmp3[i] = tmpR[i*16+(t&0xF)]; \
+	SHA1_VPARA_DO(i) tmp3[i] = tmpR[i*16+(t&0xF)]; \
 	SHA1_EXPAND2(t+16) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp3[i] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp3[i] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 #define SHA1_ROUND2x(a,b,c,d,e,F,t) \
 	F(b,c,d) \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) tmp[i] = _mm_roti_epi32(a[i], 5); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmp[i] ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], cst ); \
-	SHA1_PARA_DO(i) e[i] = _mm_add_epi32( e[i], tmpR[i*16+(t&0xF)] ); \
-	SHA1_PARA_DO(i) b[i] = _mm_roti_epi32(b[i], 30);
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) tmp[i] = vroti_epi32(a[i], 5); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmp[i] ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], cst ); \
+	SHA1_VPARA_DO(i) e[i] = vadd_epi32( e[i], tmpR[i*16+(t&0xF)] ); \
+	SHA1_VPARA_DO(i) b[i] = vroti_epi32(b[i], 30);
 
 void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
 	__m128i w[16*SHA1_SSE_PARA];
-	__m128i a[SHA1_SSE_PARA];
-	__m128i b[SHA1_SSE_PARA];
-	__m128i c[SHA1_SSE_PARA];
-	__m128i d[SHA1_SSE_PARA];
-	__m128i e[SHA1_SSE_PARA];
-	__m128i tmp[SHA1_SSE_PARA];
-	__m128i tmp2[SHA1_SSE_PARA];
-	__m128i tmp3[SHA1_SSE_PARA];
-	__m128i tmpR[SHA1_SSE_PARA*16];
-	__m128i	cst;
+	VPACK_DECL(16*SHA1_VPARA)
+	vtype a[SHA1_VPARA];
+	vtype b[SHA1_VPARA];
+	vtype c[SHA1_VPARA];
+	vtype d[SHA1_VPARA];
+	vtype e[SHA1_VPARA];
+	vtype tmp[SHA1_VPARA];
+	vtype tmp2[SHA1_VPARA];
+	vtype tmp3[SHA1_VPARA];
+	vtype tmpR[SHA1_VPARA*16];
+	vtype cst;
 	unsigned int i;
-	__m128i *data;
+	vtype *data;
 
 	if(SSEi_flags & SSEi_FLAT_IN) {
 		// Move _data to __data, mixing it MMX_COEF wise.
@@ -1327,48 +1450,48 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #endif
 
 		// now set our data pointer to point to this 'mixed' data.
-		data = w;
+		data = VPACK(w, 16, SHA1_VPARA);
 	} else
-		data = _data;
+		data = VPACK(_data, 16, SHA1_VPARA);
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			a[i] = _mm_set1_epi32(0x67452301);
-			b[i] = _mm_set1_epi32(0xefcdab89);
-			c[i] = _mm_set1_epi32(0x98badcfe);
-			d[i] = _mm_set1_epi32(0x10325476);
-			e[i] = _mm_set1_epi32(0xC3D2E1F0);
+			a[i] = vset1_epi32(0x67452301);
+			b[i] = vset1_epi32(0xefcdab89);
+			c[i] = vset1_epi32(0x98badcfe);
+			d[i] = vset1_epi32(0x10325476);
+			e[i] = vset1_epi32(0xC3D2E1F0);
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
-				e[i] = _mm_load_si128((__m128i *)&reload_state[i*16*4+16]);
+				a[i] = vload_state(reload_state, i, 16*4, 0);
+				b[i] = vload_state(reload_state, i, 16*4, 4);
+				c[i] = vload_state(reload_state, i, 16*4, 8);
+				d[i] = vload_state(reload_state, i, 16*4, 12);
+				e[i] = vload_state(reload_state, i, 16*4, 16);
 			}
 		}
 		else
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_load_si128((__m128i *)&reload_state[i*20+0]);
-				b[i] = _mm_load_si128((__m128i *)&reload_state[i*20+4]);
-				c[i] = _mm_load_si128((__m128i *)&reload_state[i*20+8]);
-				d[i] = _mm_load_si128((__m128i *)&reload_state[i*20+12]);
-				e[i] = _mm_load_si128((__m128i *)&reload_state[i*20+16]);
+				a[i] = vload_state(reload_state, i, 20, 0);
+				b[i] = vload_state(reload_state, i, 20, 4);
+				c[i] = vload_state(reload_state, i, 20, 8);
+				d[i] = vload_state(reload_state, i, 20, 12);
+				e[i] = vload_state(reload_state, i, 20, 16);
 			}
 		}
 	}
 
-	cst = _mm_set1_epi32(0x5A827999);
+	cst = vset1_epi32(0x5A827999);
 	SHA1_ROUND2a( a, b, c, d, e, SHA1_F,  0 );
 	SHA1_ROUND2a( e, a, b, c, d, SHA1_F,  1 );
 	SHA1_ROUND2a( d, e, a, b, c, SHA1_F,  2 );
@@ -1390,7 +1513,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_F, 18 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_F, 19 );
 
-	cst = _mm_set1_epi32(0x6ED9EBA1);
+	cst = vset1_epi32(0x6ED9EBA1);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_G, 20 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_G, 21 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_G, 22 );
@@ -1412,7 +1535,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_G, 38 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_G, 39 );
 
-	cst = _mm_set1_epi32(0x8F1BBCDC);
+	cst = vset1_epi32(0x8F1BBCDC);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_H, 40 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_H, 41 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_H, 42 );
@@ -1434,7 +1557,7 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	SHA1_ROUND2( c, d, e, a, b, SHA1_H, 58 );
 	SHA1_ROUND2( b, c, d, e, a, SHA1_H, 59 );
 
-	cst = _mm_set1_epi32(0xCA62C1D6);
+	cst = vset1_epi32(0xCA62C1D6);
 	SHA1_ROUND2( a, b, c, d, e, SHA1_I, 60 );
 	SHA1_ROUND2( e, a, b, c, d, SHA1_I, 61 );
 	SHA1_ROUND2( d, e, a, b, c, SHA1_I, 62 );
@@ -1458,143 +1581,191 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 
 	if((SSEi_flags & SSEi_RELOAD)==0)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			a[i] = _mm_add_epi32(a[i], _mm_set1_epi32(0x67452301));
-			b[i] = _mm_add_epi32(b[i], _mm_set1_epi32(0xefcdab89));
-			c[i] = _mm_add_epi32(c[i], _mm_set1_epi32(0x98badcfe));
-			d[i] = _mm_add_epi32(d[i], _mm_set1_epi32(0x10325476));
-			e[i] = _mm_add_epi32(e[i], _mm_set1_epi32(0xC3D2E1F0));
+			a[i] = vadd_epi32(a[i], vset1_epi32(0x67452301));
+			b[i] = vadd_epi32(b[i], vset1_epi32(0xefcdab89));
+			c[i] = vadd_epi32(c[i], vset1_epi32(0x98badcfe));
+			d[i] = vadd_epi32(d[i], vset1_epi32(0x10325476));
+			e[i] = vadd_epi32(e[i], vset1_epi32(0xC3D2E1F0));
 		}
 	}
 	else
 	{
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+12]));
-				e[i] = _mm_add_epi32(e[i], _mm_load_si128((__m128i *)&reload_state[i*16*4+16]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 16*4, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 16*4, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 16*4, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 16*4, 12));
+				e[i] = vadd_epi32(e[i], vload_state(reload_state, i, 16*4, 16));
 			}
 		}
 		else
 		{
-			SHA1_PARA_DO(i)
+			SHA1_VPARA_DO(i)
 			{
-				a[i] = _mm_add_epi32(a[i], _mm_load_si128((__m128i *)&reload_state[i*20+0]));
-				b[i] = _mm_add_epi32(b[i], _mm_load_si128((__m128i *)&reload_state[i*20+4]));
-				c[i] = _mm_add_epi32(c[i], _mm_load_si128((__m128i *)&reload_state[i*20+8]));
-				d[i] = _mm_add_epi32(d[i], _mm_load_si128((__m128i *)&reload_state[i*20+12]));
-				e[i] = _mm_add_epi32(e[i], _mm_load_si128((__m128i *)&reload_state[i*20+16]));
+				a[i] = vadd_epi32(a[i], vload_state(reload_state, i, 20, 0));
+				b[i] = vadd_epi32(b[i], vload_state(reload_state, i, 20, 4));
+				c[i] = vadd_epi32(c[i], vload_state(reload_state, i, 20, 8));
+				d[i] = vadd_epi32(d[i], vload_state(reload_state, i, 20, 12));
+				e[i] = vadd_epi32(e[i], vload_state(reload_state, i, 20, 16));
 			}
 		}
 	}
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d[i]);
-			_mm_store_si128((__m128i *)&out[i*16*4+16], e[i]);
+			vstore_state(out, i, 16*4, 0, a[i]);
+			vstore_state(out, i, 16*4, 4, b[i]);
+			vstore_state(out, i, 16*4, 8, c[i]);
+			vstore_state(out, i, 16*4, 12, d[i]);
+			vstore_state(out, i, 16*4, 16, e[i]);
 		}
 	}
 	else
 	{
-		SHA1_PARA_DO(i)
+		SHA1_VPARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*20+0], a[i]);
-			_mm_store_si128((__m128i *)&out[i*20+4], b[i]);
-			_mm_store_si128((__m128i *)&out[i*20+8], c[i]);
-			_mm_store_si128((__m128i *)&out[i*20+12], d[i]);
-			_mm_store_si128((__m128i *)&out[i*20+16], e[i]);
+			vstore_state(out, i, 20, 0, a[i]);
+			vstore_state(out, i, 20, 4, b[i]);
+			vstore_state(out, i, 20, 8, c[i]);
+			vstore_state(out, i, 20, 12, d[i]);
+			vstore_state(out, i, 20, 16, e[i]);
 		}
 	}
 }
 #endif /* SHA_BUF_SIZ */
 #endif /* SHA1_SSE_PARA */
 
+/*
+ * The SHA-2 bodies below work on one flat lane per 32/64-bit element, with
+ * no PARA interleave, so on AVX-512 builds they switch the vtype layer over
+ * to full 512-bit registers (16 SHA-256 lanes, 8 SHA-512 lanes).  The
+ * MD4/MD5/SHA1 bodies above stay at 256 bits.
+ */
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#undef vtype
+#undef VWIDTH
+#undef vadd_epi32
+#undef vand
+#undef vandnot
+#undef vor
+#undef vxor
+#undef vset1_epi32
+#undef vslli_epi32
+#undef vsrli_epi32
+#undef vcmov
+#undef vroti_epi32
+#undef vroti16_epi32
+#undef vswap_endian
+#undef vload
+#undef vstore
+
+#define vtype				__m512i
+#define VWIDTH				16
+
+#define vadd_epi32			_mm512_add_epi32
+#define vand				_mm512_and_si512
+#define vandnot				_mm512_andnot_si512
+#define vor					_mm512_or_si512
+#define vxor				_mm512_xor_si512
+#define vset1_epi32			_mm512_set1_epi32
+#define vslli_epi32			_mm512_slli_epi32
+#define vsrli_epi32			_mm512_srli_epi32
+
+/* x ? y : z, bitwise, in one vpternlogd */
+#define vcmov(y,z,x)		_mm512_ternarylogic_epi32(x, y, z, 0xCA)
+/* a negative count rotates right, same as _mm_roti_epi32 */
+#define vroti_epi32(a, s)	_mm512_rol_epi32((a), (s) & 31)
+#define vroti16_epi32(a, s)	_mm512_rol_epi32((a), 16)
+#define vswap_endian(n)		\
+	(n = _mm512_shuffle_epi8(n, _mm512_broadcast_i32x4(swap_endian_mask)))
+
+#define vload(p)			_mm512_loadu_si512((void *)(p))
+#define vstore(p, x)		_mm512_storeu_si512((void *)(p), (x))
+#endif
+
 
 #define S0(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_roti_epi32 (x, -22),        \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -2),    \
-            _mm_roti_epi32 (x, -13)     \
+    vxor (                     \
+        vroti_epi32 (x, -22),        \
+        vxor (                 \
+            vroti_epi32 (x,  -2),    \
+            vroti_epi32 (x, -13)     \
         )                               \
     )                                   \
 )
 
 #define S1(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_roti_epi32 (x, -25),        \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -6),    \
-            _mm_roti_epi32 (x, -11)     \
+    vxor (                     \
+        vroti_epi32 (x, -25),        \
+        vxor (                 \
+            vroti_epi32 (x,  -6),    \
+            vroti_epi32 (x, -11)     \
         )                               \
     )                                   \
 )
 
 #define s0(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_srli_epi32 (x, 3),          \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x,  -7),    \
-            _mm_roti_epi32 (x, -18)     \
+    vxor (                     \
+        vsrli_epi32 (x, 3),          \
+        vxor (                 \
+            vroti_epi32 (x,  -7),    \
+            vroti_epi32 (x, -18)     \
         )                               \
     )                                   \
 )
 
 #define s1(x)                           \
 (                                       \
-    _mm_xor_si128 (                     \
-        _mm_srli_epi32 (x, 10),         \
-        _mm_xor_si128 (                 \
-            _mm_roti_epi32 (x, -17),    \
-            _mm_roti_epi32 (x, -19)     \
+    vxor (                     \
+        vsrli_epi32 (x, 10),         \
+        vxor (                 \
+            vroti_epi32 (x, -17),    \
+            vroti_epi32 (x, -19)     \
         )                               \
     )                                   \
 )
 
-#define Maj(x,y,z) _mm_cmov_si128 (x, y, _mm_xor_si128 (z, y))
+#define Maj(x,y,z) vcmov (x, y, vxor (z, y))
 
-#define Ch(x,y,z) _mm_cmov_si128 (y, z, x)
+#define Ch(x,y,z) vcmov (y, z, x)
 
 #undef R
 #define R(x,x1,x2,x3)                         \
 {                                             \
-    tmp1 = _mm_add_epi32 (s1(w[x1]), w[x2]);  \
-    tmp1 = _mm_add_epi32 (w[x],  tmp1);       \
-    w[x] = _mm_add_epi32 (s0(w[x3]), tmp1);   \
+    tmp1 = vadd_epi32 (s1(w[x1]), w[x2]);  \
+    tmp1 = vadd_epi32 (w[x],  tmp1);       \
+    w[x] = vadd_epi32 (s0(w[x3]), tmp1);   \
 }
 
 #define SHA256_STEP0(a,b,c,d,e,f,g,h,x,K)            \
 {                                                    \
-    tmp1 = _mm_add_epi32 (h,    S1(e));              \
-    tmp1 = _mm_add_epi32 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi32 (tmp1, _mm_set1_epi32(K));  \
-    tmp1 = _mm_add_epi32 (tmp1, w[x]);               \
-    tmp2 = _mm_add_epi32 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi32 (tmp1, d);                  \
-    h    = _mm_add_epi32 (tmp1, tmp2);               \
+    tmp1 = vadd_epi32 (h,    S1(e));              \
+    tmp1 = vadd_epi32 (tmp1, Ch(e,f,g));          \
+    tmp1 = vadd_epi32 (tmp1, vset1_epi32(K));  \
+    tmp1 = vadd_epi32 (tmp1, w[x]);               \
+    tmp2 = vadd_epi32 (S0(a),Maj(a,b,c));         \
+    d    = vadd_epi32 (tmp1, d);                  \
+    h    = vadd_epi32 (tmp1, tmp2);               \
 }
 #define SHA256_STEP_R(a,b,c,d,e,f,g,h, x,x1,x2,x3, K)\
 {                                                    \
 	R(x,x1,x2,x3);								     \
-    tmp1 = _mm_add_epi32 (h,    S1(e));              \
-    tmp1 = _mm_add_epi32 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi32 (tmp1, _mm_set1_epi32(K));  \
-    tmp1 = _mm_add_epi32 (tmp1, w[x]);				 \
-    tmp2 = _mm_add_epi32 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi32 (tmp1, d);                  \
-    h    = _mm_add_epi32 (tmp1, tmp2);               \
+    tmp1 = vadd_epi32 (h,    S1(e));              \
+    tmp1 = vadd_epi32 (tmp1, Ch(e,f,g));          \
+    tmp1 = vadd_epi32 (tmp1, vset1_epi32(K));  \
+    tmp1 = vadd_epi32 (tmp1, w[x]);				 \
+    tmp2 = vadd_epi32 (S0(a),Maj(a,b,c));         \
+    d    = vadd_epi32 (tmp1, d);                  \
+    h    = vadd_epi32 (tmp1, tmp2);               \
 }
 
 // this macro was used to create the new macros for the smaller w[16] array.
@@ -1617,15 +1788,45 @@ void SSESHA1body(__m128i* _data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
  *  7. See if we can do anything better using 'DO_PARA' type methods, like we do in SHA1/MD4/5
  */
 #if defined (MMX_COEF_SHA256)
+#if MMX_COEF_SHA256 != VWIDTH
+#error MMX_COEF_SHA256 must match the SIMD vector width
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define VGATHER_IDX(s)                                                  \
+	_mm512_set_epi32(15<<(s), 14<<(s), 13<<(s), 12<<(s), 11<<(s), 10<<(s), \
+	                  9<<(s),  8<<(s),  7<<(s),  6<<(s),  5<<(s),  4<<(s), \
+	                  3<<(s),  2<<(s),  1<<(s), 0)
+#define VGATHER_4x(x, y, z)                                             \
+	x = _mm512_i32gather_epi32(VGATHER_IDX(6), (int *)&(y)[z], 4)
+#define VGATHER_2x(x, y, z)                                             \
+	x = _mm512_i32gather_epi32(VGATHER_IDX(5), (int *)&(y)[z], 4)
+#define VGATHER(x, y, z)                                                \
+	x = _mm512_i32gather_epi32(VGATHER_IDX(4), (int *)&(y)[z], 4)
+#elif defined(__AVX2__)
+#define VGATHER_IDX(s)                                                  \
+	_mm256_set_epi32(7<<(s), 6<<(s), 5<<(s), 4<<(s), 3<<(s), 2<<(s), 1<<(s), 0)
+#define VGATHER_4x(x, y, z)                                             \
+	x = _mm256_i32gather_epi32((int *)&(y)[z], VGATHER_IDX(6), 4)
+#define VGATHER_2x(x, y, z)                                             \
+	x = _mm256_i32gather_epi32((int *)&(y)[z], VGATHER_IDX(5), 4)
+#define VGATHER(x, y, z)                                                \
+	x = _mm256_i32gather_epi32((int *)&(y)[z], VGATHER_IDX(4), 4)
+#else
+#define VGATHER_4x			GATHER_4x
+#define VGATHER_2x			GATHER_2x
+#define VGATHER				GATHER
+#endif
+
 void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
 {
-	__m128i a, b, c, d, e, f, g, h;
+	vtype a, b, c, d, e, f, g, h;
 	union {
-		__m128i w[16];
-		ARCH_WORD_32 p[16*sizeof(__m128i)/sizeof(ARCH_WORD_32)];
+		vtype w[16];
+		ARCH_WORD_32 p[16*sizeof(vtype)/sizeof(ARCH_WORD_32)];
 
 	}_w;
-	__m128i tmp1, tmp2, *w=_w.w;
+	vtype tmp1, tmp2, *w=_w.w;
 	ARCH_WORD_32 *saved_key=0;
 
 	int i;
@@ -1634,22 +1835,22 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #ifdef __SSE4_1__
 		saved_key = (ARCH_WORD_32 *)data;
 		if (SSEi_flags & SSEi_4BUF_INPUT) {
-			for (i=0; i < 14; ++i) { GATHER_4x (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER_4x (w[14], saved_key, 14);
-			GATHER_4x (w[15], saved_key, 15);
+			for (i=0; i < 14; ++i) { VGATHER_4x (w[i], saved_key, i); vswap_endian (w[i]); }
+			VGATHER_4x (w[14], saved_key, 14);
+			VGATHER_4x (w[15], saved_key, 15);
 		} else if (SSEi_flags & SSEi_2BUF_INPUT) {
-			for (i=0; i < 14; ++i) { GATHER_2x (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER_2x (w[14], saved_key, 14);
-			GATHER_2x (w[15], saved_key, 15);
+			for (i=0; i < 14; ++i) { VGATHER_2x (w[i], saved_key, i); vswap_endian (w[i]); }
+			VGATHER_2x (w[14], saved_key, 14);
+			VGATHER_2x (w[15], saved_key, 15);
 		} else {
-			for (i=0; i < 14; ++i) { GATHER (w[i], saved_key, i); SWAP_ENDIAN (w[i]); }
-			GATHER (w[14], saved_key, 14);
-			GATHER (w[15], saved_key, 15);
+			for (i=0; i < 14; ++i) { VGATHER (w[i], saved_key, i); vswap_endian (w[i]); }
+			VGATHER (w[14], saved_key, 14);
+			VGATHER (w[15], saved_key, 15);
 		}
 		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
 			 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN (w[14]);
-			SWAP_ENDIAN (w[15]);
+			vswap_endian (w[14]);
+			vswap_endian (w[15]);
 		}
 #else
 		int j;
@@ -1669,15 +1870,15 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 					*p++ = saved_key[(i<<4)+j];
 		}
 		for (i=0; i < 14; i++)
-			SWAP_ENDIAN (w[i]);
+			vswap_endian (w[i]);
 		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
 			 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN (w[14]);
-			SWAP_ENDIAN (w[15]);
+			vswap_endian (w[14]);
+			vswap_endian (w[15]);
 		}
 #endif
 	} else
-		memcpy(w, data, 16*sizeof(__m128i));
+		memcpy(w, data, 16*sizeof(vtype));
 
 //	dump_stuff_shammx(w, 64, 0);
 
@@ -1685,49 +1886,47 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_load_si128((__m128i *)&reload_state[i*16*4+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*16*4+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*16*4+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*16*4+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*16*4+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*16*4+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*16*4+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*16*4+28]);
+			a = vload(&reload_state[0*MMX_COEF_SHA256]);
+			b = vload(&reload_state[1*MMX_COEF_SHA256]);
+			c = vload(&reload_state[2*MMX_COEF_SHA256]);
+			d = vload(&reload_state[3*MMX_COEF_SHA256]);
+			e = vload(&reload_state[4*MMX_COEF_SHA256]);
+			f = vload(&reload_state[5*MMX_COEF_SHA256]);
+			g = vload(&reload_state[6*MMX_COEF_SHA256]);
+			h = vload(&reload_state[7*MMX_COEF_SHA256]);
 		}
 		else
 		{
-			i=0;
-			a = _mm_load_si128((__m128i *)&reload_state[i*32+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*32+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*32+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*32+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*32+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*32+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*32+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*32+28]);
+			a = vload(&reload_state[0*MMX_COEF_SHA256]);
+			b = vload(&reload_state[1*MMX_COEF_SHA256]);
+			c = vload(&reload_state[2*MMX_COEF_SHA256]);
+			d = vload(&reload_state[3*MMX_COEF_SHA256]);
+			e = vload(&reload_state[4*MMX_COEF_SHA256]);
+			f = vload(&reload_state[5*MMX_COEF_SHA256]);
+			g = vload(&reload_state[6*MMX_COEF_SHA256]);
+			h = vload(&reload_state[7*MMX_COEF_SHA256]);
 		}
 	} else {
 		if (SSEi_flags & SSEi_CRYPT_SHA224) {
 			/* SHA-224 IV */
-			a = _mm_set1_epi32 (0xc1059ed8);
-			b = _mm_set1_epi32 (0x367cd507);
-			c = _mm_set1_epi32 (0x3070dd17);
-			d = _mm_set1_epi32 (0xf70e5939);
-			e = _mm_set1_epi32 (0xffc00b31);
-			f = _mm_set1_epi32 (0x68581511);
-			g = _mm_set1_epi32 (0x64f98fa7);
-			h = _mm_set1_epi32 (0xbefa4fa4);
+			a = vset1_epi32(0xc1059ed8);
+			b = vset1_epi32(0x367cd507);
+			c = vset1_epi32(0x3070dd17);
+			d = vset1_epi32(0xf70e5939);
+			e = vset1_epi32(0xffc00b31);
+			f = vset1_epi32(0x68581511);
+			g = vset1_epi32(0x64f98fa7);
+			h = vset1_epi32(0xbefa4fa4);
 		} else {
 			// SHA-256 IV */
-			a = _mm_set1_epi32 (0x6a09e667);
-			b = _mm_set1_epi32 (0xbb67ae85);
-			c = _mm_set1_epi32 (0x3c6ef372);
-			d = _mm_set1_epi32 (0xa54ff53a);
-			e = _mm_set1_epi32 (0x510e527f);
-			f = _mm_set1_epi32 (0x9b05688c);
-			g = _mm_set1_epi32 (0x1f83d9ab);
-			h = _mm_set1_epi32 (0x5be0cd19);
+			a = vset1_epi32(0x6a09e667);
+			b = vset1_epi32(0xbb67ae85);
+			c = vset1_epi32(0x3c6ef372);
+			d = vset1_epi32(0xa54ff53a);
+			e = vset1_epi32(0x510e527f);
+			f = vset1_epi32(0x9b05688c);
+			g = vset1_epi32(0x1f83d9ab);
+			h = vset1_epi32(0x5be0cd19);
 		}
 	}
 	SHA256_STEP0(a, b, c, d, e, f, g, h,  0, 0x428a2f98);
@@ -1801,49 +2000,47 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 	if (SSEi_flags & SSEi_RELOAD) {
 		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
 		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_add_epi32(a,_mm_load_si128((__m128i *)&reload_state[i*16*2+0]));
-			b = _mm_add_epi32(b,_mm_load_si128((__m128i *)&reload_state[i*16*2+4]));
-			c = _mm_add_epi32(c,_mm_load_si128((__m128i *)&reload_state[i*16*2+8]));
-			d = _mm_add_epi32(d,_mm_load_si128((__m128i *)&reload_state[i*16*2+12]));
-			e = _mm_add_epi32(e,_mm_load_si128((__m128i *)&reload_state[i*16*2+16]));
-			f = _mm_add_epi32(f,_mm_load_si128((__m128i *)&reload_state[i*16*2+20]));
-			g = _mm_add_epi32(g,_mm_load_si128((__m128i *)&reload_state[i*16*2+24]));
-			h = _mm_add_epi32(h,_mm_load_si128((__m128i *)&reload_state[i*16*2+28]));
+			a = vadd_epi32(a,vload(&reload_state[0*MMX_COEF_SHA256]));
+			b = vadd_epi32(b,vload(&reload_state[1*MMX_COEF_SHA256]));
+			c = vadd_epi32(c,vload(&reload_state[2*MMX_COEF_SHA256]));
+			d = vadd_epi32(d,vload(&reload_state[3*MMX_COEF_SHA256]));
+			e = vadd_epi32(e,vload(&reload_state[4*MMX_COEF_SHA256]));
+			f = vadd_epi32(f,vload(&reload_state[5*MMX_COEF_SHA256]));
+			g = vadd_epi32(g,vload(&reload_state[6*MMX_COEF_SHA256]));
+			h = vadd_epi32(h,vload(&reload_state[7*MMX_COEF_SHA256]));
 		}
 		else
 		{
-			i=0;
-			a = _mm_add_epi32(a,_mm_load_si128((__m128i *)&reload_state[i*32+0]));
-			b = _mm_add_epi32(b,_mm_load_si128((__m128i *)&reload_state[i*32+4]));
-			c = _mm_add_epi32(c,_mm_load_si128((__m128i *)&reload_state[i*32+8]));
-			d = _mm_add_epi32(d,_mm_load_si128((__m128i *)&reload_state[i*32+12]));
-			e = _mm_add_epi32(e,_mm_load_si128((__m128i *)&reload_state[i*32+16]));
-			f = _mm_add_epi32(f,_mm_load_si128((__m128i *)&reload_state[i*32+20]));
-			g = _mm_add_epi32(g,_mm_load_si128((__m128i *)&reload_state[i*32+24]));
-			h = _mm_add_epi32(h,_mm_load_si128((__m128i *)&reload_state[i*32+28]));
+			a = vadd_epi32(a,vload(&reload_state[0*MMX_COEF_SHA256]));
+			b = vadd_epi32(b,vload(&reload_state[1*MMX_COEF_SHA256]));
+			c = vadd_epi32(c,vload(&reload_state[2*MMX_COEF_SHA256]));
+			d = vadd_epi32(d,vload(&reload_state[3*MMX_COEF_SHA256]));
+			e = vadd_epi32(e,vload(&reload_state[4*MMX_COEF_SHA256]));
+			f = vadd_epi32(f,vload(&reload_state[5*MMX_COEF_SHA256]));
+			g = vadd_epi32(g,vload(&reload_state[6*MMX_COEF_SHA256]));
+			h = vadd_epi32(h,vload(&reload_state[7*MMX_COEF_SHA256]));
 		}
 	} else if ((SSEi_flags & SSEi_SKIP_FINAL_ADD) == 0) {
 		if (SSEi_flags & SSEi_CRYPT_SHA224) {
 			/* SHA-224 IV */
-			a = _mm_add_epi32 (a, _mm_set1_epi32 (0xc1059ed8));
-			b = _mm_add_epi32 (b, _mm_set1_epi32 (0x367cd507));
-			c = _mm_add_epi32 (c, _mm_set1_epi32 (0x3070dd17));
-			d = _mm_add_epi32 (d, _mm_set1_epi32 (0xf70e5939));
-			e = _mm_add_epi32 (e, _mm_set1_epi32 (0xffc00b31));
-			f = _mm_add_epi32 (f, _mm_set1_epi32 (0x68581511));
-			g = _mm_add_epi32 (g, _mm_set1_epi32 (0x64f98fa7));
-			h = _mm_add_epi32 (h, _mm_set1_epi32 (0xbefa4fa4));
+			a = vadd_epi32 (a, vset1_epi32(0xc1059ed8));
+			b = vadd_epi32 (b, vset1_epi32(0x367cd507));
+			c = vadd_epi32 (c, vset1_epi32(0x3070dd17));
+			d = vadd_epi32 (d, vset1_epi32(0xf70e5939));
+			e = vadd_epi32 (e, vset1_epi32(0xffc00b31));
+			f = vadd_epi32 (f, vset1_epi32(0x68581511));
+			g = vadd_epi32 (g, vset1_epi32(0x64f98fa7));
+			h = vadd_epi32 (h, vset1_epi32(0xbefa4fa4));
 		} else {
 			/* SHA-256 IV */
-			a = _mm_add_epi32 (a, _mm_set1_epi32 (0x6a09e667));
-			b = _mm_add_epi32 (b, _mm_set1_epi32 (0xbb67ae85));
-			c = _mm_add_epi32 (c, _mm_set1_epi32 (0x3c6ef372));
-			d = _mm_add_epi32 (d, _mm_set1_epi32 (0xa54ff53a));
-			e = _mm_add_epi32 (e, _mm_set1_epi32 (0x510e527f));
-			f = _mm_add_epi32 (f, _mm_set1_epi32 (0x9b05688c));
-			g = _mm_add_epi32 (g, _mm_set1_epi32 (0x1f83d9ab));
-			h = _mm_add_epi32 (h, _mm_set1_epi32 (0x5be0cd19));
+			a = vadd_epi32 (a, vset1_epi32(0x6a09e667));
+			b = vadd_epi32 (b, vset1_epi32(0xbb67ae85));
+			c = vadd_epi32 (c, vset1_epi32(0x3c6ef372));
+			d = vadd_epi32 (d, vset1_epi32(0xa54ff53a));
+			e = vadd_epi32 (e, vset1_epi32(0x510e527f));
+			f = vadd_epi32 (f, vset1_epi32(0x9b05688c));
+			g = vadd_epi32 (g, vset1_epi32(0x1f83d9ab));
+			h = vadd_epi32 (h, vset1_epi32(0x5be0cd19));
 		}
 	}
 	if (SSEi_flags & SSEi_SWAP_FINAL) {
@@ -1851,46 +2048,42 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 		 * used in a sha256_flags&SHA256_RELOAD manner, without swapping back into BE format.
 		 * NORMALLY, a format will switch binary values into BE format at start, and then
 		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
-		SWAP_ENDIAN (a);
-		SWAP_ENDIAN (b);
-		SWAP_ENDIAN (c);
-		SWAP_ENDIAN (d);
-		SWAP_ENDIAN (e);
-		SWAP_ENDIAN (f);
-		SWAP_ENDIAN (g);
-		SWAP_ENDIAN (h);
+		vswap_endian (a);
+		vswap_endian (b);
+		vswap_endian (c);
+		vswap_endian (d);
+		vswap_endian (e);
+		vswap_endian (f);
+		vswap_endian (g);
+		vswap_endian (h);
 	}
 	/* We store the MMX_mixed values.  This will be in proper 'mixed' format, in BE
 	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the prior
 	 * if statement (the SHA256_SWAP_FINAL) */
 	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
 		{
-			_mm_store_si128((__m128i *)&out[i*16*4+0], a);
-			_mm_store_si128((__m128i *)&out[i*16*4+4], b);
-			_mm_store_si128((__m128i *)&out[i*16*4+8], c);
-			_mm_store_si128((__m128i *)&out[i*16*4+12], d);
-			_mm_store_si128((__m128i *)&out[i*16*4+16], e);
-			_mm_store_si128((__m128i *)&out[i*16*4+20], f);
-			_mm_store_si128((__m128i *)&out[i*16*4+24], g);
-			_mm_store_si128((__m128i *)&out[i*16*4+28], h);
+			vstore(&out[0*MMX_COEF_SHA256], a);
+			vstore(&out[1*MMX_COEF_SHA256], b);
+			vstore(&out[2*MMX_COEF_SHA256], c);
+			vstore(&out[3*MMX_COEF_SHA256], d);
+			vstore(&out[4*MMX_COEF_SHA256], e);
+			vstore(&out[5*MMX_COEF_SHA256], f);
+			vstore(&out[6*MMX_COEF_SHA256], g);
+			vstore(&out[7*MMX_COEF_SHA256], h);
 		}
 	}
 	else
 	{
-		i=0;
-		//SHA512_PARA_DO(i)
 		{
-			_mm_store_si128 ((__m128i *)&(out[i*32+0]), a);
-			_mm_store_si128 ((__m128i *)&(out[i*32+4]), b);
-			_mm_store_si128 ((__m128i *)&(out[i*32+8]), c);
-			_mm_store_si128 ((__m128i *)&(out[i*32+12]), d);
-			_mm_store_si128 ((__m128i *)&(out[i*32+16]), e);
-			_mm_store_si128 ((__m128i *)&(out[i*32+20]), f);
-			_mm_store_si128 ((__m128i *)&(out[i*32+24]), g);
-			_mm_store_si128 ((__m128i *)&(out[i*32+28]), h);
+			vstore(&out[0*MMX_COEF_SHA256], a);
+			vstore(&out[1*MMX_COEF_SHA256], b);
+			vstore(&out[2*MMX_COEF_SHA256], c);
+			vstore(&out[3*MMX_COEF_SHA256], d);
+			vstore(&out[4*MMX_COEF_SHA256], e);
+			vstore(&out[5*MMX_COEF_SHA256], f);
+			vstore(&out[6*MMX_COEF_SHA256], g);
+			vstore(&out[7*MMX_COEF_SHA256], h);
 		}
 	}
 
@@ -1899,14 +2092,59 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 
 /* SHA-512 below */
 
+#undef Maj
+#undef Ch
+
+/*
+ * 64-bit lane helpers for SHA-512.  One vtype holds VWIDTH/2 lanes, so this
+ * runs 2 lanes on SSE/XOP, 4 on AVX2 and 8 on AVX-512 builds.
+ */
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define vadd_epi64			_mm512_add_epi64
+#define vset1_epi64x		_mm512_set1_epi64
+#define vslli_epi64			_mm512_slli_epi64
+#define vsrli_epi64			_mm512_srli_epi64
+#define vroti_epi64(a, s)	_mm512_rol_epi64((a), (s) & 63)
+#define vswap_endian64(n)	\
+	(n = _mm512_shuffle_epi8(n, _mm512_broadcast_i32x4(swap_endian64_mask)))
+#define VGATHER64(x, y, z, stride)										\
+	x = _mm512_i64gather_epi64(_mm512_set_epi64(7*(stride), 6*(stride),	\
+		5*(stride), 4*(stride), 3*(stride), 2*(stride), (stride), 0),	\
+		(long long *)&(y)[z], 8)
+#elif defined(__AVX2__)
+#define vadd_epi64			_mm256_add_epi64
+#define vset1_epi64x		_mm256_set1_epi64x
+#define vslli_epi64			_mm256_slli_epi64
+#define vsrli_epi64			_mm256_srli_epi64
+#define vroti_epi64(a, s)												\
+	((s) < 0 ?															\
+		vor(vsrli_epi64((a), -(s)), vslli_epi64((a), 64+(s)))			\
+	:																	\
+		vor(vslli_epi64((a), (s)), vsrli_epi64((a), 64-(s))))
+#define vswap_endian64(n)	\
+	(n = _mm256_shuffle_epi8(n, _mm256_broadcastsi128_si256(swap_endian64_mask)))
+#define VGATHER64(x, y, z, stride)										\
+	x = _mm256_i64gather_epi64((long long *)&(y)[z],					\
+		_mm256_set_epi64x(3*(stride), 2*(stride), (stride), 0), 8)
+#else
+#define vadd_epi64			_mm_add_epi64
+#define vset1_epi64x		_mm_set1_epi64x
+#define vslli_epi64			_mm_slli_epi64
+#define vsrli_epi64			_mm_srli_epi64
+#define vroti_epi64			_mm_roti_epi64
+#define vswap_endian64		SWAP_ENDIAN64
+#define VGATHER64(x, y, z, stride)										\
+	x = _mm_set_epi64x((y)[(stride)+(z)], (y)[z])
+#endif
+
 #undef S0
 #define S0(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_roti_epi64 (x, -39),       \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -28),   \
-            _mm_roti_epi64 (x, -34)    \
+    vxor (                             \
+        vroti_epi64 (x, -39),          \
+        vxor (                         \
+            vroti_epi64 (x, -28),      \
+            vroti_epi64 (x, -34)       \
         )                              \
     )                                  \
 )
@@ -1914,11 +2152,11 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef S1
 #define S1(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_roti_epi64 (x, -41),       \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -14),   \
-            _mm_roti_epi64 (x, -18)    \
+    vxor (                             \
+        vroti_epi64 (x, -41),          \
+        vxor (                         \
+            vroti_epi64 (x, -14),      \
+            vroti_epi64 (x, -18)       \
         )                              \
     )                                  \
 )
@@ -1926,11 +2164,11 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef s0
 #define s0(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_srli_epi64 (x, 7),         \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -1),    \
-            _mm_roti_epi64 (x, -8)     \
+    vxor (                             \
+        vsrli_epi64 (x, 7),            \
+        vxor (                         \
+            vroti_epi64 (x, -1),       \
+            vroti_epi64 (x, -8)        \
         )                              \
     )                                  \
 )
@@ -1938,131 +2176,113 @@ void SSESHA256body(__m128i *data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state,
 #undef s1
 #define s1(x)                          \
 (                                      \
-    _mm_xor_si128 (                    \
-        _mm_srli_epi64 (x, 6),         \
-        _mm_xor_si128 (                \
-            _mm_roti_epi64 (x, -19),   \
-            _mm_roti_epi64 (x, -61)    \
+    vxor (                             \
+        vsrli_epi64 (x, 6),            \
+        vxor (                         \
+            vroti_epi64 (x, -19),      \
+            vroti_epi64 (x, -61)       \
         )                              \
     )                                  \
 )
 
-#define Maj(x,y,z) _mm_cmov_si128 (x, y, _mm_xor_si128 (z, y))
+#define Maj(x,y,z) vcmov (x, y, vxor (z, y))
 
-#define Ch(x,y,z)  _mm_cmov_si128 (y, z, x)
+#define Ch(x,y,z)  vcmov (y, z, x)
 
 #undef R
 #define R(t)                                         \
 {                                                    \
-    tmp1 = _mm_add_epi64 (s1(w[t -  2]), w[t - 7]);  \
-    tmp2 = _mm_add_epi64 (s0(w[t - 15]), w[t - 16]); \
-    w[t] = _mm_add_epi64 (tmp1, tmp2);               \
+    tmp1 = vadd_epi64 (s1(w[t -  2]), w[t - 7]);     \
+    tmp2 = vadd_epi64 (s0(w[t - 15]), w[t - 16]);    \
+    w[t] = vadd_epi64 (tmp1, tmp2);                  \
 }
 
 #define SHA512_STEP(a,b,c,d,e,f,g,h,x,K)             \
 {                                                    \
-    tmp1 = _mm_add_epi64 (h,    w[x]);               \
-    tmp2 = _mm_add_epi64 (S1(e),_mm_set1_epi64x(K)); \
-    tmp1 = _mm_add_epi64 (tmp1, Ch(e,f,g));          \
-    tmp1 = _mm_add_epi64 (tmp1, tmp2);               \
-    tmp2 = _mm_add_epi64 (S0(a),Maj(a,b,c));         \
-    d    = _mm_add_epi64 (tmp1, d);                  \
-    h    = _mm_add_epi64 (tmp1, tmp2);               \
+    tmp1 = vadd_epi64 (h,    w[x]);                  \
+    tmp2 = vadd_epi64 (S1(e),vset1_epi64x(K));       \
+    tmp1 = vadd_epi64 (tmp1, Ch(e,f,g));             \
+    tmp1 = vadd_epi64 (tmp1, tmp2);                  \
+    tmp2 = vadd_epi64 (S0(a),Maj(a,b,c));            \
+    d    = vadd_epi64 (tmp1, d);                     \
+    h    = vadd_epi64 (tmp1, tmp2);                  \
 }
 
 #if defined (MMX_COEF_SHA512)
-void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags)
+#if MMX_COEF_SHA512*2 != VWIDTH
+#error MMX_COEF_SHA512 must match the SIMD vector width
+#endif
+
+void SSESHA512body(__m128i* data, ARCH_WORD_64 *out, ARCH_WORD_64 *reload_state, unsigned SSEi_flags)
 {
 	int i;
 
-	__m128i a, b, c, d, e, f, g, h;
-	__m128i w[80], tmp1, tmp2;
+	vtype a, b, c, d, e, f, g, h;
+	vtype w[80], tmp1, tmp2;
 
 	if (SSEi_flags & SSEi_FLAT_IN) {
-
-		if (SSEi_flags & SSEi_2BUF_INPUT) {
-			ARCH_WORD_64 (*saved_key)[32] = (ARCH_WORD_64(*)[32])data;
-			for (i = 0; i < 14; i += 2) {
-				GATHER64 (tmp1, saved_key, i);
-				GATHER64 (tmp2, saved_key, i + 1);
-				SWAP_ENDIAN64 (tmp1);
-				SWAP_ENDIAN64 (tmp2);
-				w[i] = tmp1;
-				w[i + 1] = tmp2;
-			}
-			GATHER64 (tmp1, saved_key, 14);
-			GATHER64 (tmp2, saved_key, 15);
-		} else {
-			ARCH_WORD_64 (*saved_key)[16] = (ARCH_WORD_64(*)[16])data;
-			for (i = 0; i < 14; i += 2) {
-				GATHER64 (tmp1, saved_key, i);
-				GATHER64 (tmp2, saved_key, i + 1);
-				SWAP_ENDIAN64 (tmp1);
-				SWAP_ENDIAN64 (tmp2);
-				w[i] = tmp1;
-				w[i + 1] = tmp2;
-			}
-			GATHER64 (tmp1, saved_key, 14);
-			GATHER64 (tmp2, saved_key, 15);
+		ARCH_WORD_64 *saved_key = (ARCH_WORD_64 *)data;
+		/* distance between two lanes' input, in 64-bit words */
+		unsigned int stride = 16;
+
+		if (SSEi_flags & SSEi_4BUF_INPUT)
+			stride = 64;
+		else if (SSEi_flags & SSEi_2BUF_INPUT)
+			stride = 32;
+		for (i = 0; i < 14; i += 2) {
+			VGATHER64 (tmp1, saved_key, i, stride);
+			VGATHER64 (tmp2, saved_key, i + 1, stride);
+			vswap_endian64 (tmp1);
+			vswap_endian64 (tmp2);
+			w[i] = tmp1;
+			w[i + 1] = tmp2;
 		}
-		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK)) {
-			SWAP_ENDIAN64 (tmp1);
-			SWAP_ENDIAN64 (tmp2);
+		VGATHER64 (tmp1, saved_key, 14, stride);
+		VGATHER64 (tmp2, saved_key, 15, stride);
+		if ( ((SSEi_flags & SSEi_2BUF_INPUT_FIRST_BLK) == SSEi_2BUF_INPUT_FIRST_BLK) ||
+			 ((SSEi_flags & SSEi_4BUF_INPUT_FIRST_BLK) == SSEi_4BUF_INPUT_FIRST_BLK)) {
+			vswap_endian64 (tmp1);
+			vswap_endian64 (tmp2);
 		}
 		w[14] = tmp1;
 		w[15] = tmp2;
 	} else
-		memcpy(w, data, 16*sizeof(__m128i));
+		memcpy(w, data, 16*sizeof(vtype));
 
 	for (i = 16; i < 80; i++)
 		R(i);
 
+	/* 'INPUT' format only differs from the packed one once there is PARA */
 	if (SSEi_flags & SSEi_RELOAD) {
-		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
-		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			a = _mm_load_si128((__m128i *)&reload_state[i*16*8+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*16*8+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*16*8+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*16*8+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*16*8+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*16*8+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*16*8+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*16*8+28]);
-		}
-		else
-		{
-			i=0;
-			a = _mm_load_si128((__m128i *)&reload_state[i*32+0]);
-			b = _mm_load_si128((__m128i *)&reload_state[i*32+4]);
-			c = _mm_load_si128((__m128i *)&reload_state[i*32+8]);
-			d = _mm_load_si128((__m128i *)&reload_state[i*32+12]);
-			e = _mm_load_si128((__m128i *)&reload_state[i*32+16]);
-			f = _mm_load_si128((__m128i *)&reload_state[i*32+20]);
-			g = _mm_load_si128((__m128i *)&reload_state[i*32+24]);
-			h = _mm_load_si128((__m128i *)&reload_state[i*32+28]);
-		}
+		a = vload(&reload_state[0*MMX_COEF_SHA512]);
+		b = vload(&reload_state[1*MMX_COEF_SHA512]);
+		c = vload(&reload_state[2*MMX_COEF_SHA512]);
+		d = vload(&reload_state[3*MMX_COEF_SHA512]);
+		e = vload(&reload_state[4*MMX_COEF_SHA512]);
+		f = vload(&reload_state[5*MMX_COEF_SHA512]);
+		g = vload(&reload_state[6*MMX_COEF_SHA512]);
+		h = vload(&reload_state[7*MMX_COEF_SHA512]);
 	} else {
 		if (SSEi_flags & SSEi_CRYPT_SHA384) {
 			/* SHA-384 IV */
-			a = _mm_set1_epi64x (0xcbbb9d5dc1059ed8ULL);
-			b = _mm_set1_epi64x (0x629a292a367cd507ULL);
-			c = _mm_set1_epi64x (0x9159015a3070dd17ULL);
-			d = _mm_set1_epi64x (0x152fecd8f70e5939ULL);
-			e = _mm_set1_epi64x (0x67332667ffc00b31ULL);
-			f = _mm_set1_epi64x (0x8eb44a8768581511ULL);
-			g = _mm_set1_epi64x (0xdb0c2e0d64f98fa7ULL);
-			h = _mm_set1_epi64x (0x47b5481dbefa4fa4ULL);
+			a = vset1_epi64x (0xcbbb9d5dc1059ed8ULL);
+			b = vset1_epi64x (0x629a292a367cd507ULL);
+			c = vset1_epi64x (0x9159015a3070dd17ULL);
+			d = vset1_epi64x (0x152fecd8f70e5939ULL);
+			e = vset1_epi64x (0x67332667ffc00b31ULL);
+			f = vset1_epi64x (0x8eb44a8768581511ULL);
+			g = vset1_epi64x (0xdb0c2e0d64f98fa7ULL);
+			h = vset1_epi64x (0x47b5481dbefa4fa4ULL);
 		} else {
 			// SHA-512 IV */
-			a = _mm_set1_epi64x (0x6a09e667f3bcc908ULL);
-			b = _mm_set1_epi64x (0xbb67ae8584caa73bULL);
-			c = _mm_set1_epi64x (0x3c6ef372fe94f82bULL);
-			d = _mm_set1_epi64x (0xa54ff53a5f1d36f1ULL);
-			e = _mm_set1_epi64x (0x510e527fade682d1ULL);
-			f = _mm_set1_epi64x (0x9b05688c2b3e6c1fULL);
-			g = _mm_set1_epi64x (0x1f83d9abfb41bd6bULL);
-			h = _mm_set1_epi64x (0x5be0cd19137e2179ULL);
+			a = vset1_epi64x (0x6a09e667f3bcc908ULL);
+			b = vset1_epi64x (0xbb67ae8584caa73bULL);
+			c = vset1_epi64x (0x3c6ef372fe94f82bULL);
+			d = vset1_epi64x (0xa54ff53a5f1d36f1ULL);
+			e = vset1_epi64x (0x510e527fade682d1ULL);
+			f = vset1_epi64x (0x9b05688c2b3e6c1fULL);
+			g = vset1_epi64x (0x1f83d9abfb41bd6bULL);
+			h = vset1_epi64x (0x5be0cd19137e2179ULL);
 		}
 	}
 
@@ -2082,7 +2302,6 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 	SHA512_STEP(d, e, f, g, h, a, b, c, 13, 0x80deb1fe3b1696b1ULL);
 	SHA512_STEP(c, d, e, f, g, h, a, b, 14, 0x9bdc06a725c71235ULL);
 	SHA512_STEP(b, c, d, e, f, g, h, a, 15, 0xc19bf174cf692694ULL);
-
 	SHA512_STEP(a, b, c, d, e, f, g, h, 16, 0xe49b69c19ef14ad2ULL);
 	SHA512_STEP(h, a, b, c, d, e, f, g, 17, 0xefbe4786384f25e3ULL);
 	SHA512_STEP(g, h, a, b, c, d, e, f, 18, 0x0fc19dc68b8cd5b5ULL);
@@ -2099,7 +2318,6 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 	SHA512_STEP(d, e, f, g, h, a, b, c, 29, 0xd5a79147930aa725ULL);
 	SHA512_STEP(c, d, e, f, g, h, a, b, 30, 0x06ca6351e003826fULL);
 	SHA512_STEP(b, c, d, e, f, g, h, a, 31, 0x142929670a0e6e70ULL);
-
 	SHA512_STEP(a, b, c, d, e, f, g, h, 32, 0x27b70a8546d22ffcULL);
 	SHA512_STEP(h, a, b, c, d, e, f, g, 33, 0x2e1b21385c26c926ULL);
 	SHA512_STEP(g, h, a, b, c, d, e, f, 34, 0x4d2c6dfc5ac42aedULL);
@@ -2116,7 +2334,6 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 	SHA512_STEP(d, e, f, g, h, a, b, c, 45, 0xd69906245565a910ULL);
 	SHA512_STEP(c, d, e, f, g, h, a, b, 46, 0xf40e35855771202aULL);
 	SHA512_STEP(b, c, d, e, f, g, h, a, 47, 0x106aa07032bbd1b8ULL);
-
 	SHA512_STEP(a, b, c, d, e, f, g, h, 48, 0x19a4c116b8d2d0c8ULL);
 	SHA512_STEP(h, a, b, c, d, e, f, g, 49, 0x1e376c085141ab53ULL);
 	SHA512_STEP(g, h, a, b, c, d, e, f, 50, 0x2748774cdf8eeb99ULL);
@@ -2133,7 +2350,6 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 	SHA512_STEP(d, e, f, g, h, a, b, c, 61, 0xa4506cebde82bde9ULL);
 	SHA512_STEP(c, d, e, f, g, h, a, b, 62, 0xbef9a3f7b2c67915ULL);
 	SHA512_STEP(b, c, d, e, f, g, h, a, 63, 0xc67178f2e372532bULL);
-
 	SHA512_STEP(a, b, c, d, e, f, g, h, 64, 0xca273eceea26619cULL);
 	SHA512_STEP(h, a, b, c, d, e, f, g, 65, 0xd186b8c721c0c207ULL);
 	SHA512_STEP(g, h, a, b, c, d, e, f, 66, 0xeada7dd6cde0eb1eULL);
@@ -2152,57 +2368,35 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 	SHA512_STEP(b, c, d, e, f, g, h, a, 79, 0x6c44198c4a475817ULL);
 
 	if (SSEi_flags & SSEi_RELOAD) {
-		if ((SSEi_flags & SSEi_RELOAD_INP_FMT)==SSEi_RELOAD_INP_FMT)
-		{
-			i=0; // later if we do PARA, i will be used in the PARA_FOR loop
-			//SHA512_PARA_DO(i)
-			{
-				a = _mm_add_epi64(a,_mm_load_si128((__m128i *)&reload_state[i*16*8+0]));
-				b = _mm_add_epi64(b,_mm_load_si128((__m128i *)&reload_state[i*16*8+4]));
-				c = _mm_add_epi64(c,_mm_load_si128((__m128i *)&reload_state[i*16*8+8]));
-				d = _mm_add_epi64(d,_mm_load_si128((__m128i *)&reload_state[i*16*8+12]));
-				e = _mm_add_epi64(e,_mm_load_si128((__m128i *)&reload_state[i*16*8+16]));
-				f = _mm_add_epi64(f,_mm_load_si128((__m128i *)&reload_state[i*16*8+20]));
-				g = _mm_add_epi64(g,_mm_load_si128((__m128i *)&reload_state[i*16*8+24]));
-				h = _mm_add_epi64(h,_mm_load_si128((__m128i *)&reload_state[i*16*8+28]));
-			}
-		}
-		else
-		{
-			i=0;
-			//SHA512_PARA_DO(i)
-			{
-				a = _mm_add_epi64(a,_mm_load_si128((__m128i *)&reload_state[i*32+0]));
-				b = _mm_add_epi64(b,_mm_load_si128((__m128i *)&reload_state[i*32+4]));
-				c = _mm_add_epi64(c,_mm_load_si128((__m128i *)&reload_state[i*32+8]));
-				d = _mm_add_epi64(d,_mm_load_si128((__m128i *)&reload_state[i*32+12]));
-				e = _mm_add_epi64(e,_mm_load_si128((__m128i *)&reload_state[i*32+16]));
-				f = _mm_add_epi64(f,_mm_load_si128((__m128i *)&reload_state[i*32+20]));
-				g = _mm_add_epi64(g,_mm_load_si128((__m128i *)&reload_state[i*32+24]));
-				h = _mm_add_epi64(h,_mm_load_si128((__m128i *)&reload_state[i*32+28]));
-				}
-		}
+		a = vadd_epi64(a,vload(&reload_state[0*MMX_COEF_SHA512]));
+		b = vadd_epi64(b,vload(&reload_state[1*MMX_COEF_SHA512]));
+		c = vadd_epi64(c,vload(&reload_state[2*MMX_COEF_SHA512]));
+		d = vadd_epi64(d,vload(&reload_state[3*MMX_COEF_SHA512]));
+		e = vadd_epi64(e,vload(&reload_state[4*MMX_COEF_SHA512]));
+		f = vadd_epi64(f,vload(&reload_state[5*MMX_COEF_SHA512]));
+		g = vadd_epi64(g,vload(&reload_state[6*MMX_COEF_SHA512]));
+		h = vadd_epi64(h,vload(&reload_state[7*MMX_COEF_SHA512]));
 	} else if ((SSEi_flags & SSEi_SKIP_FINAL_ADD) == 0) {
 		if (SSEi_flags & SSEi_CRYPT_SHA384) {
 			/* SHA-384 IV */
-			a = _mm_add_epi64 (a, _mm_set1_epi64x (0xcbbb9d5dc1059ed8ULL));
-			b = _mm_add_epi64 (b, _mm_set1_epi64x (0x629a292a367cd507ULL));
-			c = _mm_add_epi64 (c, _mm_set1_epi64x (0x9159015a3070dd17ULL));
-			d = _mm_add_epi64 (d, _mm_set1_epi64x (0x152fecd8f70e5939ULL));
-			e = _mm_add_epi64 (e, _mm_set1_epi64x (0x67332667ffc00b31ULL));
-			f = _mm_add_epi64 (f, _mm_set1_epi64x (0x8eb44a8768581511ULL));
-			g = _mm_add_epi64 (g, _mm_set1_epi64x (0xdb0c2e0d64f98fa7ULL));
-			h = _mm_add_epi64 (h, _mm_set1_epi64x (0x47b5481dbefa4fa4ULL));
+			a = vadd_epi64 (a, vset1_epi64x (0xcbbb9d5dc1059ed8ULL));
+			b = vadd_epi64 (b, vset1_epi64x (0x629a292a367cd507ULL));
+			c = vadd_epi64 (c, vset1_epi64x (0x9159015a3070dd17ULL));
+			d = vadd_epi64 (d, vset1_epi64x (0x152fecd8f70e5939ULL));
+			e = vadd_epi64 (e, vset1_epi64x (0x67332667ffc00b31ULL));
+			f = vadd_epi64 (f, vset1_epi64x (0x8eb44a8768581511ULL));
+			g = vadd_epi64 (g, vset1_epi64x (0xdb0c2e0d64f98fa7ULL));
+			h = vadd_epi64 (h, vset1_epi64x (0x47b5481dbefa4fa4ULL));
 		} else {
 			/* SHA-512 IV */
-			a = _mm_add_epi64 (a, _mm_set1_epi64x (0x6a09e667f3bcc908ULL));
-			b = _mm_add_epi64 (b, _mm_set1_epi64x (0xbb67ae8584caa73bULL));
-			c = _mm_add_epi64 (c, _mm_set1_epi64x (0x3c6ef372fe94f82bULL));
-			d = _mm_add_epi64 (d, _mm_set1_epi64x (0xa54ff53a5f1d36f1ULL));
-			e = _mm_add_epi64 (e, _mm_set1_epi64x (0x510e527fade682d1ULL));
-			f = _mm_add_epi64 (f, _mm_set1_epi64x (0x9b05688c2b3e6c1fULL));
-			g = _mm_add_epi64 (g, _mm_set1_epi64x (0x1f83d9abfb41bd6bULL));
-			h = _mm_add_epi64 (h, _mm_set1_epi64x (0x5be0cd19137e2179ULL));
+			a = vadd_epi64 (a, vset1_epi64x (0x6a09e667f3bcc908ULL));
+			b = vadd_epi64 (b, vset1_epi64x (0xbb67ae8584caa73bULL));
+			c = vadd_epi64 (c, vset1_epi64x (0x3c6ef372fe94f82bULL));
+			d = vadd_epi64 (d, vset1_epi64x (0xa54ff53a5f1d36f1ULL));
+			e = vadd_epi64 (e, vset1_epi64x (0x510e527fade682d1ULL));
+			f = vadd_epi64 (f, vset1_epi64x (0x9b05688c2b3e6c1fULL));
+			g = vadd_epi64 (g, vset1_epi64x (0x1f83d9abfb41bd6bULL));
+			h = vadd_epi64 (h, vset1_epi64x (0x5be0cd19137e2179ULL));
 		}
 	}
 
@@ -2211,50 +2405,27 @@ void SSESHA512body(__m128i* data, unsigned int *out, ARCH_WORD_32 *reload_state,
 		 * used in a sha512_flags&SHA512_RELOAD manner, without swapping back into BE format.
 		 * NORMALLY, a format will switch binary values into BE format at start, and then
 		 * just take the 'normal' non swapped output of this function (i.e. keep it in BE) */
-		SWAP_ENDIAN64(a);
-		SWAP_ENDIAN64(b);
-		SWAP_ENDIAN64(c);
-		SWAP_ENDIAN64(d);
-		SWAP_ENDIAN64(e);
-		SWAP_ENDIAN64(f);
-		SWAP_ENDIAN64(g);
-		SWAP_ENDIAN64(h);
+		vswap_endian64(a);
+		vswap_endian64(b);
+		vswap_endian64(c);
+		vswap_endian64(d);
+		vswap_endian64(e);
+		vswap_endian64(f);
+		vswap_endian64(g);
+		vswap_endian64(h);
 	}
 
 	/* We store the MMX_mixed values.  This will be in proper 'mixed' format, in BE
 	 * format (i.e. correct to reload on a subsquent call), UNLESS, swapped in the prior
-	 * if statement (the SHA512_SWAP_FINAL) */
-	if (SSEi_flags & SSEi_OUTPUT_AS_INP_FMT)
-	{
-		i=0;
-		//SHA512_PARA_DO(i)
-		{
-			_mm_store_si128((__m128i *)&out[i*16*8+0], a);
-			_mm_store_si128((__m128i *)&out[i*16*8+4], b);
-			_mm_store_si128((__m128i *)&out[i*16*8+8], c);
-			_mm_store_si128((__m128i *)&out[i*16*8+12], d);
-			_mm_store_si128((__m128i *)&out[i*16*8+16], e);
-			_mm_store_si128((__m128i *)&out[i*16*8+20], f);
-			_mm_store_si128((__m128i *)&out[i*16*8+24], g);
-			_mm_store_si128((__m128i *)&out[i*16*8+28], h);
-		}
-	}
-	else
-	{
-		i=0;
-		//SHA512_PARA_DO(i)
-		{
-			_mm_store_si128 ((__m128i *)&(out[i*32+0]), a);
-			_mm_store_si128 ((__m128i *)&(out[i*32+4]), b);
-			_mm_store_si128 ((__m128i *)&(out[i*32+8]), c);
-			_mm_store_si128 ((__m128i *)&(out[i*32+12]), d);
-			_mm_store_si128 ((__m128i *)&(out[i*32+16]), e);
-			_mm_store_si128 ((__m128i *)&(out[i*32+20]), f);
-			_mm_store_si128 ((__m128i *)&(out[i*32+24]), g);
-			_mm_store_si128 ((__m128i *)&(out[i*32+28]), h);
-		}
-	}
-
-
+	 * if statement (the SHA512_SWAP_FINAL).  As with the reload, OUTPUT_AS_INP_FMT
+	 * only matters once there is PARA. */
+	vstore(&out[0*MMX_COEF_SHA512], a);
+	vstore(&out[1*MMX_COEF_SHA512], b);
+	vstore(&out[2*MMX_COEF_SHA512], c);
+	vstore(&out[3*MMX_COEF_SHA512], d);
+	vstore(&out[4*MMX_COEF_SHA512], e);
+	vstore(&out[5*MMX_COEF_SHA512], f);
+	vstore(&out[6*MMX_COEF_SHA512], g);
+	vstore(&out[7*MMX_COEF_SHA512], h);
 }
 #endif
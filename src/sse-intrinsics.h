@@ -18,6 +18,8 @@
 
 #if defined(__XOP__)
 #define SSE_type			"XOP"
+#elif defined(__AVX2__)
+#define SSE_type			"AVX2"
 #elif defined(__AVX__)
 #define SSE_type			"AVX"
 #elif defined(MMX_COEF) && MMX_COEF == 2
@@ -26,11 +28,25 @@
 #define SSE_type			"SSE2"
 #endif
 
+/* register width of the PARA SIMD bodies below */
+#ifdef __AVX2__
+#define SIMD_WIDTH_STR			"256/256"
+#else
+#define SIMD_WIDTH_STR			"128/128"
+#endif
+
+/* the SHA-2 bodies also use the 512-bit registers when available */
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define SHA2_WIDTH_STR			"512/512"
+#else
+#define SHA2_WIDTH_STR			SIMD_WIDTH_STR
+#endif
+
 #ifdef MD5_SSE_PARA
 void md5cryptsse(unsigned char * buf, unsigned char * salt, char * out, int md5_type);
 void SSEmd5body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define MD5_SSE_type			SSE_type
-#define MD5_ALGORITHM_NAME		"128/128 " MD5_SSE_type " " MD5_N_STR
+#define MD5_ALGORITHM_NAME		SIMD_WIDTH_STR " " MD5_SSE_type " " MD5_N_STR
 #elif defined(MMX_COEF) && MMX_COEF == 4
 #define MD5_SSE_type			"SSE2"
 #define MD5_ALGORITHM_NAME		"128/128 " MD5_SSE_type " 4x"
@@ -49,7 +65,7 @@ void SSEmd5body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, un
 //void SSEmd4body(__m128i* data, unsigned int * out, int init);
 void SSEmd4body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define MD4_SSE_type			SSE_type
-#define MD4_ALGORITHM_NAME		"128/128 " MD4_SSE_type " " MD4_N_STR
+#define MD4_ALGORITHM_NAME		SIMD_WIDTH_STR " " MD4_SSE_type " " MD4_N_STR
 #elif defined(MMX_COEF) && MMX_COEF == 4
 #define MD4_SSE_type			"SSE2"
 #define MD4_ALGORITHM_NAME		"128/128 " MD4_SSE_type " 4x"
@@ -67,7 +83,7 @@ void SSEmd4body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, un
 #ifdef SHA1_SSE_PARA
 void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define SHA1_SSE_type			SSE_type
-#define SHA1_ALGORITHM_NAME		"128/128 " SHA1_SSE_type " " SHA1_N_STR
+#define SHA1_ALGORITHM_NAME		SIMD_WIDTH_STR " " SHA1_SSE_type " " SHA1_N_STR
 #elif defined(MMX_COEF) && MMX_COEF == 4
 #define SHA1_SSE_type			"SSE2"
 #define SHA1_ALGORITHM_NAME		"128/128 " SHA1_SSE_type " 4x"
@@ -86,6 +102,10 @@ void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, u
 
 #if defined __XOP__
 #define SIMD_TYPE                 "XOP"
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+#define SIMD_TYPE                 "AVX512BW"
+#elif defined __AVX2__
+#define SIMD_TYPE                 "AVX2"
 #elif defined __SSE4_1__
 #define SIMD_TYPE                 "SSE4.1"
 #elif defined __SSSE3__
@@ -98,14 +118,14 @@ void SSESHA1body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, u
 #if MMX_COEF==4
 
 #ifdef MMX_COEF_SHA256
-#define SHA256_ALGORITHM_NAME	"128/128 " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA256)"x"
+#define SHA256_ALGORITHM_NAME	SHA2_WIDTH_STR " " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA256)"x"
 void SSESHA256body(__m128i* data, ARCH_WORD_32 *out, ARCH_WORD_32 *reload_state, unsigned SSEi_flags);
 #define SHA256_BUF_SIZ 16
 #define SHA256_SSE_PARA 1
 #endif
 
 #ifdef MMX_COEF_SHA512
-#define SHA512_ALGORITHM_NAME	"128/128 " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA512)"x"
+#define SHA512_ALGORITHM_NAME	SHA2_WIDTH_STR " " SIMD_TYPE " " STRINGIZE(MMX_COEF_SHA512)"x"
 void SSESHA512body(__m128i* data, ARCH_WORD_64 *out, ARCH_WORD_64 *reload_state, unsigned SSEi_flags);
 // ????  (16 long longs).
 #define SHA512_BUF_SIZ 16
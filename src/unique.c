@@ -22,7 +22,12 @@
  * -mem=num. A number that overrides the UNIQUE_HASH_LOG value from within
  *           params.h.  The default is 21.  valid range from 13 to 25.  25
  *           will use a 2GB memory buffer, and 33 entry million hash table
+ *           (kept as 128 million 8 byte slots, so 1GB more).
  *           Each number doubles size.
+ * -disk[=num] Partitions the input into num (UNIQUE_DISK_PARTS by default)
+ *           temporary bucket files named OUTPUT-FILE.N, and uniques each of
+ *           them in memory.  Scales linearly with the input size, and gives
+ *           the same output as the default mode.
  */
 
 #define _POSIX_SOURCE /* for fdopen(3) */
@@ -43,24 +48,84 @@
 #include "memory.h"
 
 #define ENTRY_END_HASH			0xFFFFFFFF /* also hard-coded */
-#define ENTRY_END_LIST			0xFFFFFFFE
-#define ENTRY_DUPE			0xFFFFFFFD
+#define ENTRY_DUPE_SEQ			0xFFFFFFFFFFFFFFFFULL
+
+/* Hash table slots per vUNIQUE_HASH_SIZE, and how many of them may be used */
+#define SLOTS_PER_HASH			4
+#define SLOTS_LOAD(slots)		((slots) / 4 * 3)
+
+/* Most lines (and bytes of them) read, then inserted in parallel, at once */
+#define CHUNK_LINES			0x10000
+#define CHUNK_SIZE			0x400000
+
+/*
+ * A buffer entry is the lowest input sequence number its line was seen
+ * with, followed by the line.  The table is open addressing, each slot
+ * holding the full 32-bit hash of its line next to the entry's offset, so
+ * a probe only needs strcmp() once the hashes match.
+ */
+#define ENTRY_SIZE(length)		((8 + (length) + 1 + 7) & ~7U)
+#define ENTRY_SEQ(ptr) \
+	((unsigned long long *)&buffer.data[ptr])
+#define ENTRY_LINE(ptr) \
+	(&buffer.data[(ptr) + 8])
+#define SLOT_PTR(slot) \
+	((unsigned int)(slot) << 3)
 
 static struct {
-	unsigned int *hash;
+	unsigned long long *slot;
 	char *data;
+	unsigned int *order;
+	unsigned int ptr, count;
 } buffer;
 
+struct unique_chunk {
+	char *text;
+	unsigned int *line, *ref;
+	unsigned char *first;
+	unsigned int count, size, need;
+	unsigned long long seq;
+};
+
+static struct unique_chunk in_chunk, clean_chunk;
+static unsigned long long line_seq;
+
 static FILE *fpInput;
 static FILE *output;
 static FILE *use_to_unique_but_not_add;
 static int do_not_unique_against_self=0;
+static int disk_parts=0;
 
 long long totLines=0,written_lines=0;
 int verbose=0, cut_len=0, LM=0;
 unsigned int vUNIQUE_HASH_LOG=UNIQUE_HASH_LOG, vUNIQUE_HASH_SIZE=UNIQUE_HASH_SIZE, vUNIQUE_BUFFER_SIZE=UNIQUE_BUFFER_SIZE;
 unsigned int vUNIQUE_HASH_MASK = UNIQUE_HASH_SIZE - 1;
 unsigned int vUNIQUE_HASH_LOG_HALF = UNIQUE_HASH_LOG / 2;
+static unsigned int vUNIQUE_SLOTS, vUNIQUE_SLOT_MASK, vCHUNK_LINES, vCHUNK_SIZE;
+
+#ifdef _OPENMP
+#define FETCH_ADD(ptr, value) \
+	__sync_fetch_and_add(ptr, value)
+#define CAS(ptr, old, new) \
+	__sync_bool_compare_and_swap(ptr, old, new)
+#else
+static unsigned int FETCH_ADD(unsigned int *ptr, unsigned int value)
+{
+	unsigned int old = *ptr;
+
+	*ptr += value;
+	return old;
+}
+
+static int CAS(unsigned long long *ptr, unsigned long long old,
+	unsigned long long new)
+{
+	if (*ptr != old)
+		return 0;
+	*ptr = new;
+	return 1;
+}
+#endif
 
 #if ARCH_ALLOWS_UNALIGNED && !ARCH_INT_GT_32
 
@@ -95,12 +160,6 @@ static void put_int(unsigned int *ptr, unsigned int value)
 
 #endif
 
-#define get_data(ptr) \
-	get_int((unsigned int *)&buffer.data[ptr])
-
-#define put_data(ptr, value) \
-	put_int((unsigned int *)&buffer.data[ptr], value)
-
 static unsigned int line_hash(char *line)
 {
 	unsigned int hash, extra;
@@ -137,17 +196,28 @@ out:
 	return hash;
 }
 
-static void init_hash(void)
+static unsigned int seed_hash(char *line, unsigned int seed)
 {
-#if 0
-	int index;
+	unsigned int hash = 2166136261U ^ (seed * 0x9E3779B9U);
 
-	for (index = 0; index < vUNIQUE_HASH_SIZE; index++)
-		buffer.hash[index] = ENTRY_END_HASH;
-#else
-/* ENTRY_END_HASH is 0xFFFFFFFF */
-	memset(buffer.hash, 0xff, vUNIQUE_HASH_SIZE * sizeof(unsigned int));
-#endif
+	while (*line) {
+		hash ^= (unsigned char)*line++;
+		hash *= 16777619U;
+	}
+
+/* FNV's low bits are poor (and hardly depend on the seed), mix them in */
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35U;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static void init_hash(void)
+{
+	memset(buffer.slot, 0, vUNIQUE_SLOTS * sizeof(*buffer.slot));
 }
 
 static void upcase(char *cp) {
@@ -158,16 +228,103 @@ static void upcase(char *cp) {
 	}
 }
 
-static void read_buffer(void)
+static void seq_min(unsigned long long *ptr, unsigned long long seq)
 {
-	char line[LINE_BUFFER_SIZE];
-	unsigned int ptr, current, *last;
+	unsigned long long current;
 
-	init_hash();
+	while ((current = *(volatile unsigned long long *)ptr) > seq)
+		if (CAS(ptr, current, seq)) break;
+}
 
-	ptr = 0;
-	while (fgetl(line, sizeof(line), fpInput)) {
+/*
+ * Returns the entry for line, adding it if needed.  Safe to run from many
+ * threads at once: a new entry is written before a free slot is taken for
+ * it with a compare-and-swap, and if another thread wins that slot, the
+ * probe simply goes on from there.  buffer.ptr is never run out of here,
+ * as chunk_fits() reserved room for every line of the chunk to be new.
+ */
+static unsigned int table_insert(char *line, unsigned long long seq)
+{
+	unsigned int hash = seed_hash(line, 0), index, ptr = 0, length;
+	unsigned long long slot;
+
+	index = hash & vUNIQUE_SLOT_MASK;
+	while (1) {
+		slot = ((volatile unsigned long long *)buffer.slot)[index];
+		if (!slot) {
+			if (!ptr) {
+				length = strlen(line);
+				ptr = FETCH_ADD(&buffer.ptr, ENTRY_SIZE(length));
+				*ENTRY_SEQ(ptr) = seq;
+				memcpy(ENTRY_LINE(ptr), line, length + 1);
+			}
+			if (CAS(&buffer.slot[index], 0,
+			    (unsigned long long)hash << 32 | ptr >> 3))
+				return ptr;
+			slot = ((volatile unsigned long long *)buffer.slot)[index];
+		}
+		if ((unsigned int)(slot >> 32) == hash &&
+		    !strcmp(line, ENTRY_LINE(SLOT_PTR(slot)))) {
+			seq_min(ENTRY_SEQ(SLOT_PTR(slot)), seq);
+			return SLOT_PTR(slot);
+		}
+		index = (index + 1) & vUNIQUE_SLOT_MASK;
+	}
+}
+
+static unsigned int table_find(char *line)
+{
+	unsigned int hash = seed_hash(line, 0), index;
+	unsigned long long slot;
+
+	index = hash & vUNIQUE_SLOT_MASK;
+	while ((slot = buffer.slot[index])) {
+		if ((unsigned int)(slot >> 32) == hash &&
+		    !strcmp(line, ENTRY_LINE(SLOT_PTR(slot))))
+			return SLOT_PTR(slot);
+		index = (index + 1) & vUNIQUE_SLOT_MASK;
+	}
+
+	return 0;
+}
+
+static void chunk_init(struct unique_chunk *chunk)
+{
+	chunk->text = mem_alloc(vCHUNK_SIZE + 2 * LINE_BUFFER_SIZE);
+	chunk->line = mem_alloc((vCHUNK_LINES + 1) * sizeof(*chunk->line));
+	chunk->ref = mem_alloc((vCHUNK_LINES + 1) * sizeof(*chunk->ref));
+	chunk->first = mem_alloc(vCHUNK_LINES + 1);
+	chunk->count = 0;
+}
+
+static void chunk_add(struct unique_chunk *chunk, char *line)
+{
+	unsigned int length = strlen(line);
+
+	chunk->line[chunk->count++] = chunk->size;
+	memcpy(&chunk->text[chunk->size], line, length + 1);
+	chunk->size += length + 1;
+	chunk->need += ENTRY_SIZE(length);
+}
+
+/*
+ * Reads the next chunk of lines.  Input lines get -cut / -cut=LM applied
+ * and are numbered, lines from the files uniqued against only get -cut.
+ */
+static unsigned int read_chunk(struct unique_chunk *chunk, FILE *file,
+	int input)
+{
+	char line[LINE_BUFFER_SIZE];
+
+	chunk->count = chunk->size = chunk->need = 0;
+	while (chunk->count < vCHUNK_LINES && chunk->need < vCHUNK_SIZE &&
+	    fgetl(line, sizeof(line), file)) {
 		char LM_Buf[8];
+		if (!input) {
+			if (cut_len) line[cut_len] = 0;
+			chunk_add(chunk, line);
+			continue;
+		}
 		if (LM) {
 			if (strlen(line) > 7) {
 				strncpy(LM_Buf, &line[7], 7);
@@ -181,148 +338,476 @@ static void read_buffer(void)
 			upcase(line);
 		} else if (cut_len) line[cut_len] = 0;
 		++totLines;
-		last = &buffer.hash[line_hash(line)];
-#if ARCH_LITTLE_ENDIAN && !ARCH_INT_GT_32
-		current = *last;
-#else
-		current = get_int(last);
+		chunk_add(chunk, line);
+		if (LM && *LM_Buf)
+			chunk_add(chunk, LM_Buf);
+	}
+
+	if (ferror(file)) pexit("fgets");
+
+	if (input) {
+		chunk->seq = line_seq;
+		line_seq += chunk->count;
+	}
+
+	return chunk->count;
+}
+
+static int chunk_fits(struct unique_chunk *chunk)
+{
+	return buffer.ptr + chunk->need <= vUNIQUE_BUFFER_SIZE &&
+	    buffer.count + chunk->count <= SLOTS_LOAD(vUNIQUE_SLOTS);
+}
+
+/*
+ * Inserts the lines of a chunk in parallel.  Once they are all in, a line
+ * is the first occurrence if its entry kept the line's own sequence number,
+ * and those entries are listed in buffer.order in input order.
+ */
+static void insert_chunk(struct unique_chunk *chunk)
+{
+	int index, count = chunk->count;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
 #endif
-		while (current != ENTRY_END_HASH) {
-			if (!strcmp(line, &buffer.data[current + 4])) break;
-			last = (unsigned int *)&buffer.data[current];
-			current = get_int(last);
-		}
-		if (current != ENTRY_END_HASH) {
-			if (LM && *LM_Buf)
-				goto DoExtraLM;
+	for (index = 0; index < count; index++)
+		chunk->ref[index] = table_insert(
+		    &chunk->text[chunk->line[index]], chunk->seq + index);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (index = 0; index < count; index++)
+		chunk->first[index] =
+		    *ENTRY_SEQ(chunk->ref[index]) == chunk->seq + index;
+
+	for (index = 0; index < count; index++)
+		if (chunk->first[index])
+			buffer.order[buffer.count++] = chunk->ref[index];
+
+	chunk->count = 0;
+}
+
+static void read_buffer(void)
+{
+	init_hash();
+
+/* Offset 0 is never used, so an empty slot is all zero bits */
+	buffer.ptr = 8;
+	buffer.count = 0;
+
+	if (!in_chunk.count)
+		read_chunk(&in_chunk, fpInput, 1);
+	while (in_chunk.count && chunk_fits(&in_chunk)) {
+		insert_chunk(&in_chunk);
+		read_chunk(&in_chunk, fpInput, 1);
+	}
+}
+
+static void write_buffer(void)
+{
+	unsigned int index;
+
+	for (index = 0; index < buffer.count; index++) {
+		unsigned int ptr = buffer.order[index], length;
+		char *line;
+
+		if (*ENTRY_SEQ(ptr) == ENTRY_DUPE_SEQ)
 			continue;
+		line = ENTRY_LINE(ptr);
+		length = strlen(line);
+		++written_lines;
+		line[length] = '\n';
+		if (fwrite(line, length + 1, 1, output) != 1)
+			pexit("fwrite");
+	}
+}
+
+static void clean_file(FILE *file)
+{
+	struct unique_chunk *chunk = &clean_chunk;
+	int index, count;
+
+	while ((count = read_chunk(chunk, file, 0))) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (index = 0; index < count; index++) {
+			unsigned int ptr =
+			    table_find(&chunk->text[chunk->line[index]]);
+			if (ptr)
+				*ENTRY_SEQ(ptr) = ENTRY_DUPE_SEQ;
 		}
+	}
+}
 
-		put_int(last, ptr);
+static void clean_buffer(void)
+{
+	if (use_to_unique_but_not_add) {
+		if (fseek(use_to_unique_but_not_add, 0, SEEK_SET) < 0) pexit("fseek");
+		clean_file(use_to_unique_but_not_add);
+	}
 
-		put_data(ptr, ENTRY_END_HASH);
-		ptr += 4;
+	if (do_not_unique_against_self)
+	  return;
 
-		strcpy(&buffer.data[ptr], line);
-		ptr += strlen(line) + 1;
+	if (fseek(output, 0, SEEK_SET) < 0) pexit("fseek");
 
-		if (ptr > vUNIQUE_BUFFER_SIZE - sizeof(line) - 8) break;
+	clean_file(output);
 
-DoExtraLM:;
-		if (LM && *LM_Buf) {
-			last = &buffer.hash[line_hash(LM_Buf)];
-#if ARCH_LITTLE_ENDIAN && !ARCH_INT_GT_32
-			current = *last;
-#else
-			current = get_int(last);
-#endif
-			while (current != ENTRY_END_HASH) {
-				if (!strcmp(LM_Buf, &buffer.data[current + 4])) break;
-				last = (unsigned int *)&buffer.data[current];
-				current = get_int(last);
-			}
-			if (current != ENTRY_END_HASH) continue;
+/* Workaround a Solaris stdio bug */
+	if (fseek(output, 0, SEEK_END) < 0) pexit("fseek");
+}
 
-			put_int(last, ptr);
+/*
+ * -disk mode.  Rather than uniquing the input a buffer at a time against
+ * everything written so far (which re-reads the whole output file for every
+ * buffer), the input is hash-partitioned into disk_parts bucket files in one
+ * streaming pass.  Every line goes to its bucket as a record carrying its
+ * input sequence number.  Each bucket is then uniqued in memory on its own
+ * (buckets are independent, so they are done in parallel), and the per
+ * bucket results, each already in sequence order, are merged back together
+ * so the output keeps the first occurrence order of the normal mode.  A
+ * bucket which does not fit into the -mem buffer is split again, with a
+ * differently seeded hash.  -ex_file_only input is uniqued against itself
+ * as well, which is what the normal mode does whenever the input fits in
+ * a single buffer.
+ */
+#define DISK_EX_SEQ			0xFFFFFFFFFFFFFFFFULL /* -ex_file lines */
+#define DISK_MAX_LEVEL			8
+#define DISK_NAME_SIZE			(PATH_BUFFER_SIZE + 64)
 
-			put_data(ptr, ENTRY_END_HASH);
-			ptr += 4;
+struct disk_table {
+	unsigned int *hash;
+	char *data;
+	unsigned int ptr;
+};
 
-			strcpy(&buffer.data[ptr], LM_Buf);
-			ptr += strlen(LM_Buf) + 1;
+struct disk_stream {
+	FILE *fp;
+	unsigned long long seq;
+	unsigned int len;
+};
 
-			if (ptr > vUNIQUE_BUFFER_SIZE - sizeof(line) - 8) break;
-		}
+static FILE *disk_open(char *name, char *mode)
+{
+	FILE *fp;
+
+	if (!(fp = fopen(name, mode))) pexit("fopen: %s", name);
+
+	return fp;
+}
+
+static void disk_close(FILE *fp)
+{
+	if (ferror(fp)) pexit("fread/fwrite");
+	if (fclose(fp)) pexit("fclose");
+}
+
+static void rec_write(FILE *fp, unsigned long long seq, char *line,
+	unsigned int len)
+{
+	if (fwrite(&seq, sizeof(seq), 1, fp) != 1 ||
+	    fwrite(&len, sizeof(len), 1, fp) != 1 ||
+	    (len && fwrite(line, len, 1, fp) != 1))
+		pexit("fwrite");
+}
+
+/* Reads the header of the next record, the line itself is left for rec_line */
+static int rec_next(FILE *fp, unsigned long long *seq, unsigned int *len)
+{
+	if (fread(seq, sizeof(*seq), 1, fp) != 1)
+		return 0;
+	if (fread(len, sizeof(*len), 1, fp) != 1 || *len >= LINE_BUFFER_SIZE)
+		pexit("fread");
+	return 1;
+}
+
+static void rec_line(FILE *fp, char *line, unsigned int len)
+{
+	if (len && fread(line, len, 1, fp) != 1) pexit("fread");
+	line[len] = 0;
+}
+
+static FILE **disk_parts_open(char *base, char *mode)
+{
+	char name[DISK_NAME_SIZE];
+	FILE **parts;
+	int i;
+
+	parts = mem_alloc(disk_parts * sizeof(*parts));
+	for (i = 0; i < disk_parts; ++i) {
+		sprintf(name, "%s.%d", base, i);
+		parts[i] = disk_open(name, mode);
 	}
 
-	if (ferror(fpInput)) pexit("fgets");
+	return parts;
+}
+
+static void disk_parts_close(FILE **parts)
+{
+	int i;
 
-	put_data(ptr, ENTRY_END_LIST);
+	for (i = 0; i < disk_parts; ++i)
+		disk_close(parts[i]);
+	MEM_FREE(parts);
 }
 
-static void write_buffer(void)
+/* Adds line to the table.  1 if it was new, 0 if a dupe, -1 if out of room */
+static int disk_insert(struct disk_table *t, char *line, unsigned int len)
+{
+	unsigned int current, *last;
+
+	last = &t->hash[line_hash(line)];
+	current = get_int(last);
+	while (current != ENTRY_END_HASH) {
+		if (!strcmp(line, &t->data[current + 4]))
+			return 0;
+		last = (unsigned int *)&t->data[current];
+		current = get_int(last);
+	}
+
+	if (t->ptr + 4 + len + 1 > vUNIQUE_BUFFER_SIZE)
+		return -1;
+	put_int(last, t->ptr);
+	put_int((unsigned int *)&t->data[t->ptr], ENTRY_END_HASH);
+	memcpy(&t->data[t->ptr + 4], line, len + 1);
+	t->ptr += 4 + len + 1;
+
+	return 1;
+}
+
+/* Uniques one bucket into out.  Returns 0 if it would not fit in memory */
+static int disk_unique_part(struct disk_table *t, char *name, FILE *out)
+{
+	char line[LINE_BUFFER_SIZE];
+	unsigned long long seq;
+	unsigned int len;
+	FILE *in;
+	int new = 0;
+
+	memset(t->hash, 0xff, vUNIQUE_HASH_SIZE * sizeof(unsigned int));
+	t->ptr = 0;
+
+	in = disk_open(name, "rb");
+	while (rec_next(in, &seq, &len)) {
+		rec_line(in, line, len);
+		new = disk_insert(t, line, len);
+		if (new < 0)
+			break;
+		if (new && seq != DISK_EX_SEQ)
+			rec_write(out, seq, line, len);
+	}
+	disk_close(in);
+
+	return new >= 0;
+}
+
+static void disk_split(char *name, char *base, unsigned int level)
+{
+	char line[LINE_BUFFER_SIZE];
+	unsigned long long seq;
+	unsigned int len;
+	FILE *in, **parts;
+
+	parts = disk_parts_open(base, "wb");
+	in = disk_open(name, "rb");
+	while (rec_next(in, &seq, &len)) {
+		rec_line(in, line, len);
+		rec_write(parts[seed_hash(line, level) % disk_parts], seq, line, len);
+	}
+	disk_close(in);
+	disk_parts_close(parts);
+}
+
+static void disk_heap_down(struct disk_stream *s, int *heap, int n, int i)
+{
+	int child, top = heap[i];
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n && s[heap[child + 1]].seq < s[heap[child]].seq)
+			++child;
+		if (s[top].seq <= s[heap[child]].seq)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = top;
+}
+
+/*
+ * Merges the bucket results base.N.u back into sequence order.  The final
+ * merge writes plain lines to the output file, the ones for a re-split
+ * bucket write records again.
+ */
+static void disk_merge(char *base, FILE *out, int final)
 {
-	unsigned int ptr, hash;
+	char line[LINE_BUFFER_SIZE], name[DISK_NAME_SIZE];
+	struct disk_stream *s;
+	int *heap, i, n = 0;
+
+	s = mem_alloc(disk_parts * sizeof(*s));
+	heap = mem_alloc(disk_parts * sizeof(*heap));
+	for (i = 0; i < disk_parts; ++i) {
+		sprintf(name, "%s.%d.u", base, i);
+		s[i].fp = disk_open(name, "rb");
+		if (rec_next(s[i].fp, &s[i].seq, &s[i].len))
+			heap[n++] = i;
+	}
+	for (i = n / 2 - 1; i >= 0; --i)
+		disk_heap_down(s, heap, n, i);
+
+	while (n) {
+		struct disk_stream *cur = &s[heap[0]];
 
-	ptr = 0;
-	while ((hash = get_data(ptr)) != ENTRY_END_LIST) {
-		unsigned int length, size;
-		ptr += 4;
-		length = strlen(&buffer.data[ptr]);
-		size = length + 1;
-		if (hash != ENTRY_DUPE) {
+		rec_line(cur->fp, line, cur->len);
+		if (final) {
 			++written_lines;
-			buffer.data[ptr + length] = '\n';
-			if (fwrite(&buffer.data[ptr], size, 1, output) != 1)
+			line[cur->len] = '\n';
+			if (fwrite(line, cur->len + 1, 1, out) != 1)
 				pexit("fwrite");
-		}
-		ptr += size;
+		} else
+			rec_write(out, cur->seq, line, cur->len);
+
+		if (!rec_next(cur->fp, &cur->seq, &cur->len))
+			heap[0] = heap[--n];
+		disk_heap_down(s, heap, n, 0);
+	}
+
+	for (i = 0; i < disk_parts; ++i) {
+		disk_close(s[i].fp);
+		sprintf(name, "%s.%d.u", base, i);
+		remove(name);
 	}
+	MEM_FREE(heap);
+	MEM_FREE(s);
 }
 
-static void clean_buffer(void)
+static void disk_process(struct disk_table *t, char *name, unsigned int level)
+{
+	char res_name[DISK_NAME_SIZE];
+	FILE *out;
+	int i;
+
+	sprintf(res_name, "%s.u", name);
+	out = disk_open(res_name, "wb");
+	if (!disk_unique_part(t, name, out)) {
+		char sub_name[DISK_NAME_SIZE];
+
+		if (level >= DISK_MAX_LEVEL) {
+			fprintf(stderr, "Error, too many unique lines for -disk "
+			    "to fit in memory, raise -mem or -disk\n");
+			error();
+		}
+		disk_close(out);
+		disk_split(name, name, level + 1);
+		remove(name);
+		for (i = 0; i < disk_parts; ++i) {
+			sprintf(sub_name, "%s.%d", name, i);
+			disk_process(t, sub_name, level + 1);
+		}
+		out = disk_open(res_name, "wb");
+		disk_merge(name, out, 0);
+	} else
+		remove(name);
+	disk_close(out);
+}
+
+static void disk_run(char *base)
 {
 	char line[LINE_BUFFER_SIZE];
-	unsigned int current, *last;
+	unsigned long long seq = 0;
+	FILE **parts;
+	int i;
+
+	parts = disk_parts_open(base, "wb");
 
 	if (use_to_unique_but_not_add) {
-		if (fseek(use_to_unique_but_not_add, 0, SEEK_SET) < 0) pexit("fseek");
 		while (fgetl(line, sizeof(line), use_to_unique_but_not_add)) {
 			if (cut_len) line[cut_len] = 0;
-			last = &buffer.hash[line_hash(line)];
-#if ARCH_LITTLE_ENDIAN && !ARCH_INT_GT_32
-			current = *last;
-#else
-			current = get_int(last);
-#endif
-			while (current != ENTRY_END_HASH) {
-				if (current != ENTRY_DUPE && !strcmp(line, &buffer.data[current + 4])) {
-					put_int(last, get_data(current));
-					put_data(current, ENTRY_DUPE);
-					break;
-				}
-				last = (unsigned int *)&buffer.data[current];
-				current = get_int(last);
-			}
+			rec_write(parts[seed_hash(line, 0) % disk_parts],
+			    DISK_EX_SEQ, line, strlen(line));
 		}
 	}
 
-	if (do_not_unique_against_self)
-	  return;
+	while (fgetl(line, sizeof(line), fpInput)) {
+		char LM_Buf[8];
+		if (LM) {
+			if (strlen(line) > 7) {
+				strncpy(LM_Buf, &line[7], 7);
+				LM_Buf[7] = 0;
+				upcase(LM_Buf);
+				++totLines;
+			}
+			else
+				*LM_Buf = 0;
+			line[7] = 0;
+			upcase(line);
+		} else if (cut_len) line[cut_len] = 0;
+		++totLines;
+		rec_write(parts[seed_hash(line, 0) % disk_parts], seq++,
+		    line, strlen(line));
+		if (LM && *LM_Buf)
+			rec_write(parts[seed_hash(LM_Buf, 0) % disk_parts], seq++,
+			    LM_Buf, strlen(LM_Buf));
+	}
+	if (ferror(fpInput)) pexit("fgets");
 
-	if (fseek(output, 0, SEEK_SET) < 0) pexit("fseek");
+	disk_parts_close(parts);
 
-	while (fgetl(line, sizeof(line), output)) {
-		if (cut_len) line[cut_len] = 0;
-		last = &buffer.hash[line_hash(line)];
-#if ARCH_LITTLE_ENDIAN && !ARCH_INT_GT_32
-		current = *last;
+	if (verbose)
+#ifdef __MINGW32__
+		printf ("Total lines read %I64u, partitioned into %d buckets\n", totLines, disk_parts);
 #else
-		current = get_int(last);
+		printf ("Total lines read %llu, partitioned into %d buckets\n", totLines, disk_parts);
 #endif
-		while (current != ENTRY_END_HASH && current != ENTRY_DUPE) {
-			if (!strcmp(line, &buffer.data[current + 4])) {
-				put_int(last, get_data(current));
-				put_data(current, ENTRY_DUPE);
-				break;
-			}
-			last = (unsigned int *)&buffer.data[current];
-			current = get_int(last);
+
+#ifdef _OPENMP
+#pragma omp parallel private(i)
+#endif
+	{
+		struct disk_table t;
+		char name[DISK_NAME_SIZE];
+
+		t.hash = mem_alloc(vUNIQUE_HASH_SIZE * sizeof(unsigned int));
+		t.data = mem_alloc(vUNIQUE_BUFFER_SIZE);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (i = 0; i < disk_parts; ++i) {
+			sprintf(name, "%s.%d", base, i);
+			disk_process(&t, name, 0);
 		}
+		MEM_FREE(t.data);
+		MEM_FREE(t.hash);
 	}
 
-	if (ferror(output)) pexit("fgets");
-
-/* Workaround a Solaris stdio bug */
-	if (fseek(output, 0, SEEK_END) < 0) pexit("fseek");
+	disk_merge(base, output, 1);
 }
 
 static void unique_init(char *name)
 {
 	int fd;
 
-	buffer.hash = mem_alloc(vUNIQUE_HASH_SIZE * sizeof(unsigned int));
-	buffer.data = mem_alloc(vUNIQUE_BUFFER_SIZE);
+	if (!disk_parts) {
+		vUNIQUE_SLOTS = SLOTS_PER_HASH * vUNIQUE_HASH_SIZE;
+		vUNIQUE_SLOT_MASK = vUNIQUE_SLOTS - 1;
+/* Any chunk has to fit in an empty buffer */
+		vCHUNK_LINES = SLOTS_LOAD(vUNIQUE_SLOTS) / 2;
+		if (vCHUNK_LINES > CHUNK_LINES)
+			vCHUNK_LINES = CHUNK_LINES;
+		vCHUNK_SIZE = vUNIQUE_BUFFER_SIZE / 2;
+		if (vCHUNK_SIZE > CHUNK_SIZE)
+			vCHUNK_SIZE = CHUNK_SIZE;
+
+		buffer.slot = mem_alloc(vUNIQUE_SLOTS * sizeof(*buffer.slot));
+		buffer.data = mem_alloc(vUNIQUE_BUFFER_SIZE);
+		buffer.order = mem_alloc(SLOTS_LOAD(vUNIQUE_SLOTS) *
+		    sizeof(*buffer.order));
+		chunk_init(&in_chunk);
+		chunk_init(&clean_chunk);
+	}
 
 #if defined (_MSC_VER) || defined(__MINGW32__)
 	fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_BINARY, 0600);
@@ -341,7 +826,7 @@ static void unique_run(void)
 	  clean_buffer();
 	write_buffer();
 
-	while (!feof(fpInput)) {
+	while (in_chunk.count) {
 		read_buffer();
 		clean_buffer();
 		write_buffer();
@@ -362,7 +847,7 @@ static void unique_done(void)
 
 int unique(int argc, char **argv)
 {
-	while (argc > 2 && (!strcmp(argv[1], "-v") || !strncmp(argv[1], "-inp=", 5) || !strncmp(argv[1], "-cut=", 5) || !strncmp(argv[1], "-mem=", 5))) {
+	while (argc > 2 && (!strcmp(argv[1], "-v") || !strncmp(argv[1], "-inp=", 5) || !strncmp(argv[1], "-cut=", 5) || !strncmp(argv[1], "-mem=", 5) || !strncmp(argv[1], "-disk", 5))) {
 		int i;
 		if (!strcmp(argv[1], "-v"))
 		{
@@ -421,6 +906,19 @@ int unique(int argc, char **argv)
 			vUNIQUE_HASH_MASK = vUNIQUE_HASH_SIZE - 1;
 			vUNIQUE_HASH_LOG_HALF = vUNIQUE_HASH_LOG / 2;
 		}
+		else if (!strncmp(argv[1], "-disk", 5))
+		{
+			disk_parts = UNIQUE_DISK_PARTS;
+			if (argv[1][5] == '=')
+				sscanf(argv[1], "-disk=%d", &disk_parts);
+			else if (argv[1][5])
+				break;
+			if (disk_parts < 2 || disk_parts > 1024)
+				exit(fprintf(stderr, "Error, invalid number of buckets in the -disk= param\n"));
+			--argc;
+			for (i = 1; i < argc; ++i)
+				argv[i] = argv[i+1];
+		}
 	}
 	if (argc == 3 && !strncmp(argv[2], "-ex_file=", 9)) {
 		use_to_unique_but_not_add = fopen(&argv[2][9], "rb");
@@ -441,7 +939,7 @@ int unique(int argc, char **argv)
 #if defined (__MINGW32__)
 	    puts("");
 #endif
-		puts("Usage: unique [-v] [-inp=fname] [-cut=len] [-mem=num] OUTPUT-FILE [-ex_file=FNAME2] [-ex_file_only=FNAME2]\n\n"
+		printf("Usage: unique [-v] [-inp=fname] [-cut=len] [-mem=num] [-disk[=num]] OUTPUT-FILE [-ex_file=FNAME2] [-ex_file_only=FNAME2]\n\n"
 			 "       reads from stdin 'normally', but can be overridden by optional -inp=\n"
 			 "       If -ex_file=XX is used, then data from file XX is also used to\n"
 			 "       unique the data, but nothing is ever written to XX. Thus, any data in\n"
@@ -453,8 +951,13 @@ int unique(int argc, char **argv)
 			 "       params.h.  The default is 21.  This can be raised, up to 25 (memory usage\n"
 			 "       doubles each number).  If you go TOO large, unique will swap and thrash and\n"
 			 "       work VERY slow\n"
+			 "       -disk[=num]  For input much larger than the -mem buffer. Splits the\n"
+			 "       input into num (default %d) bucket files next to OUTPUT-FILE in one\n"
+			 "       pass, then uniques each bucket in memory (one -mem buffer per thread).\n"
+			 "       The output is the same as without -disk\n"
 			 "\n"
-			 "       -v is for 'verbose' mode, outputs line counts during the run");
+			 "       -v is for 'verbose' mode, outputs line counts during the run\n",
+			 UNIQUE_DISK_PARTS);
 
 		if (argc <= 1)
 			return 0;
@@ -464,8 +967,13 @@ int unique(int argc, char **argv)
 
 	if (!fpInput)
 		fpInput = stdin;
+	if (disk_parts && strlen(argv[1]) >= PATH_BUFFER_SIZE)
+		exit(fprintf(stderr, "Error, OUTPUT-FILE name too long for -disk\n"));
 	unique_init(argv[1]);
-	unique_run();
+	if (disk_parts)
+		disk_run(argv[1]);
+	else
+		unique_run();
 	unique_done();
 #ifdef __MINGW32__
     printf ("Total lines read %I64u Unique lines written %I64u\n", totLines, written_lines);
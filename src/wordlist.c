@@ -12,6 +12,7 @@
 
 #define _POSIX_SOURCE /* for fileno(3) */
 #include <stdio.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include "os.h"
 
@@ -21,6 +22,9 @@
 #if HAVE_STRINGS_H
 #include <strings.h>
 #endif
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <string.h>
 
 #if HAVE_WINDOWS_H
@@ -46,6 +50,9 @@
 #include "cracker.h"
 #include "john.h"
 #include "memory.h"
+#include "crc32.h"
+#include "config.h"
+#include "dist.h"
 
 static int dist_rules;
 
@@ -65,9 +72,425 @@ static struct rpp_context *rule_ctx;
 static char *word_file_str, **words;
 static unsigned int nWordFileLines;
 
+/*
+ * A wordlist file that is not loaded to memory is read straight from an mmap
+ * of it, if possible.  As we go, we note the offset of every MAP_IDX_STEP'th
+ * line (map_idx[k] being that of line k * MAP_IDX_STEP), so that we can later
+ * jump back or ahead to a given line without reading everything in between.
+ * map_line is the line number at map_pos, unless map_line_known is clear (a
+ * restored session that didn't record it).  map_lines is the total number of
+ * lines, once we know it.
+ *
+ * With WordlistIndex = Y, the index is kept in a file next to the wordlist,
+ * so that it only has to be built once.
+ */
+#define MAP_IDX_SHIFT			10
+#define MAP_IDX_STEP			(1UL << MAP_IDX_SHIFT)
+static char *map_str;
+static size_t map_len, map_pos;
+static unsigned long map_line, map_lines;
+static int map_line_known;
+static size_t *map_idx;
+static unsigned long map_idx_count, map_idx_size;
+
+/*
+ * Index file layout: this header (all fields 64-bit, in native byte order),
+ * followed by count offsets.  The wordlist's size, mtime and a CRC-32 of its
+ * first and last MAP_IDX_CRC_SIZE bytes tell whether the index still applies.
+ */
+#define MAP_IDX_SUFFIX			".idx"
+#define MAP_IDX_MAGIC			"JtRWIdx1"
+#define MAP_IDX_ORDER			0x0102030405060708ULL
+#define MAP_IDX_CRC_SIZE		0x10000
+struct map_idx_header {
+	char magic[8];
+	unsigned long long order, shift, size, mtime, crc, lines, count;
+};
+static char *map_idx_name;
+static struct map_idx_header map_idx_hdr;
+static unsigned long map_idx_saved, map_lines_saved;
+
+/*
+ * Dynamic distribution (--fork): chunks are (rule number, line chunk), the
+ * current one covering lines dist_start to dist_end - 1.  dist_pending is
+ * set when we've claimed a chunk for a later rule but aren't there yet.
+ */
+static unsigned long dist_lines, dist_start, dist_end;
+static struct dist_chunk dist_cur, rec_dist_next;
+static unsigned long long rec_dist_minor;
+static int dist_pending, rec_dist_held;
+
+static void map_idx_add(void)
+{
+	if (map_idx_count >= map_idx_size) {
+		size_t *old = map_idx;
+
+		map_idx_size = map_idx_size ? map_idx_size * 2 : 0x1000;
+		map_idx = mem_alloc(map_idx_size * sizeof(*map_idx));
+		if (old) {
+			memcpy(map_idx, old, map_idx_count * sizeof(*map_idx));
+			MEM_FREE(old);
+		}
+	}
+	map_idx[map_idx_count++] = map_pos;
+}
+
+/* Moves on to the next line of the mapped file, noting it in the index */
+static MAYBE_INLINE void map_next_line(size_t pos)
+{
+	map_pos = pos;
+	if (map_line_known) {
+		if (!(++map_line & (MAP_IDX_STEP - 1)) &&
+		    (map_line >> MAP_IDX_SHIFT) == map_idx_count)
+			map_idx_add();
+		if (pos == map_len)
+			map_lines = map_line;
+	}
+}
+
+/* Same as fgetl(), but for the mapped file */
+static MAYBE_INLINE char *mgetl(char *line)
+{
+	char *p, *q;
+	size_t len;
+
+	if (map_pos >= map_len)
+		return NULL;
+
+	p = map_str + map_pos;
+	if ((q = memchr(p, '\n', map_len - map_pos))) {
+		len = q - p;
+		map_next_line(map_pos + len + 1);
+	} else {
+		len = map_len - map_pos;
+		map_next_line(map_len);
+	}
+	if (len && p[len - 1] == '\r')
+		len--;
+	if (len >= LINE_BUFFER_SIZE)
+		len = LINE_BUFFER_SIZE - 1;
+	memcpy(line, p, len);
+	line[len] = 0;
+
+	return line;
+}
+
+static MAYBE_INLINE char *getl(char *line)
+{
+	if (map_str)
+		return mgetl(line);
+	return fgetl(line, LINE_BUFFER_SIZE, word_file);
+}
+
+/*
+ * Skips n lines of the mapped file, jumping ahead by the index where we can.
+ * Returns non-zero on EOF.
+ */
+static int map_skip(unsigned long n)
+{
+	unsigned long target = map_line + n;
+	char *q;
+
+	if (map_line_known && map_idx_count) {
+		unsigned long k = target >> MAP_IDX_SHIFT;
+
+		if (k >= map_idx_count)
+			k = map_idx_count - 1;
+		if ((k << MAP_IDX_SHIFT) > map_line) {
+			map_pos = map_idx[k];
+			map_line = k << MAP_IDX_SHIFT;
+		}
+		n = target - map_line;
+	}
+
+	while (n--) {
+		if (map_pos >= map_len)
+			return 1;
+		if ((q = memchr(map_str + map_pos, '\n', map_len - map_pos)))
+			map_next_line(q + 1 - map_str);
+		else
+			map_next_line(map_len);
+	}
+
+	return 0;
+}
+
+/*
+ * Seeks to offset pos, which is the start of the given line (unless that
+ * isn't known, as with a session saved by an older version).
+ */
+static void wl_seek(long pos, unsigned long line, int line_known)
+{
+	if (map_str) {
+		map_pos = pos;
+		map_line = line;
+		map_line_known = line_known;
+	} else if (fseek(word_file, pos, SEEK_SET))
+		pexit("fseek");
+}
+
+static long wl_tell(void)
+{
+	long pos;
+
+	if (map_str)
+		return map_pos;
+
+	if ((pos = ftell(word_file)) < 0) {
+#ifdef __DJGPP__
+		if (pos != -1)
+			pos = 0;
+		else
+#endif
+			pexit("ftell");
+	}
+
+	return pos;
+}
+
+/*
+ * Seeks to offset pos, finding out its line number from the index: a binary
+ * search for the last indexed line at or before pos, then counting lines from
+ * there (which also extends the index if pos is past its end).
+ */
+static void map_seek_pos(size_t pos)
+{
+	unsigned long lo = 0, hi = map_idx_count - 1, mid;
+	char *q;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) >> 1;
+		if (map_idx[mid] <= pos)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	map_pos = map_idx[lo];
+	map_line = lo << MAP_IDX_SHIFT;
+	map_line_known = 1;
+	while (map_pos < pos) {
+		if ((q = memchr(map_str + map_pos, '\n', map_len - map_pos)))
+			map_next_line(q + 1 - map_str);
+		else
+			map_next_line(map_len);
+	}
+
+/* Not at the start of a line, so the saved position was not one of ours */
+	if (map_pos != pos) {
+		map_pos = pos;
+		map_line_known = 0;
+	}
+}
+
+#if HAVE_SYS_MMAN_H
+static CRC32_t map_crc(void)
+{
+	CRC32_t crc;
+	size_t n = map_len < MAP_IDX_CRC_SIZE ? map_len : MAP_IDX_CRC_SIZE;
+
+	CRC32_Init(&crc);
+	CRC32_Update(&crc, map_str, n);
+	CRC32_Update(&crc, map_str + map_len - n, n);
+
+	return crc;
+}
+
+/*
+ * Loads the index file for the mapped wordlist, if there's one that matches
+ * it.  Otherwise, we start with an empty index (which we'll save later) unless
+ * something else by that name is in the way.
+ */
+static void map_idx_load(char *name, struct stat *st)
+{
+	struct map_idx_header hdr;
+	FILE *file;
+	unsigned long i;
+
+	map_idx_name = mem_alloc_tiny(strlen(name) + sizeof(MAP_IDX_SUFFIX),
+	    MEM_ALIGN_NONE);
+	strcpy(map_idx_name, name);
+	strcat(map_idx_name, MAP_IDX_SUFFIX);
+
+	memset(&map_idx_hdr, 0, sizeof(map_idx_hdr));
+	memcpy(map_idx_hdr.magic, MAP_IDX_MAGIC, sizeof(hdr.magic));
+	map_idx_hdr.order = MAP_IDX_ORDER;
+	map_idx_hdr.shift = MAP_IDX_SHIFT;
+	map_idx_hdr.size = map_len;
+	map_idx_hdr.mtime = st->st_mtime;
+	map_idx_hdr.crc = map_crc();
+
+	if (!(file = fopen(map_idx_name, "rb")))
+		return;
+
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    memcmp(hdr.magic, MAP_IDX_MAGIC, sizeof(hdr.magic))) {
+		log_event("! %.100s is not a wordlist index, not using it",
+		    map_idx_name);
+		map_idx_name = NULL;
+		fclose(file);
+		return;
+	}
+
+	if (hdr.order != map_idx_hdr.order || hdr.shift != map_idx_hdr.shift ||
+	    hdr.size != map_idx_hdr.size || hdr.mtime != map_idx_hdr.mtime ||
+	    hdr.crc != map_idx_hdr.crc || !hdr.count ||
+	    hdr.count > (hdr.size >> MAP_IDX_SHIFT) + 1) {
+		log_event("- Wordlist index is out of date, rebuilding it");
+		fclose(file);
+		return;
+	}
+
+	map_idx_count = 0;
+	map_idx_size = hdr.count;
+	MEM_FREE(map_idx);
+	map_idx = mem_alloc(map_idx_size * sizeof(*map_idx));
+	for (i = 0; i < hdr.count; i++) {
+		unsigned long long ofs;
+
+		if (fread(&ofs, sizeof(ofs), 1, file) != 1 || ofs > map_len ||
+		    (i && ofs <= map_idx[i - 1]) || (!i && ofs))
+			break;
+		map_idx[i] = ofs;
+	}
+	fclose(file);
+
+	if (i != hdr.count) {
+		log_event("! Wordlist index is damaged, rebuilding it");
+		map_idx[0] = 0;
+		map_idx_count = 1;
+		return;
+	}
+
+	map_idx_count = map_idx_saved = hdr.count;
+	map_lines = map_lines_saved = hdr.lines;
+	log_event("- Loaded wordlist index (%s %lu lines)",
+	    map_lines ? "all" : "first",
+	    map_lines ? map_lines : (map_idx_count - 1) << MAP_IDX_SHIFT);
+}
+
+/*
+ * Saves the index if we've added to it.  Nodes may well do this at the same
+ * time, so each writes a file of its own and renames it into place.
+ */
+static void map_idx_save(void)
+{
+	char *tmp;
+	FILE *file;
+	unsigned long i;
+	int ok;
+
+	if (!map_idx_name ||
+	    (map_idx_count <= map_idx_saved && map_lines == map_lines_saved))
+		return;
+
+	map_idx_hdr.lines = map_lines;
+	map_idx_hdr.count = map_idx_count;
+
+/* Another node may have saved one at least as good by now */
+	if ((file = fopen(map_idx_name, "rb"))) {
+		struct map_idx_header hdr;
+
+		ok = fread(&hdr, sizeof(hdr), 1, file) == 1 &&
+		    !memcmp(&hdr, &map_idx_hdr,
+		    offsetof(struct map_idx_header, lines)) &&
+		    hdr.count >= map_idx_count && (hdr.lines || !map_lines);
+		fclose(file);
+		if (ok)
+			return;
+	}
+
+	tmp = mem_alloc(strlen(map_idx_name) + 16);
+	sprintf(tmp, "%s.%u", map_idx_name, (unsigned int)getpid());
+	if (!(file = fopen(tmp, "wb"))) {
+		log_event("- Can't save wordlist index to %.100s",
+		    map_idx_name);
+		MEM_FREE(tmp);
+		return;
+	}
+
+	ok = fwrite(&map_idx_hdr, sizeof(map_idx_hdr), 1, file) == 1;
+	for (i = 0; ok && i < map_idx_count; i++) {
+		unsigned long long ofs = map_idx[i];
+
+		ok = fwrite(&ofs, sizeof(ofs), 1, file) == 1;
+	}
+	if (fclose(file))
+		ok = 0;
+
+	if (ok && !rename(tmp, map_idx_name)) {
+		map_idx_saved = map_idx_count;
+		map_lines_saved = map_lines;
+		log_event("- Saved wordlist index (%s %lu lines)",
+		    map_lines ? "all" : "first",
+		    map_lines ? map_lines :
+		    (map_idx_count - 1) << MAP_IDX_SHIFT);
+	} else {
+		log_event("- Can't save wordlist index to %.100s",
+		    map_idx_name);
+		unlink(tmp);
+	}
+	MEM_FREE(tmp);
+}
+#endif
+
+/*
+ * Maps the wordlist file, if possible.  Returns non-zero on success.
+ */
+static int map_file(char *name, long file_len)
+{
+#if HAVE_SYS_MMAN_H
+	struct stat st;
+	void *p;
+
+	if (fstat(fileno(word_file), &st)) pexit("fstat");
+
+	p = mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fileno(word_file), 0);
+	if (p == MAP_FAILED)
+		return 0;
+#ifdef POSIX_MADV_SEQUENTIAL
+	posix_madvise(p, file_len, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	map_str = p;
+	map_len = file_len;
+	map_pos = 0;
+	map_line = map_lines = 0;
+	map_line_known = 1;
+	map_idx_count = map_idx_saved = map_lines_saved = 0;
+	map_idx_add();
+
+	log_event("- Reading the wordlist file through a memory map");
+
+	map_idx_name = NULL;
+	if (cfg_get_bool(SECTION_OPTIONS, NULL, "WordlistIndex", 0))
+		map_idx_load(name, &st);
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void unmap_file(void)
+{
+#if HAVE_SYS_MMAN_H
+	if (map_str) {
+		map_idx_save();
+		munmap(map_str, map_len);
+	}
+#endif
+	map_str = NULL;
+	MEM_FREE(map_idx);
+	map_idx_count = map_idx_size = 0;
+}
+
 static void save_state(FILE *file)
 {
 	fprintf(file, "%d\n%ld\n%lu\n", rec_rule, rec_pos, rec_line);
+	if (dist_active)
+		fprintf(file, "%d %llu %u %llu\n", rec_dist_held,
+		    rec_dist_minor, rec_dist_next.major, rec_dist_next.minor);
 }
 
 static int restore_rule_number(void)
@@ -88,6 +511,9 @@ static MAYBE_INLINE int skip_lines(unsigned long n, char *line)
 	if (n) {
 		line_number += n;
 
+		if (map_str)
+			return map_skip(n);
+
 		if (!nWordFileLines)
 		do {
 			if (!fgetl(line, LINE_BUFFER_SIZE, word_file))
@@ -98,6 +524,37 @@ static MAYBE_INLINE int skip_lines(unsigned long n, char *line)
 	return 0;
 }
 
+/*
+ * Makes sure line_number is within a chunk of ours, claiming the next chunk
+ * and skipping to its start if needed.  Returns non-zero if that chunk is for
+ * a later rule.
+ */
+static int dist_seek(char *line)
+{
+	if (line_number < dist_end)
+		return 0;
+
+	if (!dist_pending)
+		dist_next(&dist_cur);
+	if ((dist_pending = (dist_cur.major != rule_number)))
+		return 1;
+
+	dist_start = dist_cur.minor * dist_lines;
+	dist_end = dist_start + dist_lines;
+
+/* After a restore, the chunk may be one another node left behind us */
+	if (dist_start < line_number) {
+		line_number = 0;
+		if (!nWordFileLines)
+			wl_seek(0, 0, 1);
+	}
+
+/* A mere EOF is seen again by the caller */
+	skip_lines(dist_start - line_number, line);
+
+	return 0;
+}
+
 static void restore_line_number(void)
 {
 	char line[LINE_BUFFER_SIZE];
@@ -119,6 +576,23 @@ static int restore_state(FILE *file)
 	if (rec_rule < 0 || rec_pos < 0)
 		return 1;
 
+	if (dist_active) {
+/* A session saved without dynamic distribution keeps the static split */
+		if (fscanf(file, "%d %llu %u %llu\n", &rec_dist_held,
+		    &rec_dist_minor, &rec_dist_next.major,
+		    &rec_dist_next.minor) != 4) {
+			dist_leave();
+			dist_active = 0;
+		} else if (rec_dist_held) {
+			dist_cur.major = rec_rule;
+			dist_cur.minor = rec_dist_minor;
+			dist_start = rec_dist_minor * dist_lines;
+			dist_end = dist_start + dist_lines;
+			dist_restore(&dist_cur, &rec_dist_next);
+		} else
+			dist_restore(NULL, &rec_dist_next);
+	}
+
 	if (restore_rule_number())
 		return 1;
 
@@ -126,9 +600,14 @@ static int restore_state(FILE *file)
 		restore_line_number();
 	} else {
 		if (!nWordFileLines)
-		if (fseek(word_file, rec_pos, SEEK_SET))
-			pexit("fseek");
+			wl_seek(rec_pos, rec_line, rec_version >= 4);
 		line_number = rec_line;
+/* Older sessions didn't record the line number, find it by the index */
+		if (map_str && !map_line_known) {
+			map_seek_pos(rec_pos);
+			if (map_line_known)
+				line_number = map_line;
+		}
 	}
 
 	return 0;
@@ -145,17 +624,16 @@ static void fix_state(void)
 	rec_rule = rule_number;
 	rec_line = line_number;
 
+	if (dist_active) {
+		rec_dist_held = 1;
+		rec_dist_minor = dist_cur.minor;
+		dist_get_next(&rec_dist_next);
+	}
+
 	if (word_file == stdin)
 		rec_pos = line_number;
 	else
-	if ((rec_pos = ftell(word_file)) < 0) {
-#ifdef __DJGPP__
-		if (rec_pos != -1)
-			rec_pos = 0;
-		else
-#endif
-			pexit("ftell");
-	}
+		rec_pos = wl_tell();
 }
 
 static int get_progress(int *hundth_perc)
@@ -179,20 +657,17 @@ static int get_progress(int *hundth_perc)
 		pos = line_number;
 	}
 	else {
-		if ((pos = ftell(word_file)) < 0) {
-#ifdef __DJGPP__
-			if (pos != -1)
-				pos = 0;
-			else
-#endif
-				pexit("ftell");
-		}
+		pos = wl_tell();
 	}
 
 	if (nWordFileLines) {
 		hundredXpercent = (int)((10000LL * (rule_number *
 		                  (long long)nWordFileLines + pos)) /
 		                  (rule_count * (long long)nWordFileLines));
+	} else if (map_str && map_lines && map_line_known) {
+		hundredXpercent = (int)((10000LL * (rule_number *
+		                  (long long)map_lines + line_number)) /
+		                  (rule_count * (long long)map_lines));
 	} else {
 		hundredXpercent = (int)((10000LL * (rule_number *
 		                  (long long)file_stat.st_size + pos)) /
@@ -309,7 +784,7 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 	char *(*apply)(char *word, char *rule, int split, char *last) = NULL;
 	int dist_switch;
 	unsigned long my_words, their_words, my_words_left;
-	long file_len;
+	long file_len = 0;
 	int i, pipe_input = 0, max_pipe_words = 0, rules_keep = 0;
 	int init_once = 1;
 #if HAVE_WINDOWS_H
@@ -396,10 +871,19 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 		   memory map of the file. But this is disabled if we are also
 		   using an external filter, as a modification of a word could
 		   trash the buffer. It's also disabled by --save-mem=N */
-		ourshare = options.node_count ?
+		ourshare = (options.node_count && !dist_active) ?
 			(file_len / options.node_count) *
 			(options.node_max - options.node_min + 1)
 			: file_len;
+		/* A node's share of a file too big to load as a whole is read
+		   straight from a map of it, skipping other nodes' lines,
+		   rather than copied to memory (unless dupe suppression or
+		   --mem-file-size=0 asks for that) */
+		if (options.node_count > 1 && !dist_active && !dupeCheck &&
+		    options.max_wordfile_memory &&
+		    file_len >= options.max_wordfile_memory)
+			map_file(path_expand(name), file_len);
+		if (!map_str)
 		if (!(options.flags & FLG_EXTERNAL_CHK) && !mem_saving_level)
 		if ((options.node_count > 1 &&
 		     file_len > options.node_count * (length * 100) &&
@@ -408,7 +892,7 @@ void do_wordlist_crack(struct db_main *db, char *name, int rules)
 			char *aep;
 
 			// Load only this node's share of words to memory
-			if (options.node_count > 1 &&
+			if (options.node_count > 1 && !dist_active &&
 			    (file_len > options.node_count * (length * 100)
 			     && forceLoad)) {
 				/* Check net size for our share. */
@@ -600,6 +1084,8 @@ skip:
 			MEM_FREE(buffer.data);
 			nWordFileLines = i;
 		}
+		if (!words && !map_str)
+			map_file(path_expand(name), file_len);
 	} else {
 /*
  * Ok, we can be in --stdin or --pipe mode.  In --stdin, we simply copy over
@@ -744,6 +1230,15 @@ SKIP_MEM_MAP_LOAD:;
 	rule_number = 0;
 	line_number = 0;
 
+	if (dist_active) {
+		dist_lines = (nWordFileLines ? nWordFileLines : file_len / 8) /
+		    (options.node_count * 64);
+		if (!dist_lines)
+			dist_lines = 1;
+		dist_end = dist_pending = 0;
+		log_event("- Nodes will claim chunks of %lu lines", dist_lines);
+	}
+
 	if (init_once) {
 		init_once = 0;
 
@@ -769,7 +1264,7 @@ SKIP_MEM_MAP_LOAD:;
 	their_words = 0;
 	/* myWordFileLines indicates we already have OUR share of words in
 	   memory buffer, so no further skipping. */
-	if (options.node_count && !myWordFileLines) {
+	if (options.node_count && !myWordFileLines && !dist_active) {
 		int rule_rem = rule_count % options.node_count;
 		const char *now, *later = "";
 		dist_switch = rule_count - rule_rem;
@@ -814,6 +1309,8 @@ SKIP_MEM_MAP_LOAD:;
 	if (prerule)
 	do {
 		if (rules) {
+			if (dist_pending && dist_cur.major > rule_number)
+				goto next_rule;
 			if (dist_rules) {
 				int for_node =
 				    rule_number % options.node_count + 1;
@@ -837,14 +1334,51 @@ SKIP_MEM_MAP_LOAD:;
 				if (options.verbosity > 2)
 				log_event("- Rule #%d: '%.100s' rejected",
 					rule_number + 1, prerule);
+				if (dist_active) {
+					dist_end_major(rule_number);
+					dist_pending = 0;
+				}
 				goto next_rule;
 			}
 		}
 
-		if (rule && nWordFileLines)
+/* Words already in memory are mangled in blocks where the rule allows, unless
+ * each word needs to be looked at on its own anyway */
+		if (rule && nWordFileLines && rules && !dist_active &&
+		    !f_filter &&
+		    (!options.node_count || myWordFileLines || dist_rules) &&
+		    rules_apply_block(words, 0, rule, NULL, NULL) >= 0)
 		while (line_number < nWordFileLines) {
+			char *block[RULE_BLOCK_SIZE];
+			unsigned long count = nWordFileLines - line_number;
+
+			if (count > RULE_BLOCK_SIZE)
+				count = RULE_BLOCK_SIZE;
+			count = rules_apply_block(&words[line_number], count,
+			    rule, block, last);
+
+			for (i = 0; i < count; i++) {
+				line_number++;
+
+				if ((word = block[i])) {
+					last = word;
+
+					if (crk_process_key(word)) {
+						rules = 0;
+						pipe_input = 0;
+						break;
+					}
+				}
+			}
+			if (i < count)
+				break;
+		}
+
+		else if (rule && nWordFileLines)
+		while ((!dist_active || !dist_seek(line)) &&
+		       line_number < nWordFileLines) {
 			if (options.node_count && !myWordFileLines)
-			if (!dist_rules) {
+			if (!dist_rules && !dist_active) {
 				int for_node = line_number %
 					options.node_count + 1;
 				int skip = for_node < options.node_min ||
@@ -874,7 +1408,7 @@ SKIP_MEM_MAP_LOAD:;
 		}
 
 		else if (rule)
-		while (fgetl(line, LINE_BUFFER_SIZE, word_file)) {
+		while ((!dist_active || !dist_seek(line)) && getl(line)) {
 			line_number++;
 
 			if (line[0] != '#') {
@@ -927,6 +1461,10 @@ next_word:
 #if HAVE_WINDOWS_H
 EndOfFile:
 #endif
+/* Let other nodes know there's nothing more for this rule */
+		if (dist_active && !dist_pending && !event_abort)
+			dist_end_major(rule_number);
+
 		if (rules) {
 next_rule:
 			if (!(rule = rpp_next(&ctx))) break;
@@ -942,9 +1480,9 @@ next_rule:
 			}
 
 			line_number = 0;
+			dist_end = 0;
 			if (!nWordFileLines && word_file != stdin)
-			if (fseek(word_file, 0, SEEK_SET))
-				pexit("fseek");
+				wl_seek(0, 0, 1);
 
 			if (their_words &&
 			    skip_lines(options.node_min - 1, line))
@@ -969,6 +1507,7 @@ next_rule:
 			progress = 100;
 
 		MEM_FREE(words);
+		unmap_file();
 		if (fclose(word_file)) pexit("fclose");
 		word_file = NULL;
 	}
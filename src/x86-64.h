@@ -47,7 +47,13 @@
 #ifdef __XOP__
 #define JOHN_XOP
 #endif
-#if defined(__AVX__) || defined(JOHN_XOP)
+#if defined(__AVX512F__) && defined(__AVX512BW__) && !defined(JOHN_AVX512)
+#define JOHN_AVX512
+#endif
+#if (defined(__AVX2__) || defined(JOHN_AVX512)) && !defined(JOHN_AVX2)
+#define JOHN_AVX2
+#endif
+#if defined(__AVX__) || defined(JOHN_XOP) || defined(JOHN_AVX2)
 #define JOHN_AVX
 #endif
 
@@ -81,7 +87,17 @@
 #define CPU_FALLBACK_BINARY_DEFAULT
 #endif
 #define DES_BS_ASM			0
-#if 0
+#if defined(JOHN_AVX512)
+/* 512-bit as 1x512, with the selects done by vpternlogd */
+#define DES_BS_VECTOR			8
+#undef DES_BS
+#define DES_BS				3
+#define DES_BS_ALGORITHM_NAME		"DES 512/512 AVX512F"
+#elif defined(JOHN_AVX2)
+/* 256-bit as 1x256, in the integer domain */
+#define DES_BS_VECTOR			4
+#define DES_BS_ALGORITHM_NAME		"DES 256/256 AVX2-16"
+#elif 0
 /* 512-bit as 2x256 */
 #define DES_BS_VECTOR			8
 #if defined(JOHN_XOP) && defined(__GNUC__)
@@ -183,7 +199,7 @@
 #endif
 #define DES_BS_EXPAND			1
 
-#if CPU_DETECT && DES_BS == 3
+#if CPU_DETECT && DES_BS == 3 && defined(JOHN_XOP)
 #define CPU_REQ_XOP
 #undef CPU_NAME
 #define CPU_NAME			"XOP"
@@ -193,6 +209,26 @@
 #endif
 #endif
 
+#if CPU_DETECT && defined(JOHN_AVX2)
+#define CPU_REQ_AVX2
+#undef CPU_NAME
+#define CPU_NAME			"AVX2"
+#ifdef CPU_FALLBACK_BINARY_DEFAULT
+#undef CPU_FALLBACK_BINARY
+#define CPU_FALLBACK_BINARY		"john-non-avx2"
+#endif
+#endif
+
+#if CPU_DETECT && defined(JOHN_AVX512)
+#define CPU_REQ_AVX512
+#undef CPU_NAME
+#define CPU_NAME			"AVX512BW"
+#ifdef CPU_FALLBACK_BINARY_DEFAULT
+#undef CPU_FALLBACK_BINARY
+#define CPU_FALLBACK_BINARY		"john-non-avx512"
+#endif
+#endif
+
 #define MD5_ASM				0
 #define MD5_X2				1
 #define MD5_IMM				1
@@ -204,7 +240,11 @@
 #endif
 
 #ifndef MD5_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX2__)
+/* must be a multiple of 2: each 256-bit vector holds two 4x groups */
+#define MD5_SSE_PARA			4
+#define MD5_N_STR			"16x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define MD5_SSE_PARA			3
 #define MD5_N_STR			"12x"
 #elif defined(__clang__)
@@ -232,7 +272,11 @@
 #endif
 
 #ifndef MD4_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX2__)
+/* must be a multiple of 2: each 256-bit vector holds two 4x groups */
+#define MD4_SSE_PARA			4
+#define MD4_N_STR			"16x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define MD4_SSE_PARA			3
 #define MD4_N_STR			"12x"
 #elif defined(__clang__)
@@ -257,7 +301,11 @@
 #endif
 
 #ifndef SHA1_SSE_PARA
-#if defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
+#if defined(__AVX2__)
+/* must be a multiple of 2: each 256-bit vector holds two 4x groups */
+#define SHA1_SSE_PARA			2
+#define SHA1_N_STR			"8x"
+#elif defined(__INTEL_COMPILER) || defined(USING_ICC_S_FILE)
 #define SHA1_SSE_PARA			1
 #define SHA1_N_STR			"4x"
 #elif defined(__clang__)
@@ -311,7 +359,16 @@
 
 #define NT_X86_64
 
+/* SHA-2 lanes follow the full vector width (see sse-intrinsics.c) */
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define MMX_COEF_SHA256 16
+#define MMX_COEF_SHA512 8
+#elif defined(__AVX2__)
+#define MMX_COEF_SHA256 8
+#define MMX_COEF_SHA512 4
+#else
 #define MMX_COEF_SHA256 4
 #define MMX_COEF_SHA512 2
+#endif
 
 #endif